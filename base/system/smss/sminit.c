@@ -48,6 +48,19 @@ BOOLEAN MiniNTBoot = FALSE;
     SmpInitLastCall = (x);              \
 }
 
+/* The known DLLs mapped while building the prelink cache */
+#define SMP_PRELINK_MAX_IMAGES  128
+
+typedef struct _SMP_PRELINK_IMAGE
+{
+    PCHAR Name;
+    PVOID Base;
+    BOOLEAN Mapped;
+    PIMAGE_NT_HEADERS NtHeaders;
+    PIMAGE_EXPORT_DIRECTORY ExportDirectory;
+    ULONG ExportSize;
+} SMP_PRELINK_IMAGE, *PSMP_PRELINK_IMAGE;
+
 /* REGISTRY CONFIGURATION *****************************************************/
 
 NTSTATUS
@@ -1420,6 +1433,369 @@ SmpProcessModuleImports(IN PVOID Unused,
     SmpSaveRegistryValue(&SmpKnownDllsList, DllName, DllValue, TRUE);
 }
 
+static
+ULONG_PTR
+SmpPrelinkResolveThunk(IN PSMP_PRELINK_IMAGE Export,
+                       IN PSMP_PRELINK_IMAGE Import,
+                       IN PIMAGE_THUNK_DATA Thunk)
+{
+    PIMAGE_EXPORT_DIRECTORY ExportDirectory = Export->ExportDirectory;
+    PIMAGE_IMPORT_BY_NAME ImportByName;
+    PULONG NameTable, FunctionTable;
+    PUSHORT OrdinalTable;
+    ULONG Ordinal, Rva, ExportRva;
+    LONG Low, Mid, High, Result;
+
+    FunctionTable = (PULONG)((ULONG_PTR)Export->Base +
+                             ExportDirectory->AddressOfFunctions);
+
+    if (IMAGE_SNAP_BY_ORDINAL(Thunk->u1.Ordinal))
+    {
+        /* Ordinals are biased by the export base */
+        Ordinal = (ULONG)(IMAGE_ORDINAL(Thunk->u1.Ordinal) - ExportDirectory->Base);
+    }
+    else
+    {
+        /* Get the name being imported */
+        Rva = (ULONG)Thunk->u1.AddressOfData;
+        if (Rva >= Import->NtHeaders->OptionalHeader.SizeOfImage) return 0;
+        ImportByName = (PIMAGE_IMPORT_BY_NAME)((ULONG_PTR)Import->Base + Rva);
+
+        NameTable = (PULONG)((ULONG_PTR)Export->Base +
+                             ExportDirectory->AddressOfNames);
+        OrdinalTable = (PUSHORT)((ULONG_PTR)Export->Base +
+                                 ExportDirectory->AddressOfNameOrdinals);
+
+        /* Try the hint first, then do a binary search like the loader */
+        Mid = ImportByName->Hint;
+        if ((ImportByName->Hint >= ExportDirectory->NumberOfNames) ||
+            strcmp((PCHAR)ImportByName->Name,
+                   (PCHAR)((ULONG_PTR)Export->Base + NameTable[Mid])))
+        {
+            Low = 0;
+            High = ExportDirectory->NumberOfNames - 1;
+            while (High >= Low)
+            {
+                Mid = (Low + High) >> 1;
+                Result = strcmp((PCHAR)ImportByName->Name,
+                                (PCHAR)((ULONG_PTR)Export->Base + NameTable[Mid]));
+                if (Result < 0)
+                    High = Mid - 1;
+                else if (Result > 0)
+                    Low = Mid + 1;
+                else
+                    break;
+            }
+
+            /* Not exported */
+            if (High < Low) return 0;
+        }
+
+        Ordinal = OrdinalTable[Mid];
+    }
+
+    /* Make sure the ordinal is valid and the export exists */
+    if (Ordinal >= ExportDirectory->NumberOfFunctions) return 0;
+    Rva = FunctionTable[Ordinal];
+    if (!Rva) return 0;
+
+    /* Forwarders depend on what else the process loads, leave them alone */
+    ExportRva = (ULONG)((ULONG_PTR)ExportDirectory - (ULONG_PTR)Export->Base);
+    if ((Rva >= ExportRva) && (Rva < ExportRva + Export->ExportSize)) return 0;
+
+    return (ULONG_PTR)Export->Base + Rva;
+}
+
+static
+VOID
+SmpPrelinkImports(IN PSMP_PRELINK_IMAGE Images,
+                  IN ULONG ImageCount,
+                  OUT PSM_PRELINK_MODULE Modules OPTIONAL,
+                  OUT PSM_PRELINK_IMPORT Imports OPTIONAL,
+                  OUT PULONG_PTR Addresses OPTIONAL,
+                  OUT PULONG ModuleCount,
+                  OUT PULONG ImportCount,
+                  OUT PULONG AddressCount)
+{
+    PSMP_PRELINK_IMAGE Import, Export;
+    PIMAGE_IMPORT_DESCRIPTOR ImportDescriptor;
+    PIMAGE_THUNK_DATA Thunk;
+    PIMAGE_OPTIONAL_HEADER OptionalHeader;
+    ULONG_PTR Address;
+    ULONG ImportSize, FirstImport, i, j, k;
+    PCHAR ImportName;
+
+    *ModuleCount = 0;
+    *ImportCount = 0;
+    *AddressCount = 0;
+
+    /* Images are sorted by base, so the modules come out sorted too */
+    for (i = 0; i < ImageCount; i++)
+    {
+        Import = &Images[i];
+        if (!Import->NtHeaders) continue;
+        OptionalHeader = &Import->NtHeaders->OptionalHeader;
+        ImportDescriptor = RtlImageDirectoryEntryToData(Import->Base,
+                                                        TRUE,
+                                                        IMAGE_DIRECTORY_ENTRY_IMPORT,
+                                                        &ImportSize);
+        if (!ImportDescriptor) continue;
+
+        FirstImport = *ImportCount;
+        for (; ImportDescriptor->Name && ImportDescriptor->FirstThunk; ImportDescriptor++)
+        {
+            /* Only imports from another known DLL can be resolved here */
+            ImportName = (PCHAR)((ULONG_PTR)Import->Base + ImportDescriptor->Name);
+            for (j = 0; j < ImageCount; j++)
+            {
+                if (!_stricmp(Images[j].Name, ImportName)) break;
+            }
+            if ((j == ImageCount) || !(Images[j].ExportDirectory)) continue;
+            Export = &Images[j];
+
+            /* Get the original thunks, watching out for weird images like the loader does */
+            if ((ImportDescriptor->Characteristics < OptionalHeader->SizeOfHeaders) ||
+                (ImportDescriptor->Characteristics >= OptionalHeader->SizeOfImage))
+            {
+                Thunk = (PIMAGE_THUNK_DATA)((ULONG_PTR)Import->Base +
+                                            ImportDescriptor->FirstThunk);
+            }
+            else
+            {
+                Thunk = (PIMAGE_THUNK_DATA)((ULONG_PTR)Import->Base +
+                                            ImportDescriptor->OriginalFirstThunk);
+            }
+
+            /* Resolve every thunk of the descriptor */
+            for (k = 0; Thunk[k].u1.AddressOfData; k++)
+            {
+                Address = SmpPrelinkResolveThunk(Export, Import, &Thunk[k]);
+                if (!Address) break;
+                if (Addresses) Addresses[*AddressCount + k] = Address;
+            }
+
+            /* If any of them failed, the loader will have to do it all */
+            if (!k || Thunk[k].u1.AddressOfData) continue;
+
+            if (Imports)
+            {
+                Imports[*ImportCount].ExportBase = (ULONG_PTR)Export->Base;
+                Imports[*ImportCount].ExportTimeDateStamp = Export->NtHeaders->FileHeader.TimeDateStamp;
+                Imports[*ImportCount].FirstThunk = ImportDescriptor->FirstThunk;
+                Imports[*ImportCount].NumberOfThunks = k;
+                Imports[*ImportCount].FirstAddress = *AddressCount;
+            }
+            (*ImportCount)++;
+            *AddressCount += k;
+        }
+
+        /* Skip modules with nothing resolved */
+        if (*ImportCount == FirstImport) continue;
+
+        if (Modules)
+        {
+            Modules[*ModuleCount].ImageBase = (ULONG_PTR)Import->Base;
+            Modules[*ModuleCount].TimeDateStamp = Import->NtHeaders->FileHeader.TimeDateStamp;
+            Modules[*ModuleCount].SizeOfImage = OptionalHeader->SizeOfImage;
+            Modules[*ModuleCount].FirstImport = FirstImport;
+            Modules[*ModuleCount].NumberOfImports = *ImportCount - FirstImport;
+        }
+        (*ModuleCount)++;
+    }
+}
+
+VOID
+NTAPI
+SmpCreatePrelinkCache(IN HANDLE DirHandle)
+{
+    SMP_PRELINK_IMAGE Images[SMP_PRELINK_MAX_IMAGES], Image;
+    ULONG ImageCount, ModuleCount, ImportCount, AddressCount, i, j;
+    PSMP_REGISTRY_VALUE RegEntry;
+    PLIST_ENTRY NextEntry;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    UNICODE_STRING DllName, CacheName;
+    LARGE_INTEGER SectionSize;
+    SECURITY_DESCRIPTOR_CONTROL OldFlag = 0;
+    PSM_PRELINK_HEADER Header;
+    HANDLE SectionHandle;
+    SIZE_T ViewSize;
+    PVOID Base;
+    NTSTATUS Status;
+
+    /* NTDLL is already mapped at the same address in every process */
+    RtlInitUnicodeString(&DllName, L"ntdll.dll");
+    Status = LdrGetDllHandle(NULL, NULL, &DllName, &Images[0].Base);
+    if (!NT_SUCCESS(Status)) return;
+    Images[0].Name = "ntdll.dll";
+    Images[0].Mapped = FALSE;
+    ImageCount = 1;
+
+    /* Map a view of each known DLL section that was created */
+    NextEntry = SmpKnownDllsList.Flink;
+    while ((NextEntry != &SmpKnownDllsList) &&
+           (ImageCount < SMP_PRELINK_MAX_IMAGES))
+    {
+        RegEntry = CONTAINING_RECORD(NextEntry, SMP_REGISTRY_VALUE, Entry);
+        NextEntry = NextEntry->Flink;
+        if (!RegEntry->AnsiValue) continue;
+
+        InitializeObjectAttributes(&ObjectAttributes,
+                                   &RegEntry->Value,
+                                   OBJ_CASE_INSENSITIVE,
+                                   DirHandle,
+                                   NULL);
+        Status = NtOpenSection(&SectionHandle, SECTION_MAP_READ, &ObjectAttributes);
+        if (!NT_SUCCESS(Status)) continue;
+
+        Base = NULL;
+        ViewSize = 0;
+        Status = NtMapViewOfSection(SectionHandle,
+                                    NtCurrentProcess(),
+                                    &Base,
+                                    0,
+                                    0,
+                                    NULL,
+                                    &ViewSize,
+                                    ViewShare,
+                                    0,
+                                    PAGE_READONLY);
+        NtClose(SectionHandle);
+        if (!NT_SUCCESS(Status)) continue;
+
+        /* A DLL that can't get its preferred base won't have stable addresses */
+        if (Status == STATUS_IMAGE_NOT_AT_BASE)
+        {
+            DPRINT("SMSS: Not prelinking %wZ, it is not at its base\n", &RegEntry->Value);
+            NtUnmapViewOfSection(NtCurrentProcess(), Base);
+            continue;
+        }
+
+        Images[ImageCount].Name = RegEntry->AnsiValue;
+        Images[ImageCount].Base = Base;
+        Images[ImageCount].Mapped = TRUE;
+        ImageCount++;
+    }
+
+    /* Get the headers and exports of everything we have */
+    for (i = 0; i < ImageCount; i++)
+    {
+        Images[i].NtHeaders = RtlImageNtHeader(Images[i].Base);
+        Images[i].ExportDirectory = RtlImageDirectoryEntryToData(Images[i].Base,
+                                                                 TRUE,
+                                                                 IMAGE_DIRECTORY_ENTRY_EXPORT,
+                                                                 &Images[i].ExportSize);
+    }
+
+    /* Sort them by base address */
+    for (i = 1; i < ImageCount; i++)
+    {
+        Image = Images[i];
+        for (j = i; (j > 0) && (Images[j - 1].Base > Image.Base); j--)
+        {
+            Images[j] = Images[j - 1];
+        }
+        Images[j] = Image;
+    }
+
+    /* Find out how much there is to cache */
+    SmpPrelinkImports(Images,
+                      ImageCount,
+                      NULL,
+                      NULL,
+                      NULL,
+                      &ModuleCount,
+                      &ImportCount,
+                      &AddressCount);
+    if (!ModuleCount) goto Quickie;
+
+    /* Temporarily hack the SD to use a default DACL for this section */
+    if (SmpLiberalSecurityDescriptor)
+    {
+        OldFlag = SmpLiberalSecurityDescriptor->Control;
+        SmpLiberalSecurityDescriptor->Control |= SE_DACL_DEFAULTED;
+    }
+
+    /* Create the cache section next to the known DLLs */
+    RtlInitUnicodeString(&CacheName, SM_PRELINK_SECTION_NAME);
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &CacheName,
+                               OBJ_PERMANENT,
+                               DirHandle,
+                               SmpLiberalSecurityDescriptor);
+    SectionSize.QuadPart = SM_PRELINK_SIZE(ModuleCount, ImportCount, AddressCount);
+    Status = NtCreateSection(&SectionHandle,
+                             SECTION_ALL_ACCESS,
+                             &ObjectAttributes,
+                             &SectionSize,
+                             PAGE_READWRITE,
+                             SEC_COMMIT,
+                             NULL);
+
+    /* Undo the hack */
+    if (SmpLiberalSecurityDescriptor) SmpLiberalSecurityDescriptor->Control = OldFlag;
+
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("SMSS: Unable to create the KnownDll prelink cache - Status == %lx\n",
+                Status);
+        goto Quickie;
+    }
+
+    Header = NULL;
+    ViewSize = 0;
+    Status = NtMapViewOfSection(SectionHandle,
+                                NtCurrentProcess(),
+                                (PVOID*)&Header,
+                                0,
+                                0,
+                                NULL,
+                                &ViewSize,
+                                ViewShare,
+                                0,
+                                PAGE_READWRITE);
+    if (NT_SUCCESS(Status))
+    {
+        /* Fill it in for real this time */
+        Header->NumberOfModules = ModuleCount;
+        Header->NumberOfImports = ImportCount;
+        Header->NumberOfAddresses = AddressCount;
+        SmpPrelinkImports(Images,
+                          ImageCount,
+                          SM_PRELINK_MODULES(Header),
+                          SM_PRELINK_IMPORTS(Header),
+                          SM_PRELINK_ADDRESSES(Header),
+                          &ModuleCount,
+                          &ImportCount,
+                          &AddressCount);
+        ASSERT(Header->NumberOfModules == ModuleCount);
+        ASSERT(Header->NumberOfImports == ImportCount);
+        ASSERT(Header->NumberOfAddresses == AddressCount);
+
+        /* Only mark it valid once everything is there */
+        Header->Size = SectionSize.LowPart;
+        Header->Signature = SM_PRELINK_SIGNATURE;
+        NtUnmapViewOfSection(NtCurrentProcess(), Header);
+
+        DPRINT("SMSS: Prelinked %lu imports of %lu known DLLs\n",
+               ImportCount, ModuleCount);
+    }
+    else
+    {
+        /* Nobody can use it, don't leave it behind */
+        NtMakeTemporaryObject(SectionHandle);
+    }
+
+    /* It's permanent, so we can close it now */
+    NtClose(SectionHandle);
+
+Quickie:
+    /* We're done with our own views */
+    for (i = 0; i < ImageCount; i++)
+    {
+        if (Images[i].Mapped) NtUnmapViewOfSection(NtCurrentProcess(), Images[i].Base);
+    }
+}
+
 NTSTATUS
 NTAPI
 SmpInitializeKnownDllsInternal(IN PUNICODE_STRING Directory,
@@ -1631,6 +2007,9 @@ SmpInitializeKnownDllsInternal(IN PUNICODE_STRING Directory,
         ASSERT(NT_SUCCESS(Status1));
     }
 
+    /* Resolve the imports between the known DLLs once for all processes */
+    SmpCreatePrelinkCache(DirHandle);
+
 Quickie:
     /* Close both handles and free the NT path buffer */
     if (DirHandle)
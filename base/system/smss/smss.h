@@ -39,6 +39,9 @@
 /* SM Protocol Header */
 #include <sm/smmsg.h>
 
+/* KnownDlls Prelinked Import Cache */
+#include <sm/prelink.h>
+
 /* DEFINES ********************************************************************/
 
 #define SMP_DEBUG_FLAG      0x01
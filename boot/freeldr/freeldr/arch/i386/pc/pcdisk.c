@@ -862,11 +862,13 @@ PcDiskGetCacheableBlockCount(UCHAR DriveNumber)
         return 1; // Unknown count.
 
     /*
-     * If LBA is supported then the block size will be 64 sectors (32k).
+     * If LBA is supported then the block size will be 16 sectors (8k).
+     * The cache reads runs of consecutive blocks at once, so a small
+     * block only costs a bigger disk read when it is all that's needed.
      * If not then the block size is the size of one track.
      */
     if (DiskDrive->Int13ExtensionsSupported)
-        return 64;
+        return 16;
     else
         return DiskDrive->Geometry.SectorsPerTrack;
 }
@@ -23,18 +23,24 @@
 #define TAG_CACHE_DATA 'DcaC'
 #define TAG_CACHE_BLOCK 'BcaC'
 
+#define CACHE_HASH_SIZE             256     // Number of block hash buckets, must be a power of 2
+#define CACHE_READ_AHEAD_BLOCKS     8       // Blocks read past the end of a sequential request
+#define CACHE_MAX_READ_BLOCKS       16      // Most blocks fetched by a single disk read
+
 ///////////////////////////////////////////////////////////////////////////////////////
 //
 // This structure describes a cached block element. The disk is divided up into
 // cache blocks. For disks which LBA is not supported each block is the size of
 // one track. This will force the cache manager to make track sized reads, and
-// therefore maximizes throughput. For disks which support LBA the block size
-// is 64k because they have no cylinder, head, or sector boundaries.
+// therefore maximizes throughput. For disks which support LBA the blocks are
+// small, because they have no cylinder, head, or sector boundaries; misses on
+// consecutive blocks are read from the disk together.
 //
 ///////////////////////////////////////////////////////////////////////////////////////
 typedef struct
 {
     LIST_ENTRY    ListEntry;                    // Doubly linked list synchronization member
+    LIST_ENTRY    HashListEntry;                // Links the block into its hash bucket
 
     ULONG            BlockNumber;                // Track index for CHS, 64k block index for LBA
     BOOLEAN        LockedInCache;                // Indicates that this block is locked in cache memory
@@ -58,6 +64,11 @@ typedef struct
 
     ULONG            BlockSize;            // Block size (in sectors)
     LIST_ENTRY        CacheBlockHead;            // Contains CACHE_BLOCK structures
+    LIST_ENTRY        CacheBlockHash[CACHE_HASH_SIZE];    // Same blocks, hashed by block number
+
+    ULONG            NextSequentialBlock;    // Block following the last request, for read-ahead
+    ULONG            ReadCallCount;          // Number of disk reads issued
+    ULONGLONG        SectorsRead;            // Number of sectors read from the disk
 
 } CACHE_DRIVE, *PCACHE_DRIVE;
 
@@ -81,6 +92,7 @@ extern    SIZE_T                CacheSizeCurrent;
 PCACHE_BLOCK    CacheInternalGetBlockPointer(PCACHE_DRIVE CacheDrive, ULONG BlockNumber);                // Returns a pointer to a CACHE_BLOCK structure given a block number
 PCACHE_BLOCK    CacheInternalFindBlock(PCACHE_DRIVE CacheDrive, ULONG BlockNumber);                    // Searches the block list for a particular block
 PCACHE_BLOCK    CacheInternalAddBlockToCache(PCACHE_DRIVE CacheDrive, ULONG BlockNumber);                // Adds a block to the cache's block list
+ULONG            CacheInternalReadBlocks(PCACHE_DRIVE CacheDrive, ULONG BlockNumber, ULONG BlockCount);    // Reads a run of uncached blocks into the cache with one disk read
 BOOLEAN            CacheInternalFreeBlock(PCACHE_DRIVE CacheDrive);                                    // Removes a block from the cache's block list & frees the memory
 VOID            CacheInternalCheckCacheSizeLimits(PCACHE_DRIVE CacheDrive);                            // Checks the cache size limits to see if we can add a new block, if not calls CacheInternalFreeBlock()
 VOID            CacheInternalDumpBlockList(PCACHE_DRIVE CacheDrive);                                // Dumps the list of cached blocks to the debug output port
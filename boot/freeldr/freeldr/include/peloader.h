@@ -26,6 +26,11 @@ typedef VOID
 
 extern PELDR_IMPORTDLL_LOAD_CALLBACK PeLdrImportDllLoadCallback;
 
+#if DBG && !defined(_M_ARM)
+extern ULONGLONG PeLdrReadTime;
+extern ULONGLONG PeLdrRelocationTime;
+#endif
+
 BOOLEAN
 PeLdrInitializeModuleList(VOID);
 
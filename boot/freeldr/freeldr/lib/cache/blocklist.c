@@ -43,6 +43,10 @@ PCACHE_BLOCK CacheInternalGetBlockPointer(PCACHE_DRIVE CacheDrive, ULONG BlockNu
     TRACE("Cache miss! BlockNumber: %d\n", BlockNumber);
 
     CacheBlock = CacheInternalAddBlockToCache(CacheDrive, BlockNumber);
+    if (CacheBlock == NULL)
+    {
+        return NULL;
+    }
 
     // Optimize the block list so it has a LRU structure
     CacheInternalOptimizeBlockList(CacheDrive, CacheBlock);
@@ -52,36 +56,32 @@ PCACHE_BLOCK CacheInternalGetBlockPointer(PCACHE_DRIVE CacheDrive, ULONG BlockNu
 
 PCACHE_BLOCK CacheInternalFindBlock(PCACHE_DRIVE CacheDrive, ULONG BlockNumber)
 {
-    PCACHE_BLOCK    CacheBlock = NULL;
+    PLIST_ENTRY     HashHead;
+    PLIST_ENTRY     Entry;
+    PCACHE_BLOCK    CacheBlock;
 
     TRACE("CacheInternalFindBlock() BlockNumber = %d\n", BlockNumber);
 
     //
-    // Make sure the block list has entries before I start searching it.
+    // Only the blocks in this bucket can match
     //
-    if (!IsListEmpty(&CacheDrive->CacheBlockHead))
+    HashHead = &CacheDrive->CacheBlockHash[BlockNumber & (CACHE_HASH_SIZE - 1)];
+
+    for (Entry = HashHead->Flink; Entry != HashHead; Entry = Entry->Flink)
     {
+        CacheBlock = CONTAINING_RECORD(Entry, CACHE_BLOCK, HashListEntry);
+
         //
-        // Search the list and find the BIOS drive number
+        // We found the block, so return it
         //
-        CacheBlock = CONTAINING_RECORD(CacheDrive->CacheBlockHead.Flink, CACHE_BLOCK, ListEntry);
-
-        while (&CacheBlock->ListEntry != &CacheDrive->CacheBlockHead)
+        if (CacheBlock->BlockNumber == BlockNumber)
         {
             //
-            // We found the block, so return it
+            // Increment the blocks access count
             //
-            if (CacheBlock->BlockNumber == BlockNumber)
-            {
-                //
-                // Increment the blocks access count
-                //
-                CacheBlock->AccessCount++;
+            CacheBlock->AccessCount++;
 
-                return CacheBlock;
-            }
-
-            CacheBlock = CONTAINING_RECORD(CacheBlock->ListEntry.Flink, CACHE_BLOCK, ListEntry);
+            return CacheBlock;
         }
     }
 
@@ -90,53 +90,108 @@ PCACHE_BLOCK CacheInternalFindBlock(PCACHE_DRIVE CacheDrive, ULONG BlockNumber)
 
 PCACHE_BLOCK CacheInternalAddBlockToCache(PCACHE_DRIVE CacheDrive, ULONG BlockNumber)
 {
-    PCACHE_BLOCK    CacheBlock = NULL;
-
     TRACE("CacheInternalAddBlockToCache() BlockNumber = %d\n", BlockNumber);
 
-    // Check the size of the cache so we don't exceed our limits
-    CacheInternalCheckCacheSizeLimits(CacheDrive);
-
-    // We will need to add the block to the
-    // drive's list of cached blocks. So allocate
-    // the block memory.
-    CacheBlock = FrLdrTempAlloc(sizeof(CACHE_BLOCK), TAG_CACHE_BLOCK);
-    if (CacheBlock == NULL)
+    if (CacheInternalReadBlocks(CacheDrive, BlockNumber, 1) == 0)
     {
         return NULL;
     }
 
-    // Now initialize the structure and
-    // allocate room for the block data
-    RtlZeroMemory(CacheBlock, sizeof(CACHE_BLOCK));
-    CacheBlock->BlockNumber = BlockNumber;
-    CacheBlock->BlockData = FrLdrTempAlloc(CacheDrive->BlockSize * CacheDrive->BytesPerSector,
-                                           TAG_CACHE_DATA);
-    if (CacheBlock->BlockData ==NULL)
+    return CacheInternalFindBlock(CacheDrive, BlockNumber);
+}
+
+// Reads BlockCount consecutive blocks starting at BlockNumber
+// with a single disk read, as far as the disk read buffer allows,
+// and adds the ones which aren't cached yet to the cache.
+// Returns the number of blocks that were read.
+ULONG CacheInternalReadBlocks(PCACHE_DRIVE CacheDrive, ULONG BlockNumber, ULONG BlockCount)
+{
+    PCACHE_BLOCK    CacheBlock;
+    ULONG           BlockBytes = CacheDrive->BlockSize * CacheDrive->BytesPerSector;
+    ULONG           MaxBlockCount;
+    ULONG           Idx;
+
+    TRACE("CacheInternalReadBlocks() BlockNumber = %d BlockCount = %d\n", BlockNumber, BlockCount);
+
+    // The whole run has to fit in the disk read buffer
+    MaxBlockCount = (ULONG)(DiskReadBufferSize / BlockBytes);
+    BlockCount = min(BlockCount, max(MaxBlockCount, 1));
+
+    // Now try to read in the blocks. If the run went past the
+    // end of the disk, fall back to just the first block.
+    CacheDrive->ReadCallCount++;
+    if (!MachDiskReadLogicalSectors(CacheDrive->DriveNumber,
+                                    (ULONGLONG)BlockNumber * CacheDrive->BlockSize,
+                                    BlockCount * CacheDrive->BlockSize,
+                                    DiskReadBuffer))
     {
-        FrLdrTempFree(CacheBlock, TAG_CACHE_BLOCK);
-        return NULL;
+        if (BlockCount == 1)
+        {
+            return 0;
+        }
+
+        BlockCount = 1;
+
+        CacheDrive->ReadCallCount++;
+        if (!MachDiskReadLogicalSectors(CacheDrive->DriveNumber,
+                                        (ULONGLONG)BlockNumber * CacheDrive->BlockSize,
+                                        CacheDrive->BlockSize,
+                                        DiskReadBuffer))
+        {
+            return 0;
+        }
     }
 
-    // Now try to read in the block
-    if (!MachDiskReadLogicalSectors(CacheDrive->DriveNumber, (BlockNumber * CacheDrive->BlockSize), CacheDrive->BlockSize, DiskReadBuffer))
+    CacheDrive->SectorsRead += BlockCount * CacheDrive->BlockSize;
+
+    for (Idx = 0; Idx < BlockCount; Idx++)
     {
-        FrLdrTempFree(CacheBlock->BlockData, TAG_CACHE_DATA);
-        FrLdrTempFree(CacheBlock, TAG_CACHE_BLOCK);
-        return NULL;
-    }
-    RtlCopyMemory(CacheBlock->BlockData, DiskReadBuffer, CacheDrive->BlockSize * CacheDrive->BytesPerSector);
+        // Read-ahead may have overlapped blocks we already have
+        if (CacheInternalFindBlock(CacheDrive, BlockNumber + Idx) != NULL)
+        {
+            continue;
+        }
 
-    // Add it to our list of blocks managed by the cache
-    InsertTailList(&CacheDrive->CacheBlockHead, &CacheBlock->ListEntry);
+        // Check the size of the cache so we don't exceed our limits
+        CacheInternalCheckCacheSizeLimits(CacheDrive);
 
-    // Update the cache data
-    CacheBlockCount++;
-    CacheSizeCurrent = CacheBlockCount * (CacheDrive->BlockSize * CacheDrive->BytesPerSector);
+        // We will need to add the block to the
+        // drive's list of cached blocks. So allocate
+        // the block memory.
+        CacheBlock = FrLdrTempAlloc(sizeof(CACHE_BLOCK), TAG_CACHE_BLOCK);
+        if (CacheBlock == NULL)
+        {
+            break;
+        }
+
+        // Now initialize the structure and
+        // allocate room for the block data
+        RtlZeroMemory(CacheBlock, sizeof(CACHE_BLOCK));
+        CacheBlock->BlockNumber = BlockNumber + Idx;
+        CacheBlock->BlockData = FrLdrTempAlloc(BlockBytes, TAG_CACHE_DATA);
+        if (CacheBlock->BlockData == NULL)
+        {
+            FrLdrTempFree(CacheBlock, TAG_CACHE_BLOCK);
+            break;
+        }
+
+        RtlCopyMemory(CacheBlock->BlockData, (PUCHAR)DiskReadBuffer + (Idx * BlockBytes), BlockBytes);
+
+        // Add it to our list of blocks managed by the cache.
+        // Put it at the head, so that read-ahead blocks aren't
+        // the first ones to go when the cache is full.
+        InsertHeadList(&CacheDrive->CacheBlockHead, &CacheBlock->ListEntry);
+        InsertHeadList(&CacheDrive->CacheBlockHash[CacheBlock->BlockNumber & (CACHE_HASH_SIZE - 1)],
+                       &CacheBlock->HashListEntry);
+
+        // Update the cache data
+        CacheBlockCount++;
+        CacheSizeCurrent = CacheBlockCount * BlockBytes;
+    }
 
     CacheInternalDumpBlockList(CacheDrive);
 
-    return CacheBlock;
+    return Idx;
 }
 
 BOOLEAN CacheInternalFreeBlock(PCACHE_DRIVE CacheDrive)
@@ -156,12 +211,13 @@ BOOLEAN CacheInternalFreeBlock(PCACHE_DRIVE CacheDrive)
 
     // No blocks left in cache that can be freed
     // so just return
-    if (IsListEmpty(&CacheDrive->CacheBlockHead))
+    if (&CacheBlockToFree->ListEntry == &CacheDrive->CacheBlockHead)
     {
         return FALSE;
     }
 
     RemoveEntryList(&CacheBlockToFree->ListEntry);
+    RemoveEntryList(&CacheBlockToFree->HashListEntry);
 
     // Free the block memory and the block structure
     FrLdrTempFree(CacheBlockToFree->BlockData, TAG_CACHE_DATA);
@@ -38,6 +38,7 @@ BOOLEAN CacheInitializeDrive(UCHAR DriveNumber)
 {
     PCACHE_BLOCK    NextCacheBlock;
     GEOMETRY    DriveGeometry;
+    ULONG       Idx;
 
     // If we already have a cache for this drive then
     // by all means lets keep it, unless it is a removable
@@ -63,6 +64,8 @@ BOOLEAN CacheInitializeDrive(UCHAR DriveNumber)
         TRACE("CacheBlockCount: %d\n", CacheBlockCount);
         TRACE("CacheSizeLimit: %d\n", CacheSizeLimit);
         TRACE("CacheSizeCurrent: %d\n", CacheSizeCurrent);
+        TRACE("ReadCallCount: %d\n", CacheManagerDrive.ReadCallCount);
+        TRACE("SectorsRead: %I64u\n", CacheManagerDrive.SectorsRead);
         //
         // Loop through and free the cache blocks
         //
@@ -80,6 +83,10 @@ BOOLEAN CacheInitializeDrive(UCHAR DriveNumber)
     // Initialize the structure
     RtlZeroMemory(&CacheManagerDrive, sizeof(CACHE_DRIVE));
     InitializeListHead(&CacheManagerDrive.CacheBlockHead);
+    for (Idx = 0; Idx < CACHE_HASH_SIZE; Idx++)
+    {
+        InitializeListHead(&CacheManagerDrive.CacheBlockHash[Idx]);
+    }
     CacheManagerDrive.DriveNumber = DriveNumber;
     if (!MachDiskGetDriveGeometry(DriveNumber, &DriveGeometry))
     {
@@ -115,10 +122,13 @@ BOOLEAN CacheReadDiskSectors(UCHAR DiskNumber, ULONGLONG StartSector, ULONG Sect
     PCACHE_BLOCK    CacheBlock;
     ULONG                StartBlock;
     ULONG                SectorOffsetInStartBlock;
-    ULONG                CopyLengthInStartBlock;
     ULONG                EndBlock;
     ULONG                SectorOffsetInEndBlock;
-    ULONG                BlockCount;
+    ULONG                BlockOffset;
+    ULONG                BlockLength;
+    ULONG                RunLength;
+    ULONG                ReadAheadEnd;
+    BOOLEAN              Sequential;
     ULONG                Idx;
 
     TRACE("CacheReadDiskSectors() DiskNumber: 0x%x StartSector: %I64u SectorCount: %u Buffer: 0x%x\n", DiskNumber, StartSector, SectorCount, Buffer);
@@ -129,116 +139,81 @@ BOOLEAN CacheReadDiskSectors(UCHAR DiskNumber, ULONGLONG StartSector, ULONG Sect
         return FALSE;
     }
 
+    if (SectorCount == 0)
+    {
+        return TRUE;
+    }
+
     //
     // Calculate which blocks we must cache
     //
     StartBlock = (ULONG)(StartSector / CacheManagerDrive.BlockSize);
     SectorOffsetInStartBlock = (ULONG)(StartSector % CacheManagerDrive.BlockSize);
-    CopyLengthInStartBlock = (ULONG)((SectorCount > (CacheManagerDrive.BlockSize - SectorOffsetInStartBlock)) ? (CacheManagerDrive.BlockSize - SectorOffsetInStartBlock) : SectorCount);
     EndBlock = (ULONG)((StartSector + (SectorCount - 1)) / CacheManagerDrive.BlockSize);
     SectorOffsetInEndBlock = (ULONG)(1 + (StartSector + (SectorCount - 1)) % CacheManagerDrive.BlockSize);
-    BlockCount = (EndBlock - StartBlock) + 1;
-    TRACE("StartBlock: %d SectorOffsetInStartBlock: %d CopyLengthInStartBlock: %d EndBlock: %d SectorOffsetInEndBlock: %d BlockCount: %d\n", StartBlock, SectorOffsetInStartBlock, CopyLengthInStartBlock, EndBlock, SectorOffsetInEndBlock, BlockCount);
+    TRACE("StartBlock: %d SectorOffsetInStartBlock: %d EndBlock: %d SectorOffsetInEndBlock: %d\n", StartBlock, SectorOffsetInStartBlock, EndBlock, SectorOffsetInEndBlock);
 
     //
-    // Read the first block into the buffer
+    // A request that starts where the previous one ended (or in its last
+    // block) is most likely part of a file being read from start to end,
+    // so read further ahead than asked for.
     //
-    if (BlockCount > 0)
+    Sequential = (StartBlock == CacheManagerDrive.NextSequentialBlock) ||
+                 (StartBlock + 1 == CacheManagerDrive.NextSequentialBlock);
+    ReadAheadEnd = Sequential ? EndBlock + CACHE_READ_AHEAD_BLOCKS : EndBlock;
+    if (ReadAheadEnd < EndBlock)
     {
-        //
-        // Get cache block pointer (this forces the disk sectors into the cache memory)
-        //
-        CacheBlock = CacheInternalGetBlockPointer(&CacheManagerDrive, StartBlock);
-        if (CacheBlock == NULL)
-        {
-            return FALSE;
-        }
-
-        //
-        // Copy the portion requested into the buffer
-        //
-        RtlCopyMemory(Buffer,
-            (PVOID)((ULONG_PTR)CacheBlock->BlockData + (SectorOffsetInStartBlock * CacheManagerDrive.BytesPerSector)),
-            (CopyLengthInStartBlock * CacheManagerDrive.BytesPerSector));
-        TRACE("1 - RtlCopyMemory(0x%x, 0x%x, %d)\n", Buffer, ((ULONG_PTR)CacheBlock->BlockData + (SectorOffsetInStartBlock * CacheManagerDrive.BytesPerSector)), (CopyLengthInStartBlock * CacheManagerDrive.BytesPerSector));
-
-        //
-        // Update the buffer address
-        //
-        Buffer = (PVOID)((ULONG_PTR)Buffer + (CopyLengthInStartBlock * CacheManagerDrive.BytesPerSector));
-
-        //
-        // Update the block count
-        //
-        BlockCount--;
+        ReadAheadEnd = EndBlock;
     }
 
-    //
-    // Loop through the middle blocks and read them into the buffer
-    //
-    for (Idx=StartBlock+1; BlockCount>1; Idx++)
+    for (Idx = StartBlock; Idx <= EndBlock; Idx++)
     {
-        //
-        // Get cache block pointer (this forces the disk sectors into the cache memory)
-        //
-        CacheBlock = CacheInternalGetBlockPointer(&CacheManagerDrive, Idx);
+        CacheBlock = CacheInternalFindBlock(&CacheManagerDrive, Idx);
         if (CacheBlock == NULL)
         {
-            return FALSE;
+            //
+            // Fetch this block together with the missing blocks that follow
+            // it, so that a large request doesn't cost one disk read per block
+            //
+            RunLength = 1;
+            while ((RunLength < CACHE_MAX_READ_BLOCKS) &&
+                   (Idx + RunLength <= ReadAheadEnd) &&
+                   (CacheInternalFindBlock(&CacheManagerDrive, Idx + RunLength) == NULL))
+            {
+                RunLength++;
+            }
+
+            CacheInternalReadBlocks(&CacheManagerDrive, Idx, RunLength);
+
+            //
+            // Get cache block pointer (this forces the disk sectors into the cache memory)
+            //
+            CacheBlock = CacheInternalGetBlockPointer(&CacheManagerDrive, Idx);
+            if (CacheBlock == NULL)
+            {
+                return FALSE;
+            }
         }
 
         //
         // Copy the portion requested into the buffer
         //
-        RtlCopyMemory(Buffer,
-            CacheBlock->BlockData,
-            CacheManagerDrive.BlockSize * CacheManagerDrive.BytesPerSector);
-        TRACE("2 - RtlCopyMemory(0x%x, 0x%x, %d)\n", Buffer, CacheBlock->BlockData, CacheManagerDrive.BlockSize * CacheManagerDrive.BytesPerSector);
-
-        //
-        // Update the buffer address
-        //
-        Buffer = (PVOID)((ULONG_PTR)Buffer + (CacheManagerDrive.BlockSize * CacheManagerDrive.BytesPerSector));
-
-        //
-        // Update the block count
-        //
-        BlockCount--;
-    }
-
-    //
-    // Read the last block into the buffer
-    //
-    if (BlockCount > 0)
-    {
-        //
-        // Get cache block pointer (this forces the disk sectors into the cache memory)
-        //
-        CacheBlock = CacheInternalGetBlockPointer(&CacheManagerDrive, EndBlock);
-        if (CacheBlock == NULL)
-        {
-            return FALSE;
-        }
+        BlockOffset = (Idx == StartBlock) ? SectorOffsetInStartBlock : 0;
+        BlockLength = ((Idx == EndBlock) ? SectorOffsetInEndBlock : CacheManagerDrive.BlockSize) - BlockOffset;
 
-        //
-        // Copy the portion requested into the buffer
-        //
         RtlCopyMemory(Buffer,
-            CacheBlock->BlockData,
-            SectorOffsetInEndBlock * CacheManagerDrive.BytesPerSector);
-        TRACE("3 - RtlCopyMemory(0x%x, 0x%x, %d)\n", Buffer, CacheBlock->BlockData, SectorOffsetInEndBlock * CacheManagerDrive.BytesPerSector);
+            (PVOID)((ULONG_PTR)CacheBlock->BlockData + (BlockOffset * CacheManagerDrive.BytesPerSector)),
+            BlockLength * CacheManagerDrive.BytesPerSector);
+        TRACE("RtlCopyMemory(0x%x, 0x%x, %d)\n", Buffer, ((ULONG_PTR)CacheBlock->BlockData + (BlockOffset * CacheManagerDrive.BytesPerSector)), BlockLength * CacheManagerDrive.BytesPerSector);
 
         //
         // Update the buffer address
         //
-        Buffer = (PVOID)((ULONG_PTR)Buffer + (SectorOffsetInEndBlock * CacheManagerDrive.BytesPerSector));
-
-        //
-        // Update the block count
-        //
-        BlockCount--;
+        Buffer = (PVOID)((ULONG_PTR)Buffer + (BlockLength * CacheManagerDrive.BytesPerSector));
     }
 
+    CacheManagerDrive.NextSequentialBlock = EndBlock + 1;
+
     return TRUE;
 }
 
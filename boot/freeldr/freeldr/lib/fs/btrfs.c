@@ -684,10 +684,55 @@ static u64 btrfs_read_extent_inline(struct btrfs_path *path,
     return READ_ERROR;
 }
 
+/*
+ * Reads of consecutive extents which are also next to each other on disk
+ * are put together, so a file written in one go is read with a single
+ * disk read rather than one per extent
+ */
+struct btrfs_read_run
+{
+    u64 physical;
+    char *out;
+    u64 length;
+};
+
+static BOOLEAN flush_read_run(PBTRFS_INFO BtrFsInfo, struct btrfs_read_run *run)
+{
+    BOOLEAN ret = TRUE;
+
+    if (run->length)
+        ret = disk_read(BtrFsInfo->DeviceId, run->physical, run->out, (u32)run->length);
+
+    run->length = 0;
+    return ret;
+}
+
+static BOOLEAN queue_read_run(PBTRFS_INFO BtrFsInfo, struct btrfs_read_run *run,
+                              u64 physical, char *out, u64 length)
+{
+    if (run->length &&
+        run->physical + run->length == physical &&
+        run->out + run->length == out &&
+        run->length + length <= MAXULONG)
+    {
+        run->length += length;
+        return TRUE;
+    }
+
+    if (!flush_read_run(BtrFsInfo, run))
+        return FALSE;
+
+    run->physical = physical;
+    run->out = out;
+    run->length = length;
+    return TRUE;
+}
+
 static u64 btrfs_read_extent_reg(PBTRFS_INFO BtrFsInfo,
                                  struct btrfs_path *path,
                                  struct btrfs_file_extent_item *extent,
-                                 u64 offset, u64 size, char *out)
+                                 u64 offset, u64 size, char *out,
+                                 struct btrfs_read_run *run)
 {
     u64 physical, dlen;
     char *temp_out;
@@ -756,7 +801,7 @@ static u64 btrfs_read_extent_reg(PBTRFS_INFO BtrFsInfo,
             }
         } else
         {
-            if (!disk_read(BtrFsInfo->DeviceId, physical, out, size))
+            if (!queue_read_run(BtrFsInfo, run, physical, out, size))
                 return READ_ERROR;
         }
 
@@ -774,6 +819,7 @@ static u64 btrfs_file_read(PBTRFS_INFO BtrFsInfo,
     struct btrfs_path path;
     struct btrfs_disk_key key;
     struct btrfs_file_extent_item *extent;
+    struct btrfs_read_run run = { 0 };
     int res = 0;
     u64 rd, seek_pointer = READ_ERROR, offset_in_extent;
     BOOLEAN find_res;
@@ -820,7 +866,7 @@ static u64 btrfs_file_read(PBTRFS_INFO BtrFsInfo,
         }
         else
         {
-            rd = btrfs_read_extent_reg(BtrFsInfo, &path, extent, offset_in_extent, size, buf);
+            rd = btrfs_read_extent_reg(BtrFsInfo, &path, extent, offset_in_extent, size, buf, &run);
         }
 
         if (rd == READ_ERROR)
@@ -839,7 +885,7 @@ static u64 btrfs_file_read(PBTRFS_INFO BtrFsInfo,
             break;
     } while (!(res = next_slot(BtrFsInfo, &key, &path)));
 
-    if (res)
+    if (res || !flush_read_run(BtrFsInfo, &run))
     {
         seek_pointer = READ_ERROR;
         goto out;
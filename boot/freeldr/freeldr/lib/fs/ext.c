@@ -36,6 +36,7 @@ BOOLEAN    ExtReadSuperBlock(PEXT_VOLUME_INFO Volume);
 BOOLEAN    ExtReadGroupDescriptors(PEXT_VOLUME_INFO Volume);
 BOOLEAN    ExtReadDirectory(PEXT_VOLUME_INFO Volume, ULONG Inode, PVOID* DirectoryBuffer, PEXT_INODE InodePointer);
 BOOLEAN    ExtReadBlock(PEXT_VOLUME_INFO Volume, ULONG BlockNumber, PVOID Buffer);
+BOOLEAN    ExtReadBlocks(PEXT_VOLUME_INFO Volume, ULONG BlockNumber, ULONG BlockCount, PVOID Buffer);
 BOOLEAN    ExtReadPartialBlock(PEXT_VOLUME_INFO Volume, ULONG BlockNumber, ULONG StartingOffset, ULONG Length, PVOID Buffer);
 BOOLEAN    ExtReadInode(PEXT_VOLUME_INFO Volume, ULONG Inode, PEXT_INODE InodeBuffer);
 BOOLEAN    ExtReadGroupDescriptor(PEXT_VOLUME_INFO Volume, ULONG Group, PEXT_GROUP_DESC GroupBuffer);
@@ -392,6 +393,7 @@ BOOLEAN ExtReadFileBig(PEXT_FILE_INFO ExtFileInfo, ULONGLONG BytesToRead, ULONGL
     ULONG                OffsetInBlock;
     ULONG                LengthInBlock;
     ULONG                NumberOfBlocks;
+    ULONG                RunLength;
 
     TRACE("ExtReadFileBig() BytesToRead = %d Buffer = 0x%x\n", (ULONG)BytesToRead, Buffer);
 
@@ -523,21 +525,34 @@ BOOLEAN ExtReadFileBig(PEXT_FILE_INFO ExtFileInfo, ULONGLONG BytesToRead, ULONGL
             BlockNumberIndex = (ULONG)(ExtFileInfo->FilePointer / Volume->BlockSizeInBytes);
             BlockNumber = ExtFileInfo->FileBlockList[BlockNumberIndex];
 
+            //
+            // Extents and indirect blocks usually map runs of the file
+            // to consecutive blocks on disk, so read as many of those
+            // (or of sparse blocks) as we can in one go
+            //
+            RunLength = 1;
+            while ((RunLength < NumberOfBlocks) &&
+                   (ExtFileInfo->FileBlockList[BlockNumberIndex + RunLength] ==
+                    (BlockNumber ? BlockNumber + RunLength : 0)))
+            {
+                RunLength++;
+            }
+
             //
             // Now do the read and update BytesRead, BytesToRead, FilePointer, & Buffer
             //
-            if (!ExtReadBlock(Volume, BlockNumber, Buffer))
+            if (!ExtReadBlocks(Volume, BlockNumber, RunLength, Buffer))
             {
                 return FALSE;
             }
             if (BytesRead != NULL)
             {
-                *BytesRead += Volume->BlockSizeInBytes;
+                *BytesRead += RunLength * Volume->BlockSizeInBytes;
             }
-            BytesToRead -= Volume->BlockSizeInBytes;
-            ExtFileInfo->FilePointer += Volume->BlockSizeInBytes;
-            Buffer = (PVOID)((ULONG_PTR)Buffer + Volume->BlockSizeInBytes);
-            NumberOfBlocks--;
+            BytesToRead -= RunLength * Volume->BlockSizeInBytes;
+            ExtFileInfo->FilePointer += RunLength * Volume->BlockSizeInBytes;
+            Buffer = (PVOID)((ULONG_PTR)Buffer + (RunLength * Volume->BlockSizeInBytes));
+            NumberOfBlocks -= RunLength;
         }
     }
 
@@ -897,6 +912,46 @@ BOOLEAN ExtReadBlock(PEXT_VOLUME_INFO Volume, ULONG BlockNumber, PVOID Buffer)
     return ExtReadVolumeSectors(Volume, (ULONGLONG)BlockNumber * Volume->BlockSizeInSectors, Volume->BlockSizeInSectors, Buffer);
 }
 
+/*
+ * ExtReadBlocks()
+ * Reads BlockCount consecutive blocks into memory with a single disk read.
+ * A BlockNumber of 0 means the blocks are sparse.
+ */
+BOOLEAN ExtReadBlocks(PEXT_VOLUME_INFO Volume, ULONG BlockNumber, ULONG BlockCount, PVOID Buffer)
+{
+    CHAR    ErrorString[80];
+
+    TRACE("ExtReadBlocks() BlockNumber = %d BlockCount = %d Buffer = 0x%x\n", BlockNumber, BlockCount, Buffer);
+
+    if (BlockCount == 1)
+    {
+        return ExtReadBlock(Volume, BlockNumber, Buffer);
+    }
+
+    // Check to see if these are sparse blocks
+    if (BlockNumber == 0)
+    {
+        TRACE("Blocks are part of a sparse file. Zeroing input buffer.\n");
+
+        RtlZeroMemory(Buffer, BlockCount * Volume->BlockSizeInBytes);
+
+        return TRUE;
+    }
+
+    // Make sure the whole run is valid
+    if (BlockNumber + BlockCount - 1 > Volume->SuperBlock->BlocksCountLo)
+    {
+        sprintf(ErrorString, "Error reading block %d - block out of range.", (int) (BlockNumber + BlockCount - 1));
+        FileSystemError(ErrorString);
+        return FALSE;
+    }
+
+    return ExtReadVolumeSectors(Volume,
+                                (ULONGLONG)BlockNumber * Volume->BlockSizeInSectors,
+                                BlockCount * Volume->BlockSizeInSectors,
+                                Buffer);
+}
+
 /*
  * ExtReadPartialBlock()
  * Reads part of a block into memory
@@ -29,6 +29,12 @@ LIST_ENTRY FrLdrModuleList;
 
 PELDR_IMPORTDLL_LOAD_CALLBACK PeLdrImportDllLoadCallback = NULL;
 
+#if DBG && !defined(_M_ARM)
+/* Time stamp counter ticks spent reading and relocating images */
+ULONGLONG PeLdrReadTime = 0;
+ULONGLONG PeLdrRelocationTime = 0;
+#endif
+
 #ifdef _WIN64
 #define COOKIE_MAX 0x0000FFFFFFFFFFFFll
 #define DEFAULT_SECURITY_COOKIE 0x00002B992DDFA232ll
@@ -864,6 +870,9 @@ PeLdrLoadImageEx(
     ARC_STATUS Status;
     LARGE_INTEGER Position;
     ULONG i, BytesRead;
+#if DBG && !defined(_M_ARM)
+    ULONGLONG Time = __rdtsc();
+#endif
 
     TRACE("PeLdrLoadImage('%s', %ld)\n", FilePath, MemoryType);
 
@@ -1009,6 +1018,11 @@ PeLdrLoadImageEx(
     /* We are done with the file, close it */
     ArcClose(FileId);
 
+#if DBG && !defined(_M_ARM)
+    PeLdrReadTime += (__rdtsc() - Time);
+    Time = __rdtsc();
+#endif
+
     /* If loading failed, return right now */
     if (Status != ESUCCESS)
         goto Failure;
@@ -1027,6 +1041,10 @@ PeLdrLoadImageEx(
             goto Failure;
     }
 
+#if DBG && !defined(_M_ARM)
+    PeLdrRelocationTime += (__rdtsc() - Time);
+#endif
+
     /* Fill output parameters */
     *ImageBasePA = PhysicalBase;
 
@@ -288,11 +288,11 @@ WinLdrInitializePhase1(PLOADER_PARAMETER_BLOCK LoaderBlock,
 }
 
 static BOOLEAN
-WinLdrLoadDeviceDriver(PLIST_ENTRY LoadOrderListHead,
-                       PCSTR BootPath,
-                       PUNICODE_STRING FilePath,
-                       ULONG Flags,
-                       PLDR_DATA_TABLE_ENTRY *DriverDTE)
+WinLdrLoadDeviceDriverImage(PLIST_ENTRY LoadOrderListHead,
+                            PCSTR BootPath,
+                            PUNICODE_STRING FilePath,
+                            ULONG Flags,
+                            PLDR_DATA_TABLE_ENTRY *DriverDTE)
 {
     CHAR FullPath[1024];
     CHAR DriverPath[1024];
@@ -360,21 +360,173 @@ WinLdrLoadDeviceDriver(PLIST_ENTRY LoadOrderListHead,
     // Modify any flags, if needed
     (*DriverDTE)->Flags |= Flags;
 
+    // Its imports are resolved later on by WinLdrScanDeviceDriverImports()
+    (*DriverDTE)->Flags |= LDRP_LOAD_IN_PROGRESS;
+
+    return TRUE;
+}
+
+static BOOLEAN
+WinLdrScanDeviceDriverImports(PLIST_ENTRY LoadOrderListHead,
+                              PCSTR BootPath,
+                              PUNICODE_STRING FilePath,
+                              PLDR_DATA_TABLE_ENTRY DriverDTE)
+{
+    CHAR FullPath[1024];
+    PCHAR DriverNamePos;
+    BOOLEAN Success;
+
+    // Nothing to do if the driver was loaded before, or is listed twice
+    if (!(DriverDTE->Flags & LDRP_LOAD_IN_PROGRESS))
+        return !(DriverDTE->Flags & LDRP_FAILED_BUILTIN_LOAD);
+
+    DriverDTE->Flags &= ~LDRP_LOAD_IN_PROGRESS;
+
+    // Dependencies are looked for in the directory of the driver
+    RtlStringCbPrintfA(FullPath, sizeof(FullPath), "%s%wZ", BootPath, FilePath);
+    DriverNamePos = strrchr(FullPath, '\\');
+    if (DriverNamePos != NULL)
+        *(DriverNamePos+1) = ANSI_NULL;
+    else
+        RtlStringCbCopyA(FullPath, sizeof(FullPath), BootPath);
+
     // Look for any dependencies it may have, and load them too
-    RtlStringCbPrintfA(FullPath, sizeof(FullPath), "%s%s", BootPath, DriverPath);
-    Success = PeLdrScanImportDescriptorTable(LoadOrderListHead, FullPath, *DriverDTE);
+    Success = PeLdrScanImportDescriptorTable(LoadOrderListHead, FullPath, DriverDTE);
     if (!Success)
     {
-        /* Cleanup and bail out */
+        /*
+         * Don't free it yet: it may be listed again further down, and the
+         * drivers whose imports were resolved before may already be bound
+         * to it. WinLdrFreeFailedImages() takes care of all of them.
+         */
         ERR("PeLdrScanImportDescriptorTable('%s') failed\n", FullPath);
-        PeLdrFreeDataTableEntry(*DriverDTE);
-        MmFreeMemory(DriverBase);
+        DriverDTE->Flags |= LDRP_FAILED_BUILTIN_LOAD;
         return FALSE;
     }
 
     return TRUE;
 }
 
+/* Returns TRUE if any import of the image points into an image that failed */
+static BOOLEAN
+WinLdrIsBoundToFailedImage(PLIST_ENTRY LoadOrderListHead,
+                           PLDR_DATA_TABLE_ENTRY DataTableEntry)
+{
+    PIMAGE_IMPORT_DESCRIPTOR ImportTable;
+    PIMAGE_THUNK_DATA ThunkData;
+    PLIST_ENTRY NextEntry;
+    PLDR_DATA_TABLE_ENTRY FailedEntry;
+    ULONG ImportTableSize;
+
+    ImportTable = RtlImageDirectoryEntryToData(VaToPa(DataTableEntry->DllBase),
+                                               TRUE,
+                                               IMAGE_DIRECTORY_ENTRY_IMPORT,
+                                               &ImportTableSize);
+    if (!ImportTable)
+        return FALSE;
+
+    /* Check the bound addresses, so that forwarded exports are caught too */
+    for (; ImportTable->Name != 0 && ImportTable->FirstThunk != 0; ImportTable++)
+    {
+        ThunkData = VaToPa(RVA(DataTableEntry->DllBase, ImportTable->FirstThunk));
+        for (; ThunkData->u1.Function != 0; ThunkData++)
+        {
+            for (NextEntry = LoadOrderListHead->Flink;
+                 NextEntry != LoadOrderListHead;
+                 NextEntry = NextEntry->Flink)
+            {
+                FailedEntry = CONTAINING_RECORD(NextEntry,
+                                                LDR_DATA_TABLE_ENTRY,
+                                                InLoadOrderLinks);
+                if (!(FailedEntry->Flags & LDRP_FAILED_BUILTIN_LOAD))
+                    continue;
+
+                if (ThunkData->u1.Function >= (ULONG_PTR)FailedEntry->DllBase &&
+                    ThunkData->u1.Function < (ULONG_PTR)FailedEntry->DllBase + FailedEntry->SizeOfImage)
+                {
+                    return TRUE;
+                }
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+/*
+ * Fails every image that got bound to a driver whose imports couldn't be
+ * resolved, then whatever got bound to those, and so on. The imports of a
+ * driver are resolved against the images loaded at that time, which include
+ * the boot drivers further down the list that were already read.
+ */
+static VOID
+WinLdrFailBoundImages(PLIST_ENTRY LoadOrderListHead)
+{
+    PLIST_ENTRY NextEntry;
+    PLDR_DATA_TABLE_ENTRY DataTableEntry;
+    BOOLEAN Changed;
+
+    do
+    {
+        Changed = FALSE;
+        for (NextEntry = LoadOrderListHead->Flink;
+             NextEntry != LoadOrderListHead;
+             NextEntry = NextEntry->Flink)
+        {
+            DataTableEntry = CONTAINING_RECORD(NextEntry,
+                                               LDR_DATA_TABLE_ENTRY,
+                                               InLoadOrderLinks);
+            if (DataTableEntry->Flags & (LDRP_FAILED_BUILTIN_LOAD | LDRP_LOAD_IN_PROGRESS))
+                continue;
+
+            if (WinLdrIsBoundToFailedImage(LoadOrderListHead, DataTableEntry))
+            {
+                ERR("'%.*S' is bound to a driver that failed to load\n",
+                    DataTableEntry->BaseDllName.Length / sizeof(WCHAR),
+                    VaToPa(DataTableEntry->BaseDllName.Buffer));
+                DataTableEntry->Flags |= LDRP_FAILED_BUILTIN_LOAD;
+                Changed = TRUE;
+            }
+        }
+    } while (Changed);
+}
+
+/* Unloads the images marked by WinLdrScanDeviceDriverImports() and WinLdrFailBoundImages() */
+static VOID
+WinLdrFreeFailedImages(PLIST_ENTRY LoadOrderListHead)
+{
+    PLIST_ENTRY NextEntry;
+    PLDR_DATA_TABLE_ENTRY DataTableEntry;
+    PVOID DllBase;
+
+    NextEntry = LoadOrderListHead->Flink;
+    while (NextEntry != LoadOrderListHead)
+    {
+        DataTableEntry = CONTAINING_RECORD(NextEntry,
+                                           LDR_DATA_TABLE_ENTRY,
+                                           InLoadOrderLinks);
+        NextEntry = NextEntry->Flink;
+
+        if (!(DataTableEntry->Flags & LDRP_FAILED_BUILTIN_LOAD))
+            continue;
+
+        DllBase = VaToPa(DataTableEntry->DllBase);
+        PeLdrFreeDataTableEntry(DataTableEntry);
+        MmFreeMemory(DllBase);
+    }
+}
+
+/*
+ * The boot drivers are loaded in two passes: all the driver images are read
+ * and relocated first, and their imports are only resolved afterwards. This
+ * keeps the reads of the driver files (which mostly live next to each other
+ * in the drivers directory) back to back, instead of having them interleaved
+ * with the reads of the DLLs they import.
+ *
+ * Since a driver may get bound to another boot driver whose imports are
+ * not resolved yet, the drivers that fail are only unloaded once every
+ * import has been resolved, along with whatever got bound to them.
+ */
 BOOLEAN
 WinLdrLoadBootDrivers(PLOADER_PARAMETER_BLOCK LoaderBlock,
                       PCSTR BootPath)
@@ -383,9 +535,18 @@ WinLdrLoadBootDrivers(PLOADER_PARAMETER_BLOCK LoaderBlock,
     PBOOT_DRIVER_NODE DriverNode;
     PBOOT_DRIVER_LIST_ENTRY BootDriver;
     BOOLEAN Success;
+    BOOLEAN Failed = FALSE;
     BOOLEAN ret = TRUE;
+#if DBG && !defined(_M_ARM)
+    ULONG DriverCount = 0;
+    ULONGLONG ReadTime = PeLdrReadTime;
+    ULONGLONG RelocationTime = PeLdrRelocationTime;
+    ULONGLONG ImportTime, ImportIoTime;
+    ULONGLONG Time = __rdtsc();
+    ULONGLONG DriverTime;
+#endif
 
-    /* Walk through the boot drivers list */
+    /* Walk through the boot drivers list and load their images */
     NextBd = LoaderBlock->BootDriverListHead.Flink;
     while (NextBd != &LoaderBlock->BootDriverListHead)
     {
@@ -405,12 +566,72 @@ WinLdrLoadBootDrivers(PLOADER_PARAMETER_BLOCK LoaderBlock,
 
         /* Load it */
         UiIndicateProgress();
-        Success = WinLdrLoadDeviceDriver(&LoaderBlock->LoadOrderListHead,
-                                         BootPath,
-                                         &BootDriver->FilePath,
-                                         0,
-                                         &BootDriver->LdrEntry);
-        if (Success)
+#if DBG && !defined(_M_ARM)
+        DriverTime = __rdtsc();
+#endif
+        Success = WinLdrLoadDeviceDriverImage(&LoaderBlock->LoadOrderListHead,
+                                              BootPath,
+                                              &BootDriver->FilePath,
+                                              0,
+                                              &BootDriver->LdrEntry);
+#if DBG && !defined(_M_ARM)
+        DriverCount++;
+        TRACE("BootDriver %wZ loaded in %I64d ticks\n",
+              &BootDriver->FilePath, __rdtsc() - DriverTime);
+#endif
+        if (!Success)
+        {
+            /* Loading failed: cry loudly */
+            ERR("Cannot load boot driver '%wZ'!\n", &BootDriver->FilePath);
+            UiMessageBox("Cannot load boot driver '%wZ'!", &BootDriver->FilePath);
+            ret = FALSE;
+
+            /* Remove it from the list and try to continue */
+            RemoveEntryList(&BootDriver->Link);
+        }
+    }
+
+#if DBG && !defined(_M_ARM)
+    ImportIoTime = PeLdrReadTime + PeLdrRelocationTime;
+    ImportTime = __rdtsc();
+#endif
+
+    /* Now resolve the imports of the drivers that did load */
+    NextBd = LoaderBlock->BootDriverListHead.Flink;
+    while (NextBd != &LoaderBlock->BootDriverListHead)
+    {
+        DriverNode = CONTAINING_RECORD(NextBd,
+                                       BOOT_DRIVER_NODE,
+                                       ListEntry.Link);
+        BootDriver = &DriverNode->ListEntry;
+        NextBd = BootDriver->Link.Flink;
+
+        Success = WinLdrScanDeviceDriverImports(&LoaderBlock->LoadOrderListHead,
+                                                BootPath,
+                                                &BootDriver->FilePath,
+                                                BootDriver->LdrEntry);
+        if (!Success)
+            Failed = TRUE;
+    }
+
+    /*
+     * A driver that failed takes down the other entries for the same image,
+     * and everything already bound to it. The list entries for those drivers
+     * are removed before the images go away.
+     */
+    if (Failed)
+        WinLdrFailBoundImages(&LoaderBlock->LoadOrderListHead);
+
+    NextBd = LoaderBlock->BootDriverListHead.Flink;
+    while (NextBd != &LoaderBlock->BootDriverListHead)
+    {
+        DriverNode = CONTAINING_RECORD(NextBd,
+                                       BOOT_DRIVER_NODE,
+                                       ListEntry.Link);
+        BootDriver = &DriverNode->ListEntry;
+        NextBd = BootDriver->Link.Flink;
+
+        if (!(BootDriver->LdrEntry->Flags & LDRP_FAILED_BUILTIN_LOAD))
         {
             /* Convert the addresses to VA since we are not going to use them anymore */
             BootDriver->RegistryPath.Buffer = PaToVa(BootDriver->RegistryPath.Buffer);
@@ -423,16 +644,28 @@ WinLdrLoadBootDrivers(PLOADER_PARAMETER_BLOCK LoaderBlock,
         }
         else
         {
-            /* Loading failed: cry loudly */
             ERR("Cannot load boot driver '%wZ'!\n", &BootDriver->FilePath);
             UiMessageBox("Cannot load boot driver '%wZ'!", &BootDriver->FilePath);
             ret = FALSE;
 
-            /* Remove it from the list and try to continue */
             RemoveEntryList(&BootDriver->Link);
         }
     }
 
+    if (Failed)
+        WinLdrFreeFailedImages(&LoaderBlock->LoadOrderListHead);
+
+#if DBG && !defined(_M_ARM)
+    /* The import pass may load more DLLs: count that as reading and relocating */
+    ImportTime = __rdtsc() - ImportTime;
+    ImportTime -= min(ImportTime, PeLdrReadTime + PeLdrRelocationTime - ImportIoTime);
+    ReadTime = PeLdrReadTime - ReadTime;
+    RelocationTime = PeLdrRelocationTime - RelocationTime;
+    Time = __rdtsc() - Time;
+    TRACE("Loading %lu boot drivers took %I64d ticks: read %I64d, relocate %I64d, imports %I64d\n",
+          DriverCount, Time, ReadTime, RelocationTime, ImportTime);
+#endif
+
     return ret;
 }
 
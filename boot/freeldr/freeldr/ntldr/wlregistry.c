@@ -56,6 +56,9 @@ WinLdrLoadSystemHive(
     PVOID HiveDataPhysical;
     PVOID HiveDataVirtual;
     ULONG BytesRead;
+#if DBG && !defined(_M_ARM)
+    ULONGLONG Time = __rdtsc();
+#endif
 
     /* Do not setup any bad reason for now */
     *Reason = GoodHive;
@@ -118,6 +121,11 @@ WinLdrLoadSystemHive(
     BootFileSystem = FsGetServiceName(FileId);
 
     ArcClose(FileId);
+
+#if DBG && !defined(_M_ARM)
+    TRACE("Hive '%s' (%lu bytes) read in %I64d ticks\n",
+          FullHiveName, HiveFileSize, __rdtsc() - Time);
+#endif
     return TRUE;
 }
 
@@ -487,7 +487,7 @@
 @ stdcall NtReleaseSemaphore(long long ptr)
 @ stdcall -stub -version=0x600+ NtReleaseWorkerFactoryWorker(ptr)
 @ stdcall NtRemoveIoCompletion(ptr ptr ptr ptr ptr)
-@ stdcall -stub -version=0x600+ NtRemoveIoCompletionEx(ptr ptr long ptr ptr long)
+@ stdcall NtRemoveIoCompletionEx(ptr ptr long ptr ptr long)
 @ stdcall NtRemoveProcessDebug(ptr ptr)
 @ stdcall NtRenameKey(ptr ptr)
 @ stdcall -stub -version=0x600+ NtRenameTransactionManager(ptr ptr)
@@ -1649,7 +1649,7 @@
 @ stdcall ZwReleaseSemaphore(long long ptr)
 @ stdcall -stub -version=0x600+ ZwReleaseWorkerFactoryWorker(ptr)
 @ stdcall ZwRemoveIoCompletion(ptr ptr ptr ptr ptr)
-@ stdcall -stub -version=0x600+ ZwRemoveIoCompletionEx(ptr ptr long ptr ptr long)
+@ stdcall ZwRemoveIoCompletionEx(ptr ptr long ptr ptr long)
 @ stdcall ZwRemoveProcessDebug(ptr ptr)
 @ stdcall ZwRenameKey(ptr ptr)
 @ stdcall -stub -version=0x600+ ZwRenameTransactionManager(wstr ptr)
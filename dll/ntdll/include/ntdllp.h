@@ -96,6 +96,9 @@ NTSTATUS NTAPI
 LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
                          IN PLDR_DATA_TABLE_ENTRY LdrEntry);
 
+VOID NTAPI
+LdrpFreeExportHash(IN PVOID DllBase);
+
 /* libsupp.c */
 NTSYSAPI
 NTSTATUS
@@ -9,6 +9,7 @@
 /* INCLUDES *****************************************************************/
 
 #include <ntdll.h>
+#include <sm/prelink.h>
 
 #define NDEBUG
 #include <debug.h>
@@ -18,8 +19,164 @@
 PLDR_MANIFEST_PROBER_ROUTINE LdrpManifestProberRoutine;
 ULONG LdrpNormalSnap;
 
+/* Export name hashes, built for a module the first time a hint misses */
+#define LDRP_EXPORT_HASH_MIN_NAMES 32
+#define LDRP_EXPORT_HASH_MAX_NAMES 0x100000
+
+typedef struct _LDRP_EXPORT_HASH
+{
+    LIST_ENTRY Links;
+    PVOID DllBase;
+    PULONG NameTable;
+    ULONG NumberOfNames;
+    ULONG Mask;
+    ULONG Buckets[ANYSIZE_ARRAY];
+} LDRP_EXPORT_HASH, *PLDRP_EXPORT_HASH;
+
+LIST_ENTRY LdrpExportHashList = {&LdrpExportHashList, &LdrpExportHashList};
+PLDRP_EXPORT_HASH LdrpExportHashCache;
+
+/* Import address tables resolved by SMSS for the known DLLs */
+PSM_PRELINK_HEADER LdrpPrelinkCache;
+BOOLEAN LdrpPrelinkCacheChecked;
+
 /* FUNCTIONS *****************************************************************/
 
+static
+PSM_PRELINK_HEADER
+LdrpGetPrelinkCache(VOID)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    UNICODE_STRING CacheName;
+    HANDLE SectionHandle;
+    PSM_PRELINK_HEADER Header = NULL;
+    SIZE_T ViewSize = 0;
+    NTSTATUS Status;
+
+    /* Only try once per process */
+    if (LdrpPrelinkCacheChecked) return LdrpPrelinkCache;
+    LdrpPrelinkCacheChecked = TRUE;
+    if (!LdrpKnownDllObjectDirectory) return NULL;
+
+    /* Open the cache SMSS left next to the known DLL sections */
+    RtlInitUnicodeString(&CacheName, SM_PRELINK_SECTION_NAME);
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &CacheName,
+                               OBJ_CASE_INSENSITIVE,
+                               LdrpKnownDllObjectDirectory,
+                               NULL);
+    Status = NtOpenSection(&SectionHandle, SECTION_MAP_READ, &ObjectAttributes);
+    if (!NT_SUCCESS(Status)) return NULL;
+
+    Status = NtMapViewOfSection(SectionHandle,
+                                NtCurrentProcess(),
+                                (PVOID*)&Header,
+                                0,
+                                0,
+                                NULL,
+                                &ViewSize,
+                                ViewShare,
+                                0,
+                                PAGE_READONLY);
+    NtClose(SectionHandle);
+    if (!NT_SUCCESS(Status)) return NULL;
+
+    /* Make sure it is complete and consistent before trusting it */
+    if ((ViewSize < sizeof(SM_PRELINK_HEADER)) ||
+        (Header->Signature != SM_PRELINK_SIGNATURE) ||
+        (Header->Size > ViewSize) ||
+        (Header->NumberOfModules > Header->Size / sizeof(SM_PRELINK_MODULE)) ||
+        (Header->NumberOfImports > Header->Size / sizeof(SM_PRELINK_IMPORT)) ||
+        (Header->NumberOfAddresses > Header->Size / sizeof(ULONG_PTR)) ||
+        (SM_PRELINK_SIZE((SIZE_T)Header->NumberOfModules,
+                         (SIZE_T)Header->NumberOfImports,
+                         (SIZE_T)Header->NumberOfAddresses) != Header->Size))
+    {
+        DPRINT1("LDR: Ignoring invalid prelink cache\n");
+        NtUnmapViewOfSection(NtCurrentProcess(), Header);
+        return NULL;
+    }
+
+    LdrpPrelinkCache = Header;
+    return Header;
+}
+
+static
+BOOLEAN
+LdrpApplyPrelinkedImports(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
+                          IN PLDR_DATA_TABLE_ENTRY ImportLdrEntry,
+                          IN PIMAGE_IMPORT_DESCRIPTOR IatEntry)
+{
+    PSM_PRELINK_HEADER Cache;
+    PSM_PRELINK_MODULE Module;
+    PSM_PRELINK_IMPORT Import;
+    PIMAGE_NT_HEADERS ImportNtHeader, ExportNtHeader;
+    ULONG_PTR ImportBase = (ULONG_PTR)ImportLdrEntry->DllBase;
+    LONG Low, Mid, High;
+    ULONG i;
+
+    Cache = LdrpGetPrelinkCache();
+    if (!Cache) return FALSE;
+
+    /* Find the importing module, the array is sorted by base */
+    Module = NULL;
+    Low = 0;
+    High = Cache->NumberOfModules - 1;
+    while (High >= Low)
+    {
+        Mid = (Low + High) >> 1;
+        if (ImportBase < SM_PRELINK_MODULES(Cache)[Mid].ImageBase)
+            High = Mid - 1;
+        else if (ImportBase > SM_PRELINK_MODULES(Cache)[Mid].ImageBase)
+            Low = Mid + 1;
+        else
+        {
+            Module = &SM_PRELINK_MODULES(Cache)[Mid];
+            break;
+        }
+    }
+    if (!Module) return FALSE;
+
+    /* It has to be the very same image SMSS looked at */
+    ImportNtHeader = RtlImageNtHeader(ImportLdrEntry->DllBase);
+    if (!ImportNtHeader ||
+        (ImportNtHeader->FileHeader.TimeDateStamp != Module->TimeDateStamp) ||
+        (ImportNtHeader->OptionalHeader.SizeOfImage != Module->SizeOfImage) ||
+        (Module->FirstImport > Cache->NumberOfImports) ||
+        (Module->NumberOfImports > Cache->NumberOfImports - Module->FirstImport))
+    {
+        return FALSE;
+    }
+
+    /* And so does the DLL it imports from */
+    ExportNtHeader = RtlImageNtHeader(ExportLdrEntry->DllBase);
+    if (!ExportNtHeader) return FALSE;
+
+    for (i = 0; i < Module->NumberOfImports; i++)
+    {
+        Import = &SM_PRELINK_IMPORTS(Cache)[Module->FirstImport + i];
+        if (Import->FirstThunk != IatEntry->FirstThunk) continue;
+
+        if ((Import->ExportBase != (ULONG_PTR)ExportLdrEntry->DllBase) ||
+            (Import->ExportTimeDateStamp != ExportNtHeader->FileHeader.TimeDateStamp) ||
+            (Import->FirstAddress > Cache->NumberOfAddresses) ||
+            (Import->NumberOfThunks > Cache->NumberOfAddresses - Import->FirstAddress) ||
+            (Import->FirstThunk >= Module->SizeOfImage) ||
+            (Import->NumberOfThunks > (Module->SizeOfImage - Import->FirstThunk) / sizeof(ULONG_PTR)))
+        {
+            return FALSE;
+        }
+
+        /* Everything matches, copy the resolved addresses into the IAT */
+        RtlCopyMemory((PVOID)(ImportBase + Import->FirstThunk),
+                      &SM_PRELINK_ADDRESSES(Cache)[Import->FirstAddress],
+                      Import->NumberOfThunks * sizeof(ULONG_PTR));
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
 
 NTSTATUS
 NTAPI
@@ -182,6 +339,12 @@ LdrpSnapIAT(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
             if (!NT_SUCCESS(Status)) break;
         }
     }
+    else if (IatEntry->FirstThunk &&
+             LdrpApplyPrelinkedImports(ExportLdrEntry, ImportLdrEntry, IatEntry))
+    {
+        /* SMSS already resolved this one at boot */
+        Status = STATUS_SUCCESS;
+    }
     else if (IatEntry->FirstThunk)
     {
         /* Full snapping. Get the First thunk */
@@ -665,6 +828,145 @@ LdrpNameToOrdinal(IN LPSTR ImportName,
     return OrdinalTable[Next];
 }
 
+FORCEINLINE
+ULONG
+LdrpHashExportName(IN LPSTR Name)
+{
+    ULONG Hash = 0;
+
+    /* Same multiplier as RtlHashUnicodeString */
+    while (*Name) Hash = Hash * 65599 + (UCHAR)*Name++;
+    return Hash;
+}
+
+static
+PLDRP_EXPORT_HASH
+LdrpGetExportHash(IN PVOID ExportBase,
+                  IN PULONG NameTable,
+                  IN ULONG NumberOfNames)
+{
+    PLDRP_EXPORT_HASH ExportHash;
+    PLIST_ENTRY ListEntry;
+    ULONG Size, i, Bucket;
+
+    /* A binary search over a few names is as good as it gets */
+    if ((NumberOfNames < LDRP_EXPORT_HASH_MIN_NAMES) ||
+        (NumberOfNames > LDRP_EXPORT_HASH_MAX_NAMES))
+    {
+        return NULL;
+    }
+
+    /* Check the cache first, then the modules we already hashed */
+    ExportHash = LdrpExportHashCache;
+    if (!(ExportHash) || (ExportHash->DllBase != ExportBase))
+    {
+        ExportHash = NULL;
+        for (ListEntry = LdrpExportHashList.Flink;
+             ListEntry != &LdrpExportHashList;
+             ListEntry = ListEntry->Flink)
+        {
+            ExportHash = CONTAINING_RECORD(ListEntry, LDRP_EXPORT_HASH, Links);
+            if (ExportHash->DllBase == ExportBase) break;
+            ExportHash = NULL;
+        }
+    }
+
+    if (ExportHash)
+    {
+        /* Make sure it still describes this export directory */
+        if ((ExportHash->NameTable != NameTable) ||
+            (ExportHash->NumberOfNames != NumberOfNames))
+        {
+            return NULL;
+        }
+
+        LdrpExportHashCache = ExportHash;
+        return ExportHash;
+    }
+
+    /* Size it to stay at most half full */
+    for (Size = 2 * LDRP_EXPORT_HASH_MIN_NAMES; Size < 2 * NumberOfNames; Size <<= 1);
+    ExportHash = RtlAllocateHeap(LdrpHeap,
+                                 HEAP_ZERO_MEMORY,
+                                 FIELD_OFFSET(LDRP_EXPORT_HASH, Buckets[Size]));
+    if (!ExportHash) return NULL;
+
+    ExportHash->DllBase = ExportBase;
+    ExportHash->NameTable = NameTable;
+    ExportHash->NumberOfNames = NumberOfNames;
+    ExportHash->Mask = Size - 1;
+
+    /* Buckets hold a name index plus one, zero marks a free bucket */
+    for (i = 0; i < NumberOfNames; i++)
+    {
+        Bucket = LdrpHashExportName((LPSTR)((ULONG_PTR)ExportBase + NameTable[i]));
+        for (Bucket &= ExportHash->Mask;
+             ExportHash->Buckets[Bucket];
+             Bucket = (Bucket + 1) & ExportHash->Mask);
+        ExportHash->Buckets[Bucket] = i + 1;
+    }
+
+    InsertHeadList(&LdrpExportHashList, &ExportHash->Links);
+    LdrpExportHashCache = ExportHash;
+    return ExportHash;
+}
+
+VOID
+NTAPI
+LdrpFreeExportHash(IN PVOID DllBase)
+{
+    PLDRP_EXPORT_HASH ExportHash;
+    PLIST_ENTRY ListEntry;
+
+    for (ListEntry = LdrpExportHashList.Flink;
+         ListEntry != &LdrpExportHashList;
+         ListEntry = ListEntry->Flink)
+    {
+        ExportHash = CONTAINING_RECORD(ListEntry, LDRP_EXPORT_HASH, Links);
+        if (ExportHash->DllBase == DllBase)
+        {
+            if (LdrpExportHashCache == ExportHash) LdrpExportHashCache = NULL;
+            RemoveEntryList(&ExportHash->Links);
+            RtlFreeHeap(LdrpHeap, 0, ExportHash);
+            return;
+        }
+    }
+}
+
+static
+USHORT
+LdrpHashedNameToOrdinal(IN LPSTR ImportName,
+                        IN ULONG NumberOfNames,
+                        IN PVOID ExportBase,
+                        IN PULONG NameTable,
+                        IN PUSHORT OrdinalTable)
+{
+    PLDRP_EXPORT_HASH ExportHash;
+    ULONG Bucket, Index;
+
+    /* Fall back to the binary search if we have no hash for this module */
+    ExportHash = LdrpGetExportHash(ExportBase, NameTable, NumberOfNames);
+    if (!ExportHash)
+    {
+        return LdrpNameToOrdinal(ImportName,
+                                 NumberOfNames,
+                                 ExportBase,
+                                 NameTable,
+                                 OrdinalTable);
+    }
+
+    /* Probe until we find the name or a free bucket */
+    for (Bucket = LdrpHashExportName(ImportName) & ExportHash->Mask;
+         (Index = ExportHash->Buckets[Bucket]);
+         Bucket = (Bucket + 1) & ExportHash->Mask)
+    {
+        if (!strcmp(ImportName, (PCHAR)((ULONG_PTR)ExportBase + NameTable[Index - 1])))
+            return OrdinalTable[Index - 1];
+    }
+
+    return -1;
+}
+
 NTSTATUS
 NTAPI
 LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
@@ -1000,11 +1302,11 @@ LdrpSnapThunk(IN PVOID ExportBase,
         else
         {
             /* Well bummer, hint didn't work, do it the long way */
-            Ordinal = LdrpNameToOrdinal(ImportName,
-                                        ExportDirectory->NumberOfNames,
-                                        ExportBase,
-                                        NameTable,
-                                        OrdinalTable);
+            Ordinal = LdrpHashedNameToOrdinal(ImportName,
+                                              ExportDirectory->NumberOfNames,
+                                              ExportBase,
+                                              NameTable,
+                                              OrdinalTable);
         }
     }
 
@@ -1588,6 +1588,9 @@ LdrpFinalizeAndDeallocateDataTableEntry(IN PLDR_DATA_TABLE_ENTRY Entry)
         Entry->EntryPointActivationContext = INVALID_HANDLE_VALUE;
     }
 
+    /* Drop the export name hash, if we built one */
+    LdrpFreeExportHash(Entry->DllBase);
+
     /* Release the full dll name string */
     if (Entry->FullDllName.Buffer) LdrpFreeUnicodeString(&Entry->FullDllName);
 
@@ -184,6 +184,62 @@ GetQueuedCompletionStatus(IN HANDLE CompletionHandle,
     return TRUE;
 }
 
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+GetQueuedCompletionStatusEx(IN HANDLE CompletionPort,
+                            OUT LPOVERLAPPED_ENTRY lpCompletionPortEntries,
+                            IN ULONG ulCount,
+                            OUT PULONG ulNumEntriesRemoved,
+                            IN DWORD dwMilliseconds,
+                            IN BOOL fAlertable)
+{
+    NTSTATUS Status;
+    LARGE_INTEGER Time;
+    PLARGE_INTEGER TimePtr;
+
+    /* The native entries have the same layout as the Win32 ones */
+    C_ASSERT(sizeof(OVERLAPPED_ENTRY) == sizeof(FILE_IO_COMPLETION_INFORMATION));
+    C_ASSERT(FIELD_OFFSET(OVERLAPPED_ENTRY, lpOverlapped) ==
+             FIELD_OFFSET(FILE_IO_COMPLETION_INFORMATION, ApcContext));
+    C_ASSERT(FIELD_OFFSET(OVERLAPPED_ENTRY, Internal) ==
+             FIELD_OFFSET(FILE_IO_COMPLETION_INFORMATION, IoStatusBlock.Status));
+    C_ASSERT(FIELD_OFFSET(OVERLAPPED_ENTRY, dwNumberOfBytesTransferred) ==
+             FIELD_OFFSET(FILE_IO_COMPLETION_INFORMATION, IoStatusBlock.Information));
+
+    /* Convert the timeout and then call the native API */
+    TimePtr = BaseFormatTimeOut(&Time, dwMilliseconds);
+    Status = NtRemoveIoCompletionEx(CompletionPort,
+                                    (PFILE_IO_COMPLETION_INFORMATION)lpCompletionPortEntries,
+                                    ulCount,
+                                    ulNumEntriesRemoved,
+                                    TimePtr,
+                                    fAlertable ? TRUE : FALSE);
+    if (Status == STATUS_SUCCESS) return TRUE;
+
+    /* Check what kind of error we got */
+    if (Status == STATUS_TIMEOUT)
+    {
+        /* Timeout error is set directly since there's no conversion */
+        SetLastError(WAIT_TIMEOUT);
+    }
+    else if (Status == STATUS_USER_APC)
+    {
+        /* An APC ran during an alertable wait */
+        SetLastError(WAIT_IO_COMPLETION);
+    }
+    else
+    {
+        /* Any other error gets converted */
+        BaseSetLastNTError(Status);
+    }
+
+    /* This is a failure case */
+    return FALSE;
+}
+
 /*
  * @implemented
  */
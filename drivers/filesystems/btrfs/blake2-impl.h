@@ -194,3 +194,14 @@ BLAKE2_PACKED(struct blake2b_param__
 });
 
 typedef struct blake2b_param__ blake2b_param;
+
+void blake2b_compress_ref( blake2b_state *S, const uint8_t block[BLAKE2B_BLOCKBYTES] );
+
+#if defined(_AMD64_)
+/* in blake2b-sse.c */
+void blake2b_compress_sse( blake2b_state *S, const uint8_t block[BLAKE2B_BLOCKBYTES] );
+#endif
+
+typedef void (*blake2b_compress_func)( blake2b_state *S, const uint8_t block[BLAKE2B_BLOCKBYTES] );
+
+extern blake2b_compress_func blake2b_compress;
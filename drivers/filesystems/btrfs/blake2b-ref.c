@@ -45,6 +45,9 @@ static const uint8_t blake2b_sigma[12][16] =
 
 static int blake2b_update(blake2b_state* S, const void* in, size_t inlen);
 
+/* Replaced by check_cpu() in btrfs.c when there's a faster version */
+blake2b_compress_func blake2b_compress = blake2b_compress_ref;
+
 static void blake2b_set_lastnode( blake2b_state *S )
 {
   S->f[1] = (uint64_t)-1;
@@ -138,7 +141,7 @@ static void blake2b_init( blake2b_state *S, size_t outlen )
     G(r,7,v[ 3],v[ 4],v[ 9],v[14]); \
   } while(0)
 
-static void blake2b_compress( blake2b_state *S, const uint8_t block[BLAKE2B_BLOCKBYTES] )
+void blake2b_compress_ref( blake2b_state *S, const uint8_t block[BLAKE2B_BLOCKBYTES] )
 {
   uint64_t m[16];
   uint64_t v[16];
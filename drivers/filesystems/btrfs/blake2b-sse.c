@@ -0,0 +1,171 @@
+/*
+ * PROJECT:     ReactOS btrfs driver
+ * LICENSE:     LGPL-3.0-or-later (https://spdx.org/licenses/LGPL-3.0-or-later)
+ * PURPOSE:     BLAKE2b compression function using SSSE3
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "blake2-impl.h"
+
+/* Only built for amd64, where kernel code is free to use the XMM registers.
+   check_cpu() in btrfs.c only picks this if the CPU has SSSE3. */
+
+#if defined(__GNUC__) || defined(__clang__)
+#define BLAKE2_SSSE3_TARGET __attribute__((__target__("ssse3")))
+#else
+#define BLAKE2_SSSE3_TARGET
+#endif
+
+static const uint64_t blake2b_IV[8] =
+{
+  0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+  0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+  0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+  0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static const uint8_t blake2b_sigma[12][16] =
+{
+  {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 } ,
+  { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 } ,
+  { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 } ,
+  {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 } ,
+  {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 } ,
+  {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 } ,
+  { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 } ,
+  { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 } ,
+  {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 } ,
+  { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13 , 0 } ,
+  {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 } ,
+  { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+/*
+   The 4x4 state matrix is kept a row at a time, each row split over two
+   registers (l holding columns 0-1, h columns 2-3), so the four G functions
+   of a column or diagonal step run two by two in parallel. The diagonal step
+   rotates rows 2-4 so that the diagonals line up as columns, then back.
+*/
+
+#define ROTR32(x) _mm_shuffle_epi32( (x), _MM_SHUFFLE( 2, 3, 0, 1 ) )
+#define ROTR24(x) _mm_shuffle_epi8( (x), r24 )
+#define ROTR16(x) _mm_shuffle_epi8( (x), r16 )
+#define ROTR63(x) _mm_xor_si128( _mm_srli_epi64( (x), 63 ), _mm_add_epi64( (x), (x) ) )
+
+#define G1( b0, b1 )                                                    \
+  do {                                                                  \
+    row1l = _mm_add_epi64( _mm_add_epi64( row1l, b0 ), row2l );         \
+    row1h = _mm_add_epi64( _mm_add_epi64( row1h, b1 ), row2h );         \
+    row4l = ROTR32( _mm_xor_si128( row4l, row1l ) );                    \
+    row4h = ROTR32( _mm_xor_si128( row4h, row1h ) );                    \
+    row3l = _mm_add_epi64( row3l, row4l );                              \
+    row3h = _mm_add_epi64( row3h, row4h );                              \
+    row2l = ROTR24( _mm_xor_si128( row2l, row3l ) );                    \
+    row2h = ROTR24( _mm_xor_si128( row2h, row3h ) );                    \
+  } while(0)
+
+#define G2( b0, b1 )                                                    \
+  do {                                                                  \
+    row1l = _mm_add_epi64( _mm_add_epi64( row1l, b0 ), row2l );         \
+    row1h = _mm_add_epi64( _mm_add_epi64( row1h, b1 ), row2h );         \
+    row4l = ROTR16( _mm_xor_si128( row4l, row1l ) );                    \
+    row4h = ROTR16( _mm_xor_si128( row4h, row1h ) );                    \
+    row3l = _mm_add_epi64( row3l, row4l );                              \
+    row3h = _mm_add_epi64( row3h, row4h );                              \
+    row2l = ROTR63( _mm_xor_si128( row2l, row3l ) );                    \
+    row2h = ROTR63( _mm_xor_si128( row2h, row3h ) );                    \
+  } while(0)
+
+#define DIAGONALIZE()                                                   \
+  do {                                                                  \
+    t0 = _mm_alignr_epi8( row2h, row2l, 8 );                            \
+    t1 = _mm_alignr_epi8( row2l, row2h, 8 );                            \
+    row2l = t0;                                                         \
+    row2h = t1;                                                         \
+    t0 = row3l;                                                         \
+    row3l = row3h;                                                      \
+    row3h = t0;                                                         \
+    t0 = _mm_alignr_epi8( row4h, row4l, 8 );                            \
+    t1 = _mm_alignr_epi8( row4l, row4h, 8 );                            \
+    row4l = t1;                                                         \
+    row4h = t0;                                                         \
+  } while(0)
+
+#define UNDIAGONALIZE()                                                 \
+  do {                                                                  \
+    t0 = _mm_alignr_epi8( row2l, row2h, 8 );                            \
+    t1 = _mm_alignr_epi8( row2h, row2l, 8 );                            \
+    row2l = t0;                                                         \
+    row2h = t1;                                                         \
+    t0 = row3l;                                                         \
+    row3l = row3h;                                                      \
+    row3h = t0;                                                         \
+    t0 = _mm_alignr_epi8( row4l, row4h, 8 );                            \
+    t1 = _mm_alignr_epi8( row4h, row4l, 8 );                            \
+    row4l = t1;                                                         \
+    row4h = t0;                                                         \
+  } while(0)
+
+#define MSG( r, a, b ) _mm_set_epi64x( m[blake2b_sigma[r][b]], m[blake2b_sigma[r][a]] )
+
+#define ROUND( r )                                                      \
+  do {                                                                  \
+    G1( MSG( r,  0,  2 ), MSG( r,  4,  6 ) );                           \
+    G2( MSG( r,  1,  3 ), MSG( r,  5,  7 ) );                           \
+    DIAGONALIZE();                                                      \
+    G1( MSG( r,  8, 10 ), MSG( r, 12, 14 ) );                           \
+    G2( MSG( r,  9, 11 ), MSG( r, 13, 15 ) );                           \
+    UNDIAGONALIZE();                                                    \
+  } while(0)
+
+BLAKE2_SSSE3_TARGET
+void blake2b_compress_sse( blake2b_state *S, const uint8_t block[BLAKE2B_BLOCKBYTES] )
+{
+  const __m128i r16 = _mm_setr_epi8( 2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9 );
+  const __m128i r24 = _mm_setr_epi8( 3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10 );
+  __m128i row1l, row1h, row2l, row2h, row3l, row3h, row4l, row4h;
+  __m128i t0, t1;
+  uint64_t m[16];
+  size_t i;
+
+  for( i = 0; i < 16; ++i ) {
+    m[i] = load64( block + i * sizeof( m[i] ) );
+  }
+
+  row1l = _mm_loadu_si128( ( const __m128i * )&S->h[0] );
+  row1h = _mm_loadu_si128( ( const __m128i * )&S->h[2] );
+  row2l = _mm_loadu_si128( ( const __m128i * )&S->h[4] );
+  row2h = _mm_loadu_si128( ( const __m128i * )&S->h[6] );
+  row3l = _mm_loadu_si128( ( const __m128i * )&blake2b_IV[0] );
+  row3h = _mm_loadu_si128( ( const __m128i * )&blake2b_IV[2] );
+  row4l = _mm_xor_si128( _mm_loadu_si128( ( const __m128i * )&blake2b_IV[4] ),
+                         _mm_loadu_si128( ( const __m128i * )&S->t[0] ) );
+  row4h = _mm_xor_si128( _mm_loadu_si128( ( const __m128i * )&blake2b_IV[6] ),
+                         _mm_loadu_si128( ( const __m128i * )&S->f[0] ) );
+
+  ROUND( 0 );
+  ROUND( 1 );
+  ROUND( 2 );
+  ROUND( 3 );
+  ROUND( 4 );
+  ROUND( 5 );
+  ROUND( 6 );
+  ROUND( 7 );
+  ROUND( 8 );
+  ROUND( 9 );
+  ROUND( 10 );
+  ROUND( 11 );
+
+  row1l = _mm_xor_si128( row3l, row1l );
+  row1h = _mm_xor_si128( row3h, row1h );
+  row2l = _mm_xor_si128( row4l, row2l );
+  row2h = _mm_xor_si128( row4h, row2h );
+
+  _mm_storeu_si128( ( __m128i * )&S->h[0], _mm_xor_si128( _mm_loadu_si128( ( const __m128i * )&S->h[0] ), row1l ) );
+  _mm_storeu_si128( ( __m128i * )&S->h[2], _mm_xor_si128( _mm_loadu_si128( ( const __m128i * )&S->h[2] ), row1h ) );
+  _mm_storeu_si128( ( __m128i * )&S->h[4], _mm_xor_si128( _mm_loadu_si128( ( const __m128i * )&S->h[4] ), row2l ) );
+  _mm_storeu_si128( ( __m128i * )&S->h[6], _mm_xor_si128( _mm_loadu_si128( ( const __m128i * )&S->h[6] ), row2h ) );
+}
@@ -22,6 +22,9 @@
 #include "btrfs_drv.h"
 #include "xxhash.h"
 #include "crc32c.h"
+#ifdef _AMD64_
+#include "blake2-impl.h"
+#endif
 #ifndef __REACTOS__
 #ifndef _MSC_VER
 #include <cpuid.h>
@@ -125,6 +128,7 @@ static NTSTATUS close_file(_In_ PFILE_OBJECT FileObject, _In_ PIRP Irp);
 static void __stdcall do_xor_basic(uint8_t* buf1, uint8_t* buf2, uint32_t len);
 
 xor_func do_xor = do_xor_basic;
+sha256_func calc_sha256 = calc_sha256_sw;
 
 typedef struct {
     KEVENT Event;
@@ -5971,18 +5975,43 @@ static void init_serial(bool first_time) {
 }
 #endif
 
-#if !defined(__REACTOS__) && (defined(_X86_) || defined(_AMD64_))
+#if defined(_X86_) || defined(_AMD64_)
 static void check_cpu() {
-    bool have_sse2 = false, have_sse42 = false, have_avx2 = false;
+    bool have_sse42 = false;
+#ifdef _AMD64_
+    bool have_ssse3 = false, have_sse41 = false, have_sha = false;
+#endif
+#ifndef __REACTOS__
+    bool have_sse2 = false, have_avx2 = false;
+#endif
     int cpu_info[4];
+    int max_leaf;
+
+    __cpuid(cpu_info, 0);
+    max_leaf = cpu_info[0];
 
     __cpuid(cpu_info, 1);
     have_sse42 = cpu_info[2] & (1 << 20);
+#ifdef _AMD64_
+    have_ssse3 = cpu_info[2] & (1 << 9);
+    have_sse41 = cpu_info[2] & (1 << 19);
+#endif
+#ifndef __REACTOS__
     have_sse2 = cpu_info[3] & (1 << 26);
+#endif
 
-    __cpuidex(cpu_info, 7, 0);
-    have_avx2 = cpu_info[1] & (1 << 5);
+    // leaf 7 isn't there on older CPUs
+    if (max_leaf >= 7) {
+        __cpuidex(cpu_info, 7, 0);
+#ifndef __REACTOS__
+        have_avx2 = cpu_info[1] & (1 << 5);
+#endif
+#ifdef _AMD64_
+        have_sha = cpu_info[1] & (1 << 29);
+#endif
+    }
 
+#ifndef __REACTOS__
     if (have_avx2) {
         // check Windows has enabled AVX2 - Windows 10 doesn't immediately
 
@@ -6000,6 +6029,7 @@ static void check_cpu() {
         } else
             have_avx2 = false;
     }
+#endif // __REACTOS__
 
     if (have_sse42) {
         TRACE("SSE4.2 is supported\n");
@@ -6007,6 +6037,23 @@ static void check_cpu() {
     } else
         TRACE("SSE4.2 not supported\n");
 
+#ifdef _AMD64_
+    // XMM registers don't need saving in kernel mode on amd64, unlike on x86
+
+    if (have_sha && have_sse41) {
+        TRACE("SHA extensions are supported\n");
+        calc_sha256 = calc_sha256_ni;
+    } else
+        TRACE("SHA extensions not supported\n");
+
+    if (have_ssse3) {
+        TRACE("SSSE3 is supported\n");
+        blake2b_compress = blake2b_compress_sse;
+    } else
+        TRACE("SSSE3 not supported\n");
+#endif
+
+#ifndef __REACTOS__
     if (have_sse2) {
         TRACE("SSE2 is supported\n");
 
@@ -6020,6 +6067,7 @@ static void check_cpu() {
         do_xor = do_xor_avx2;
     } else
         TRACE("AVX2 is not supported\n");
+#endif // __REACTOS__
 }
 #endif
 
@@ -6332,7 +6380,7 @@ NTSTATUS __stdcall DriverEntry(_In_ PDRIVER_OBJECT DriverObject, _In_ PUNICODE_S
 
     TRACE("DriverEntry\n");
 
-#if !defined(__REACTOS__) && (defined(_X86_) || defined(_AMD64_))
+#if defined(_X86_) || defined(_AMD64_)
     check_cpu();
 #endif
 
@@ -656,12 +656,21 @@ typedef struct {
     bool quit;
 } drv_calc_thread;
 
+typedef struct {
+    uint64_t extents_compressed;
+    uint64_t extents_incompressible;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t time;
+} comp_stats;
+
 typedef struct {
     ULONG num_threads;
     LIST_ENTRY job_list;
     KSPIN_LOCK spinlock;
     drv_calc_thread* threads;
     KEVENT event;
+    comp_stats comp_stats; // protected by spinlock
 } drv_calc_threads;
 
 typedef struct {
@@ -1244,9 +1253,18 @@ void _free_fcb(_Inout_ fcb* fcb, _In_ const char* func);
 void init_fast_io_dispatch(FAST_IO_DISPATCH** fiod);
 
 // in sha256.c
-void calc_sha256(uint8_t* hash, const void* input, size_t len);
+void calc_sha256_sw(uint8_t* hash, const void* input, size_t len);
 #define SHA256_HASH_SIZE 32
 
+#ifdef _AMD64_
+// in sha256-ni.c
+void calc_sha256_ni(uint8_t* hash, const void* input, size_t len);
+#endif
+
+typedef void (*sha256_func)(uint8_t* hash, const void* input, size_t len);
+
+extern sha256_func calc_sha256;
+
 // in blake2b-ref.c
 void blake2b(void *out, size_t outlen, const void* in, size_t inlen);
 #define BLAKE2_HASH_SIZE 32
@@ -38,6 +38,7 @@
 #define FSCTL_BTRFS_RESIZE CTL_CODE(FILE_DEVICE_UNKNOWN, 0x848, METHOD_IN_DIRECT, FILE_ANY_ACCESS)
 #define IOCTL_BTRFS_UNLOAD CTL_CODE(FILE_DEVICE_UNKNOWN, 0x849, METHOD_NEITHER, FILE_ANY_ACCESS)
 #define FSCTL_BTRFS_GET_CSUM_INFO CTL_CODE(FILE_DEVICE_UNKNOWN, 0x84a, METHOD_BUFFERED, FILE_READ_ACCESS)
+#define FSCTL_BTRFS_GET_COMPRESSION_STATS CTL_CODE(FILE_DEVICE_UNKNOWN, 0x84b, METHOD_BUFFERED, FILE_ANY_ACCESS)
 
 typedef struct {
     uint64_t subvol;
@@ -287,3 +288,11 @@ typedef struct {
     uint64_t num_sectors;
     uint8_t data[1];
 } btrfs_csum_info;
+
+typedef struct {
+    uint64_t extents_compressed;
+    uint64_t extents_incompressible;
+    uint64_t bytes_in; // before compression
+    uint64_t bytes_out; // as written, including extents which didn't compress
+    uint64_t time; // spent compressing, summed over all threads, in 100-nanosecond units
+} btrfs_compression_stats;
@@ -19,13 +19,19 @@
 #include "xxhash.h"
 #include "crc32c.h"
 
+// Checksum jobs hand out this many sectors at a time, so that the spinlock
+// isn't taken for every sector now that the hashes themselves are quicker.
+#define CALC_SECTORS_PER_GRAB 8
+
 void calc_thread_main(device_extension* Vcb, calc_job* cj) {
     while (true) {
         KIRQL irql;
         calc_job* cj2;
         uint8_t* src;
         void* dest;
-        bool last_one = false;
+        bool last_one = false, comp;
+        LONG num = 1, i;
+        LARGE_INTEGER time1, time2, freq;
 
         KeAcquireSpinLock(&Vcb->calcthreads.spinlock, &irql);
 
@@ -53,15 +59,16 @@ void calc_thread_main(device_extension* Vcb, calc_job* cj) {
             case calc_thread_xxhash:
             case calc_thread_sha256:
             case calc_thread_blake2:
-                cj2->in = (uint8_t*)cj2->in + Vcb->superblock.sector_size;
-                cj2->out = (uint8_t*)cj2->out + Vcb->csum_size;
+                num = min(cj2->not_started, CALC_SECTORS_PER_GRAB);
+                cj2->in = (uint8_t*)cj2->in + (num * Vcb->superblock.sector_size);
+                cj2->out = (uint8_t*)cj2->out + (num * Vcb->csum_size);
             break;
 
             default:
                 break;
         }
 
-        cj2->not_started--;
+        cj2->not_started -= num;
 
         if (cj2->not_started == 0) {
             RemoveEntryList(&cj2->list_entry);
@@ -70,21 +77,39 @@ void calc_thread_main(device_extension* Vcb, calc_job* cj) {
 
         KeReleaseSpinLock(&Vcb->calcthreads.spinlock, irql);
 
+        // only the compression itself counts towards the stats, not the writes waiting on it
+        comp = cj2->type == calc_thread_comp_zlib || cj2->type == calc_thread_comp_lzo || cj2->type == calc_thread_comp_zstd;
+
+        if (comp)
+            time1 = KeQueryPerformanceCounter(&freq);
+
         switch (cj2->type) {
             case calc_thread_crc32c:
-                *(uint32_t*)dest = ~calc_crc32c(0xffffffff, src, Vcb->superblock.sector_size);
+                for (i = 0; i < num; i++) {
+                    ((uint32_t*)dest)[i] = ~calc_crc32c(0xffffffff, src, Vcb->superblock.sector_size);
+                    src += Vcb->superblock.sector_size;
+                }
             break;
 
             case calc_thread_xxhash:
-                *(uint64_t*)dest = XXH64(src, Vcb->superblock.sector_size, 0);
+                for (i = 0; i < num; i++) {
+                    ((uint64_t*)dest)[i] = XXH64(src, Vcb->superblock.sector_size, 0);
+                    src += Vcb->superblock.sector_size;
+                }
             break;
 
             case calc_thread_sha256:
-                calc_sha256(dest, src, Vcb->superblock.sector_size);
+                for (i = 0; i < num; i++) {
+                    calc_sha256((uint8_t*)dest + (i * SHA256_HASH_SIZE), src, Vcb->superblock.sector_size);
+                    src += Vcb->superblock.sector_size;
+                }
             break;
 
             case calc_thread_blake2:
-                blake2b(dest, BLAKE2_HASH_SIZE, src, Vcb->superblock.sector_size);
+                for (i = 0; i < num; i++) {
+                    blake2b((uint8_t*)dest + (i * BLAKE2_HASH_SIZE), BLAKE2_HASH_SIZE, src, Vcb->superblock.sector_size);
+                    src += Vcb->superblock.sector_size;
+                }
             break;
 
             case calc_thread_decomp_zlib:
@@ -130,7 +155,15 @@ void calc_thread_main(device_extension* Vcb, calc_job* cj) {
             break;
         }
 
-        if (InterlockedDecrement(&cj2->left) == 0)
+        if (comp) {
+            time2 = KeQueryPerformanceCounter(NULL);
+
+            KeAcquireSpinLock(&Vcb->calcthreads.spinlock, &irql);
+            Vcb->calcthreads.comp_stats.time += ((time2.QuadPart - time1.QuadPart) * 10000000) / freq.QuadPart;
+            KeReleaseSpinLock(&Vcb->calcthreads.spinlock, irql);
+        }
+
+        if (InterlockedExchangeAdd(&cj2->left, -num) == num)
             KeSetEvent(&cj2->event, 0, false);
 
         if (last_one)
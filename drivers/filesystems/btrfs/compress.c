@@ -872,90 +872,20 @@ typedef struct {
     calc_job* cj;
 } comp_part;
 
-NTSTATUS write_compressed(fcb* fcb, uint64_t start_data, uint64_t end_data, void* data, PIRP Irp, LIST_ENTRY* rollback) {
+// Writes out a run of parts whose calc jobs have finished, as one allocation.
+static NTSTATUS write_compressed_parts(fcb* fcb, uint64_t start_data, void* data, comp_part* parts, unsigned int num_parts,
+                                       uint8_t type, PIRP Irp, LIST_ENTRY* rollback) {
     NTSTATUS Status;
     uint64_t i;
-    unsigned int num_parts = (unsigned int)sector_align(end_data - start_data, COMPRESSED_EXTENT_SIZE) / COMPRESSED_EXTENT_SIZE;
-    uint8_t type;
-    comp_part* parts;
     unsigned int buflen = 0;
     uint8_t* buf;
     chunk* c = NULL;
     LIST_ENTRY* le;
     uint64_t address, extaddr;
     void* csum = NULL;
-
-    if (fcb->Vcb->options.compress_type != 0 && fcb->prop_compression == PropCompression_None)
-        type = fcb->Vcb->options.compress_type;
-    else {
-        if (!(fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_ZSTD) && fcb->prop_compression == PropCompression_ZSTD)
-            type = BTRFS_COMPRESSION_ZSTD;
-        else if (fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_ZSTD && fcb->prop_compression != PropCompression_Zlib && fcb->prop_compression != PropCompression_LZO)
-            type = BTRFS_COMPRESSION_ZSTD;
-        else if (!(fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_LZO) && fcb->prop_compression == PropCompression_LZO)
-            type = BTRFS_COMPRESSION_LZO;
-        else if (fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_LZO && fcb->prop_compression != PropCompression_Zlib)
-            type = BTRFS_COMPRESSION_LZO;
-        else
-            type = BTRFS_COMPRESSION_ZLIB;
-    }
-
-    Status = excise_extents(fcb->Vcb, fcb, start_data, end_data, Irp, rollback);
-    if (!NT_SUCCESS(Status)) {
-        ERR("excise_extents returned %08lx\n", Status);
-        return Status;
-    }
-
-    parts = ExAllocatePoolWithTag(PagedPool, sizeof(comp_part) * num_parts, ALLOC_TAG);
-    if (!parts) {
-        ERR("out of memory\n");
-        return STATUS_INSUFFICIENT_RESOURCES;
-    }
+    KIRQL irql;
 
     for (i = 0; i < num_parts; i++) {
-        if (i == num_parts - 1)
-            parts[i].inlen = ((unsigned int)(end_data - start_data) - ((num_parts - 1) * COMPRESSED_EXTENT_SIZE));
-        else
-            parts[i].inlen = COMPRESSED_EXTENT_SIZE;
-
-        Status = add_calc_job_comp(fcb->Vcb, type, (uint8_t*)data + (i * COMPRESSED_EXTENT_SIZE), parts[i].inlen,
-                                   parts[i].buf, parts[i].inlen, &parts[i].cj);
-        if (!NT_SUCCESS(Status)) {
-            ERR("add_calc_job_comp returned %08lx\n", Status);
-
-            for (unsigned int j = 0; j < i; j++) {
-                KeWaitForSingleObject(&parts[j].cj->event, Executive, KernelMode, false, NULL);
-                ExFreePool(parts[j].cj);
-            }
-
-            ExFreePool(parts);
-            return Status;
-        }
-    }
-
-    Status = STATUS_SUCCESS;
-
-    for (int i = num_parts - 1; i >= 0; i--) {
-        calc_thread_main(fcb->Vcb, parts[i].cj);
-
-        KeWaitForSingleObject(&parts[i].cj->event, Executive, KernelMode, false, NULL);
-
-        if (!NT_SUCCESS(parts[i].cj->Status))
-            Status = parts[i].cj->Status;
-    }
-
-    if (!NT_SUCCESS(Status)) {
-        ERR("calc job returned %08lx\n", Status);
-
-        for (unsigned int i = 0; i < num_parts; i++) {
-            ExFreePool(parts[i].cj);
-        }
-
-        ExFreePool(parts);
-        return Status;
-    }
-
-    for (unsigned int i = 0; i < num_parts; i++) {
         if (parts[i].cj->space_left >= fcb->Vcb->superblock.sector_size) {
             parts[i].compression_type = type;
             parts[i].outlen = parts[i].inlen - parts[i].cj->space_left;
@@ -978,9 +908,22 @@ NTSTATUS write_compressed(fcb* fcb, uint64_t start_data, uint64_t end_data, void
         }
 
         buflen += parts[i].outlen;
-        ExFreePool(parts[i].cj);
     }
 
+    KeAcquireSpinLock(&fcb->Vcb->calcthreads.spinlock, &irql);
+
+    for (i = 0; i < num_parts; i++) {
+        if (parts[i].compression_type == BTRFS_COMPRESSION_NONE)
+            fcb->Vcb->calcthreads.comp_stats.extents_incompressible++;
+        else
+            fcb->Vcb->calcthreads.comp_stats.extents_compressed++;
+
+        fcb->Vcb->calcthreads.comp_stats.bytes_in += parts[i].inlen;
+        fcb->Vcb->calcthreads.comp_stats.bytes_out += parts[i].outlen;
+    }
+
+    KeReleaseSpinLock(&fcb->Vcb->calcthreads.spinlock, irql);
+
     // check if first 128 KB of file is incompressible
 
     if (start_data == 0 && parts[0].compression_type == BTRFS_COMPRESSION_NONE && !fcb->Vcb->options.compress_force) {
@@ -996,7 +939,6 @@ NTSTATUS write_compressed(fcb* fcb, uint64_t start_data, uint64_t end_data, void
     buf = ExAllocatePoolWithTag(PagedPool, buflen, ALLOC_TAG);
     if (!buf) {
         ERR("out of memory\n");
-        ExFreePool(parts);
         return STATUS_INSUFFICIENT_RESOURCES;
     }
 
@@ -1054,7 +996,6 @@ NTSTATUS write_compressed(fcb* fcb, uint64_t start_data, uint64_t end_data, void
         if (!NT_SUCCESS(Status)) {
             ERR("alloc_chunk returned %08lx\n", Status);
             ExFreePool(buf);
-            ExFreePool(parts);
             return Status;
         }
 
@@ -1072,7 +1013,6 @@ NTSTATUS write_compressed(fcb* fcb, uint64_t start_data, uint64_t end_data, void
     if (!c) {
         WARN("couldn't find any data chunks with %x bytes free\n", buflen);
         ExFreePool(buf);
-        ExFreePool(parts);
         return STATUS_DISK_FULL;
     }
 
@@ -1085,7 +1025,6 @@ NTSTATUS write_compressed(fcb* fcb, uint64_t start_data, uint64_t end_data, void
     if (!NT_SUCCESS(Status)) {
         ERR("write_data_complete returned %08lx\n", Status);
         ExFreePool(buf);
-        ExFreePool(parts);
         return Status;
     }
 
@@ -1100,7 +1039,6 @@ NTSTATUS write_compressed(fcb* fcb, uint64_t start_data, uint64_t end_data, void
         if (!csum) {
             ERR("out of memory\n");
             ExFreePool(buf);
-            ExFreePool(parts);
             return STATUS_INSUFFICIENT_RESOURCES;
         }
 
@@ -1121,7 +1059,6 @@ NTSTATUS write_compressed(fcb* fcb, uint64_t start_data, uint64_t end_data, void
         ed = ExAllocatePoolWithTag(PagedPool, offsetof(EXTENT_DATA, data[0]) + sizeof(EXTENT_DATA2), ALLOC_TAG);
         if (!ed) {
             ERR("out of memory\n");
-            ExFreePool(parts);
 
             if (csum)
                 ExFreePool(csum);
@@ -1147,7 +1084,6 @@ NTSTATUS write_compressed(fcb* fcb, uint64_t start_data, uint64_t end_data, void
             if (!csum2) {
                 ERR("out of memory\n");
                 ExFreePool(ed);
-                ExFreePool(parts);
                 ExFreePool(csum);
                 return STATUS_INSUFFICIENT_RESOURCES;
             }
@@ -1162,7 +1098,6 @@ NTSTATUS write_compressed(fcb* fcb, uint64_t start_data, uint64_t end_data, void
         if (!NT_SUCCESS(Status)) {
             ERR("add_extent_to_fcb returned %08lx\n", Status);
             ExFreePool(ed);
-            ExFreePool(parts);
 
             if (csum)
                 ExFreePool(csum);
@@ -1199,7 +1134,112 @@ NTSTATUS write_compressed(fcb* fcb, uint64_t start_data, uint64_t end_data, void
     fcb->inode_item_changed = true;
     mark_fcb_dirty(fcb);
 
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS write_compressed(fcb* fcb, uint64_t start_data, uint64_t end_data, void* data, PIRP Irp, LIST_ENTRY* rollback) {
+    NTSTATUS Status;
+    unsigned int i;
+    unsigned int num_parts = (unsigned int)sector_align(end_data - start_data, COMPRESSED_EXTENT_SIZE) / COMPRESSED_EXTENT_SIZE;
+    unsigned int first, group;
+    uint8_t type;
+    comp_part* parts;
+
+    if (fcb->Vcb->options.compress_type != 0 && fcb->prop_compression == PropCompression_None)
+        type = fcb->Vcb->options.compress_type;
+    else {
+        if (!(fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_ZSTD) && fcb->prop_compression == PropCompression_ZSTD)
+            type = BTRFS_COMPRESSION_ZSTD;
+        else if (fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_ZSTD && fcb->prop_compression != PropCompression_Zlib && fcb->prop_compression != PropCompression_LZO)
+            type = BTRFS_COMPRESSION_ZSTD;
+        else if (!(fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_LZO) && fcb->prop_compression == PropCompression_LZO)
+            type = BTRFS_COMPRESSION_LZO;
+        else if (fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_LZO && fcb->prop_compression != PropCompression_Zlib)
+            type = BTRFS_COMPRESSION_LZO;
+        else
+            type = BTRFS_COMPRESSION_ZLIB;
+    }
+
+    Status = excise_extents(fcb->Vcb, fcb, start_data, end_data, Irp, rollback);
+    if (!NT_SUCCESS(Status)) {
+        ERR("excise_extents returned %08lx\n", Status);
+        return Status;
+    }
+
+    parts = ExAllocatePoolWithTag(PagedPool, sizeof(comp_part) * num_parts, ALLOC_TAG);
+    if (!parts) {
+        ERR("out of memory\n");
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    for (i = 0; i < num_parts; i++) {
+        if (i == num_parts - 1)
+            parts[i].inlen = ((unsigned int)(end_data - start_data) - ((num_parts - 1) * COMPRESSED_EXTENT_SIZE));
+        else
+            parts[i].inlen = COMPRESSED_EXTENT_SIZE;
+
+        Status = add_calc_job_comp(fcb->Vcb, type, (uint8_t*)data + (i * COMPRESSED_EXTENT_SIZE), parts[i].inlen,
+                                   parts[i].buf, parts[i].inlen, &parts[i].cj);
+        if (!NT_SUCCESS(Status)) {
+            ERR("add_calc_job_comp returned %08lx\n", Status);
+
+            for (unsigned int j = 0; j < i; j++) {
+                KeWaitForSingleObject(&parts[j].cj->event, Executive, KernelMode, false, NULL);
+                ExFreePool(parts[j].cj);
+            }
+
+            ExFreePool(parts);
+            return Status;
+        }
+    }
+
+    // All the parts are queued at once, so that every calc thread has something to do. We then write
+    // them out a group at a time, as soon as each group has been compressed, while the threads carry on
+    // with the rest - rather than waiting for the whole range before submitting anything.
+
+    group = max(fcb->Vcb->calcthreads.num_threads, 1);
+    first = 0;
+
+    while (first < num_parts) {
+        unsigned int num = min(num_parts - first, group);
+
+        // help out, starting at the end of the group so we're less likely to collide with the calc threads
+        for (i = first + num; i > first; i--) {
+            calc_thread_main(fcb->Vcb, parts[i - 1].cj);
+        }
+
+        for (i = first; i < first + num; i++) {
+            KeWaitForSingleObject(&parts[i].cj->event, Executive, KernelMode, false, NULL);
+
+            if (!NT_SUCCESS(parts[i].cj->Status))
+                Status = parts[i].cj->Status;
+        }
+
+        if (!NT_SUCCESS(Status)) {
+            ERR("calc job returned %08lx\n", Status);
+            break;
+        }
+
+        Status = write_compressed_parts(fcb, start_data + ((uint64_t)first * COMPRESSED_EXTENT_SIZE),
+                                        (uint8_t*)data + (first * COMPRESSED_EXTENT_SIZE), &parts[first], num, type, Irp, rollback);
+        if (!NT_SUCCESS(Status)) {
+            ERR("write_compressed_parts returned %08lx\n", Status);
+            break;
+        }
+
+        first += num;
+    }
+
+    // on failure, parts which haven't been written yet may still be being worked on
+
+    for (i = 0; i < num_parts; i++) {
+        if (i >= first)
+            KeWaitForSingleObject(&parts[i].cj->event, Executive, KernelMode, false, NULL);
+
+        ExFreePool(parts[i].cj);
+    }
+
     ExFreePool(parts);
 
-    return STATUS_SUCCESS;
+    return Status;
 }
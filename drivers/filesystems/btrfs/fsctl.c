@@ -5342,6 +5342,30 @@ static NTSTATUS get_csum_info(device_extension* Vcb, PFILE_OBJECT FileObject, bt
     return Status;
 }
 
+static NTSTATUS get_compression_stats(device_extension* Vcb, btrfs_compression_stats* buf, ULONG buflen, ULONG_PTR* retlen) {
+    KIRQL irql;
+
+    if (!buf)
+        return STATUS_INVALID_PARAMETER;
+
+    if (buflen < sizeof(btrfs_compression_stats))
+        return STATUS_BUFFER_TOO_SMALL;
+
+    KeAcquireSpinLock(&Vcb->calcthreads.spinlock, &irql);
+
+    buf->extents_compressed = Vcb->calcthreads.comp_stats.extents_compressed;
+    buf->extents_incompressible = Vcb->calcthreads.comp_stats.extents_incompressible;
+    buf->bytes_in = Vcb->calcthreads.comp_stats.bytes_in;
+    buf->bytes_out = Vcb->calcthreads.comp_stats.bytes_out;
+    buf->time = Vcb->calcthreads.comp_stats.time;
+
+    KeReleaseSpinLock(&Vcb->calcthreads.spinlock, irql);
+
+    *retlen = sizeof(btrfs_compression_stats);
+
+    return STATUS_SUCCESS;
+}
+
 NTSTATUS fsctl_request(PDEVICE_OBJECT DeviceObject, PIRP* Pirp, uint32_t type) {
     PIRP Irp = *Pirp;
     PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation(Irp);
@@ -5944,6 +5968,11 @@ NTSTATUS fsctl_request(PDEVICE_OBJECT DeviceObject, PIRP* Pirp, uint32_t type) {
                                    Irp->RequestorMode);
             break;
 
+        case FSCTL_BTRFS_GET_COMPRESSION_STATS:
+            Status = get_compression_stats(DeviceObject->DeviceExtension, Irp->AssociatedIrp.SystemBuffer,
+                                           IrpSp->Parameters.FileSystemControl.OutputBufferLength, &Irp->IoStatus.Information);
+            break;
+
         default:
             WARN("unknown control code %lx (DeviceType = %lx, Access = %lx, Function = %lx, Method = %lx)\n",
                           IrpSp->Parameters.FileSystemControl.FsControlCode, (IrpSp->Parameters.FileSystemControl.FsControlCode & 0xff0000) >> 16,
@@ -0,0 +1,139 @@
+/*
+ * PROJECT:     ReactOS btrfs driver
+ * LICENSE:     LGPL-3.0-or-later (https://spdx.org/licenses/LGPL-3.0-or-later)
+ * PURPOSE:     SHA-256 using the x86 SHA extensions
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+// Only built for amd64, where kernel code is free to use the XMM registers.
+// check_cpu() in btrfs.c only picks this if the CPU has SHA and SSE4.1.
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SHA_NI_TARGET __attribute__((__target__("sse4.1,sha")))
+#else
+#define SHA_NI_TARGET
+#endif
+
+static const uint32_t k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Each step does four rounds. The message schedule is kept in four registers,
+// msg[i & 3] holding w[4i..4i+3]; the next four words are worked out with
+// sha256msg1/sha256msg2 while the current ones are being used. The steps are
+// unrolled so that the msg[] indices are constants and stay in registers.
+#define SHA_NI_STEP(i) \
+    do { \
+        if ((i) < 4) \
+            msg[(i)] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + ((i) * 16))), shuf_mask); \
+        \
+        m = _mm_add_epi32(msg[(i) & 3], _mm_loadu_si128((const __m128i*)&k[(i) * 4])); \
+        state1 = _mm_sha256rnds2_epu32(state1, state0, m); \
+        \
+        if ((i) >= 3 && (i) < 15) { \
+            tmp = _mm_alignr_epi8(msg[(i) & 3], msg[((i) - 1) & 3], 4); \
+            msg[((i) + 1) & 3] = _mm_add_epi32(msg[((i) + 1) & 3], tmp); \
+            msg[((i) + 1) & 3] = _mm_sha256msg2_epu32(msg[((i) + 1) & 3], msg[(i) & 3]); \
+        } \
+        \
+        m = _mm_shuffle_epi32(m, 0x0e); \
+        state0 = _mm_sha256rnds2_epu32(state0, state1, m); \
+        \
+        if ((i) >= 1 && (i) < 13) \
+            msg[((i) - 1) & 3] = _mm_sha256msg1_epu32(msg[((i) - 1) & 3], msg[(i) & 3]); \
+    } while (0)
+
+SHA_NI_TARGET
+static void sha256_ni_blocks(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    const __m128i shuf_mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i state0, state1, abef_save, cdgh_save, tmp, m;
+    __m128i msg[4];
+
+    // state0 = ABEF, state1 = CDGH, the layout sha256rnds2 wants
+    tmp = _mm_loadu_si128((const __m128i*)&state[0]);
+    state1 = _mm_loadu_si128((const __m128i*)&state[4]);
+
+    tmp = _mm_shuffle_epi32(tmp, 0xb1);
+    state1 = _mm_shuffle_epi32(state1, 0x1b);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+    while (blocks > 0) {
+        abef_save = state0;
+        cdgh_save = state1;
+
+        SHA_NI_STEP(0);
+        SHA_NI_STEP(1);
+        SHA_NI_STEP(2);
+        SHA_NI_STEP(3);
+        SHA_NI_STEP(4);
+        SHA_NI_STEP(5);
+        SHA_NI_STEP(6);
+        SHA_NI_STEP(7);
+        SHA_NI_STEP(8);
+        SHA_NI_STEP(9);
+        SHA_NI_STEP(10);
+        SHA_NI_STEP(11);
+        SHA_NI_STEP(12);
+        SHA_NI_STEP(13);
+        SHA_NI_STEP(14);
+        SHA_NI_STEP(15);
+
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+
+        data += 64;
+        blocks--;
+    }
+
+    // back to ABCD and EFGH
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    _mm_storeu_si128((__m128i*)&state[0], state0);
+    _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+void calc_sha256_ni(uint8_t* hash, const void* input, size_t len) {
+    uint32_t h[] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    uint8_t tail[128];
+    size_t full = len / 64, left = len % 64, tail_len;
+    uint64_t bits = (uint64_t)len << 3;
+    unsigned int i;
+
+    if (full > 0)
+        sha256_ni_blocks(h, input, full);
+
+    // padding: 0x80, zeroes, then the length in bits as a big-endian 64-bit number
+    tail_len = left < 56 ? 64 : 128;
+
+    memcpy(tail, (const uint8_t*)input + (full * 64), left);
+    tail[left] = 0x80;
+    memset(tail + left + 1, 0, tail_len - left - 1 - sizeof(uint64_t));
+
+    for (i = 0; i < sizeof(uint64_t); i++) {
+        tail[tail_len - 1 - i] = (uint8_t)bits;
+        bits >>= 8;
+    }
+
+    sha256_ni_blocks(h, tail, tail_len / 64);
+
+    for (i = 0; i < 8; i++) {
+        hash[(i * 4) + 0] = (uint8_t)(h[i] >> 24);
+        hash[(i * 4) + 1] = (uint8_t)(h[i] >> 16);
+        hash[(i * 4) + 2] = (uint8_t)(h[i] >> 8);
+        hash[(i * 4) + 3] = (uint8_t)h[i];
+    }
+}
@@ -3,7 +3,7 @@
 
 // Public domain code from https://github.com/amosnier/sha-2
 
-// FIXME - x86 SHA extensions
+// x86 SHA extensions version lives in sha256-ni.c
 
 #define CHUNK_SIZE 64
 #define TOTAL_LEN_LEN 8
@@ -123,7 +123,7 @@ static int calc_chunk(uint8_t chunk[CHUNK_SIZE], struct buffer_state * state)
  *   for bit string lengths that are not multiples of eight, and it really operates on arrays of bytes.
  *   In particular, the len parameter is a number of bytes.
  */
-void calc_sha256(uint8_t* hash, const void* input, size_t len)
+void calc_sha256_sw(uint8_t* hash, const void* input, size_t len)
 {
 	/*
 	 * Note 1: All integers (expect indexes) are 32-bit unsigned integers and addition is calculated modulo 2^32.
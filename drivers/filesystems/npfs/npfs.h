@@ -32,6 +32,13 @@
 #define MIN_INDEXED_LENGTH 5
 #define MAX_INDEXED_LENGTH 9
 
+//
+// Reads at least this large that have to wait for a writer get their buffer
+// locked down, so that the write can copy straight into it rather than into
+// an intermediate pool buffer that the I/O manager copies out again.
+//
+#define NP_DIRECT_READ_THRESHOLD    (64 * 1024)
+
 /* TYPEDEFS & DEFINES *********************************************************/
 
 //
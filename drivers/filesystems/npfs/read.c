@@ -21,6 +21,32 @@ ULONG NpFastReadFalse;
 
 /* FUNCTIONS ******************************************************************/
 
+static
+VOID
+NpLockReadBuffer(IN PIRP Irp,
+                 IN ULONG BufferSize)
+{
+    PMDL Mdl;
+    PAGED_CODE();
+
+    ASSERT(Irp->MdlAddress == NULL);
+
+    Mdl = IoAllocateMdl(Irp->UserBuffer, BufferSize, FALSE, TRUE, Irp);
+    if (!Mdl) return;
+
+    _SEH2_TRY
+    {
+        MmProbeAndLockPages(Mdl, Irp->RequestorMode, IoWriteAccess);
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Keep using the buffered path, which will fail the read later on */
+        Irp->MdlAddress = NULL;
+        IoFreeMdl(Mdl);
+    }
+    _SEH2_END;
+}
+
 BOOLEAN
 NTAPI
 NpCommonRead(IN PFILE_OBJECT FileObject,
@@ -129,6 +155,11 @@ NpCommonRead(IN PFILE_OBJECT FileObject,
         goto Quickie;
     }
 
+    if (BufferSize >= NP_DIRECT_READ_THRESHOLD && !Irp->MdlAddress)
+    {
+        NpLockReadBuffer(Irp, BufferSize);
+    }
+
     Status = NpAddDataQueueEntry(NamedPipeEnd,
                                  Ccb,
                                  ReadQueue,
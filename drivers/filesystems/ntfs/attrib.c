@@ -1098,7 +1098,7 @@ FreeClusters(PNTFS_VCB Vcb,
         return 0;
     }
 
-    Status = FindAttribute(Vcb, BitmapRecord, AttributeData, L"", 0, &DataContext, NULL);
+    Status = FindAttribute(Vcb, BitmapRecord, NTFS_FILE_BITMAP, AttributeData, L"", 0, &DataContext, NULL);
     if (!NT_SUCCESS(Status))
     {
         DPRINT1("Error: Unable to find data attribute for bitmap file!\n");
@@ -146,6 +146,7 @@ AllocateIndexNode(PDEVICE_EXTENSION DeviceExt,
     // Find the bitmap attribute for the index
     Status = FindAttribute(DeviceExt,
                            FileRecord,
+                           IndexAllocationCtx->FileMFTIndex,
                            AttributeBitmap,
                            L"$I30",
                            4,
@@ -511,7 +512,6 @@ CreateBTreeNodeFromIndexNode(PDEVICE_EXTENSION Vcb,
     PB_TREE_KEY CurrentKey;
     NTSTATUS Status;
     ULONGLONG IndexNodeOffset;
-    ULONG BytesRead;
 
     if (IndexAllocationAttributeCtx == NULL)
     {
@@ -557,28 +557,25 @@ CreateBTreeNodeFromIndexNode(PDEVICE_EXTENSION Vcb,
 
     // TODO: Confirm index bitmap has this node marked as in-use
 
-    // Read the node
-    BytesRead = ReadAttribute(Vcb,
+    // Read the node and apply its fixup array
+    Status = ReadCachedRecord(Vcb,
                               IndexAllocationAttributeCtx,
+                              IndexAllocationAttributeCtx->FileMFTIndex,
                               IndexNodeOffset,
-                              (PCHAR)NodeBuffer,
+                              &NodeBuffer->Ntfs,
                               IndexBufferSize);
-
-    ASSERT(BytesRead == IndexBufferSize);
-    NT_ASSERT(NodeBuffer->Ntfs.Type == NRH_INDX_TYPE);
-    NT_ASSERT(NodeBuffer->VCN == *VCN);
-
-    // Apply the fixup array to the node buffer
-    Status = FixupUpdateSequenceArray(Vcb, &NodeBuffer->Ntfs);
     if (!NT_SUCCESS(Status))
     {
-        DPRINT1("ERROR: Couldn't apply fixup array to index node buffer!\n");
+        DPRINT1("ERROR: Couldn't read index node buffer!\n");
         ExFreePoolWithTag(NodeBuffer, TAG_NTFS);
         ExFreePoolWithTag(CurrentKey, TAG_NTFS);
         ExFreePoolWithTag(NewNode, TAG_NTFS);
         return NULL;
     }
 
+    NT_ASSERT(NodeBuffer->Ntfs.Type == NRH_INDX_TYPE);
+    NT_ASSERT(NodeBuffer->VCN == *VCN);
+
     // Walk through the index and create keys for all the entries
     FirstNodeEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)(&NodeBuffer->Header)
                                                + NodeBuffer->Header.FirstEntryOffset);
@@ -715,6 +712,7 @@ CreateBTreeFromIndex(PDEVICE_EXTENSION Vcb,
     // See if the file record has an attribute allocation
     Status = FindAttribute(Vcb,
                            FileRecordWithIndex,
+                           IndexRootContext->FileMFTIndex,
                            AttributeIndexAllocation,
                            L"$I30",
                            4,
@@ -1182,7 +1180,8 @@ NTSTATUS
 UpdateIndexAllocation(PDEVICE_EXTENSION DeviceExt,
                       PB_TREE Tree,
                       ULONG IndexBufferSize,
-                      PFILE_RECORD_HEADER FileRecord)
+                      PFILE_RECORD_HEADER FileRecord,
+                      ULONGLONG MFTIndex)
 {
     // Find the index allocation and bitmap
     PNTFS_ATTR_CONTEXT IndexAllocationContext;
@@ -1194,7 +1193,7 @@ UpdateIndexAllocation(PDEVICE_EXTENSION DeviceExt,
 
     DPRINT("UpdateIndexAllocation() called.\n");
 
-    Status = FindAttribute(DeviceExt, FileRecord, AttributeIndexAllocation, L"$I30", 4, &IndexAllocationContext, &IndexAllocationOffset);
+    Status = FindAttribute(DeviceExt, FileRecord, MFTIndex, AttributeIndexAllocation, L"$I30", 4, &IndexAllocationContext, &IndexAllocationOffset);
     if (NT_SUCCESS(Status))
     {
         HasIndexAllocation = TRUE;
@@ -1230,7 +1229,7 @@ UpdateIndexAllocation(PDEVICE_EXTENSION DeviceExt,
                 }
 
                 // Find the new attribute
-                Status = FindAttribute(DeviceExt, FileRecord, AttributeIndexAllocation, L"$I30", 4, &IndexAllocationContext, &IndexAllocationOffset);
+                Status = FindAttribute(DeviceExt, FileRecord, MFTIndex, AttributeIndexAllocation, L"$I30", 4, &IndexAllocationContext, &IndexAllocationOffset);
                 if (!NT_SUCCESS(Status))
                 {
                     DPRINT1("ERROR: Couldn't find newly-created index allocation!\n");
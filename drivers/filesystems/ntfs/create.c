@@ -513,7 +513,7 @@ NtfsCreateFile(PDEVICE_OBJECT DeviceObject,
                     goto DoneOverwriting;
 
                 // find the data attribute and set it's length to 0 (TODO: Handle Alternate Data Streams)
-                Status = FindAttribute(Fcb->Vcb, fileRecord, AttributeData, L"", 0, &dataContext, &DataAttributeOffset);
+                Status = FindAttribute(Fcb->Vcb, fileRecord, Fcb->MFTIndex, AttributeData, L"", 0, &dataContext, &DataAttributeOffset);
                 if (!NT_SUCCESS(Status))
                     goto DoneOverwriting;
 
@@ -37,6 +37,7 @@
 ULONGLONG
 NtfsGetFileSize(PDEVICE_EXTENSION DeviceExt,
                 PFILE_RECORD_HEADER FileRecord,
+                ULONGLONG MFTIndex,
                 PCWSTR Stream,
                 ULONG StreamLength,
                 PULONGLONG AllocatedSize)
@@ -46,7 +47,7 @@ NtfsGetFileSize(PDEVICE_EXTENSION DeviceExt,
     NTSTATUS Status;
     PNTFS_ATTR_CONTEXT DataContext;
 
-    Status = FindAttribute(DeviceExt, FileRecord, AttributeData, Stream, StreamLength, &DataContext, NULL);
+    Status = FindAttribute(DeviceExt, FileRecord, MFTIndex, AttributeData, Stream, StreamLength, &DataContext, NULL);
     if (NT_SUCCESS(Status))
     {
         Size = AttributeDataLength(DataContext->pRecord);
@@ -184,7 +185,7 @@ NtfsGetDirectoryInformation(PDEVICE_EXTENSION DeviceExt,
         /* Convert file flags */
         NtfsFileFlagsToAttributes(FileName->FileAttributes | StdInfo->FileAttribute, &Info->FileAttributes);
 
-        Info->EndOfFile.QuadPart = NtfsGetFileSize(DeviceExt, FileRecord, L"", 0, (PULONGLONG)&Info->AllocationSize.QuadPart);
+        Info->EndOfFile.QuadPart = NtfsGetFileSize(DeviceExt, FileRecord, MFTIndex, L"", 0, (PULONGLONG)&Info->AllocationSize.QuadPart);
 
         Info->FileIndex = MFTIndex;
     }
@@ -257,7 +258,7 @@ NtfsGetFullDirectoryInformation(PDEVICE_EXTENSION DeviceExt,
         /* Convert file flags */
         NtfsFileFlagsToAttributes(FileName->FileAttributes | StdInfo->FileAttribute, &Info->FileAttributes);
 
-        Info->EndOfFile.QuadPart = NtfsGetFileSize(DeviceExt, FileRecord, L"", 0, (PULONGLONG)&Info->AllocationSize.QuadPart);
+        Info->EndOfFile.QuadPart = NtfsGetFileSize(DeviceExt, FileRecord, MFTIndex, L"", 0, (PULONGLONG)&Info->AllocationSize.QuadPart);
 
         Info->FileIndex = MFTIndex;
         Info->EaSize = 0;
@@ -345,7 +346,7 @@ NtfsGetBothDirectoryInformation(PDEVICE_EXTENSION DeviceExt,
         /* Convert file flags */
         NtfsFileFlagsToAttributes(FileName->FileAttributes | StdInfo->FileAttribute, &Info->FileAttributes);
 
-        Info->EndOfFile.QuadPart = NtfsGetFileSize(DeviceExt, FileRecord, L"", 0, (PULONGLONG)&Info->AllocationSize.QuadPart);
+        Info->EndOfFile.QuadPart = NtfsGetFileSize(DeviceExt, FileRecord, MFTIndex, L"", 0, (PULONGLONG)&Info->AllocationSize.QuadPart);
 
         Info->FileIndex = MFTIndex;
         Info->EaSize = 0;
@@ -429,7 +429,7 @@ NtfsMakeFCBFromDirEntry(PNTFS_VCB Vcb,
         pathName[FileName->NameLength] = UNICODE_NULL;
     }
 
-    Size = NtfsGetFileSize(Vcb, Record, (Stream ? Stream : L""), (Stream ? wcslen(Stream) : 0), &AllocatedSize);
+    Size = NtfsGetFileSize(Vcb, Record, MFTIndex, (Stream ? Stream : L""), (Stream ? wcslen(Stream) : 0), &AllocatedSize);
 
     rcFCB = NtfsCreateFCB(pathName, Stream, Vcb);
     if (!rcFCB)
@@ -584,7 +584,7 @@ NtfsDirFindFile(PNTFS_VCB Vcb,
     }
     else if (Colon != 0)
     {
-        Status = FindAttribute(Vcb, FileRecord, AttributeData, Colon, wcslen(Colon), &DataContext, NULL);
+        Status = FindAttribute(Vcb, FileRecord, MFTIndex, AttributeData, Colon, wcslen(Colon), &DataContext, NULL);
         if (!NT_SUCCESS(Status))
         {
             return STATUS_OBJECT_NAME_NOT_FOUND;
@@ -757,7 +757,7 @@ NtfsReadFCBAttribute(PNTFS_VCB Vcb,
         return Status;
     }
 
-    Status = FindAttribute(Vcb, FileRecord, Type, Name, NameLength, &AttrCtxt, NULL);
+    Status = FindAttribute(Vcb, FileRecord, pFCB->MFTIndex, Type, Name, NameLength, &AttrCtxt, NULL);
     if (!NT_SUCCESS(Status))
     {
         ExFreeToNPagedLookasideList(&Vcb->FileRecLookasideList, FileRecord);
@@ -599,7 +599,7 @@ NtfsSetEndOfFile(PNTFS_FCB Fcb,
 
     DPRINT("Found record for %wS\n", Fcb->ObjectName);
 
-    CurrentFileSize.QuadPart = NtfsGetFileSize(DeviceExt, FileRecord, L"", 0, NULL);
+    CurrentFileSize.QuadPart = NtfsGetFileSize(DeviceExt, FileRecord, Fcb->MFTIndex, L"", 0, NULL);
 
     // Are we trying to decrease the file size?
     if (NewFileSize->QuadPart < CurrentFileSize.QuadPart)
@@ -618,6 +618,7 @@ NtfsSetEndOfFile(PNTFS_FCB Fcb,
     DPRINT("Finding Data Attribute...\n");
     Status = FindAttribute(DeviceExt,
                            FileRecord,
+                           Fcb->MFTIndex,
                            AttributeData,
                            Fcb->Stream,
                            wcslen(Fcb->Stream),
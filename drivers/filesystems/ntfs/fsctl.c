@@ -300,6 +300,7 @@ NtfsGetVolumeData(PDEVICE_OBJECT DeviceObject,
 
     Status = FindAttribute(DeviceExt,
                            DeviceExt->MasterFileTable,
+                           NTFS_FILE_MFT,
                            AttributeData,
                            L"",
                            0,
@@ -343,7 +344,7 @@ NtfsGetVolumeData(PDEVICE_OBJECT DeviceObject,
     NtfsDumpFileAttributes(DeviceExt, VolumeRecord);
 
     /* Get volume name */
-    Status = FindAttribute(DeviceExt, VolumeRecord, AttributeVolumeName, L"", 0, &AttrCtxt, NULL);
+    Status = FindAttribute(DeviceExt, VolumeRecord, NTFS_FILE_VOLUME, AttributeVolumeName, L"", 0, &AttrCtxt, NULL);
 
     if (NT_SUCCESS(Status) && AttrCtxt->pRecord->Resident.ValueLength != 0)
     {
@@ -385,7 +386,7 @@ NtfsGetVolumeData(PDEVICE_OBJECT DeviceObject,
     DeviceExt->VolumeFcb = VolumeFcb;
 
     /* Get volume information */
-    Status = FindAttribute(DeviceExt, VolumeRecord, AttributeVolumeInformation, L"", 0, &AttrCtxt, NULL);
+    Status = FindAttribute(DeviceExt, VolumeRecord, NTFS_FILE_VOLUME, AttributeVolumeInformation, L"", 0, &AttrCtxt, NULL);
 
     if (NT_SUCCESS(Status) && AttrCtxt->pRecord->Resident.ValueLength != 0)
     {
@@ -411,6 +412,79 @@ NtfsGetVolumeData(PDEVICE_OBJECT DeviceObject,
 }
 
 
+/*
+ * Reads the $UpCase table of the volume. $I30 indexes are sorted with it, so
+ * looking up a name in the index has to use it too (see SearchIndexEntries()).
+ * Without it, lookups go through every entry of the directory instead.
+ */
+static
+VOID
+NtfsLoadUpcaseTable(PDEVICE_EXTENSION DeviceExt)
+{
+    PFILE_RECORD_HEADER UpcaseRecord;
+    PNTFS_ATTR_CONTEXT DataContext;
+    ULONGLONG DataLength;
+    PWCHAR UpcaseTable;
+    ULONG Length;
+    NTSTATUS Status;
+
+    UpcaseRecord = ExAllocateFromNPagedLookasideList(&DeviceExt->FileRecLookasideList);
+    if (UpcaseRecord == NULL)
+        return;
+
+    Status = ReadFileRecord(DeviceExt, NTFS_FILE_UPCASE, UpcaseRecord);
+    if (NT_SUCCESS(Status))
+        Status = FindAttribute(DeviceExt, UpcaseRecord, NTFS_FILE_UPCASE, AttributeData, L"", 0, &DataContext, NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Can't find $UpCase data: 0x%08lx\n", Status);
+        ExFreeToNPagedLookasideList(&DeviceExt->FileRecLookasideList, UpcaseRecord);
+        return;
+    }
+
+    /* One entry per UTF-16 code unit, any entry past the end maps to itself */
+    DataLength = AttributeDataLength(DataContext->pRecord);
+    Length = (ULONG)min(DataLength, 0x10000 * sizeof(WCHAR));
+    Length = ROUND_DOWN(Length, sizeof(WCHAR));
+
+    UpcaseTable = ExAllocatePoolWithTag(PagedPool,
+                                        ROUND_UP(Length, DeviceExt->NtfsInfo.BytesPerSector),
+                                        TAG_NTFS);
+    if (UpcaseTable != NULL && Length != 0 &&
+        ReadAttribute(DeviceExt, DataContext, 0, (PCHAR)UpcaseTable, Length) == Length)
+    {
+        DeviceExt->UpcaseTable = UpcaseTable;
+        DeviceExt->UpcaseTableLength = Length / sizeof(WCHAR);
+    }
+    else if (UpcaseTable != NULL)
+    {
+        DPRINT1("Failed reading $UpCase\n");
+        ExFreePoolWithTag(UpcaseTable, TAG_NTFS);
+    }
+
+    ReleaseAttributeContext(DataContext);
+    ExFreeToNPagedLookasideList(&DeviceExt->FileRecLookasideList, UpcaseRecord);
+}
+
+/*
+ * Frees what NtfsGetVolumeData() and the mount set up in the VCB: the upcase
+ * table, the record cache and the file record lookaside list. Whatever tears
+ * a VCB down has to go through here, so none of them is left behind.
+ */
+VOID
+NtfsUninitializeVcb(PNTFS_VCB Vcb)
+{
+    if (Vcb->UpcaseTable != NULL)
+    {
+        ExFreePoolWithTag(Vcb->UpcaseTable, TAG_NTFS);
+        Vcb->UpcaseTable = NULL;
+        Vcb->UpcaseTableLength = 0;
+    }
+
+    NtfsUninitializeRecordCache(Vcb);
+    ExDeleteNPagedLookasideList(&Vcb->FileRecLookasideList);
+}
+
 static
 NTSTATUS
 NtfsMountVolume(PDEVICE_OBJECT DeviceObject,
@@ -466,6 +540,12 @@ NtfsMountVolume(PDEVICE_OBJECT DeviceObject,
 
     Lookaside = TRUE;
 
+    Status = NtfsInitializeRecordCache(Vcb);
+    if (!NT_SUCCESS(Status))
+        goto ByeBye;
+
+    NtfsLoadUpcaseTable(Vcb);
+
     NewDeviceObject->Vpb = DeviceToMount->Vpb;
 
     Vcb->StorageDevice = DeviceToMount;
@@ -565,7 +645,7 @@ ByeBye:
             ExFreePool(Ccb);
 
         if (Lookaside)
-            ExDeleteNPagedLookasideList(&Vcb->FileRecLookasideList);
+            NtfsUninitializeVcb(Vcb);
 
         if (NewDeviceObject)
             IoDeleteDevice(NewDeviceObject);
@@ -817,7 +897,7 @@ GetVolumeBitmap(PDEVICE_EXTENSION DeviceExt,
         return Status;
     }
 
-    Status = FindAttribute(DeviceExt, BitmapRecord, AttributeData, L"", 0, &DataContext, NULL);
+    Status = FindAttribute(DeviceExt, BitmapRecord, NTFS_FILE_BITMAP, AttributeData, L"", 0, &DataContext, NULL);
     if (!NT_SUCCESS(Status))
     {
         DPRINT1("Failed find $DATA for bitmap: %lx\n", Status);
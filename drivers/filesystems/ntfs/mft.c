@@ -123,6 +123,11 @@ ReleaseAttributeContext(PNTFS_ATTR_CONTEXT Context)
 *
 * Searches a file record for an attribute matching the given type and name.
 *
+* @param MFTIndex
+* MFT index MftRecord was read from. The context returned refers to the file record
+* with this index (or to the one the attribute list points to), as the record number
+* in the header of NTFS 3.0 records isn't reliable.
+*
 * @param Offset
 * Optional pointer to a ULONG that will receive the offset of the found attribute
 * from the beginning of the record. Can be set to NULL.
@@ -130,6 +135,7 @@ ReleaseAttributeContext(PNTFS_ATTR_CONTEXT Context)
 NTSTATUS
 FindAttribute(PDEVICE_EXTENSION Vcb,
               PFILE_RECORD_HEADER MftRecord,
+              ULONGLONG MFTIndex,
               ULONG Type,
               PCWSTR Name,
               ULONG NameLength,
@@ -142,7 +148,7 @@ FindAttribute(PDEVICE_EXTENSION Vcb,
     PNTFS_ATTR_RECORD Attribute;
     PNTFS_ATTRIBUTE_LIST_ITEM AttrListItem;
 
-    DPRINT("FindAttribute(%p, %p, 0x%x, %S, %lu, %p, %p)\n", Vcb, MftRecord, Type, Name, NameLength, AttrCtx, Offset);
+    DPRINT("FindAttribute(%p, %p, %I64u, 0x%x, %S, %lu, %p, %p)\n", Vcb, MftRecord, MFTIndex, Type, Name, NameLength, AttrCtx, Offset);
 
     Found = FALSE;
     Status = FindFirstAttribute(&Context, Vcb, MftRecord, FALSE, &Attribute);
@@ -172,7 +178,7 @@ FindAttribute(PDEVICE_EXTENSION Vcb,
                 DPRINT("Found context\n");
                 *AttrCtx = PrepareAttributeContext(Attribute);
 
-                (*AttrCtx)->FileMFTIndex = MftRecord->MFTRecordNumber;
+                (*AttrCtx)->FileMFTIndex = MFTIndex;
 
                 if (Offset != NULL)
                     *Offset = Context.Offset;
@@ -210,10 +216,10 @@ FindAttribute(PDEVICE_EXTENSION Vcb,
             if (Found == TRUE)
             {
                 /* Get the MFT Index of attribute */
-                ULONGLONG MftIndex;
+                ULONGLONG RemoteMFTIndex;
                 PFILE_RECORD_HEADER RemoteHdr;
 
-                MftIndex = AttrListItem->MFTIndex & NTFS_MFT_MASK;
+                RemoteMFTIndex = AttrListItem->MFTIndex & NTFS_MFT_MASK;
                 RemoteHdr = ExAllocateFromNPagedLookasideList(&Vcb->FileRecLookasideList);
 
                 if (RemoteHdr == NULL)
@@ -223,7 +229,7 @@ FindAttribute(PDEVICE_EXTENSION Vcb,
                 }
 
                 /* Check we are not reading ourselves */
-                if (MftRecord->MFTRecordNumber == MftIndex)
+                if (MFTIndex == RemoteMFTIndex)
                 {
                     DPRINT1("Attribute list references missing attribute to this file entry !");
                     ExFreeToNPagedLookasideList(&Vcb->FileRecLookasideList, RemoteHdr);
@@ -231,8 +237,8 @@ FindAttribute(PDEVICE_EXTENSION Vcb,
                     return STATUS_OBJECT_NAME_NOT_FOUND;
                 }
                 /* Read the new file record */
-                ReadFileRecord(Vcb, MftIndex, RemoteHdr);
-                Status = FindAttribute(Vcb, RemoteHdr, Type, Name, NameLength, AttrCtx, Offset);
+                ReadFileRecord(Vcb, RemoteMFTIndex, RemoteHdr);
+                Status = FindAttribute(Vcb, RemoteHdr, RemoteMFTIndex, Type, Name, NameLength, AttrCtx, Offset);
                 ExFreeToNPagedLookasideList(&Vcb->FileRecLookasideList, RemoteHdr);
                 FindCloseAttribute(&Context);
                 return Status;
@@ -329,7 +335,7 @@ IncreaseMftSize(PDEVICE_EXTENSION Vcb, BOOLEAN CanWait)
     BlankFileRecord->Flags = 0;
 
     // Find the bitmap attribute of master file table
-    Status = FindAttribute(Vcb, Vcb->MasterFileTable, AttributeBitmap, L"", 0, &BitmapContext, NULL);
+    Status = FindAttribute(Vcb, Vcb->MasterFileTable, NTFS_FILE_MFT, AttributeBitmap, L"", 0, &BitmapContext, NULL);
     if (!NT_SUCCESS(Status))
     {
         DPRINT1("ERROR: Couldn't find $BITMAP attribute of Mft!\n");
@@ -403,7 +409,7 @@ IncreaseMftSize(PDEVICE_EXTENSION Vcb, BOOLEAN CanWait)
 
     // We'll need to find the bitmap again, because its offset will have changed after resizing the data attribute
     ReleaseAttributeContext(BitmapContext);
-    Status = FindAttribute(Vcb, Vcb->MasterFileTable, AttributeBitmap, L"", 0, &BitmapContext, &BitmapOffset);
+    Status = FindAttribute(Vcb, Vcb->MasterFileTable, NTFS_FILE_MFT, AttributeBitmap, L"", 0, &BitmapContext, &BitmapOffset);
     if (!NT_SUCCESS(Status))
     {
         DPRINT1("ERROR: Couldn't find $BITMAP attribute of Mft!\n");
@@ -1374,6 +1380,7 @@ WriteAttribute(PDEVICE_EXTENSION Vcb,
 
         // find where to write the attribute data to
         Status = FindAttribute(Vcb, FileRecord,
+                               Context->FileMFTIndex,
                                Context->pRecord->Type,
                                (PCWSTR)((ULONG_PTR)Context->pRecord + Context->pRecord->NameOffset),
                                Context->pRecord->NameLength,
@@ -1624,6 +1631,12 @@ Cleanup:
     if (Context->pRecord->IsNonResident)
         ExFreePoolWithTag(TempBuffer, TAG_NTFS);
 
+    // Drop the cached copies of the records we've overwritten
+    if (Context == Vcb->MFTContext)
+        InvalidateCachedRecords(Vcb, NTFS_FILE_MFT, Offset, *RealLengthWritten);
+    else if (Context->pRecord->Type == AttributeIndexAllocation)
+        InvalidateCachedRecords(Vcb, Context->FileMFTIndex, Offset, *RealLengthWritten);
+
     return Status;
 }
 
@@ -1632,20 +1645,15 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
                ULONGLONG index,
                PFILE_RECORD_HEADER file)
 {
-    ULONGLONG BytesRead;
-
     DPRINT("ReadFileRecord(%p, %I64x, %p)\n", Vcb, index, file);
 
-    BytesRead = ReadAttribute(Vcb, Vcb->MFTContext, index * Vcb->NtfsInfo.BytesPerFileRecord, (PCHAR)file, Vcb->NtfsInfo.BytesPerFileRecord);
-    if (BytesRead != Vcb->NtfsInfo.BytesPerFileRecord)
-    {
-        DPRINT1("ReadFileRecord failed: %I64u read, %lu expected\n", BytesRead, Vcb->NtfsInfo.BytesPerFileRecord);
-        return STATUS_PARTIAL_COPY;
-    }
-
-    /* Apply update sequence array fixups. */
-    DPRINT("Sequence number: %u\n", file->SequenceNumber);
-    return FixupUpdateSequenceArray(Vcb, &file->Ntfs);
+    /* File records are cached with their update sequence array fixups applied */
+    return ReadCachedRecord(Vcb,
+                            Vcb->MFTContext,
+                            NTFS_FILE_MFT,
+                            index * Vcb->NtfsInfo.BytesPerFileRecord,
+                            &file->Ntfs,
+                            Vcb->NtfsInfo.BytesPerFileRecord);
 }
 
 
@@ -1696,7 +1704,7 @@ UpdateFileNameRecord(PDEVICE_EXTENSION Vcb,
     }
 
     ASSERT(MftRecord->Ntfs.Type == NRH_FILE_TYPE);
-    Status = FindAttribute(Vcb, MftRecord, AttributeIndexRoot, L"$I30", 4, &IndexRootCtx, NULL);
+    Status = FindAttribute(Vcb, MftRecord, ParentMFTIndex, AttributeIndexRoot, L"$I30", 4, &IndexRootCtx, NULL);
     if (!NT_SUCCESS(Status))
     {
         ExFreeToNPagedLookasideList(&Vcb->FileRecLookasideList, MftRecord);
@@ -1730,6 +1738,7 @@ UpdateFileNameRecord(PDEVICE_EXTENSION Vcb,
 
     Status = UpdateIndexEntryFileNameSize(Vcb,
                                           MftRecord,
+                                          ParentMFTIndex,
                                           IndexRecord,
                                           IndexRoot->SizeOfEntry,
                                           IndexEntry,
@@ -1769,6 +1778,7 @@ UpdateFileNameRecord(PDEVICE_EXTENSION Vcb,
 NTSTATUS
 UpdateIndexEntryFileNameSize(PDEVICE_EXTENSION Vcb,
                              PFILE_RECORD_HEADER MftRecord,
+                             ULONGLONG MFTIndex,
                              PCHAR IndexRecord,
                              ULONG IndexBlockSize,
                              PINDEX_ENTRY_ATTRIBUTE FirstEntry,
@@ -1788,9 +1798,10 @@ UpdateIndexEntryFileNameSize(PDEVICE_EXTENSION Vcb,
     ULONGLONG IndexAllocationSize;
     PINDEX_BUFFER IndexBuffer;
 
-    DPRINT("UpdateIndexEntrySize(%p, %p, %p, %lu, %p, %p, %wZ, %lu, %lu, %s, %I64u, %I64u, %s)\n",
+    DPRINT("UpdateIndexEntrySize(%p, %p, %I64u, %p, %lu, %p, %p, %wZ, %lu, %lu, %s, %I64u, %I64u, %s)\n",
            Vcb,
            MftRecord,
+           MFTIndex,
            IndexRecord,
            IndexBlockSize,
            FirstEntry,
@@ -1837,7 +1848,7 @@ UpdateIndexEntryFileNameSize(PDEVICE_EXTENSION Vcb,
         return STATUS_OBJECT_PATH_NOT_FOUND;
     }
 
-    Status = FindAttribute(Vcb, MftRecord, AttributeIndexAllocation, L"$I30", 4, &IndexAllocationCtx, NULL);
+    Status = FindAttribute(Vcb, MftRecord, MFTIndex, AttributeIndexAllocation, L"$I30", 4, &IndexAllocationCtx, NULL);
     if (!NT_SUCCESS(Status))
     {
         DPRINT("Corrupted filesystem!\n");
@@ -1848,8 +1859,12 @@ UpdateIndexEntryFileNameSize(PDEVICE_EXTENSION Vcb,
     Status = STATUS_OBJECT_PATH_NOT_FOUND;
     for (RecordOffset = 0; RecordOffset < IndexAllocationSize; RecordOffset += IndexBlockSize)
     {
-        ReadAttribute(Vcb, IndexAllocationCtx, RecordOffset, IndexRecord, IndexBlockSize);
-        Status = FixupUpdateSequenceArray(Vcb, &((PFILE_RECORD_HEADER)IndexRecord)->Ntfs);
+        Status = ReadCachedRecord(Vcb,
+                                  IndexAllocationCtx,
+                                  IndexAllocationCtx->FileMFTIndex,
+                                  RecordOffset,
+                                  &((PFILE_RECORD_HEADER)IndexRecord)->Ntfs,
+                                  IndexBlockSize);
         if (!NT_SUCCESS(Status))
         {
             break;
@@ -1864,6 +1879,7 @@ UpdateIndexEntryFileNameSize(PDEVICE_EXTENSION Vcb,
 
         Status = UpdateIndexEntryFileNameSize(NULL,
                                               NULL,
+                                              0,
                                               NULL,
                                               0,
                                               FirstEntry,
@@ -1957,6 +1973,16 @@ UpdateFileRecord(PDEVICE_EXTENSION Vcb,
     // remove the fixup array (so the file record pointer can still be used)
     FixupUpdateSequenceArray(Vcb, &FileRecord->Ntfs);
 
+    // and keep what we've just written for the next reader
+    if (NT_SUCCESS(Status))
+    {
+        UpdateCachedRecord(Vcb,
+                           NTFS_FILE_MFT,
+                           MftIndex * Vcb->NtfsInfo.BytesPerFileRecord,
+                           &FileRecord->Ntfs,
+                           Vcb->NtfsInfo.BytesPerFileRecord);
+    }
+
     return Status;
 }
 
@@ -2041,7 +2067,7 @@ AddNewMftEntry(PFILE_RECORD_HEADER FileRecord,
     // First, we have to read the mft's $Bitmap attribute
 
     // Find the attribute
-    Status = FindAttribute(DeviceExt, DeviceExt->MasterFileTable, AttributeBitmap, L"", 0, &BitmapContext, NULL);
+    Status = FindAttribute(DeviceExt, DeviceExt->MasterFileTable, NTFS_FILE_MFT, AttributeBitmap, L"", 0, &BitmapContext, NULL);
     if (!NT_SUCCESS(Status))
     {
         DPRINT1("ERROR: Couldn't find $Bitmap attribute of master file table!\n");
@@ -2240,6 +2266,7 @@ NtfsAddFilenameToDirectory(PDEVICE_EXTENSION DeviceExt,
     // Find the index root attribute for the directory
     Status = FindAttribute(DeviceExt,
                            ParentFileRecord,
+                           DirectoryMftIndex,
                            AttributeIndexRoot,
                            L"$I30",
                            4,
@@ -2389,7 +2416,7 @@ NtfsAddFilenameToDirectory(PDEVICE_EXTENSION DeviceExt,
     }
 
     // Update the index allocation
-    Status = UpdateIndexAllocation(DeviceExt, NewTree, I30IndexRoot->SizeOfEntry, ParentFileRecord);
+    Status = UpdateIndexAllocation(DeviceExt, NewTree, I30IndexRoot->SizeOfEntry, ParentFileRecord, DirectoryMftIndex);
     if (!NT_SUCCESS(Status))
     {
         DPRINT1("ERROR: Failed to update index allocation from B-Tree!\n");
@@ -2450,7 +2477,7 @@ NtfsAddFilenameToDirectory(PDEVICE_EXTENSION DeviceExt,
         }
 
         // We need to update the index allocation once more
-        Status = UpdateIndexAllocation(DeviceExt, NewTree, I30IndexRoot->SizeOfEntry, ParentFileRecord);
+        Status = UpdateIndexAllocation(DeviceExt, NewTree, I30IndexRoot->SizeOfEntry, ParentFileRecord, DirectoryMftIndex);
         if (!NT_SUCCESS(Status))
         {
             DPRINT1("ERROR: Failed to update index allocation from B-Tree!\n");
@@ -2740,7 +2767,7 @@ UpdateMftMirror(PNTFS_VCB Vcb)
     }
 
     // Find the $DATA attribute of $MFTMirr
-    Status = FindAttribute(Vcb, MirrorFileRecord, AttributeData, L"", 0, &MirrDataContext, NULL);
+    Status = FindAttribute(Vcb, MirrorFileRecord, NTFS_FILE_MFTMIRR, AttributeData, L"", 0, &MirrDataContext, NULL);
     if (!NT_SUCCESS(Status))
     {
         DPRINT1("ERROR: Couldn't find $DATA attribute!\n");
@@ -2749,7 +2776,7 @@ UpdateMftMirror(PNTFS_VCB Vcb)
     }
 
     // Find the $DATA attribute of $MFT
-    Status = FindAttribute(Vcb, Vcb->MasterFileTable, AttributeData, L"", 0, &MftDataContext, NULL);
+    Status = FindAttribute(Vcb, Vcb->MasterFileTable, NTFS_FILE_MFT, AttributeData, L"", 0, &MftDataContext, NULL);
     if (!NT_SUCCESS(Status))
     {
         DPRINT1("ERROR: Couldn't find $DATA attribute!\n");
@@ -2851,7 +2878,6 @@ BrowseSubNodeIndexEntries(PNTFS_VCB Vcb,
 {
     PINDEX_BUFFER IndexRecord;
     ULONGLONG Offset;
-    ULONG BytesRead;
     PINDEX_ENTRY_ATTRIBUTE FirstEntry;
     PINDEX_ENTRY_ATTRIBUTE LastEntry;
     PINDEX_ENTRY_ATTRIBUTE IndexEntry;
@@ -2894,27 +2920,23 @@ BrowseSubNodeIndexEntries(PNTFS_VCB Vcb,
     // Calculate offset of index record
     Offset = VCN * Vcb->NtfsInfo.BytesPerCluster;
 
-    // Read the index record
-    BytesRead = ReadAttribute(Vcb, IndexAllocationContext, Offset, (PCHAR)IndexRecord, IndexBlockSize);
-    if (BytesRead != IndexBlockSize)
+    // Read the index record, with the fixup array applied
+    Status = ReadCachedRecord(Vcb,
+                              IndexAllocationContext,
+                              IndexAllocationContext->FileMFTIndex,
+                              Offset,
+                              &IndexRecord->Ntfs,
+                              IndexBlockSize);
+    if (!NT_SUCCESS(Status))
     {
-        DPRINT1("Unable to read index record!\n");
         ExFreePoolWithTag(IndexRecord, TAG_NTFS);
-        return STATUS_UNSUCCESSFUL;
+        DPRINT1("Unable to read index record!\n");
+        return Status;
     }
 
     // Assert that we're dealing with an index record here
     ASSERT(IndexRecord->Ntfs.Type == NRH_INDX_TYPE);
 
-    // Apply the fixup array to the index record
-    Status = FixupUpdateSequenceArray(Vcb, &((PFILE_RECORD_HEADER)IndexRecord)->Ntfs);
-    if (!NT_SUCCESS(Status))
-    {
-        ExFreePoolWithTag(IndexRecord, TAG_NTFS);
-        DPRINT1("Failed to apply fixup array!\n");
-        return Status;
-    }
-
     ASSERT(IndexRecord->Header.AllocatedSize + FIELD_OFFSET(INDEX_BUFFER, Header) == IndexBlockSize);
     FirstEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)&IndexRecord->Header + IndexRecord->Header.FirstEntryOffset);
     LastEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)&IndexRecord->Header + IndexRecord->Header.TotalSizeOfEntries);
@@ -2983,6 +3005,7 @@ BrowseSubNodeIndexEntries(PNTFS_VCB Vcb,
 NTSTATUS
 BrowseIndexEntries(PDEVICE_EXTENSION Vcb,
                    PFILE_RECORD_HEADER MftRecord,
+                   ULONGLONG MFTIndex,
                    PINDEX_ROOT_ATTRIBUTE IndexRecord,
                    ULONG IndexBlockSize,
                    PINDEX_ENTRY_ATTRIBUTE FirstEntry,
@@ -3002,9 +3025,10 @@ BrowseIndexEntries(PDEVICE_EXTENSION Vcb,
     ULONG *BitmapPtr;
     RTL_BITMAP  Bitmap;
 
-    DPRINT("BrowseIndexEntries(%p, %p, %p, %lu, %p, %p, %wZ, %lu, %lu, %s, %s, %p)\n",
+    DPRINT("BrowseIndexEntries(%p, %p, %I64u, %p, %lu, %p, %p, %wZ, %lu, %lu, %s, %s, %p)\n",
            Vcb,
            MftRecord,
+           MFTIndex,
            IndexRecord,
            IndexBlockSize,
            FirstEntry,
@@ -3017,12 +3041,12 @@ BrowseIndexEntries(PDEVICE_EXTENSION Vcb,
            OutMFTIndex);
 
     // Find the $I30 index allocation, if there is one
-    Status = FindAttribute(Vcb, MftRecord, AttributeIndexAllocation, L"$I30", 4, &IndexAllocationContext, NULL);
+    Status = FindAttribute(Vcb, MftRecord, MFTIndex, AttributeIndexAllocation, L"$I30", 4, &IndexAllocationContext, NULL);
     if (NT_SUCCESS(Status))
     {
         ULONGLONG BitmapLength;
         // Find the bitmap attribute for the index
-        Status = FindAttribute(Vcb, MftRecord, AttributeBitmap, L"$I30", 4, &BitmapContext, NULL);
+        Status = FindAttribute(Vcb, MftRecord, MFTIndex, AttributeBitmap, L"$I30", 4, &BitmapContext, NULL);
         if (!NT_SUCCESS(Status))
         {
             DPRINT1("Potential file system corruption detected!\n");
@@ -3142,6 +3166,258 @@ BrowseIndexEntries(PDEVICE_EXTENSION Vcb,
     return STATUS_OBJECT_PATH_NOT_FOUND;
 }
 
+/**
+* @name CollateFileName
+* @implemented
+*
+* Compares a file name with the name of an index entry, in the order the entries
+* of a $I30 index are sorted in: names are upcased with the $UpCase table of the
+* volume and compared code unit by code unit, a shorter name sorting first.
+*
+* @returns
+* 0 if the names are equal, < 0 if FileName sorts before the entry, > 0 if it sorts after.
+* The end entry of a node sorts after any name.
+*/
+static
+LONG
+CollateFileName(PDEVICE_EXTENSION Vcb,
+                PUNICODE_STRING FileName,
+                PINDEX_ENTRY_ATTRIBUTE IndexEntry)
+{
+    ULONG FileNameLength, EntryNameLength, i;
+    WCHAR FileNameChar, EntryNameChar;
+
+    if (IndexEntry->Flags & NTFS_INDEX_ENTRY_END)
+        return -1;
+
+    FileNameLength = FileName->Length / sizeof(WCHAR);
+    EntryNameLength = IndexEntry->FileName.NameLength;
+
+    for (i = 0; i < min(FileNameLength, EntryNameLength); i++)
+    {
+        FileNameChar = FileName->Buffer[i];
+        if (FileNameChar < Vcb->UpcaseTableLength)
+            FileNameChar = Vcb->UpcaseTable[FileNameChar];
+
+        EntryNameChar = IndexEntry->FileName.Name[i];
+        if (EntryNameChar < Vcb->UpcaseTableLength)
+            EntryNameChar = Vcb->UpcaseTable[EntryNameChar];
+
+        if (FileNameChar != EntryNameChar)
+            return (LONG)FileNameChar - (LONG)EntryNameChar;
+    }
+
+    return (LONG)FileNameLength - (LONG)EntryNameLength;
+}
+
+static
+NTSTATUS
+SearchIndexNode(PDEVICE_EXTENSION Vcb,
+                PNTFS_ATTR_CONTEXT IndexAllocationContext,
+                ULONG IndexBlockSize,
+                PINDEX_ENTRY_ATTRIBUTE FirstEntry,
+                PINDEX_ENTRY_ATTRIBUTE LastEntry,
+                PUNICODE_STRING FileName,
+                BOOLEAN CaseSensitive,
+                ULONGLONG *OutMFTIndex);
+
+static
+NTSTATUS
+SearchSubNodeIndexEntries(PDEVICE_EXTENSION Vcb,
+                          PNTFS_ATTR_CONTEXT IndexAllocationContext,
+                          ULONG IndexBlockSize,
+                          ULONGLONG VCN,
+                          PUNICODE_STRING FileName,
+                          BOOLEAN CaseSensitive,
+                          ULONGLONG *OutMFTIndex)
+{
+    PINDEX_BUFFER IndexBuffer;
+    PINDEX_ENTRY_ATTRIBUTE FirstEntry, LastEntry;
+    NTSTATUS Status;
+
+    IndexBuffer = ExAllocatePoolWithTag(NonPagedPool, IndexBlockSize, TAG_NTFS);
+    if (!IndexBuffer)
+    {
+        DPRINT1("Unable to allocate memory for index record!\n");
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Status = ReadCachedRecord(Vcb,
+                              IndexAllocationContext,
+                              IndexAllocationContext->FileMFTIndex,
+                              GetAllocationOffsetFromVCN(Vcb, IndexBlockSize, VCN),
+                              &IndexBuffer->Ntfs,
+                              IndexBlockSize);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Unable to read index record!\n");
+        ExFreePoolWithTag(IndexBuffer, TAG_NTFS);
+        return Status;
+    }
+
+    if (IndexBuffer->Ntfs.Type != NRH_INDX_TYPE ||
+        IndexBuffer->VCN != VCN ||
+        IndexBuffer->Header.TotalSizeOfEntries > IndexBlockSize - FIELD_OFFSET(INDEX_BUFFER, Header))
+    {
+        DPRINT1("File system corruption detected in index node with VCN %I64u\n", VCN);
+        ExFreePoolWithTag(IndexBuffer, TAG_NTFS);
+        return STATUS_DATA_ERROR;
+    }
+
+    FirstEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)&IndexBuffer->Header + IndexBuffer->Header.FirstEntryOffset);
+    LastEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)&IndexBuffer->Header + IndexBuffer->Header.TotalSizeOfEntries);
+
+    Status = SearchIndexNode(Vcb,
+                             IndexAllocationContext,
+                             IndexBlockSize,
+                             FirstEntry,
+                             LastEntry,
+                             FileName,
+                             CaseSensitive,
+                             OutMFTIndex);
+
+    ExFreePoolWithTag(IndexBuffer, TAG_NTFS);
+
+    return Status;
+}
+
+/**
+* @name SearchIndexNode
+* @implemented
+*
+* Looks for a file name in a node of a $I30 index, and in the nodes below it.
+*
+* Entries are sorted, so only the sub-node in front of the first entry that doesn't
+* sort before FileName has to be looked at, instead of every entry of the directory.
+* Names that only differ in case sort as equal; when looking for a case-sensitive
+* match, each of them (and the sub-nodes in front of them) is checked in turn.
+*/
+static
+NTSTATUS
+SearchIndexNode(PDEVICE_EXTENSION Vcb,
+                PNTFS_ATTR_CONTEXT IndexAllocationContext,
+                ULONG IndexBlockSize,
+                PINDEX_ENTRY_ATTRIBUTE FirstEntry,
+                PINDEX_ENTRY_ATTRIBUTE LastEntry,
+                PUNICODE_STRING FileName,
+                BOOLEAN CaseSensitive,
+                ULONGLONG *OutMFTIndex)
+{
+    PINDEX_ENTRY_ATTRIBUTE IndexEntry;
+    LONG Comparison;
+    NTSTATUS Status;
+
+    for (IndexEntry = FirstEntry;
+         IndexEntry <= LastEntry;
+         IndexEntry = (PINDEX_ENTRY_ATTRIBUTE)((PCHAR)IndexEntry + IndexEntry->Length))
+    {
+        if (IndexEntry->Length < sizeof(INDEX_ENTRY_ATTRIBUTE) &&
+            !(IndexEntry->Flags & NTFS_INDEX_ENTRY_END))
+        {
+            DPRINT1("File system corruption detected, index entry of length %u\n", IndexEntry->Length);
+            return STATUS_DATA_ERROR;
+        }
+
+        Comparison = CollateFileName(Vcb, FileName, IndexEntry);
+
+        // Is this the file we're looking for?
+        if (Comparison == 0 &&
+            (IndexEntry->Data.Directory.IndexedFile & NTFS_MFT_MASK) >= NTFS_FILE_FIRST_USER_FILE &&
+            IndexEntry->FileName.NameType != NTFS_FILE_NAME_DOS &&
+            CompareFileName(FileName, IndexEntry, FALSE, CaseSensitive))
+        {
+            *OutMFTIndex = (IndexEntry->Data.Directory.IndexedFile & NTFS_MFT_MASK);
+            return STATUS_SUCCESS;
+        }
+
+        // Anything sorting before this entry is in its sub-node
+        if (Comparison <= 0 && (IndexEntry->Flags & NTFS_INDEX_ENTRY_NODE))
+        {
+            if (!IndexAllocationContext)
+            {
+                DPRINT1("Filesystem corruption detected!\n");
+                return STATUS_DATA_ERROR;
+            }
+
+            Status = SearchSubNodeIndexEntries(Vcb,
+                                               IndexAllocationContext,
+                                               IndexBlockSize,
+                                               GetIndexEntryVCN(IndexEntry),
+                                               FileName,
+                                               CaseSensitive,
+                                               OutMFTIndex);
+            if (Status != STATUS_OBJECT_PATH_NOT_FOUND)
+                return Status;
+        }
+
+        // Past the name, it isn't in this directory
+        if (Comparison < 0)
+            break;
+    }
+
+    return STATUS_OBJECT_PATH_NOT_FOUND;
+}
+
+/**
+* @name SearchIndexEntries
+* @implemented
+*
+* Looks up a file name in a directory by walking down its $I30 B+tree, rather
+* than going through all of its entries like BrowseIndexEntries() does.
+*
+* @remarks
+* The index is sorted with the $UpCase table of the volume, so this can only be used
+* once that table has been read (Vcb->UpcaseTable isn't NULL).
+*/
+static
+NTSTATUS
+SearchIndexEntries(PDEVICE_EXTENSION Vcb,
+                   PFILE_RECORD_HEADER MftRecord,
+                   ULONGLONG MFTIndex,
+                   PINDEX_ROOT_ATTRIBUTE IndexRoot,
+                   PINDEX_ENTRY_ATTRIBUTE FirstEntry,
+                   PINDEX_ENTRY_ATTRIBUTE LastEntry,
+                   PUNICODE_STRING FileName,
+                   BOOLEAN CaseSensitive,
+                   ULONGLONG *OutMFTIndex)
+{
+    PNTFS_ATTR_CONTEXT IndexAllocationContext = NULL;
+    NTSTATUS Status;
+
+    DPRINT("SearchIndexEntries(%p, %p, %I64u, %p, %wZ, %s, %p)\n",
+           Vcb,
+           MftRecord,
+           MFTIndex,
+           IndexRoot,
+           FileName,
+           CaseSensitive ? "TRUE" : "FALSE",
+           OutMFTIndex);
+
+    if (IndexRoot->Header.Flags & INDEX_ROOT_LARGE)
+    {
+        Status = FindAttribute(Vcb, MftRecord, MFTIndex, AttributeIndexAllocation, L"$I30", 4, &IndexAllocationContext, NULL);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Potential file system corruption detected!\n");
+            return Status;
+        }
+    }
+
+    Status = SearchIndexNode(Vcb,
+                             IndexAllocationContext,
+                             IndexRoot->SizeOfEntry,
+                             FirstEntry,
+                             LastEntry,
+                             FileName,
+                             CaseSensitive,
+                             OutMFTIndex);
+
+    if (IndexAllocationContext)
+        ReleaseAttributeContext(IndexAllocationContext);
+
+    return Status;
+}
+
 NTSTATUS
 NtfsFindMftRecord(PDEVICE_EXTENSION Vcb,
                   ULONGLONG MFTIndex,
@@ -3182,7 +3458,7 @@ NtfsFindMftRecord(PDEVICE_EXTENSION Vcb,
     }
 
     ASSERT(MftRecord->Ntfs.Type == NRH_FILE_TYPE);
-    Status = FindAttribute(Vcb, MftRecord, AttributeIndexRoot, L"$I30", 4, &IndexRootCtx, NULL);
+    Status = FindAttribute(Vcb, MftRecord, MFTIndex, AttributeIndexRoot, L"$I30", 4, &IndexRootCtx, NULL);
     if (!NT_SUCCESS(Status))
     {
         ExFreeToNPagedLookasideList(&Vcb->FileRecLookasideList, MftRecord);
@@ -3206,8 +3482,27 @@ NtfsFindMftRecord(PDEVICE_EXTENSION Vcb,
 
     DPRINT("IndexRecordSize: %x IndexBlockSize: %x\n", Vcb->NtfsInfo.BytesPerIndexRecord, IndexRoot->SizeOfEntry);
 
+    // Looking for a given name: walk down the index instead of enumerating it
+    if (!DirSearch && *FirstEntry == 0 && Vcb->UpcaseTable != NULL)
+    {
+        Status = SearchIndexEntries(Vcb,
+                                    MftRecord,
+                                    MFTIndex,
+                                    IndexRoot,
+                                    IndexEntry,
+                                    IndexEntryEnd,
+                                    FileName,
+                                    CaseSensitive,
+                                    OutMFTIndex);
+
+        ExFreePoolWithTag(IndexRecord, TAG_NTFS);
+        ExFreeToNPagedLookasideList(&Vcb->FileRecLookasideList, MftRecord);
+        return Status;
+    }
+
     Status = BrowseIndexEntries(Vcb,
                                 MftRecord,
+                                MFTIndex,
                                 (PINDEX_ROOT_ATTRIBUTE)IndexRecord,
                                 IndexRoot->SizeOfEntry,
                                 IndexEntry,
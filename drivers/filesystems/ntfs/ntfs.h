@@ -15,6 +15,7 @@
 #define TAG_IRP_CTXT 'iftN'
 #define TAG_ATT_CTXT 'aftN'
 #define TAG_FILE_REC 'rftN'
+#define TAG_REC_CACHE 'cftN'
 
 #define ROUND_UP(N, S) ((((N) + (S) - 1) / (S)) * (S))
 #define ROUND_DOWN(N, S) ((N) - ((N) % (S)))
@@ -96,6 +97,23 @@ typedef struct
     ULONG Size;
 } NTFSIDENTIFIER, *PNTFSIDENTIFIER;
 
+#define NTFS_RECORD_CACHE_BUCKETS   256
+#define NTFS_RECORD_CACHE_SIZE      (2 * 1024 * 1024)
+#define NTFS_RECORD_CACHE_ALIGNMENT 512
+
+/* Fixed up copies of MFT records and index buffers, see reccache.c */
+typedef struct _NTFS_RECORD_CACHE
+{
+    FAST_MUTEX Lock;
+    PLIST_ENTRY Buckets;
+    LIST_ENTRY LruListHead;
+    ULONG Generation;
+    ULONG Size;
+    ULONG MaxRecordSize;
+    ULONG Hits;
+    ULONG Misses;
+} NTFS_RECORD_CACHE, *PNTFS_RECORD_CACHE;
+
 typedef struct
 {
     NTFSIDENTIFIER Identifier;
@@ -117,6 +135,10 @@ typedef struct
     NTFS_INFO NtfsInfo;
 
     NPAGED_LOOKASIDE_LIST FileRecLookasideList;
+    NTFS_RECORD_CACHE RecordCache;
+
+    PWCHAR UpcaseTable;
+    ULONG UpcaseTableLength;
 
     ULONG MftDataOffset;
     ULONG Flags;
@@ -822,7 +844,8 @@ NTSTATUS
 UpdateIndexAllocation(PDEVICE_EXTENSION DeviceExt,
                       PB_TREE Tree,
                       ULONG IndexBufferSize,
-                      PFILE_RECORD_HEADER FileRecord);
+                      PFILE_RECORD_HEADER FileRecord,
+                      ULONGLONG MFTIndex);
 
 NTSTATUS
 UpdateIndexNode(PDEVICE_EXTENSION DeviceExt,
@@ -879,6 +902,7 @@ NtfsDeviceControl(PNTFS_IRP_CONTEXT IrpContext);
 ULONGLONG
 NtfsGetFileSize(PDEVICE_EXTENSION DeviceExt,
                 PFILE_RECORD_HEADER FileRecord,
+                ULONGLONG MFTIndex,
                 PCWSTR Stream,
                 ULONG StreamLength,
                 PULONGLONG AllocatedSize);
@@ -1018,6 +1042,9 @@ NtfsSetInformation(PNTFS_IRP_CONTEXT IrpContext);
 NTSTATUS
 NtfsFileSystemControl(PNTFS_IRP_CONTEXT IrpContext);
 
+VOID
+NtfsUninitializeVcb(PNTFS_VCB Vcb);
+
 
 /* mft.c */
 NTSTATUS
@@ -1121,6 +1148,7 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
 NTSTATUS
 UpdateIndexEntryFileNameSize(PDEVICE_EXTENSION Vcb,
                              PFILE_RECORD_HEADER MftRecord,
+                             ULONGLONG MFTIndex,
                              PCHAR IndexRecord,
                              ULONG IndexBlockSize,
                              PINDEX_ENTRY_ATTRIBUTE FirstEntry,
@@ -1150,6 +1178,7 @@ UpdateFileRecord(PDEVICE_EXTENSION Vcb,
 NTSTATUS
 FindAttribute(PDEVICE_EXTENSION Vcb,
               PFILE_RECORD_HEADER MftRecord,
+              ULONGLONG MFTIndex,
               ULONG Type,
               PCWSTR Name,
               ULONG NameLength,
@@ -1253,6 +1282,35 @@ NtfsFileFlagsToAttributes(ULONG NtfsAttributes,
                           PULONG FileAttributes);
 
 
+/* reccache.c */
+
+NTSTATUS
+NtfsInitializeRecordCache(PDEVICE_EXTENSION Vcb);
+
+VOID
+NtfsUninitializeRecordCache(PDEVICE_EXTENSION Vcb);
+
+NTSTATUS
+ReadCachedRecord(PDEVICE_EXTENSION Vcb,
+                 PNTFS_ATTR_CONTEXT Context,
+                 ULONGLONG FileMFTIndex,
+                 ULONGLONG Offset,
+                 PNTFS_RECORD_HEADER Record,
+                 ULONG Size);
+
+VOID
+UpdateCachedRecord(PDEVICE_EXTENSION Vcb,
+                   ULONGLONG FileMFTIndex,
+                   ULONGLONG Offset,
+                   PNTFS_RECORD_HEADER Record,
+                   ULONG Size);
+
+VOID
+InvalidateCachedRecords(PDEVICE_EXTENSION Vcb,
+                        ULONGLONG FileMFTIndex,
+                        ULONGLONG Offset,
+                        ULONG Length);
+
 /* rw.c */
 
 NTSTATUS
@@ -0,0 +1,396 @@
+/*
+*  ReactOS kernel
+*  Copyright (C) 2002, 2017 ReactOS Team
+*
+*  This program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2 of the License, or
+*  (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software
+*  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*
+* COPYRIGHT:        See COPYING in the top level directory
+* PROJECT:          ReactOS kernel
+* FILE:             drivers/filesystem/ntfs/reccache.c
+* PURPOSE:          NTFS filesystem driver
+*/
+
+/* INCLUDES *****************************************************************/
+
+#include "ntfs.h"
+
+#define NDEBUG
+#include <debug.h>
+
+/* GLOBALS *****************************************************************/
+
+/*
+ * Every file record and directory index buffer the driver looks at used to be
+ * read from the disk and fixed up again, even when it had just been read for
+ * the previous lookup. The record cache keeps the fixed up copies around, keyed
+ * by the MFT index of the file owning the attribute and the offset of the
+ * record in it. File records belong to $MFT (NTFS_FILE_MFT) and index buffers
+ * to their directory, so both kinds share one set of buckets and one LRU list.
+ *
+ * WriteAttribute() drops whatever it overwrote. A reader that missed takes a
+ * snapshot of the generation before going to the disk and only inserts what it
+ * read if nothing was invalidated meanwhile, so it can't put back a stale copy.
+ */
+typedef struct _NTFS_RECORD_CACHE_ENTRY
+{
+    LIST_ENTRY HashLink;
+    LIST_ENTRY LruLink;
+    ULONGLONG FileMFTIndex;
+    ULONGLONG Offset;
+    ULONG Size;
+    UCHAR Data[ANYSIZE_ARRAY];
+} NTFS_RECORD_CACHE_ENTRY, *PNTFS_RECORD_CACHE_ENTRY;
+
+/* FUNCTIONS ****************************************************************/
+
+static
+PLIST_ENTRY
+RecordCacheBucket(PNTFS_RECORD_CACHE Cache,
+                  ULONGLONG FileMFTIndex,
+                  ULONGLONG Offset)
+{
+    ULONGLONG Hash;
+
+    Hash = (FileMFTIndex * 0x9E3779B97F4A7C15ULL) ^ (Offset >> 9);
+    Hash ^= Hash >> 32;
+    Hash ^= Hash >> 16;
+
+    return &Cache->Buckets[Hash % NTFS_RECORD_CACHE_BUCKETS];
+}
+
+static
+PNTFS_RECORD_CACHE_ENTRY
+FindCacheEntry(PNTFS_RECORD_CACHE Cache,
+               ULONGLONG FileMFTIndex,
+               ULONGLONG Offset)
+{
+    PLIST_ENTRY Bucket, Current;
+    PNTFS_RECORD_CACHE_ENTRY Entry;
+
+    Bucket = RecordCacheBucket(Cache, FileMFTIndex, Offset);
+    for (Current = Bucket->Flink; Current != Bucket; Current = Current->Flink)
+    {
+        Entry = CONTAINING_RECORD(Current, NTFS_RECORD_CACHE_ENTRY, HashLink);
+        if (Entry->FileMFTIndex == FileMFTIndex && Entry->Offset == Offset)
+            return Entry;
+    }
+
+    return NULL;
+}
+
+static
+VOID
+RemoveCacheEntry(PNTFS_RECORD_CACHE Cache,
+                 PNTFS_RECORD_CACHE_ENTRY Entry)
+{
+    RemoveEntryList(&Entry->HashLink);
+    RemoveEntryList(&Entry->LruLink);
+    Cache->Size -= Entry->Size;
+}
+
+static
+VOID
+InsertCacheEntry(PNTFS_RECORD_CACHE Cache,
+                 ULONGLONG FileMFTIndex,
+                 ULONGLONG Offset,
+                 PNTFS_RECORD_HEADER Record,
+                 ULONG Size)
+{
+    PNTFS_RECORD_CACHE_ENTRY Entry, Reuse = NULL;
+
+    /* An existing copy is simply refreshed */
+    Entry = FindCacheEntry(Cache, FileMFTIndex, Offset);
+    if (Entry != NULL && Entry->Size == Size)
+    {
+        RtlCopyMemory(Entry->Data, Record, Size);
+        RemoveEntryList(&Entry->LruLink);
+        InsertHeadList(&Cache->LruListHead, &Entry->LruLink);
+        return;
+    }
+
+    if (Entry != NULL)
+    {
+        RemoveCacheEntry(Cache, Entry);
+        ExFreePoolWithTag(Entry, TAG_REC_CACHE);
+    }
+
+    /* Make room, keeping the last evicted entry if it has the right size */
+    while (Cache->Size + Size > NTFS_RECORD_CACHE_SIZE &&
+           !IsListEmpty(&Cache->LruListHead))
+    {
+        Entry = CONTAINING_RECORD(Cache->LruListHead.Blink, NTFS_RECORD_CACHE_ENTRY, LruLink);
+        RemoveCacheEntry(Cache, Entry);
+
+        if (Reuse != NULL)
+            ExFreePoolWithTag(Reuse, TAG_REC_CACHE);
+        Reuse = Entry;
+    }
+
+    if (Reuse != NULL && Reuse->Size == Size)
+    {
+        Entry = Reuse;
+    }
+    else
+    {
+        if (Reuse != NULL)
+            ExFreePoolWithTag(Reuse, TAG_REC_CACHE);
+
+        Entry = ExAllocatePoolWithTag(PagedPool,
+                                      FIELD_OFFSET(NTFS_RECORD_CACHE_ENTRY, Data[Size]),
+                                      TAG_REC_CACHE);
+        if (Entry == NULL)
+            return;
+    }
+
+    Entry->FileMFTIndex = FileMFTIndex;
+    Entry->Offset = Offset;
+    Entry->Size = Size;
+    RtlCopyMemory(Entry->Data, Record, Size);
+    Cache->MaxRecordSize = max(Cache->MaxRecordSize, Size);
+
+    InsertHeadList(RecordCacheBucket(Cache, FileMFTIndex, Offset), &Entry->HashLink);
+    InsertHeadList(&Cache->LruListHead, &Entry->LruLink);
+    Cache->Size += Size;
+}
+
+NTSTATUS
+NtfsInitializeRecordCache(PDEVICE_EXTENSION Vcb)
+{
+    PNTFS_RECORD_CACHE Cache = &Vcb->RecordCache;
+    ULONG i;
+
+    Cache->Buckets = ExAllocatePoolWithTag(NonPagedPool,
+                                           NTFS_RECORD_CACHE_BUCKETS * sizeof(LIST_ENTRY),
+                                           TAG_REC_CACHE);
+    if (Cache->Buckets == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    for (i = 0; i < NTFS_RECORD_CACHE_BUCKETS; i++)
+        InitializeListHead(&Cache->Buckets[i]);
+
+    ExInitializeFastMutex(&Cache->Lock);
+    InitializeListHead(&Cache->LruListHead);
+    Cache->Generation = 0;
+    Cache->Size = 0;
+    Cache->MaxRecordSize = 0;
+    Cache->Hits = 0;
+    Cache->Misses = 0;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+NtfsUninitializeRecordCache(PDEVICE_EXTENSION Vcb)
+{
+    PNTFS_RECORD_CACHE Cache = &Vcb->RecordCache;
+    PNTFS_RECORD_CACHE_ENTRY Entry;
+
+    if (Cache->Buckets == NULL)
+        return;
+
+    DPRINT("Record cache: %lu hits, %lu misses\n", Cache->Hits, Cache->Misses);
+
+    while (!IsListEmpty(&Cache->LruListHead))
+    {
+        Entry = CONTAINING_RECORD(Cache->LruListHead.Flink, NTFS_RECORD_CACHE_ENTRY, LruLink);
+        RemoveCacheEntry(Cache, Entry);
+        ExFreePoolWithTag(Entry, TAG_REC_CACHE);
+    }
+
+    ExFreePoolWithTag(Cache->Buckets, TAG_REC_CACHE);
+    Cache->Buckets = NULL;
+}
+
+/**
+* @name ReadCachedRecord
+* @implemented
+*
+* Reads a multi-sector record (a file record or an index buffer) and applies its
+* update sequence array, using the copy kept in the record cache when there is one.
+*
+* @param Vcb
+* Pointer to the DEVICE_EXTENSION of the volume.
+*
+* @param Context
+* Attribute holding the record, used when it has to be read from disk.
+*
+* @param FileMFTIndex
+* Key the record is cached under: NTFS_FILE_MFT for file records, the MFT index of
+* the directory for index buffers.
+*
+* @param Offset
+* Offset of the record in the attribute.
+*
+* @param Record
+* Buffer receiving the fixed up record.
+*
+* @param Size
+* Size of the record, in bytes.
+*
+* @return
+* STATUS_SUCCESS if successful, STATUS_PARTIAL_COPY if the record couldn't be read
+* entirely, or the error returned by FixupUpdateSequenceArray().
+*
+*/
+NTSTATUS
+ReadCachedRecord(PDEVICE_EXTENSION Vcb,
+                 PNTFS_ATTR_CONTEXT Context,
+                 ULONGLONG FileMFTIndex,
+                 ULONGLONG Offset,
+                 PNTFS_RECORD_HEADER Record,
+                 ULONG Size)
+{
+    PNTFS_RECORD_CACHE Cache = &Vcb->RecordCache;
+    PNTFS_RECORD_CACHE_ENTRY Entry;
+    ULONG Generation = 0;
+    ULONG BytesRead;
+    NTSTATUS Status;
+
+    if (Cache->Buckets != NULL)
+    {
+        ExAcquireFastMutex(&Cache->Lock);
+
+        Entry = FindCacheEntry(Cache, FileMFTIndex, Offset);
+        if (Entry != NULL && Entry->Size == Size)
+        {
+            RtlCopyMemory(Record, Entry->Data, Size);
+            RemoveEntryList(&Entry->LruLink);
+            InsertHeadList(&Cache->LruListHead, &Entry->LruLink);
+            Cache->Hits++;
+            ExReleaseFastMutex(&Cache->Lock);
+            return STATUS_SUCCESS;
+        }
+
+        Cache->Misses++;
+        Generation = Cache->Generation;
+        ExReleaseFastMutex(&Cache->Lock);
+    }
+
+    BytesRead = ReadAttribute(Vcb, Context, Offset, (PCHAR)Record, Size);
+    if (BytesRead != Size)
+    {
+        DPRINT1("ReadCachedRecord failed: %lu read, %lu expected\n", BytesRead, Size);
+        return STATUS_PARTIAL_COPY;
+    }
+
+    Status = FixupUpdateSequenceArray(Vcb, Record);
+    if (!NT_SUCCESS(Status) || Cache->Buckets == NULL ||
+        (Offset % NTFS_RECORD_CACHE_ALIGNMENT) != 0)
+    {
+        return Status;
+    }
+
+    ExAcquireFastMutex(&Cache->Lock);
+    if (Cache->Generation == Generation)
+        InsertCacheEntry(Cache, FileMFTIndex, Offset, Record, Size);
+    ExReleaseFastMutex(&Cache->Lock);
+
+    return Status;
+}
+
+/**
+* @name UpdateCachedRecord
+* @implemented
+*
+* Replaces the cached copy of a record that has just been written to disk, so the
+* next reader doesn't have to read it back. Record must have its fixups applied.
+*/
+VOID
+UpdateCachedRecord(PDEVICE_EXTENSION Vcb,
+                   ULONGLONG FileMFTIndex,
+                   ULONGLONG Offset,
+                   PNTFS_RECORD_HEADER Record,
+                   ULONG Size)
+{
+    PNTFS_RECORD_CACHE Cache = &Vcb->RecordCache;
+
+    if (Cache->Buckets == NULL || (Offset % NTFS_RECORD_CACHE_ALIGNMENT) != 0)
+        return;
+
+    ExAcquireFastMutex(&Cache->Lock);
+    InsertCacheEntry(Cache, FileMFTIndex, Offset, Record, Size);
+    ExReleaseFastMutex(&Cache->Lock);
+}
+
+/**
+* @name InvalidateCachedRecords
+* @implemented
+*
+* Drops the cached records of FileMFTIndex overlapping the range
+* [Offset, Offset + Length). Called once the range has been written.
+*/
+VOID
+InvalidateCachedRecords(PDEVICE_EXTENSION Vcb,
+                        ULONGLONG FileMFTIndex,
+                        ULONGLONG Offset,
+                        ULONG Length)
+{
+    PNTFS_RECORD_CACHE Cache = &Vcb->RecordCache;
+    PNTFS_RECORD_CACHE_ENTRY Entry;
+    PLIST_ENTRY Current;
+    ULONGLONG Start, RecordOffset, End = Offset + Length;
+
+    if (Cache->Buckets == NULL || Length == 0)
+        return;
+
+    ExAcquireFastMutex(&Cache->Lock);
+
+    Cache->Generation++;
+
+    /*
+     * Records start on a sector boundary and are never larger than MaxRecordSize,
+     * so for a small write just look up every place one could start at.
+     */
+    Start = Offset & ~(ULONGLONG)(NTFS_RECORD_CACHE_ALIGNMENT - 1);
+    if (Cache->MaxRecordSize > NTFS_RECORD_CACHE_ALIGNMENT)
+    {
+        if (Start > Cache->MaxRecordSize - NTFS_RECORD_CACHE_ALIGNMENT)
+            Start -= Cache->MaxRecordSize - NTFS_RECORD_CACHE_ALIGNMENT;
+        else
+            Start = 0;
+    }
+
+    if ((End - Start) / NTFS_RECORD_CACHE_ALIGNMENT <= NTFS_RECORD_CACHE_BUCKETS)
+    {
+        for (RecordOffset = Start; RecordOffset < End; RecordOffset += NTFS_RECORD_CACHE_ALIGNMENT)
+        {
+            Entry = FindCacheEntry(Cache, FileMFTIndex, RecordOffset);
+            if (Entry != NULL && Entry->Offset + Entry->Size > Offset)
+            {
+                RemoveCacheEntry(Cache, Entry);
+                ExFreePoolWithTag(Entry, TAG_REC_CACHE);
+            }
+        }
+    }
+    else
+    {
+        for (Current = Cache->LruListHead.Flink; Current != &Cache->LruListHead; )
+        {
+            Entry = CONTAINING_RECORD(Current, NTFS_RECORD_CACHE_ENTRY, LruLink);
+            Current = Current->Flink;
+
+            if (Entry->FileMFTIndex == FileMFTIndex &&
+                Entry->Offset < End && Entry->Offset + Entry->Size > Offset)
+            {
+                RemoveCacheEntry(Cache, Entry);
+                ExFreePoolWithTag(Entry, TAG_REC_CACHE);
+            }
+        }
+    }
+
+    ExReleaseFastMutex(&Cache->Lock);
+}
+
+/* EOF */
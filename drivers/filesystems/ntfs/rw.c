@@ -102,7 +102,7 @@ NtfsReadFile(PDEVICE_EXTENSION DeviceExt,
     }
 
 
-    Status = FindAttribute(DeviceExt, FileRecord, AttributeData, Fcb->Stream, wcslen(Fcb->Stream), &DataContext, NULL);
+    Status = FindAttribute(DeviceExt, FileRecord, Fcb->MFTIndex, AttributeData, Fcb->Stream, wcslen(Fcb->Stream), &DataContext, NULL);
     if (!NT_SUCCESS(Status))
     {
         NTSTATUS BrowseStatus;
@@ -384,7 +384,7 @@ NTSTATUS NtfsWriteFile(PDEVICE_EXTENSION DeviceExt,
 
     // Find the attribute with the data stream for our file
     DPRINT("Finding Data Attribute...\n");
-    Status = FindAttribute(DeviceExt, FileRecord, AttributeData, Fcb->Stream, wcslen(Fcb->Stream), &DataContext,
+    Status = FindAttribute(DeviceExt, FileRecord, Fcb->MFTIndex, AttributeData, Fcb->Stream, wcslen(Fcb->Stream), &DataContext,
                            &AttributeOffset);
 
     // Did we fail to find the attribute?
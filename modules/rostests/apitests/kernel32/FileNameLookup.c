@@ -0,0 +1,313 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Tests for opening files by name in large directories
+ */
+
+#include "precomp.h"
+
+/*
+ * Enough files for the directory index not to fit in its root, with names in
+ * several scripts. File systems sorting their directories (NTFS) have to find
+ * every one of them, ASCII or not, whatever order their upcase table puts them in.
+ */
+static const PCWSTR Prefixes[] =
+{
+    L"file",
+    L"Zz",
+    L"_",
+    L"~",
+    L"\x00C9t\x00E9",               /* Latin-1 */
+    L"\x00DF",                      /* Sharp s */
+    L"\x0131i",                     /* Dotless i */
+    L"\x01C5",                      /* Title case DZ with caron */
+    L"\x0391\x03B2\x03B3",          /* Greek */
+    L"\x0416\x0438\x0437",          /* Cyrillic */
+    L"\x05D0\x05D1",                /* Hebrew */
+    L"\x4E2D\x6587",                /* CJK */
+    L"\xFF21\xFF42",                /* Fullwidth Latin */
+};
+
+/* The same names, in another case */
+static const PCWSTR OtherCasePrefixes[] =
+{
+    L"FILE",
+    L"zZ",
+    L"_",
+    L"~",
+    L"\x00E9T\x00C9",
+    L"\x00DF",
+    L"\x0131I",
+    L"\x01C5",
+    L"\x03B1\x0392\x0393",
+    L"\x0436\x0418\x0417",
+    L"\x05D0\x05D1",
+    L"\x4E2D\x6587",
+    L"\xFF41\xFF22",
+};
+
+static const PCWSTR MissingNames[] =
+{
+    L"file999",
+    L"filf0",
+    L"a",
+    L"\x00C9t\x00E9" L"999",
+    L"\x0416\x0438\x0437" L"999",
+    L"\x0416\x0438",
+    L"\x4E2D",
+    L"\xFF21\xFF42" L"999",
+    L"\xFFFD",
+};
+
+#define FILES_PER_PREFIX 50
+
+static WCHAR TestDir[MAX_PATH];
+static BOOL OnNtfs;
+
+static
+BOOL
+MakePath(
+    _Out_writes_(MAX_PATH) PWSTR Path,
+    _In_ PCWSTR Prefix,
+    _In_ ULONG Number)
+{
+    return SUCCEEDED(StringCchPrintfW(Path, MAX_PATH, L"%s\\%s%lu", TestDir, Prefix, Number));
+}
+
+static
+BOOL
+FileExists(
+    _In_ PCWSTR Path)
+{
+    HANDLE hFile;
+
+    hFile = CreateFileW(Path, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    CloseHandle(hFile);
+    return TRUE;
+}
+
+static
+void
+Cleanup(void)
+{
+    WCHAR Path[MAX_PATH];
+    ULONG i, j;
+
+    for (i = 0; i < _countof(Prefixes); i++)
+    {
+        for (j = 0; j < FILES_PER_PREFIX; j++)
+        {
+            if (MakePath(Path, Prefixes[i], j))
+                DeleteFileW(Path);
+        }
+    }
+
+    RemoveDirectoryW(TestDir);
+}
+
+static
+BOOL
+IsNtfsVolume(
+    _In_ PCWSTR Root)
+{
+    WCHAR FileSystem[MAX_PATH];
+
+    if (!GetVolumeInformationW(Root, NULL, 0, NULL, NULL, NULL, FileSystem, _countof(FileSystem)))
+        return FALSE;
+
+    return _wcsicmp(FileSystem, L"NTFS") == 0;
+}
+
+/*
+ * The temporary directory is hardly ever on NTFS on ReactOS, so fall back to
+ * any fixed NTFS drive. Without one, the tests still run in the temporary
+ * directory, but only those that don't depend on NTFS.
+ */
+static
+BOOL
+FindTestDir(void)
+{
+    WCHAR Root[MAX_PATH];
+    WCHAR Drives[MAX_PATH];
+    PCWSTR Drive;
+
+    if (!GetTempPathW(_countof(TestDir), TestDir))
+        return FALSE;
+
+    OnNtfs = GetVolumePathNameW(TestDir, Root, _countof(Root)) && IsNtfsVolume(Root);
+    if (!OnNtfs && GetLogicalDriveStringsW(_countof(Drives), Drives))
+    {
+        for (Drive = Drives; *Drive; Drive += wcslen(Drive) + 1)
+        {
+            if (GetDriveTypeW(Drive) == DRIVE_FIXED && IsNtfsVolume(Drive) &&
+                SUCCEEDED(StringCchCopyW(TestDir, _countof(TestDir), Drive)))
+            {
+                OnNtfs = TRUE;
+                break;
+            }
+        }
+    }
+
+    return SUCCEEDED(StringCchCatW(TestDir, _countof(TestDir), L"FileNameLookup"));
+}
+
+static
+BOOL
+CreateTestDir(void)
+{
+    Cleanup();
+    if (!CreateDirectoryW(TestDir, NULL))
+    {
+        skip("CreateDirectoryW failed with %lu\n", GetLastError());
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Each failed lookup reads the index buffers on the way to where the name would
+ * be, and NTFS keeps them in its record cache. Adding the name has to drop those
+ * copies, or the next lookup misses the file that was just created.
+ */
+static
+void
+Test_LookupAfterCreate(void)
+{
+    WCHAR Path[MAX_PATH];
+    HANDLE hFile;
+    ULONG i, j;
+    ULONG StaleMisses = 0, StaleHits = 0, Listed = 0;
+    WIN32_FIND_DATAW FindData;
+
+    if (!OnNtfs)
+    {
+        skip("No NTFS volume to test the record cache on\n");
+        return;
+    }
+
+    if (!CreateTestDir())
+        return;
+
+    for (j = 0; j < FILES_PER_PREFIX; j++)
+    {
+        for (i = 0; i < _countof(Prefixes); i++)
+        {
+            if (!MakePath(Path, Prefixes[i], j))
+                continue;
+
+            if (FileExists(Path))
+                StaleHits++;
+
+            hFile = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+            ok(hFile != INVALID_HANDLE_VALUE, "Creating %S failed with %lu\n", Path, GetLastError());
+            if (hFile == INVALID_HANDLE_VALUE)
+                continue;
+            CloseHandle(hFile);
+
+            if (!FileExists(Path))
+                StaleMisses++;
+        }
+    }
+    ok(StaleHits == 0, "%lu files were found before being created\n", StaleHits);
+    ok(StaleMisses == 0, "%lu files weren't found right after being created\n", StaleMisses);
+
+    /* The directory listing reads the same buffers */
+    if (SUCCEEDED(StringCchPrintfW(Path, _countof(Path), L"%s\\*", TestDir)))
+    {
+        hFile = FindFirstFileW(Path, &FindData);
+        ok(hFile != INVALID_HANDLE_VALUE, "FindFirstFileW failed with %lu\n", GetLastError());
+        if (hFile != INVALID_HANDLE_VALUE)
+        {
+            do
+            {
+                if (!(FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                    Listed++;
+            } while (FindNextFileW(hFile, &FindData));
+            FindClose(hFile);
+        }
+        ok_long(Listed, _countof(Prefixes) * FILES_PER_PREFIX);
+    }
+
+    Cleanup();
+}
+
+static
+void
+Test_MixedScriptLookup(void)
+{
+    WCHAR Path[MAX_PATH];
+    HANDLE hFile;
+    ULONG i, j;
+    ULONG Created = 0, Found, FoundOtherCase;
+    BOOL Exists;
+
+    /* Only NTFS sorts its directories with the upcase table */
+    if (!OnNtfs)
+    {
+        skip("No NTFS volume to test the directory index on\n");
+        return;
+    }
+
+    if (!CreateTestDir())
+        return;
+
+    /* Interleave the scripts, so the index gets split between them */
+    for (j = 0; j < FILES_PER_PREFIX; j++)
+    {
+        for (i = 0; i < _countof(Prefixes); i++)
+        {
+            ok(MakePath(Path, Prefixes[i], j), "Path too long\n");
+            hFile = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+            ok(hFile != INVALID_HANDLE_VALUE, "Creating %S failed with %lu\n", Path, GetLastError());
+            if (hFile != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(hFile);
+                Created++;
+            }
+        }
+    }
+    ok_long(Created, _countof(Prefixes) * FILES_PER_PREFIX);
+
+    for (i = 0; i < _countof(Prefixes); i++)
+    {
+        Found = FoundOtherCase = 0;
+        for (j = 0; j < FILES_PER_PREFIX; j++)
+        {
+            if (MakePath(Path, Prefixes[i], j) && FileExists(Path))
+                Found++;
+            if (MakePath(Path, OtherCasePrefixes[i], j) && FileExists(Path))
+                FoundOtherCase++;
+        }
+        ok(Found == FILES_PER_PREFIX, "Found %lu files named %S*\n", Found, Prefixes[i]);
+        ok(FoundOtherCase == FILES_PER_PREFIX, "Found %lu files named %S*\n", FoundOtherCase, OtherCasePrefixes[i]);
+    }
+
+    for (i = 0; i < _countof(MissingNames); i++)
+    {
+        if (FAILED(StringCchPrintfW(Path, _countof(Path), L"%s\\%s", TestDir, MissingNames[i])))
+            continue;
+        SetLastError(0xdeadbeef);
+        Exists = FileExists(Path);
+        ok(!Exists, "%S exists\n", Path);
+        ok_err(ERROR_FILE_NOT_FOUND);
+    }
+
+    Cleanup();
+}
+
+START_TEST(FileNameLookup)
+{
+    if (!FindTestDir())
+    {
+        skip("No test directory\n");
+        return;
+    }
+
+    Test_MixedScriptLookup();
+    Test_LookupAfterCreate();
+}
@@ -0,0 +1,212 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests for large named pipe transfers into pending reads
+ */
+
+#include "precomp.h"
+
+#define PIPE_NAME TEXT("\\\\.\\pipe\\rostest_namedpipe")
+#define BIG_SIZE (1024 * 1024)
+#define SPEED_LOOPS 64
+
+static void FillPattern(PUCHAR Buffer, DWORD Size, DWORD Seed)
+{
+    DWORD i;
+
+    for (i = 0; i < Size; i++)
+        Buffer[i] = (UCHAR)((i * 31) + (i >> 8) + Seed);
+}
+
+static BOOL CreatePipePair(DWORD PipeMode, PHANDLE Server, PHANDLE Client)
+{
+    *Server = CreateNamedPipe(PIPE_NAME,
+                              PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+                              PipeMode | PIPE_WAIT,
+                              1,
+                              4096,
+                              4096,
+                              0,
+                              NULL);
+    ok(*Server != INVALID_HANDLE_VALUE, "CreateNamedPipe failed: %lu\n", GetLastError());
+    if (*Server == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    /* Both ends are asynchronous, so that the reads are surely pending when
+       the write comes in, and a write that does not fit does not block us */
+    *Client = CreateFile(PIPE_NAME,
+                         GENERIC_READ | GENERIC_WRITE,
+                         0,
+                         NULL,
+                         OPEN_EXISTING,
+                         FILE_FLAG_OVERLAPPED,
+                         NULL);
+    ok(*Client != INVALID_HANDLE_VALUE, "CreateFile failed: %lu\n", GetLastError());
+    if (*Client == INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(*Server);
+        return FALSE;
+    }
+
+    if (PipeMode & PIPE_TYPE_MESSAGE)
+    {
+        DWORD ReadMode = PIPE_READMODE_MESSAGE;
+        ok(SetNamedPipeHandleState(*Client, &ReadMode, NULL, NULL),
+           "SetNamedPipeHandleState failed: %lu\n", GetLastError());
+    }
+
+    return TRUE;
+}
+
+static BOOL WaitForOverlapped(HANDLE Handle, LPOVERLAPPED Overlapped, BOOL Ret, PDWORD Transferred)
+{
+    *Transferred = 0;
+    if (!Ret && GetLastError() != ERROR_IO_PENDING)
+        return FALSE;
+    return GetOverlappedResult(Handle, Overlapped, Transferred, TRUE);
+}
+
+/*
+ * Start a read on the client, write on the server and finish the read. If the
+ * message did not fit, read the rest of it right after the first part.
+ */
+static BOOL PendingReadWrite(HANDLE Server, HANDLE Client,
+                             PUCHAR OutBuffer, DWORD OutSize,
+                             PUCHAR InBuffer, DWORD InSize,
+                             PDWORD Read, PDWORD Error)
+{
+    OVERLAPPED ReadOverlapped = { 0 }, WriteOverlapped = { 0 };
+    DWORD Written, Rest;
+    BOOL Ret, WriteRet;
+
+    ReadOverlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    WriteOverlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    Ret = ReadFile(Client, InBuffer, InSize, NULL, &ReadOverlapped);
+    ok(!Ret && GetLastError() == ERROR_IO_PENDING, "ReadFile returned %d, error %lu\n", Ret, GetLastError());
+
+    WriteRet = WriteFile(Server, OutBuffer, OutSize, NULL, &WriteOverlapped);
+    ok(WriteRet || GetLastError() == ERROR_IO_PENDING, "WriteFile failed: %lu\n", GetLastError());
+
+    Ret = GetOverlappedResult(Client, &ReadOverlapped, Read, TRUE);
+    *Error = Ret ? ERROR_SUCCESS : GetLastError();
+
+    if (!Ret && *Error == ERROR_MORE_DATA)
+    {
+        ResetEvent(ReadOverlapped.hEvent);
+        ok(WaitForOverlapped(Client,
+                             &ReadOverlapped,
+                             ReadFile(Client, InBuffer + *Read, OutSize - *Read, NULL, &ReadOverlapped),
+                             &Rest),
+           "ReadFile failed: %lu\n", GetLastError());
+        ok(*Read + Rest == OutSize, "Read %lu + %lu bytes, expected %lu\n", *Read, Rest, OutSize);
+    }
+
+    ok(WaitForOverlapped(Server, &WriteOverlapped, WriteRet, &Written),
+       "WriteFile failed: %lu\n", GetLastError());
+    ok(Written == OutSize, "Wrote %lu bytes, expected %lu\n", Written, OutSize);
+
+    CloseHandle(WriteOverlapped.hEvent);
+    CloseHandle(ReadOverlapped.hEvent);
+    return Ret;
+}
+
+static void TestPendingReads(PUCHAR OutBuffer, PUCHAR InBuffer)
+{
+    HANDLE Server, Client;
+    DWORD Read, Error;
+    BOOL Ret;
+
+    /* A whole message into a big enough pending read */
+    if (CreatePipePair(PIPE_TYPE_MESSAGE, &Server, &Client))
+    {
+        FillPattern(OutBuffer, BIG_SIZE, 1);
+        ZeroMemory(InBuffer, BIG_SIZE);
+        Ret = PendingReadWrite(Server, Client, OutBuffer, BIG_SIZE, InBuffer, BIG_SIZE, &Read, &Error);
+        ok(Ret, "GetOverlappedResult failed: %lu\n", Error);
+        ok(Read == BIG_SIZE, "Read %lu bytes\n", Read);
+        ok(!memcmp(InBuffer, OutBuffer, BIG_SIZE), "Data mismatch\n");
+
+        /* A message bigger than the pending read: the rest stays queued */
+        FillPattern(OutBuffer, BIG_SIZE, 2);
+        ZeroMemory(InBuffer, BIG_SIZE);
+        Ret = PendingReadWrite(Server, Client, OutBuffer, BIG_SIZE, InBuffer, BIG_SIZE / 4, &Read, &Error);
+        ok(!Ret && Error == ERROR_MORE_DATA, "GetOverlappedResult returned %d, error %lu\n", Ret, Error);
+        ok(Read == BIG_SIZE / 4, "Read %lu bytes\n", Read);
+        ok(!memcmp(InBuffer, OutBuffer, BIG_SIZE), "Data mismatch\n");
+
+        CloseHandle(Client);
+        CloseHandle(Server);
+    }
+
+    /* A byte mode write smaller than the pending read */
+    if (CreatePipePair(PIPE_TYPE_BYTE, &Server, &Client))
+    {
+        FillPattern(OutBuffer, BIG_SIZE, 3);
+        ZeroMemory(InBuffer, BIG_SIZE);
+        Ret = PendingReadWrite(Server, Client, OutBuffer, BIG_SIZE / 8, InBuffer, BIG_SIZE, &Read, &Error);
+        ok(Ret, "GetOverlappedResult failed: %lu\n", Error);
+        ok(Read == BIG_SIZE / 8, "Read %lu bytes\n", Read);
+        ok(!memcmp(InBuffer, OutBuffer, BIG_SIZE / 8), "Data mismatch\n");
+
+        CloseHandle(Client);
+        CloseHandle(Server);
+    }
+}
+
+static void TestThroughput(PUCHAR OutBuffer, PUCHAR InBuffer, DWORD Size)
+{
+    HANDLE Server, Client;
+    LARGE_INTEGER Frequency, Start, End;
+    DWORD Read, Error, i;
+    double Seconds;
+
+    if (!CreatePipePair(PIPE_TYPE_MESSAGE, &Server, &Client))
+        return;
+
+    FillPattern(OutBuffer, Size, 4);
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (i = 0; i < SPEED_LOOPS * (BIG_SIZE / Size); i++)
+    {
+        if (!PendingReadWrite(Server, Client, OutBuffer, Size, InBuffer, Size, &Read, &Error) ||
+            Read != Size)
+        {
+            ok(FALSE, "Transfer %lu failed: %lu bytes, error %lu\n", i, Read, Error);
+            break;
+        }
+    }
+
+    QueryPerformanceCounter(&End);
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+    if (Seconds > 0)
+        trace("%lu byte messages: %.1f MB/s\n", Size, SPEED_LOOPS / Seconds);
+
+    CloseHandle(Client);
+    CloseHandle(Server);
+}
+
+START_TEST(NamedPipe)
+{
+    PUCHAR OutBuffer, InBuffer;
+
+    OutBuffer = HeapAlloc(GetProcessHeap(), 0, BIG_SIZE);
+    InBuffer = HeapAlloc(GetProcessHeap(), 0, BIG_SIZE);
+    if (!OutBuffer || !InBuffer)
+    {
+        skip("Out of memory\n");
+        HeapFree(GetProcessHeap(), 0, OutBuffer);
+        HeapFree(GetProcessHeap(), 0, InBuffer);
+        return;
+    }
+
+    TestPendingReads(OutBuffer, InBuffer);
+
+    /* Below and above the size where NPFS copies into the reader's buffer directly */
+    TestThroughput(OutBuffer, InBuffer, 4096);
+    TestThroughput(OutBuffer, InBuffer, BIG_SIZE);
+
+    HeapFree(GetProcessHeap(), 0, OutBuffer);
+    HeapFree(GetProcessHeap(), 0, InBuffer);
+}
@@ -0,0 +1,346 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.0-or-later (https://spdx.org/licenses/LGPL-2.0-or-later)
+ * PURPOSE:     Test for imports by name whose hint doesn't match the exports
+ */
+
+#include "precomp.h"
+
+/*
+ * The loader only trusts an import's hint if the export name at that index
+ * matches, and looks the name up otherwise. The test DLLs written here import
+ * from kernel32 with hints that are out of range, point at another name, or
+ * are zero. They have no code and no relocations, so they load anywhere.
+ */
+#if defined(_M_IX86)
+#define TEST_MACHINE IMAGE_FILE_MACHINE_I386
+#elif defined(_M_AMD64)
+#define TEST_MACHINE IMAGE_FILE_MACHINE_AMD64
+#elif defined(_M_ARM)
+#define TEST_MACHINE IMAGE_FILE_MACHINE_ARMNT
+#elif defined(_M_ARM64)
+#define TEST_MACHINE IMAGE_FILE_MACHINE_ARM64
+#endif
+
+#define HEADERS_SIZE    0x200
+#define SECTION_RVA     0x1000
+#define SECTION_SIZE    0x1000
+#define MAX_IMPORTS     16
+
+typedef enum _HINT_KIND
+{
+    HintRight,
+    HintOutOfRange,
+    HintOtherName,
+    HintZero
+} HINT_KIND;
+
+typedef struct _TEST_IMPORT
+{
+    PCSTR Name;
+    HINT_KIND Hint;
+} TEST_IMPORT, *PTEST_IMPORT;
+
+static const TEST_IMPORT GoodImports[] =
+{
+    { "GetModuleHandleW",       HintRight },
+    { "CreateFileW",            HintOutOfRange },
+    { "WriteFile",              HintOtherName },
+    { "VirtualAlloc",           HintZero },
+    { "lstrlenA",               HintOtherName },
+    { "Sleep",                  HintOutOfRange },
+    /* Forwarded to ntdll */
+    { "HeapAlloc",              HintOtherName },
+    { "EnterCriticalSection",   HintOutOfRange },
+    { "DeleteCriticalSection",  HintZero },
+};
+
+static const TEST_IMPORT MissingImports[] =
+{
+    { "GetModuleHandleW",       HintOtherName },
+    { "NoSuchExportInKernel32", HintOtherName },
+};
+
+static HMODULE Kernel32;
+
+/* Walks the export names one by one, so that it doesn't share any code with the loader */
+static
+ULONG
+FindExportName(
+    _In_ HMODULE Module,
+    _In_ PCSTR Name,
+    _Out_ PIMAGE_EXPORT_DIRECTORY* ExportDirectory,
+    _Out_ PULONG ExportSize)
+{
+    PULONG NameTable;
+    ULONG i;
+
+    *ExportDirectory = RtlImageDirectoryEntryToData(Module, TRUE, IMAGE_DIRECTORY_ENTRY_EXPORT, ExportSize);
+    if (!*ExportDirectory)
+        return MAXULONG;
+
+    NameTable = (PULONG)((ULONG_PTR)Module + (*ExportDirectory)->AddressOfNames);
+    for (i = 0; i < (*ExportDirectory)->NumberOfNames; i++)
+    {
+        if (!strcmp((PCSTR)((ULONG_PTR)Module + NameTable[i]), Name))
+            return i;
+    }
+
+    return MAXULONG;
+}
+
+static
+ULONG_PTR
+LookupExport(
+    _In_ HMODULE Module,
+    _In_ PCSTR Name)
+{
+    PIMAGE_EXPORT_DIRECTORY ExportDirectory;
+    PUSHORT OrdinalTable;
+    PULONG FunctionTable;
+    ULONG Index, Size;
+    ULONG_PTR Address;
+    CHAR DllName[MAX_PATH];
+    PCSTR Dot;
+
+    Index = FindExportName(Module, Name, &ExportDirectory, &Size);
+    if (Index == MAXULONG)
+        return 0;
+
+    OrdinalTable = (PUSHORT)((ULONG_PTR)Module + ExportDirectory->AddressOfNameOrdinals);
+    FunctionTable = (PULONG)((ULONG_PTR)Module + ExportDirectory->AddressOfFunctions);
+    Address = (ULONG_PTR)Module + FunctionTable[OrdinalTable[Index]];
+
+    /* A forwarder is a "DLL.Name" string inside the export directory */
+    if (Address > (ULONG_PTR)ExportDirectory && Address < (ULONG_PTR)ExportDirectory + Size)
+    {
+        Dot = strchr((PCSTR)Address, '.');
+        if (!Dot || (ULONG_PTR)(Dot - (PCSTR)Address) >= sizeof(DllName))
+            return 0;
+        RtlCopyMemory(DllName, (PCSTR)Address, Dot - (PCSTR)Address);
+        DllName[Dot - (PCSTR)Address] = ANSI_NULL;
+        /* API set forwarders on newer Windows are left to the loader */
+        if (!GetModuleHandleA(DllName))
+            return (ULONG_PTR)GetProcAddress(Module, Name);
+        return LookupExport(GetModuleHandleA(DllName), Dot + 1);
+    }
+
+    return Address;
+}
+
+static
+USHORT
+GetHint(
+    _In_ PCSTR Name,
+    _In_ HINT_KIND Kind)
+{
+    PIMAGE_EXPORT_DIRECTORY ExportDirectory;
+    ULONG Index, Size;
+
+    Index = FindExportName(Kernel32, Name, &ExportDirectory, &Size);
+    switch (Kind)
+    {
+        case HintRight:
+            return (USHORT)Index;
+        case HintOutOfRange:
+            return MAXUSHORT;
+        case HintOtherName:
+            /* The neighbour of the right one, or of the first one for a missing name */
+            return (Index == MAXULONG) ? 1 : (USHORT)((Index + 1) % ExportDirectory->NumberOfNames);
+        default:
+            return 0;
+    }
+}
+
+static
+BOOL
+WriteTestDll(
+    _In_ PCWSTR Path,
+    _In_reads_(Count) const TEST_IMPORT* Imports,
+    _In_ ULONG Count,
+    _Out_ PULONG IatRva)
+{
+    PUCHAR File, Section;
+    PIMAGE_DOS_HEADER DosHeader;
+    PIMAGE_NT_HEADERS NtHeaders;
+    PIMAGE_SECTION_HEADER SectionHeader;
+    PIMAGE_IMPORT_DESCRIPTOR ImportDescriptor;
+    PIMAGE_THUNK_DATA OriginalThunk, FirstThunk;
+    PIMAGE_IMPORT_BY_NAME ImportByName;
+    ULONG Next, i;
+    HANDLE hFile;
+    DWORD Written;
+    BOOL Ret;
+
+    File = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, HEADERS_SIZE + SECTION_SIZE);
+    if (!File)
+        return FALSE;
+    Section = File + HEADERS_SIZE;
+
+    DosHeader = (PIMAGE_DOS_HEADER)File;
+    DosHeader->e_magic = IMAGE_DOS_SIGNATURE;
+    DosHeader->e_lfanew = sizeof(IMAGE_DOS_HEADER);
+
+    NtHeaders = (PIMAGE_NT_HEADERS)(File + DosHeader->e_lfanew);
+    NtHeaders->Signature = IMAGE_NT_SIGNATURE;
+    NtHeaders->FileHeader.Machine = TEST_MACHINE;
+    NtHeaders->FileHeader.NumberOfSections = 1;
+    NtHeaders->FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER);
+    NtHeaders->FileHeader.Characteristics = IMAGE_FILE_EXECUTABLE_IMAGE | IMAGE_FILE_DLL;
+    NtHeaders->OptionalHeader.Magic = IMAGE_NT_OPTIONAL_HDR_MAGIC;
+    NtHeaders->OptionalHeader.ImageBase = 0x10000000;
+    NtHeaders->OptionalHeader.SectionAlignment = SECTION_RVA;
+    NtHeaders->OptionalHeader.FileAlignment = HEADERS_SIZE;
+    NtHeaders->OptionalHeader.MajorOperatingSystemVersion = 4;
+    NtHeaders->OptionalHeader.MajorSubsystemVersion = 4;
+    NtHeaders->OptionalHeader.SizeOfImage = SECTION_RVA + SECTION_SIZE;
+    NtHeaders->OptionalHeader.SizeOfHeaders = HEADERS_SIZE;
+    NtHeaders->OptionalHeader.Subsystem = IMAGE_SUBSYSTEM_WINDOWS_CUI;
+    NtHeaders->OptionalHeader.SizeOfStackReserve = 0x100000;
+    NtHeaders->OptionalHeader.SizeOfStackCommit = 0x1000;
+    NtHeaders->OptionalHeader.SizeOfHeapReserve = 0x100000;
+    NtHeaders->OptionalHeader.SizeOfHeapCommit = 0x1000;
+    NtHeaders->OptionalHeader.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+    NtHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress = SECTION_RVA;
+    NtHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].Size = 2 * sizeof(IMAGE_IMPORT_DESCRIPTOR);
+
+    SectionHeader = IMAGE_FIRST_SECTION(NtHeaders);
+    RtlCopyMemory(SectionHeader->Name, ".idata", sizeof(".idata"));
+    SectionHeader->Misc.VirtualSize = SECTION_SIZE;
+    SectionHeader->VirtualAddress = SECTION_RVA;
+    SectionHeader->SizeOfRawData = SECTION_SIZE;
+    SectionHeader->PointerToRawData = HEADERS_SIZE;
+    SectionHeader->Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE;
+
+    /* One descriptor and the terminator, then both thunk arrays, then the names */
+    ImportDescriptor = (PIMAGE_IMPORT_DESCRIPTOR)Section;
+    Next = 2 * sizeof(IMAGE_IMPORT_DESCRIPTOR);
+    ImportDescriptor->OriginalFirstThunk = SECTION_RVA + Next;
+    OriginalThunk = (PIMAGE_THUNK_DATA)(Section + Next);
+    Next += (MAX_IMPORTS + 1) * sizeof(IMAGE_THUNK_DATA);
+    ImportDescriptor->FirstThunk = SECTION_RVA + Next;
+    FirstThunk = (PIMAGE_THUNK_DATA)(Section + Next);
+    Next += (MAX_IMPORTS + 1) * sizeof(IMAGE_THUNK_DATA);
+    ImportDescriptor->Name = SECTION_RVA + Next;
+    RtlCopyMemory(Section + Next, "kernel32.dll", sizeof("kernel32.dll"));
+    Next += sizeof("kernel32.dll") + 1;
+
+    for (i = 0; i < Count && i < MAX_IMPORTS; i++)
+    {
+        Next = ALIGN_UP_BY(Next, sizeof(USHORT));
+        ImportByName = (PIMAGE_IMPORT_BY_NAME)(Section + Next);
+        ImportByName->Hint = GetHint(Imports[i].Name, Imports[i].Hint);
+        RtlCopyMemory(ImportByName->Name, Imports[i].Name, strlen(Imports[i].Name) + 1);
+        OriginalThunk[i].u1.AddressOfData = SECTION_RVA + Next;
+        FirstThunk[i].u1.AddressOfData = SECTION_RVA + Next;
+        Next += FIELD_OFFSET(IMAGE_IMPORT_BY_NAME, Name) + strlen(Imports[i].Name) + 1;
+    }
+    *IatRva = ImportDescriptor->FirstThunk;
+
+    hFile = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    Ret = (hFile != INVALID_HANDLE_VALUE);
+    if (Ret)
+    {
+        Ret = WriteFile(hFile, File, HEADERS_SIZE + SECTION_SIZE, &Written, NULL) &&
+              Written == HEADERS_SIZE + SECTION_SIZE;
+        CloseHandle(hFile);
+    }
+
+    HeapFree(GetProcessHeap(), 0, File);
+    return Ret;
+}
+
+static
+BOOL
+GetTestDllPath(
+    _Out_writes_(MAX_PATH) PWSTR Path,
+    _In_ PCWSTR Name)
+{
+    return GetTempPathW(MAX_PATH, Path) &&
+           SUCCEEDED(StringCchCatW(Path, MAX_PATH, Name));
+}
+
+static
+void
+Test_WrongHints(void)
+{
+    WCHAR Path[MAX_PATH];
+    HMODULE Module;
+    PIMAGE_THUNK_DATA Iat;
+    ULONG_PTR Expected;
+    ULONG IatRva, i;
+
+    if (!GetTestDllPath(Path, L"ldrhint_good.dll") ||
+        !WriteTestDll(Path, GoodImports, _countof(GoodImports), &IatRva))
+    {
+        skip("Failed to write the test DLL (%lu)\n", GetLastError());
+        return;
+    }
+
+    Module = LoadLibraryW(Path);
+    ok(Module != NULL, "LoadLibraryW failed (%lu)\n", GetLastError());
+    if (Module)
+    {
+        Iat = (PIMAGE_THUNK_DATA)((ULONG_PTR)Module + IatRva);
+        for (i = 0; i < _countof(GoodImports); i++)
+        {
+            Expected = LookupExport(Kernel32, GoodImports[i].Name);
+            ok(Expected != 0, "%s isn't exported\n", GoodImports[i].Name);
+            ok(Iat[i].u1.Function == Expected, "%s with hint kind %d: got %p, expected %p\n",
+               GoodImports[i].Name, GoodImports[i].Hint, (PVOID)Iat[i].u1.Function, (PVOID)Expected);
+
+            /* The forwarded ones have to end up in ntdll */
+            if (!strcmp(GoodImports[i].Name, "HeapAlloc"))
+            {
+                ok(Iat[i].u1.Function == (ULONG_PTR)GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "RtlAllocateHeap"),
+                   "HeapAlloc isn't RtlAllocateHeap\n");
+            }
+        }
+
+        FreeLibrary(Module);
+    }
+
+    DeleteFileW(Path);
+}
+
+static
+void
+Test_MissingName(void)
+{
+    WCHAR Path[MAX_PATH];
+    HMODULE Module;
+    ULONG IatRva;
+    UINT ErrorMode;
+
+    if (!GetTestDllPath(Path, L"ldrhint_missing.dll") ||
+        !WriteTestDll(Path, MissingImports, _countof(MissingImports), &IatRva))
+    {
+        skip("Failed to write the test DLL (%lu)\n", GetLastError());
+        return;
+    }
+
+    /* No message box about the missing entry point */
+    ErrorMode = SetErrorMode(SEM_FAILCRITICALERRORS);
+    SetLastError(0xdeadbeef);
+    Module = LoadLibraryW(Path);
+    ok(Module == NULL, "LoadLibraryW succeeded\n");
+    ok_err(ERROR_PROC_NOT_FOUND);
+    SetErrorMode(ErrorMode);
+
+    if (Module)
+        FreeLibrary(Module);
+    ok(GetModuleHandleW(L"ldrhint_missing.dll") == NULL, "The DLL stayed loaded\n");
+
+    DeleteFileW(Path);
+}
+
+START_TEST(LdrImportHint)
+{
+    Kernel32 = GetModuleHandleW(L"kernel32.dll");
+    ok(Kernel32 != NULL, "No kernel32\n");
+    if (!Kernel32)
+        return;
+
+    Test_WrongHints();
+    Test_MissingName();
+}
@@ -0,0 +1,125 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.0-or-later (https://spdx.org/licenses/LGPL-2.0-or-later)
+ * PURPOSE:     Test for the KnownDlls prelinked import cache
+ */
+
+#include "precomp.h"
+
+#define PROCESS_COUNT   20
+
+static
+ULONG
+CheckImports(
+    _In_ HMODULE Module,
+    _In_ PCSTR ExportName,
+    _Out_ PULONG Checked)
+{
+    PIMAGE_IMPORT_DESCRIPTOR ImportDescriptor;
+    PIMAGE_THUNK_DATA OriginalThunk, FirstThunk;
+    HMODULE ExportModule;
+    FARPROC Expected;
+    ULONG Size, Mismatches = 0;
+
+    *Checked = 0;
+    ExportModule = GetModuleHandleA(ExportName);
+    ImportDescriptor = RtlImageDirectoryEntryToData(Module, TRUE, IMAGE_DIRECTORY_ENTRY_IMPORT, &Size);
+    if (!ExportModule || !ImportDescriptor)
+        return 0;
+
+    for (; ImportDescriptor->Name && ImportDescriptor->FirstThunk; ImportDescriptor++)
+    {
+        if (_stricmp((PCSTR)Module + ImportDescriptor->Name, ExportName) ||
+            !ImportDescriptor->OriginalFirstThunk)
+        {
+            continue;
+        }
+
+        OriginalThunk = (PIMAGE_THUNK_DATA)((ULONG_PTR)Module + ImportDescriptor->OriginalFirstThunk);
+        FirstThunk = (PIMAGE_THUNK_DATA)((ULONG_PTR)Module + ImportDescriptor->FirstThunk);
+        for (; OriginalThunk->u1.AddressOfData; OriginalThunk++, FirstThunk++)
+        {
+            PCSTR Name;
+
+            if (IMAGE_SNAP_BY_ORDINAL(OriginalThunk->u1.Ordinal))
+            {
+                Name = (PCSTR)IMAGE_ORDINAL(OriginalThunk->u1.Ordinal);
+            }
+            else
+            {
+                Name = (PCSTR)((PIMAGE_IMPORT_BY_NAME)((ULONG_PTR)Module + OriginalThunk->u1.AddressOfData))->Name;
+            }
+
+            /* Whether snapped by the loader or copied from the cache, the IAT must hold the real export */
+            Expected = GetProcAddress(ExportModule, Name);
+            if ((ULONG_PTR)Expected != FirstThunk->u1.Function)
+            {
+                if (IS_INTRESOURCE(Name))
+                    trace("%s!#%u: %p != %p\n", ExportName, (USHORT)(ULONG_PTR)Name, (PVOID)FirstThunk->u1.Function, Expected);
+                else
+                    trace("%s!%s: %p != %p\n", ExportName, Name, (PVOID)FirstThunk->u1.Function, Expected);
+                Mismatches++;
+            }
+            (*Checked)++;
+        }
+    }
+
+    return Mismatches;
+}
+
+START_TEST(LdrPrelink)
+{
+    NTSTATUS Status;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    UNICODE_STRING CacheName = RTL_CONSTANT_STRING(L"\\KnownDlls\\PrelinkCache");
+    HANDLE SectionHandle;
+    HMODULE Kernel32, Advapi32;
+    STARTUPINFOW StartupInfo = { sizeof(StartupInfo) };
+    PROCESS_INFORMATION ProcessInfo;
+    WCHAR CommandLine[MAX_PATH];
+    DWORD StartTime, EndTime;
+    ULONG Checked, i;
+
+    /* The cache is optional, but if it is there it must be readable by everyone */
+    InitializeObjectAttributes(&ObjectAttributes, &CacheName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtOpenSection(&SectionHandle, SECTION_MAP_READ, &ObjectAttributes);
+    ok(NT_SUCCESS(Status) || Status == STATUS_OBJECT_NAME_NOT_FOUND, "Status = 0x%lx\n", Status);
+    if (NT_SUCCESS(Status))
+        NtClose(SectionHandle);
+    else
+        trace("No prelink cache\n");
+
+    /* Known DLLs imports must resolve to the same thing either way */
+    Kernel32 = GetModuleHandleW(L"kernel32.dll");
+    ok(Kernel32 != NULL, "No kernel32\n");
+    if (Kernel32)
+    {
+        ok_eq_ulong(CheckImports(Kernel32, "ntdll.dll", &Checked), 0UL);
+        ok(Checked != 0, "No imports checked\n");
+    }
+
+    Advapi32 = LoadLibraryW(L"advapi32.dll");
+    ok(Advapi32 != NULL, "No advapi32\n");
+    if (Advapi32)
+    {
+        ok_eq_ulong(CheckImports(Advapi32, "ntdll.dll", &Checked), 0UL);
+        ok_eq_ulong(CheckImports(Advapi32, "kernel32.dll", &Checked), 0UL);
+        FreeLibrary(Advapi32);
+    }
+
+    /* How long does it take to start a process that uses them? */
+    StartTime = GetTickCount();
+    for (i = 0; i < PROCESS_COUNT; i++)
+    {
+        StringCbCopyW(CommandLine, sizeof(CommandLine), L"cmd.exe /c exit");
+        if (!CreateProcessW(NULL, CommandLine, NULL, NULL, FALSE, 0, NULL, NULL, &StartupInfo, &ProcessInfo))
+            break;
+        WaitForSingleObject(ProcessInfo.hProcess, INFINITE);
+        CloseHandle(ProcessInfo.hThread);
+        CloseHandle(ProcessInfo.hProcess);
+    }
+    EndTime = GetTickCount();
+    ok_eq_ulong(i, (ULONG)PROCESS_COUNT);
+    trace("Started %lu cmd.exe processes in %lu ms each\n",
+          i, i ? (EndTime - StartTime) / i : 0);
+}
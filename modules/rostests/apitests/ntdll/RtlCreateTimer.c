@@ -0,0 +1,300 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Test for RtlCreateTimer and RtlUpdateTimer
+ */
+
+#include "precomp.h"
+
+/*
+ * The timer queue keeps its timers in a wheel with 64 slots per level, a slot
+ * on level n covering 64^n milliseconds. These due times cover the first three
+ * levels and their edges, so that timers have to move down one or two levels
+ * before they fire.
+ */
+static const ULONG DueTimes[] =
+{
+    0, 1, 10, 63, 64, 65, 100, 127, 128, 500, 1000, 4095, 4096, 4097, 4200, 5000,
+};
+
+#define MANY_TIMERS 1000
+#define MANY_TIMERS_SPAN 3000
+
+/* Timer queue timers may be a tick late, but never early */
+#define LATE_TOLERANCE 1000
+
+typedef struct _TIMER_DATA
+{
+    HANDLE Timer;
+    ULONG DueTime;
+    LONG FireCount;
+    ULONGLONG FiredAt;
+    HANDLE Event;
+} TIMER_DATA, *PTIMER_DATA;
+
+static LARGE_INTEGER Frequency;
+static ULONGLONG StartTime;
+static LONG PendingCount;
+static HANDLE AllFiredEvent;
+
+static
+ULONGLONG
+NowMs(void)
+{
+    LARGE_INTEGER Counter;
+
+    QueryPerformanceCounter(&Counter);
+    return Counter.QuadPart * 1000 / Frequency.QuadPart;
+}
+
+static
+VOID
+NTAPI
+TimerCallback(
+    _In_ PVOID Parameter,
+    _In_ BOOLEAN TimerOrWaitFired)
+{
+    PTIMER_DATA Data = Parameter;
+
+    if (InterlockedIncrement(&Data->FireCount) == 1)
+        Data->FiredAt = NowMs() - StartTime;
+    if (Data->Event)
+        SetEvent(Data->Event);
+    if (InterlockedDecrement(&PendingCount) == 0 && AllFiredEvent)
+        SetEvent(AllFiredEvent);
+}
+
+static
+void
+CheckFired(
+    _In_ PTIMER_DATA Data,
+    _In_ ULONG Count,
+    _Out_ PULONG Early,
+    _Out_ PULONG Late,
+    _Out_ PULONG Wrong)
+{
+    ULONG i;
+
+    *Early = *Late = *Wrong = 0;
+    for (i = 0; i < Count; i++)
+    {
+        if (Data[i].FireCount != 1)
+            (*Wrong)++;
+        else if (Data[i].FiredAt < Data[i].DueTime)
+            (*Early)++;
+        else if (Data[i].FiredAt > Data[i].DueTime + LATE_TOLERANCE)
+            (*Late)++;
+    }
+}
+
+static
+void
+Test_DueTimes(HANDLE Queue)
+{
+    TIMER_DATA Data[_countof(DueTimes)];
+    NTSTATUS Status;
+    ULONG i;
+    DWORD Result;
+
+    RtlZeroMemory(Data, sizeof(Data));
+    PendingCount = _countof(DueTimes);
+    ResetEvent(AllFiredEvent);
+
+    StartTime = NowMs();
+    for (i = 0; i < _countof(DueTimes); i++)
+    {
+        Data[i].DueTime = DueTimes[i];
+        Status = RtlCreateTimer(Queue, &Data[i].Timer, TimerCallback, &Data[i], DueTimes[i], 0, WT_EXECUTEDEFAULT);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+
+    Result = WaitForSingleObject(AllFiredEvent, 5000 + 2 * LATE_TOLERANCE);
+    ok_long(Result, WAIT_OBJECT_0);
+
+    for (i = 0; i < _countof(DueTimes); i++)
+    {
+        ok(Data[i].FireCount == 1, "Timer due in %lu ms fired %ld times\n", Data[i].DueTime, Data[i].FireCount);
+        if (Data[i].FireCount)
+        {
+            ok(Data[i].FiredAt >= Data[i].DueTime && Data[i].FiredAt <= Data[i].DueTime + LATE_TOLERANCE,
+               "Timer due in %lu ms fired after %I64u ms\n", Data[i].DueTime, Data[i].FiredAt);
+        }
+        Status = RtlDeleteTimer(Queue, Data[i].Timer, INVALID_HANDLE_VALUE);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+}
+
+static
+void
+Test_ManyTimers(HANDLE Queue)
+{
+    PTIMER_DATA Data;
+    NTSTATUS Status;
+    ULONG i, Early, Late, Wrong, Seed = 0x4e7;
+    DWORD Result;
+
+    Data = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, MANY_TIMERS * sizeof(*Data));
+    if (!Data)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    PendingCount = MANY_TIMERS;
+    ResetEvent(AllFiredEvent);
+
+    StartTime = NowMs();
+    for (i = 0; i < MANY_TIMERS; i++)
+    {
+        Data[i].DueTime = RtlRandom(&Seed) % MANY_TIMERS_SPAN;
+        Status = RtlCreateTimer(Queue, &Data[i].Timer, TimerCallback, &Data[i], Data[i].DueTime, 0, WT_EXECUTEDEFAULT);
+        if (!NT_SUCCESS(Status))
+        {
+            ok_ntstatus(Status, STATUS_SUCCESS);
+            InterlockedDecrement(&PendingCount);
+            Data[i].Timer = NULL;
+            Data[i].FireCount = 1;
+        }
+    }
+
+    Result = WaitForSingleObject(AllFiredEvent, MANY_TIMERS_SPAN + 10000);
+    ok_long(Result, WAIT_OBJECT_0);
+
+    for (i = 0; i < MANY_TIMERS; i++)
+    {
+        if (Data[i].Timer)
+            RtlDeleteTimer(Queue, Data[i].Timer, INVALID_HANDLE_VALUE);
+    }
+
+    CheckFired(Data, MANY_TIMERS, &Early, &Late, &Wrong);
+    ok(Wrong == 0, "%lu timers didn't fire exactly once\n", Wrong);
+    ok(Early == 0, "%lu timers fired early\n", Early);
+    ok(Late == 0, "%lu timers fired more than %d ms late\n", Late, LATE_TOLERANCE);
+
+    HeapFree(GetProcessHeap(), 0, Data);
+}
+
+/*
+ * Rescheduling has to take the timer out of whichever wheel level it was on,
+ * and put it on the one matching its new due time.
+ */
+static
+void
+Test_Update(HANDLE Queue)
+{
+    static const ULONG DeletedDueTimes[] = { 50, 300, 6000 };
+    TIMER_DATA Sooner, Later, Deleted[_countof(DeletedDueTimes)];
+    NTSTATUS Status;
+    DWORD Result;
+    ULONG i;
+
+    RtlZeroMemory(&Sooner, sizeof(Sooner));
+    RtlZeroMemory(&Later, sizeof(Later));
+    RtlZeroMemory(Deleted, sizeof(Deleted));
+    Sooner.Event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    Later.Event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(Sooner.Event != NULL && Later.Event != NULL, "CreateEventW failed\n");
+    if (!Sooner.Event || !Later.Event)
+        goto Cleanup;
+    PendingCount = MAXLONG;
+
+    StartTime = NowMs();
+
+    /* From the third level down to the second */
+    Status = RtlCreateTimer(Queue, &Sooner.Timer, TimerCallback, &Sooner, 10000, 0, WT_EXECUTEDEFAULT);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    /* From the first level up to the third */
+    Status = RtlCreateTimer(Queue, &Later.Timer, TimerCallback, &Later, 50, 0, WT_EXECUTEDEFAULT);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    /* Deleted timers must not fire, on any level */
+    for (i = 0; i < _countof(Deleted); i++)
+    {
+        Status = RtlCreateTimer(Queue, &Deleted[i].Timer, TimerCallback, &Deleted[i], DeletedDueTimes[i], 0, WT_EXECUTEDEFAULT);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+
+    Later.DueTime = (ULONG)(NowMs() - StartTime) + 4500;
+    Status = RtlUpdateTimer(Queue, Later.Timer, 4500, 0);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    Sooner.DueTime = (ULONG)(NowMs() - StartTime) + 100;
+    Status = RtlUpdateTimer(Queue, Sooner.Timer, 100, 0);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    for (i = 0; i < _countof(Deleted); i++)
+    {
+        Status = RtlDeleteTimer(Queue, Deleted[i].Timer, INVALID_HANDLE_VALUE);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+
+    Result = WaitForSingleObject(Sooner.Event, 100 + LATE_TOLERANCE);
+    ok_long(Result, WAIT_OBJECT_0);
+    ok(Sooner.FiredAt >= Sooner.DueTime, "Timer due at %lu ms fired at %I64u ms\n", Sooner.DueTime, Sooner.FiredAt);
+    ok(Later.FireCount == 0, "Postponed timer fired at %I64u ms\n", Later.FiredAt);
+
+    Result = WaitForSingleObject(Later.Event, 4500 + LATE_TOLERANCE);
+    ok_long(Result, WAIT_OBJECT_0);
+    ok(Later.FiredAt >= Later.DueTime, "Timer due at %lu ms fired at %I64u ms\n", Later.DueTime, Later.FiredAt);
+
+    Sleep(100);
+    ok_long(Sooner.FireCount, 1);
+    ok_long(Later.FireCount, 1);
+    for (i = 0; i < _countof(Deleted); i++)
+        ok(Deleted[i].FireCount == 0, "Deleted timer %lu fired %ld times\n", i, Deleted[i].FireCount);
+
+    /* A fired timer can be made periodic, then postponed to another level */
+    Later.FireCount = 0;
+    Status = RtlUpdateTimer(Queue, Later.Timer, 0, 100);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Sleep(1000);
+    Status = RtlUpdateTimer(Queue, Later.Timer, 5000, 0);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(Later.FireCount >= 5, "Periodic timer fired %ld times in a second\n", Later.FireCount);
+
+    /* Let a callback that was already running finish */
+    Sleep(100);
+    Later.FireCount = 0;
+    Sleep(1000);
+    ok(Later.FireCount == 0, "Postponed periodic timer fired %ld times\n", Later.FireCount);
+
+    Status = RtlDeleteTimer(Queue, Sooner.Timer, INVALID_HANDLE_VALUE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = RtlDeleteTimer(Queue, Later.Timer, INVALID_HANDLE_VALUE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+Cleanup:
+    if (Sooner.Event)
+        CloseHandle(Sooner.Event);
+    if (Later.Event)
+        CloseHandle(Later.Event);
+}
+
+START_TEST(RtlCreateTimer)
+{
+    HANDLE Queue;
+    NTSTATUS Status;
+
+    QueryPerformanceFrequency(&Frequency);
+    AllFiredEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(AllFiredEvent != NULL, "CreateEventW failed\n");
+    if (!AllFiredEvent)
+        return;
+
+    Status = RtlCreateTimerQueue(&Queue);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        CloseHandle(AllFiredEvent);
+        return;
+    }
+
+    Test_DueTimes(Queue);
+    Test_ManyTimers(Queue);
+    Test_Update(Queue);
+
+    Status = RtlDeleteTimerQueueEx(Queue, INVALID_HANDLE_VALUE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    CloseHandle(AllFiredEvent);
+}
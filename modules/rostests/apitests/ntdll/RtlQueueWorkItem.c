@@ -0,0 +1,146 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Test for RtlQueueWorkItem
+ */
+
+#include "precomp.h"
+
+#define BLOCKING_ITEMS 8
+#define SUBMIT_THREADS 4
+#define ITEMS_PER_THREAD 5000
+
+static LONG StartedCount;
+static HANDLE AllStartedEvent;
+static HANDLE ReleaseEvent;
+
+static LONG ExecutedCount;
+static HANDLE AllExecutedEvent;
+static HANDLE StartSubmitEvent;
+
+static
+VOID
+NTAPI
+BlockingWorkItem(
+    _In_ PVOID Context)
+{
+    /* Only returns once every item is running on its own worker */
+    if (InterlockedIncrement(&StartedCount) == BLOCKING_ITEMS)
+        SetEvent(AllStartedEvent);
+    WaitForSingleObject(ReleaseEvent, 10000);
+}
+
+static
+VOID
+NTAPI
+CountingWorkItem(
+    _In_ PVOID Context)
+{
+    if (InterlockedIncrement(&ExecutedCount) == SUBMIT_THREADS * ITEMS_PER_THREAD)
+        SetEvent(AllExecutedEvent);
+}
+
+static
+DWORD
+WINAPI
+SubmitThread(
+    _In_ PVOID Parameter)
+{
+    ULONG i;
+    NTSTATUS Status;
+    ULONG Failures = 0;
+
+    WaitForSingleObject(StartSubmitEvent, INFINITE);
+    for (i = 0; i < ITEMS_PER_THREAD; i++)
+    {
+        Status = RtlQueueWorkItem(CountingWorkItem, NULL, WT_EXECUTEDEFAULT);
+        if (!NT_SUCCESS(Status))
+            Failures++;
+    }
+    return Failures;
+}
+
+static
+void
+Test_NewWorkers(void)
+{
+    NTSTATUS Status;
+    ULONG i;
+    DWORD Result;
+
+    /* Every item blocks, so each submission has to start a new worker */
+    StartedCount = 0;
+    AllStartedEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ReleaseEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(AllStartedEvent != NULL && ReleaseEvent != NULL, "CreateEventW failed\n");
+    if (!AllStartedEvent || !ReleaseEvent)
+        return;
+
+    for (i = 0; i < BLOCKING_ITEMS; i++)
+    {
+        Status = RtlQueueWorkItem(BlockingWorkItem, NULL, WT_EXECUTEDEFAULT);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+
+    Result = WaitForSingleObject(AllStartedEvent, 5000);
+    ok_long(Result, WAIT_OBJECT_0);
+    ok_long(StartedCount, BLOCKING_ITEMS);
+
+    SetEvent(ReleaseEvent);
+}
+
+static
+void
+Test_ConcurrentSubmit(void)
+{
+    HANDLE Threads[SUBMIT_THREADS];
+    DWORD ExitCode;
+    DWORD Result;
+    ULONG i;
+
+    /* Idle workers must be woken for every item, even when nobody holds the lock */
+    ExecutedCount = 0;
+    AllExecutedEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    StartSubmitEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(AllExecutedEvent != NULL && StartSubmitEvent != NULL, "CreateEventW failed\n");
+    if (!AllExecutedEvent || !StartSubmitEvent)
+        return;
+
+    for (i = 0; i < SUBMIT_THREADS; i++)
+    {
+        Threads[i] = CreateThread(NULL, 0, SubmitThread, NULL, 0, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+        if (!Threads[i])
+        {
+            SetEvent(StartSubmitEvent);
+            WaitForMultipleObjects(i, Threads, TRUE, INFINITE);
+            while (i--)
+                CloseHandle(Threads[i]);
+            return;
+        }
+    }
+
+    SetEvent(StartSubmitEvent);
+    WaitForMultipleObjects(SUBMIT_THREADS, Threads, TRUE, INFINITE);
+    for (i = 0; i < SUBMIT_THREADS; i++)
+    {
+        GetExitCodeThread(Threads[i], &ExitCode);
+        ok(ExitCode == 0, "Thread %lu failed to queue %lu items\n", i, ExitCode);
+        CloseHandle(Threads[i]);
+    }
+
+    Result = WaitForSingleObject(AllExecutedEvent, 30000);
+    ok_long(Result, WAIT_OBJECT_0);
+    ok_long(ExecutedCount, SUBMIT_THREADS * ITEMS_PER_THREAD);
+
+    CloseHandle(StartSubmitEvent);
+    CloseHandle(AllExecutedEvent);
+}
+
+START_TEST(RtlQueueWorkItem)
+{
+    Test_NewWorkers();
+    Test_ConcurrentSubmit();
+
+    /* The blocking items may still be returning, so leave their events open */
+}
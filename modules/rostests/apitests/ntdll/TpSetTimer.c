@@ -0,0 +1,243 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Test for TpSetTimer
+ */
+
+#include "precomp.h"
+
+#define MANY_TIMERS 10000
+#define MANY_TIMERS_SPAN 3000
+#define MAX_WINDOW 100
+
+/* Thread pool timers may be a tick late, but never early */
+#define LATE_TOLERANCE 1000
+
+typedef struct _TIMER_DATA
+{
+    PTP_TIMER Timer;
+    ULONG DueTime;
+    ULONG Window;
+    LONG FireCount;
+    ULONGLONG FiredAt;
+} TIMER_DATA, *PTIMER_DATA;
+
+static NTSTATUS (NTAPI *pTpAllocTimer)(PTP_TIMER *, PTP_TIMER_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static VOID (NTAPI *pTpSetTimer)(PTP_TIMER, PLARGE_INTEGER, LONG, LONG);
+static VOID (NTAPI *pTpWaitForTimer)(PTP_TIMER, BOOL);
+static VOID (NTAPI *pTpReleaseTimer)(PTP_TIMER);
+
+static LARGE_INTEGER Frequency;
+static ULONGLONG StartTime;
+static LONG PendingCount;
+static HANDLE AllFiredEvent;
+
+static
+ULONGLONG
+NowMs(void)
+{
+    LARGE_INTEGER Counter;
+
+    QueryPerformanceCounter(&Counter);
+    return Counter.QuadPart * 1000 / Frequency.QuadPart;
+}
+
+static
+VOID
+NTAPI
+TimerCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _Inout_ PTP_TIMER Timer)
+{
+    PTIMER_DATA Data = Context;
+
+    if (InterlockedIncrement(&Data->FireCount) == 1)
+        Data->FiredAt = NowMs() - StartTime;
+    if (InterlockedDecrement(&PendingCount) == 0)
+        SetEvent(AllFiredEvent);
+}
+
+static
+VOID
+SetTimerMs(
+    _In_ PTIMER_DATA Data,
+    _In_ ULONG DueTime,
+    _In_ LONG Period)
+{
+    LARGE_INTEGER Due;
+
+    Due.QuadPart = (LONGLONG)DueTime * -10000;
+    pTpSetTimer(Data->Timer, &Due, Period, Data->Window);
+}
+
+static
+void
+FreeTimers(
+    _In_ PTIMER_DATA Data,
+    _In_ ULONG Count)
+{
+    ULONG i;
+
+    for (i = 0; i < Count; i++)
+    {
+        if (!Data[i].Timer)
+            continue;
+        pTpSetTimer(Data[i].Timer, NULL, 0, 0);
+        pTpWaitForTimer(Data[i].Timer, TRUE);
+        pTpReleaseTimer(Data[i].Timer);
+    }
+}
+
+/*
+ * Many timers, half of them with a window the timer thread may use to fire
+ * them along with others. None of them may fire before its due time, nor
+ * later than its window allows, give or take the scheduling delays.
+ */
+static
+void
+Test_ManyTimers(void)
+{
+    PTIMER_DATA Data;
+    NTSTATUS Status;
+    ULONG i, Early, Late, Wrong, Seed = 0x7153;
+    ULONGLONG InsertTime;
+    DWORD Result;
+
+    Data = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, MANY_TIMERS * sizeof(*Data));
+    if (!Data)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    for (i = 0; i < MANY_TIMERS; i++)
+    {
+        Status = pTpAllocTimer(&Data[i].Timer, TimerCallback, &Data[i], NULL);
+        if (!NT_SUCCESS(Status))
+        {
+            ok_ntstatus(Status, STATUS_SUCCESS);
+            goto Cleanup;
+        }
+        Data[i].DueTime = RtlRandom(&Seed) % MANY_TIMERS_SPAN;
+        Data[i].Window = (i % 2) ? RtlRandom(&Seed) % MAX_WINDOW : 0;
+    }
+
+    PendingCount = MANY_TIMERS;
+    ResetEvent(AllFiredEvent);
+
+    StartTime = NowMs();
+    for (i = 0; i < MANY_TIMERS; i++)
+        SetTimerMs(&Data[i], Data[i].DueTime, 0);
+    InsertTime = NowMs() - StartTime;
+    trace("Setting %d timers took %I64u ms\n", MANY_TIMERS, InsertTime);
+
+    Result = WaitForSingleObject(AllFiredEvent, MANY_TIMERS_SPAN + 10000);
+    ok_long(Result, WAIT_OBJECT_0);
+
+    Early = Late = Wrong = 0;
+    for (i = 0; i < MANY_TIMERS; i++)
+    {
+        if (Data[i].FireCount != 1)
+            Wrong++;
+        else if (Data[i].FiredAt < Data[i].DueTime)
+            Early++;
+        else if (Data[i].FiredAt > Data[i].DueTime + Data[i].Window + LATE_TOLERANCE)
+            Late++;
+    }
+    ok(Wrong == 0, "%lu timers didn't fire exactly once\n", Wrong);
+    ok(Early == 0, "%lu timers fired early\n", Early);
+    ok(Late == 0, "%lu timers fired after their window\n", Late);
+
+Cleanup:
+    FreeTimers(Data, MANY_TIMERS);
+    HeapFree(GetProcessHeap(), 0, Data);
+}
+
+/* Moved, cancelled and periodic timers have to leave the wheel properly */
+static
+void
+Test_Reset(void)
+{
+    TIMER_DATA Data[4];
+    NTSTATUS Status;
+    DWORD Result;
+    ULONG i;
+
+    RtlZeroMemory(Data, sizeof(Data));
+    for (i = 0; i < _countof(Data); i++)
+    {
+        Status = pTpAllocTimer(&Data[i].Timer, TimerCallback, &Data[i], NULL);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+        if (!NT_SUCCESS(Status))
+            goto Cleanup;
+    }
+
+    PendingCount = MAXLONG;
+    StartTime = NowMs();
+
+    /* Postponed from the second level of the wheel to the third */
+    SetTimerMs(&Data[0], 100, 0);
+    Data[0].DueTime = 5000;
+    SetTimerMs(&Data[0], 5000, 0);
+
+    /* Brought forward */
+    SetTimerMs(&Data[1], 8000, 0);
+    Data[1].DueTime = 200;
+    SetTimerMs(&Data[1], 200, 0);
+
+    /* Cancelled */
+    SetTimerMs(&Data[2], 300, 0);
+    pTpSetTimer(Data[2].Timer, NULL, 0, 0);
+
+    /* Periodic, with a window */
+    Data[3].Window = 20;
+    SetTimerMs(&Data[3], 0, 100);
+
+    Sleep(1000);
+    ok_long(Data[0].FireCount, 0);
+    ok_long(Data[1].FireCount, 1);
+    ok(Data[1].FiredAt >= 200, "Timer due at 200 ms fired at %I64u ms\n", Data[1].FiredAt);
+    ok_long(Data[2].FireCount, 0);
+    ok(Data[3].FireCount >= 5, "Periodic timer fired %ld times in a second\n", Data[3].FireCount);
+
+    pTpSetTimer(Data[3].Timer, NULL, 0, 0);
+    pTpWaitForTimer(Data[3].Timer, TRUE);
+
+    PendingCount = 1;
+    ResetEvent(AllFiredEvent);
+    Result = WaitForSingleObject(AllFiredEvent, 5000 + LATE_TOLERANCE);
+    ok_long(Result, WAIT_OBJECT_0);
+    ok_long(Data[0].FireCount, 1);
+    ok(Data[0].FiredAt >= 5000, "Timer due at 5000 ms fired at %I64u ms\n", Data[0].FiredAt);
+    ok_long(Data[2].FireCount, 0);
+
+Cleanup:
+    FreeTimers(Data, _countof(Data));
+}
+
+START_TEST(TpSetTimer)
+{
+    HMODULE hNtdll = GetModuleHandleW(L"ntdll.dll");
+
+    pTpAllocTimer = (PVOID)GetProcAddress(hNtdll, "TpAllocTimer");
+    pTpSetTimer = (PVOID)GetProcAddress(hNtdll, "TpSetTimer");
+    pTpWaitForTimer = (PVOID)GetProcAddress(hNtdll, "TpWaitForTimer");
+    pTpReleaseTimer = (PVOID)GetProcAddress(hNtdll, "TpReleaseTimer");
+    if (!pTpAllocTimer || !pTpSetTimer || !pTpWaitForTimer || !pTpReleaseTimer)
+    {
+        skip("Thread pool timers are not available\n");
+        return;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    AllFiredEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(AllFiredEvent != NULL, "CreateEventW failed\n");
+    if (!AllFiredEvent)
+        return;
+
+    Test_ManyTimers();
+    Test_Reset();
+
+    CloseHandle(AllFiredEvent);
+}
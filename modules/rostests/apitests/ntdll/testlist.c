@@ -27,7 +27,9 @@ extern void func_wcstombs(void);
 extern void func_DllLoadNotification(void);
 extern void func_LdrEnumResources(void);
 extern void func_LdrFindResource_U(void);
+extern void func_LdrImportHint(void);
 extern void func_LdrLoadDll(void);
+extern void func_LdrPrelink(void);
 extern void func_load_notifications(void);
 extern void func_NtAcceptConnectPort(void);
 extern void func_NtAccessCheck(void);
@@ -86,6 +88,7 @@ extern void func_RtlBitmap(void);
 extern void func_RtlCaptureContext(void);
 extern void func_RtlComputePrivatizedDllName_U(void);
 extern void func_RtlCopyMappedMemory(void);
+extern void func_RtlCreateTimer(void);
 extern void func_RtlCriticalSection(void);
 extern void func_RtlDebugInformation(void);
 extern void func_RtlDeleteAce(void);
@@ -118,6 +121,7 @@ extern void func_RtlNtPathNameToDosPathName(void);
 extern void func_RtlpApplyLengthFunction(void);
 extern void func_RtlpEnsureBufferSize(void);
 extern void func_RtlQueryTimeZoneInformation(void);
+extern void func_RtlQueueWorkItem(void);
 extern void func_RtlReAllocateHeap(void);
 extern void func_RtlRemovePrivileges(void);
 extern void func_RtlUnhandledExceptionFilter(void);
@@ -131,6 +135,7 @@ extern void func_RtlxUnicodeStringToAnsiSize(void);
 extern void func_RtlxUnicodeStringToOemSize(void);
 extern void func_StackOverflow(void);
 extern void func_TimerResolution(void);
+extern void func_TpSetTimer(void);
 extern void func_UserModeException(void);
 
 const struct test winetest_testlist[] =
@@ -161,7 +166,9 @@ const struct test winetest_testlist[] =
     { "DllLoadNotification",            func_DllLoadNotification },
     { "LdrEnumResources",               func_LdrEnumResources },
     { "LdrFindResource_U",              func_LdrFindResource_U },
+    { "LdrImportHint",                  func_LdrImportHint },
     { "LdrLoadDll",                     func_LdrLoadDll },
+    { "LdrPrelink",                     func_LdrPrelink },
     { "load_notifications",             func_load_notifications },
     { "NtAcceptConnectPort",            func_NtAcceptConnectPort },
     { "NtAccessCheck",                  func_NtAccessCheck },
@@ -219,6 +226,7 @@ const struct test winetest_testlist[] =
     { "RtlBitmapApi",                   func_RtlBitmap },
     { "RtlComputePrivatizedDllName_U",  func_RtlComputePrivatizedDllName_U },
     { "RtlCopyMappedMemory",            func_RtlCopyMappedMemory },
+    { "RtlCreateTimer",                 func_RtlCreateTimer },
     { "RtlCriticalSection",             func_RtlCriticalSection },
     { "RtlDebugInformation",            func_RtlDebugInformation },
     { "RtlDeleteAce",                   func_RtlDeleteAce },
@@ -251,6 +259,7 @@ const struct test winetest_testlist[] =
     { "RtlpApplyLengthFunction",        func_RtlpApplyLengthFunction },
     { "RtlpEnsureBufferSize",           func_RtlpEnsureBufferSize },
     { "RtlQueryTimeZoneInformation",    func_RtlQueryTimeZoneInformation },
+    { "RtlQueueWorkItem",               func_RtlQueueWorkItem },
     { "RtlReAllocateHeap",              func_RtlReAllocateHeap },
     { "RtlRemovePrivileges",            func_RtlRemovePrivileges },
     { "RtlUnhandledExceptionFilter",    func_RtlUnhandledExceptionFilter },
@@ -263,6 +272,7 @@ const struct test winetest_testlist[] =
     { "RtlValidateUnicodeString",       func_RtlValidateUnicodeString },
     { "StackOverflow",                  func_StackOverflow },
     { "TimerResolution",                func_TimerResolution },
+    { "TpSetTimer",                     func_TpSetTimer },
     { "UserModeException",              func_UserModeException },
 #ifdef _M_IX86
     { "RtlUnwind",                      func_RtlUnwind },
@@ -0,0 +1,286 @@
+/*
+ * PROJECT:         ReactOS kernel-mode tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Kernel-Mode Test for byte range locks on files with many locks
+ */
+
+#include <kmt_test.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#define LOCK_COUNT      10000
+#define LOCK_STRIDE     0x1000
+#define LOCK_LENGTH     0x100
+#define CHECK_COUNT     100000
+#define OTHER_PROCESS   ((PEPROCESS)(ULONG_PTR)0x1234)
+
+static
+BOOLEAN
+TakeLock(
+    _In_ PFILE_LOCK FileLock,
+    _In_ PFILE_OBJECT FileObject,
+    _In_ LONGLONG Offset,
+    _In_ LONGLONG Length,
+    _In_ PEPROCESS Process,
+    _In_ ULONG Key,
+    _In_ BOOLEAN Exclusive)
+{
+    LARGE_INTEGER FileOffset, LockLength;
+    IO_STATUS_BLOCK IoStatus;
+
+    FileOffset.QuadPart = Offset;
+    LockLength.QuadPart = Length;
+    return FsRtlFastLock(FileLock,
+                         FileObject,
+                         &FileOffset,
+                         &LockLength,
+                         Process,
+                         Key,
+                         TRUE,
+                         Exclusive,
+                         &IoStatus,
+                         NULL,
+                         FALSE);
+}
+
+static
+BOOLEAN
+CheckRead(
+    _In_ PFILE_LOCK FileLock,
+    _In_ PFILE_OBJECT FileObject,
+    _In_ LONGLONG Offset,
+    _In_ LONGLONG Length,
+    _In_ PEPROCESS Process,
+    _In_ ULONG Key)
+{
+    LARGE_INTEGER FileOffset, CheckLength;
+
+    FileOffset.QuadPart = Offset;
+    CheckLength.QuadPart = Length;
+    return FsRtlFastCheckLockForRead(FileLock, &FileOffset, &CheckLength, Key, FileObject, Process);
+}
+
+static
+BOOLEAN
+CheckWrite(
+    _In_ PFILE_LOCK FileLock,
+    _In_ PFILE_OBJECT FileObject,
+    _In_ LONGLONG Offset,
+    _In_ LONGLONG Length,
+    _In_ PEPROCESS Process,
+    _In_ ULONG Key)
+{
+    LARGE_INTEGER FileOffset, CheckLength;
+
+    FileOffset.QuadPart = Offset;
+    CheckLength.QuadPart = Length;
+    return FsRtlFastCheckLockForWrite(FileLock, &FileOffset, &CheckLength, Key, FileObject, Process);
+}
+
+static
+ULONG
+CountLocks(
+    _In_ PFILE_LOCK FileLock)
+{
+    PFILE_LOCK_INFO LockInfo;
+    ULONG Count = 0;
+
+    for (LockInfo = FsRtlGetNextFileLock(FileLock, TRUE);
+         LockInfo;
+         LockInfo = FsRtlGetNextFileLock(FileLock, FALSE))
+    {
+        Count++;
+    }
+
+    return Count;
+}
+
+static BOOLEAN LockIrpCompleted;
+static NTSTATUS LockIrpStatus;
+
+static
+NTSTATUS
+NTAPI
+CompleteLockIrp(
+    _In_ PVOID Context,
+    _In_ PIRP Irp)
+{
+    LockIrpCompleted = TRUE;
+    LockIrpStatus = Irp->IoStatus.Status;
+    IoFreeIrp(Irp);
+    return LockIrpStatus;
+}
+
+/* A waiting shared lock granted by UnlockAll must not pull the table from
+ * under its walk: the granted range swallows a lock the walk had passed */
+static
+VOID
+TestUnlockAllGrantsSharedLock(VOID)
+{
+    FILE_LOCK FileLock;
+    FILE_OBJECT FileObject;
+    PEPROCESS Process = PsGetCurrentProcess();
+    LARGE_INTEGER FileOffset, LockLength;
+    IO_STATUS_BLOCK IoStatus;
+    PIO_STACK_LOCATION IoStack;
+    PIRP Irp;
+    BOOLEAN Result;
+
+    RtlZeroMemory(&FileObject, sizeof(FileObject));
+    FsRtlInitializeFileLock(&FileLock, CompleteLockIrp, NULL);
+    LockIrpCompleted = FALSE;
+
+    /* Somebody else's shared lock, and our exclusive one right after it */
+    ok(TakeLock(&FileLock, &FileObject, 0, LOCK_LENGTH, OTHER_PROCESS, 0, FALSE), "Lock failed\n");
+    ok(TakeLock(&FileLock, &FileObject, LOCK_LENGTH, LOCK_LENGTH, Process, 0, TRUE), "Lock failed\n");
+
+    Irp = IoAllocateIrp(1, FALSE);
+    if (skip(Irp != NULL, "Out of memory\n"))
+    {
+        FsRtlUninitializeFileLock(&FileLock);
+        return;
+    }
+
+    /* A shared lock across both has to wait for the exclusive one */
+    FileOffset.QuadPart = LOCK_LENGTH / 2;
+    LockLength.QuadPart = LOCK_LENGTH;
+    IoSetNextIrpStackLocation(Irp);
+    IoStack = IoGetCurrentIrpStackLocation(Irp);
+    IoStack->MajorFunction = IRP_MJ_LOCK_CONTROL;
+    IoStack->MinorFunction = IRP_MN_LOCK;
+    IoStack->Flags = 0;
+    IoStack->FileObject = &FileObject;
+    IoStack->Parameters.LockControl.Length = &LockLength;
+    IoStack->Parameters.LockControl.Key = 0;
+    IoStack->Parameters.LockControl.ByteOffset = FileOffset;
+    Irp->Tail.Overlay.Thread = PsGetCurrentThread();
+    Irp->RequestorMode = KernelMode;
+
+    Result = FsRtlPrivateLock(&FileLock,
+                              &FileObject,
+                              &FileOffset,
+                              &LockLength,
+                              Process,
+                              0,
+                              FALSE,
+                              FALSE,
+                              &IoStatus,
+                              Irp,
+                              NULL,
+                              FALSE);
+    ok(!Result, "Lock granted\n");
+    ok_eq_hex(IoStatus.Status, STATUS_PENDING);
+    ok(!LockIrpCompleted, "Lock IRP completed\n");
+
+    /* Dropping the exclusive lock grants the waiting one, and the shared
+     * ranges are rebuilt into a single one */
+    FsRtlFastUnlockAll(&FileLock, &FileObject, Process, NULL);
+    ok(LockIrpCompleted, "Lock IRP not completed\n");
+    ok_eq_hex(LockIrpStatus, STATUS_SUCCESS);
+    ok_eq_ulong(CountLocks(&FileLock), 1UL);
+    ok(!CheckWrite(&FileLock, &FileObject, LOCK_LENGTH / 2, LOCK_LENGTH, OTHER_PROCESS, 0), "Write allowed\n");
+    ok(CheckWrite(&FileLock, &FileObject, LOCK_LENGTH / 2 + LOCK_LENGTH, LOCK_LENGTH / 2, OTHER_PROCESS, 0), "Write denied\n");
+
+    FsRtlFastUnlockAll(&FileLock, &FileObject, Process, NULL);
+    FsRtlFastUnlockAll(&FileLock, &FileObject, OTHER_PROCESS, NULL);
+    ok_eq_ulong(CountLocks(&FileLock), 0UL);
+
+    FsRtlUninitializeFileLock(&FileLock);
+}
+
+START_TEST(FsRtlFileLock)
+{
+    FILE_LOCK FileLock;
+    FILE_OBJECT FileObject;
+    PEPROCESS Process = PsGetCurrentProcess();
+    ULONG Taken, i;
+    ULONG Failures;
+    ULONGLONG StartTime, EndTime;
+
+    RtlZeroMemory(&FileObject, sizeof(FileObject));
+    FsRtlInitializeFileLock(&FileLock, NULL, NULL);
+
+    /* A file without locks lets everything through */
+    ok(CheckRead(&FileLock, &FileObject, 0, LOCK_LENGTH, OTHER_PROCESS, 1), "Read denied\n");
+    ok(CheckWrite(&FileLock, &FileObject, 0, LOCK_LENGTH, OTHER_PROCESS, 1), "Write denied\n");
+
+    /* Lock the first bytes of many pages */
+    StartTime = KeQueryInterruptTime();
+    for (Taken = 0; Taken < LOCK_COUNT; Taken++)
+    {
+        if (!TakeLock(&FileLock, &FileObject, (LONGLONG)Taken * LOCK_STRIDE, LOCK_LENGTH, Process, 0, TRUE))
+            break;
+    }
+    EndTime = KeQueryInterruptTime();
+    ok_eq_ulong(Taken, (ULONG)LOCK_COUNT);
+    trace("Took %lu locks in %I64u ms\n", Taken, (EndTime - StartTime) / 10000);
+    ok_eq_ulong(CountLocks(&FileLock), Taken);
+
+    /* Overlapping exclusive locks must conflict, whoever asks */
+    ok(!TakeLock(&FileLock, &FileObject, LOCK_STRIDE + 1, 1, Process, 0, TRUE), "Lock taken\n");
+    ok(!TakeLock(&FileLock, &FileObject, LOCK_STRIDE + 1, 1, OTHER_PROCESS, 0, FALSE), "Lock taken\n");
+    ok(!TakeLock(&FileLock, &FileObject, LOCK_LENGTH, 3 * LOCK_STRIDE, Process, 0, TRUE), "Lock taken\n");
+
+    /* Checks only fail against somebody else's lock */
+    Failures = 0;
+    StartTime = KeQueryInterruptTime();
+    for (i = 0; i < CHECK_COUNT; i++)
+    {
+        LONGLONG Offset = (LONGLONG)((i * 7919) % Taken) * LOCK_STRIDE;
+
+        if (!CheckRead(&FileLock, &FileObject, Offset, LOCK_LENGTH, Process, 0) ||
+            !CheckWrite(&FileLock, &FileObject, Offset, LOCK_LENGTH, Process, 0) ||
+            CheckWrite(&FileLock, &FileObject, Offset, LOCK_LENGTH, OTHER_PROCESS, 0) ||
+            CheckRead(&FileLock, &FileObject, Offset, LOCK_LENGTH, Process, 1) ||
+            !CheckWrite(&FileLock, &FileObject, Offset + LOCK_LENGTH, LOCK_STRIDE - LOCK_LENGTH, OTHER_PROCESS, 1))
+        {
+            Failures++;
+        }
+    }
+    EndTime = KeQueryInterruptTime();
+    ok_eq_ulong(Failures, 0UL);
+    trace("Did %lu checks in %I64u ns each\n",
+          5 * i, (EndTime - StartTime) * 100 / (5 * i));
+
+    /* A range spanning several locks must look at all of them, not just one */
+    if (Taken > 3)
+    {
+        ok(CheckWrite(&FileLock, &FileObject, 0, 3 * LOCK_STRIDE, Process, 0), "Write denied\n");
+        ok(!CheckWrite(&FileLock, &FileObject, LOCK_LENGTH, 3 * LOCK_STRIDE, OTHER_PROCESS, 0), "Write allowed\n");
+        ok(!CheckRead(&FileLock, &FileObject, LOCK_LENGTH, 3 * LOCK_STRIDE, Process, 1), "Read allowed\n");
+
+        /* Including when only one of them belongs to somebody else */
+        ok(TakeLock(&FileLock, &FileObject, 2 * LOCK_STRIDE + 2 * LOCK_LENGTH, LOCK_LENGTH, OTHER_PROCESS, 0, TRUE), "Lock failed\n");
+        ok(!CheckWrite(&FileLock, &FileObject, 0, 3 * LOCK_STRIDE, Process, 0), "Write allowed\n");
+        ok(!CheckRead(&FileLock, &FileObject, 0, 3 * LOCK_STRIDE, Process, 0), "Read allowed\n");
+        ok(CheckRead(&FileLock, &FileObject, 0, 2 * LOCK_STRIDE + 2 * LOCK_LENGTH, Process, 0), "Read denied\n");
+        Taken++;
+    }
+
+    /* Past the last lock, nothing is in the way */
+    ok(CheckWrite(&FileLock, &FileObject, (LONGLONG)Taken * LOCK_STRIDE, LOCK_STRIDE, OTHER_PROCESS, 1), "Write denied\n");
+
+    /* Overlapping shared locks end up as a single range */
+    ok(TakeLock(&FileLock, &FileObject, (LONGLONG)LOCK_COUNT * LOCK_STRIDE, LOCK_LENGTH, Process, 0, FALSE), "Lock failed\n");
+    ok(TakeLock(&FileLock, &FileObject, (LONGLONG)LOCK_COUNT * LOCK_STRIDE + LOCK_LENGTH / 2, LOCK_LENGTH, OTHER_PROCESS, 0, FALSE), "Lock failed\n");
+    ok_eq_ulong(CountLocks(&FileLock), Taken + 1);
+    ok(CheckRead(&FileLock, &FileObject, (LONGLONG)LOCK_COUNT * LOCK_STRIDE, 2 * LOCK_LENGTH, OTHER_PROCESS, 1), "Read denied\n");
+    ok(!TakeLock(&FileLock, &FileObject, (LONGLONG)LOCK_COUNT * LOCK_STRIDE + LOCK_LENGTH, 1, Process, 0, TRUE), "Lock taken\n");
+
+    /* Dropping our locks leaves the other process' alone */
+    StartTime = KeQueryInterruptTime();
+    FsRtlFastUnlockAll(&FileLock, &FileObject, Process, NULL);
+    EndTime = KeQueryInterruptTime();
+    trace("Dropped all locks in %I64u ms\n", (EndTime - StartTime) / 10000);
+    ok_eq_ulong(CountLocks(&FileLock), Taken > LOCK_COUNT ? 2UL : 1UL);
+    ok(CheckWrite(&FileLock, &FileObject, 0, (LONGLONG)LOCK_COUNT * LOCK_STRIDE, OTHER_PROCESS, 0), "Write denied\n");
+
+    FsRtlFastUnlockAll(&FileLock, &FileObject, OTHER_PROCESS, NULL);
+    ok_eq_ulong(CountLocks(&FileLock), 0UL);
+    ok(CheckWrite(&FileLock, &FileObject, 0, MAXLONG, OTHER_PROCESS, 1), "Write denied\n");
+
+    FsRtlUninitializeFileLock(&FileLock);
+
+    TestUnlockAllGrantsSharedLock();
+}
@@ -2474,6 +2474,77 @@ end_test:
     FsRtlUninitializeLargeMcb(&Mcb);
 }
 
+#define MANY_RUNS_COUNT 100000
+
+static VOID FsRtlLargeMcbTestsManyRuns(VOID)
+{
+    LARGE_MCB Mcb;
+    ULONG i, k, NbRuns, Index, Failures;
+    LONGLONG Vbn, Lbn, SectorCount, StartingLbn, CountFromStartingLbn;
+    ULONGLONG StartTime, EndTime;
+
+    FsRtlInitializeLargeMcb(&Mcb, PagedPool);
+
+    /* One sector every other sector: a run, then a hole, and so on */
+    Failures = 0;
+    StartTime = KeQueryInterruptTime();
+    for (i = 0; i < MANY_RUNS_COUNT; i++)
+    {
+        if (!FsRtlAddLargeMcbEntry(&Mcb, 2 * i, 2 * i, 1))
+            Failures++;
+    }
+    EndTime = KeQueryInterruptTime();
+    ok_eq_ulong(Failures, 0UL);
+    trace("Added %lu runs in %I64u ms\n", i, (EndTime - StartTime) / 10000);
+
+    NbRuns = FsRtlNumberOfRunsInLargeMcb(&Mcb);
+    ok(NbRuns == 2 * MANY_RUNS_COUNT - 1, "Expected %lu runs, got: %lu\n", 2 * MANY_RUNS_COUNT - 1, NbRuns);
+
+    Failures = 0;
+    StartTime = KeQueryInterruptTime();
+    for (i = 0; FsRtlGetNextLargeMcbEntry(&Mcb, i, &Vbn, &Lbn, &SectorCount); i++)
+    {
+        if (Vbn != i || Lbn != ((i % 2) ? -1 : (LONGLONG)i) || SectorCount != 1)
+            Failures++;
+    }
+    EndTime = KeQueryInterruptTime();
+    ok_eq_ulong(Failures, 0UL);
+    ok(i == NbRuns, "Expected %lu runs, enumerated: %lu\n", NbRuns, i);
+    trace("Enumerated %lu runs in %I64u ms\n", i, (EndTime - StartTime) / 10000);
+
+    Failures = 0;
+    StartTime = KeQueryInterruptTime();
+    for (i = 0; i < MANY_RUNS_COUNT; i++)
+    {
+        k = (i * 7919) % NbRuns;
+        if (!FsRtlLookupLargeMcbEntry(&Mcb, k, &Lbn, &SectorCount, &StartingLbn, &CountFromStartingLbn, &Index) ||
+            Lbn != ((k % 2) ? -1 : (LONGLONG)k) || SectorCount != 1 || CountFromStartingLbn != 1 || Index != k)
+        {
+            Failures++;
+        }
+    }
+    EndTime = KeQueryInterruptTime();
+    ok_eq_ulong(Failures, 0UL);
+    trace("Looked up %lu runs in %I64u ms\n", i, (EndTime - StartTime) / 10000);
+
+    /* Filling the holes must coalesce everything back into a single run */
+    for (i = 0; i < MANY_RUNS_COUNT - 1; i++)
+    {
+        k = 2 * ((i * 7919) % (MANY_RUNS_COUNT - 1)) + 1;
+        if (!FsRtlAddLargeMcbEntry(&Mcb, k, k, 1))
+            break;
+    }
+    ok(i == MANY_RUNS_COUNT - 1, "Failed to fill hole %lu\n", i);
+    NbRuns = FsRtlNumberOfRunsInLargeMcb(&Mcb);
+    ok(NbRuns == 1, "Expected 1 run, got: %lu\n", NbRuns);
+    ok(FsRtlLookupLastLargeMcbEntryAndIndex(&Mcb, &Vbn, &Lbn, &Index) == TRUE, "expected TRUE, got FALSE\n");
+    ok(Vbn == 2 * MANY_RUNS_COUNT - 2, "Expected Vbn %lu, got: %I64d\n", 2 * MANY_RUNS_COUNT - 2, Vbn);
+    ok(Lbn == 2 * MANY_RUNS_COUNT - 2, "Expected Lbn %lu, got: %I64d\n", 2 * MANY_RUNS_COUNT - 2, Lbn);
+    ok(Index == 0, "Expected Index 0, got: %lu\n", Index);
+
+    FsRtlUninitializeLargeMcb(&Mcb);
+}
+
 START_TEST(FsRtlMcb)
 {
     FsRtlMcbTest();
@@ -2482,4 +2553,5 @@ START_TEST(FsRtlMcb)
     FsRtlLargeMcbTestsFastFat();
     FsRtlLargeMcbTestsFastFat_2();
     FsRtlLargeMcbTestsFastFat_3();
+    FsRtlLargeMcbTestsManyRuns();
 }
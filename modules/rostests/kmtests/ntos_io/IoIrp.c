@@ -11,6 +11,177 @@
 #define NDEBUG
 #include <debug.h>
 
+#define ALLOCATIONS 32
+
+static BOOLEAN IsReactOS;
+
+/*
+ * Allocates a batch of IRPs, frees them and does it again, so that the second
+ * batch comes from the lookaside lists. On ReactOS, IRPs with up to 16 stack
+ * locations come from lists holding 1, 4, 8 or 16 of them; ClassSize is the
+ * one expected, 0 for pool.
+ */
+static
+VOID
+TestIrpClass(
+    _In_ CCHAR StackSize,
+    _In_ CCHAR ClassSize)
+{
+    PIRP Irps[ALLOCATIONS];
+    ULONG Round, i;
+    ULONG Failed = 0, BadFields = 0, BadSize = 0, BadFlags = 0;
+    KIRQL OldIrql;
+
+    /* Stay on this processor, so that the IRPs go back to its lists */
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+    for (Round = 0; Round < 2; Round++)
+    {
+        for (i = 0; i < ALLOCATIONS; i++)
+        {
+            Irps[i] = IoAllocateIrp(StackSize, FALSE);
+            if (!Irps[i])
+            {
+                Failed++;
+                continue;
+            }
+
+            if (Irps[i]->Type != IO_TYPE_IRP ||
+                Irps[i]->StackCount != StackSize ||
+                Irps[i]->CurrentLocation != StackSize + 1 ||
+                Irps[i]->Tail.Overlay.CurrentStackLocation != (PIO_STACK_LOCATION)(Irps[i] + 1) + StackSize ||
+                !IsListEmpty(&Irps[i]->ThreadListEntry))
+            {
+                BadFields++;
+            }
+
+            if (Irps[i]->Size < IoSizeOfIrp(StackSize) ||
+                (IsReactOS && ClassSize && Irps[i]->Size != IoSizeOfIrp(ClassSize)))
+            {
+                BadSize++;
+            }
+            else
+            {
+                /* Every stack location must be ours, whatever size the IRP had before */
+                RtlFillMemory(Irps[i] + 1, StackSize * sizeof(IO_STACK_LOCATION), 0x55);
+            }
+
+            if (IsReactOS && !!(Irps[i]->AllocationFlags & IRP_ALLOCATED_FIXED_SIZE) != !!ClassSize)
+                BadFlags++;
+        }
+
+        for (i = 0; i < ALLOCATIONS; i++)
+        {
+            if (Irps[i])
+                IoFreeIrp(Irps[i]);
+        }
+    }
+    KeLowerIrql(OldIrql);
+
+    ok(Failed == 0, "%lu allocations of %d stack locations failed\n", Failed, StackSize);
+    ok(BadFields == 0, "%lu IRPs of %d stack locations weren't initialized\n", BadFields, StackSize);
+    ok(BadSize == 0, "%lu IRPs of %d stack locations had the wrong size\n", BadSize, StackSize);
+    ok(BadFlags == 0, "%lu IRPs of %d stack locations had the wrong allocation flags\n", BadFlags, StackSize);
+}
+
+/* The same for MDLs, which come from lists of 23 or 256 pages on ReactOS */
+static
+VOID
+TestMdlClass(
+    _In_ ULONG Pages,
+    _In_ BOOLEAN FixedSize)
+{
+    PVOID Address = (PVOID)(ULONG_PTR)(16 * PAGE_SIZE);
+    ULONG Length = Pages * PAGE_SIZE;
+    PMDL Mdls[ALLOCATIONS];
+    ULONG Round, i;
+    ULONG Failed = 0, BadFields = 0, BadFlags = 0;
+    KIRQL OldIrql;
+
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+    for (Round = 0; Round < 2; Round++)
+    {
+        for (i = 0; i < ALLOCATIONS; i++)
+        {
+            Mdls[i] = IoAllocateMdl(Address, Length, FALSE, FALSE, NULL);
+            if (!Mdls[i])
+            {
+                Failed++;
+                continue;
+            }
+
+            if (Mdls[i]->Size != MmSizeOfMdl(Address, Length) ||
+                Mdls[i]->ByteCount != Length ||
+                Mdls[i]->StartVa != Address ||
+                Mdls[i]->Next != NULL)
+            {
+                BadFields++;
+            }
+            else
+            {
+                RtlFillMemory(MmGetMdlPfnArray(Mdls[i]), Pages * sizeof(PFN_NUMBER), 0x55);
+            }
+
+            if (IsReactOS && !!(Mdls[i]->MdlFlags & MDL_ALLOCATED_FIXED_SIZE) != FixedSize)
+                BadFlags++;
+        }
+
+        for (i = 0; i < ALLOCATIONS; i++)
+        {
+            if (Mdls[i])
+                IoFreeMdl(Mdls[i]);
+        }
+    }
+    KeLowerIrql(OldIrql);
+
+    ok(Failed == 0, "%lu allocations of %lu page MDLs failed\n", Failed, Pages);
+    ok(BadFields == 0, "%lu MDLs of %lu pages weren't initialized\n", BadFields, Pages);
+    ok(BadFlags == 0, "%lu MDLs of %lu pages had the wrong allocation flags\n", BadFlags, Pages);
+}
+
+/* The lists kept in the PRCB count every allocation and free made through them */
+static
+VOID
+TestLookasideCounters(
+    _In_ PP_NPAGED_LOOKASIDE_NUMBER Number,
+    _In_ CCHAR StackSize,
+    _In_ ULONG Pages)
+{
+    PGENERAL_LOOKASIDE Lookaside;
+    ULONG Allocates, Frees;
+    PVOID Entries[ALLOCATIONS];
+    ULONG i;
+    KIRQL OldIrql;
+
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+    Lookaside = KeGetCurrentPrcb()->PPLookasideList[Number].P;
+    Allocates = Lookaside->TotalAllocates;
+    Frees = Lookaside->TotalFrees;
+
+    for (i = 0; i < ALLOCATIONS; i++)
+    {
+        if (StackSize)
+            Entries[i] = IoAllocateIrp(StackSize, FALSE);
+        else
+            Entries[i] = IoAllocateMdl(NULL, Pages * PAGE_SIZE, FALSE, FALSE, NULL);
+    }
+    Allocates = Lookaside->TotalAllocates - Allocates;
+
+    for (i = 0; i < ALLOCATIONS; i++)
+    {
+        if (!Entries[i])
+            continue;
+        if (StackSize)
+            IoFreeIrp(Entries[i]);
+        else
+            IoFreeMdl(Entries[i]);
+    }
+    Frees = Lookaside->TotalFrees - Frees;
+    KeLowerIrql(OldIrql);
+
+    ok(Allocates == ALLOCATIONS, "List %d counted %lu allocations instead of %d\n", Number, Allocates, ALLOCATIONS);
+    ok(Frees == ALLOCATIONS, "List %d counted %lu frees instead of %d\n", Number, Frees, ALLOCATIONS);
+}
+
 START_TEST(IoIrp)
 {
     USHORT size;
@@ -26,7 +197,7 @@ START_TEST(IoIrp)
 
         ok(6 == iorp->Type, "Irp type should be 6, but got %d\n", iorp->Type);
         ok(iorp->Size == size, "Irp size should be %d, but got %d\n",
-            iorp->Size, size);
+            size, iorp->Size);
         ok(5 == iorp->StackCount, "Irp StackCount should be 5, but got %d\n",
             iorp->StackCount);
         ok(6 == iorp->CurrentLocation, "Irp CurrentLocation should be 6, but got %d\n",
@@ -48,7 +219,7 @@ START_TEST(IoIrp)
         ok(6 == iorp->Type, "Irp type should be 6, but got %d\n", iorp->Type);
         ok(iorp->Size >= size,
             "Irp size should be more or equal to %d, but got %d\n",
-            iorp->Size, size);
+            size, iorp->Size);
         ok(2 == iorp->StackCount, "Irp StackCount should be 2, but got %d\n",
             iorp->StackCount);
         ok(3 == iorp->CurrentLocation, "Irp CurrentLocation should be 3, but got %d\n",
@@ -74,7 +245,7 @@ START_TEST(IoIrp)
         ok(6 == iorp->Type, "Irp type should be 6, but got %d\n", iorp->Type);
         ok(iorp->Size >= size,
             "Irp size should be more or equal to %d, but got %d\n",
-            iorp->Size, size);
+            size, iorp->Size);
         ok(2 == iorp->StackCount, "Irp StackCount should be 2, but got %d\n",
             iorp->StackCount);
         ok(3 == iorp->CurrentLocation, "Irp CurrentLocation should be 3, but got %d\n",
@@ -90,4 +261,67 @@ START_TEST(IoIrp)
 
         IoFreeIrp(iorp);
     }
+
+    // 4th test: deep stacks, freed and reallocated
+    size = sizeof(IRP) + 12 * sizeof(IO_STACK_LOCATION);
+    iorp = IoAllocateIrp(12, FALSE);
+
+    if (NULL != iorp)
+    {
+        ok(iorp->Size >= size,
+            "Irp size should be more or equal to %d, but got %d\n",
+            size, iorp->Size);
+        ok(12 == iorp->StackCount, "Irp StackCount should be 12, but got %d\n",
+            iorp->StackCount);
+        ok(13 == iorp->CurrentLocation, "Irp CurrentLocation should be 13, but got %d\n",
+            iorp->CurrentLocation);
+        ok ((PIO_STACK_LOCATION)(iorp + 1) + 12 ==
+            iorp->Tail.Overlay.CurrentStackLocation,
+            "CurrentStackLocation mismatch\n");
+
+        IoFreeIrp(iorp);
+
+        iorp = IoAllocateIrp(10, FALSE);
+        ok(iorp != NULL, "IoAllocateIrp failed\n");
+        if (NULL != iorp)
+        {
+            size = sizeof(IRP) + 10 * sizeof(IO_STACK_LOCATION);
+            ok(iorp->Size >= size,
+                "Irp size should be more or equal to %d, but got %d\n",
+                size, iorp->Size);
+            ok(10 == iorp->StackCount, "Irp StackCount should be 10, but got %d\n",
+                iorp->StackCount);
+            ok(IsListEmpty(&iorp->ThreadListEntry), "IRP thread list is not empty\n");
+
+            IoFreeIrp(iorp);
+        }
+    }
+
+    // 5th test: every lookaside class, each one refilled by the smaller sizes it holds
+    IsReactOS = *(PULONG)(KI_USER_SHARED_DATA + PAGE_SIZE - sizeof(ULONG)) == 0x8eac705;
+    if (!IsReactOS)
+        trace("Not ReactOS, not checking the lookaside classes\n");
+
+    TestIrpClass(1, 1);
+    TestIrpClass(2, 4);
+    TestIrpClass(4, 4);
+    TestIrpClass(5, 8);
+    TestIrpClass(8, 8);
+    TestIrpClass(9, 16);
+    TestIrpClass(16, 16);
+    TestIrpClass(17, 0);
+
+    TestMdlClass(1, TRUE);
+    TestMdlClass(23, TRUE);
+    TestMdlClass(24, TRUE);
+    TestMdlClass(256, TRUE);
+    TestMdlClass(257, FALSE);
+
+    // 6th test: reuse counters
+    if (IsReactOS)
+    {
+        TestLookasideCounters(LookasideSmallIrpList, 1, 0);
+        TestLookasideCounters(LookasideLargeIrpList, 8, 0);
+        TestLookasideCounters(LookasideMdlList, 0, 1);
+    }
 }
@@ -0,0 +1,210 @@
+/*
+ * PROJECT:         ReactOS kernel-mode tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Kernel-Mode Test for large object directories
+ */
+
+#include <kmt_test.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#define OBJECT_COUNT    100000
+#define OPEN_COUNT      10000
+
+static
+NTSTATUS
+CreateNamedEvent(
+    _In_ HANDLE DirectoryHandle,
+    _In_ ULONG Number,
+    _Out_ PHANDLE EventHandle)
+{
+    WCHAR NameBuffer[32];
+    UNICODE_STRING Name;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+
+    RtlInitEmptyUnicodeString(&Name, NameBuffer, sizeof(NameBuffer));
+    RtlUnicodeStringPrintf(&Name, L"Event%lu", Number);
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &Name,
+                               OBJ_KERNEL_HANDLE,
+                               DirectoryHandle,
+                               NULL);
+    return ZwCreateEvent(EventHandle,
+                         EVENT_ALL_ACCESS,
+                         &ObjectAttributes,
+                         NotificationEvent,
+                         FALSE);
+}
+
+static
+NTSTATUS
+OpenNamedEvent(
+    _In_ HANDLE DirectoryHandle,
+    _In_ ULONG Number,
+    _Out_ PHANDLE EventHandle)
+{
+    WCHAR NameBuffer[32];
+    UNICODE_STRING Name;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+
+    RtlInitEmptyUnicodeString(&Name, NameBuffer, sizeof(NameBuffer));
+    RtlUnicodeStringPrintf(&Name, L"Event%lu", Number);
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &Name,
+                               OBJ_KERNEL_HANDLE | OBJ_CASE_INSENSITIVE,
+                               DirectoryHandle,
+                               NULL);
+    return ZwOpenEvent(EventHandle, EVENT_ALL_ACCESS, &ObjectAttributes);
+}
+
+static
+ULONG
+CountDirectoryEntries(
+    _In_ HANDLE DirectoryHandle)
+{
+    NTSTATUS Status;
+    PVOID Buffer;
+    ULONG Context = 0, ReturnLength;
+    ULONG Count = 0;
+    POBJECT_DIRECTORY_INFORMATION DirectoryInfo;
+
+    Buffer = ExAllocatePoolWithTag(PagedPool, PAGE_SIZE, 'dOmK');
+    if (skip(Buffer != NULL, "No buffer\n"))
+        return 0;
+
+    do
+    {
+        Status = ZwQueryDirectoryObject(DirectoryHandle,
+                                        Buffer,
+                                        PAGE_SIZE,
+                                        FALSE,
+                                        FALSE,
+                                        &Context,
+                                        &ReturnLength);
+        if (!NT_SUCCESS(Status))
+            break;
+
+        for (DirectoryInfo = Buffer; DirectoryInfo->Name.Length; DirectoryInfo++)
+            Count++;
+    } while (Status == STATUS_MORE_ENTRIES);
+    ok_eq_hex(Status, STATUS_NO_MORE_ENTRIES);
+
+    ExFreePoolWithTag(Buffer, 'dOmK');
+    return Count;
+}
+
+START_TEST(ObDirectory)
+{
+    NTSTATUS Status;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    HANDLE DirectoryHandle;
+    HANDLE EventHandle;
+    PHANDLE Handles;
+    ULONG Created, i;
+    ULONG Failures;
+    ULONGLONG StartTime, EndTime;
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               NULL,
+                               OBJ_KERNEL_HANDLE,
+                               NULL,
+                               NULL);
+    Status = ZwCreateDirectoryObject(&DirectoryHandle,
+                                     DIRECTORY_ALL_ACCESS,
+                                     &ObjectAttributes);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    if (skip(NT_SUCCESS(Status), "No directory\n"))
+        return;
+
+    Handles = ExAllocatePoolWithTag(PagedPool,
+                                    OBJECT_COUNT * sizeof(HANDLE),
+                                    'dOmK');
+    if (skip(Handles != NULL, "No handle array\n"))
+    {
+        ObCloseHandle(DirectoryHandle, KernelMode);
+        return;
+    }
+
+    /* A name that isn't there yet must not be found, and must be found once created */
+    Status = OpenNamedEvent(DirectoryHandle, OBJECT_COUNT, &EventHandle);
+    ok_eq_hex(Status, STATUS_OBJECT_NAME_NOT_FOUND);
+    Status = OpenNamedEvent(DirectoryHandle, OBJECT_COUNT, &EventHandle);
+    ok_eq_hex(Status, STATUS_OBJECT_NAME_NOT_FOUND);
+
+    /* Fill the directory, growing it well past its initial hash buckets */
+    StartTime = KeQueryInterruptTime();
+    for (Created = 0; Created < OBJECT_COUNT; Created++)
+    {
+        Status = CreateNamedEvent(DirectoryHandle, Created, &Handles[Created]);
+        if (!NT_SUCCESS(Status))
+            break;
+    }
+    EndTime = KeQueryInterruptTime();
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    ok_eq_ulong(Created, (ULONG)OBJECT_COUNT);
+    trace("Created %lu named events in %I64u ms\n", Created, (EndTime - StartTime) / 10000);
+
+    /* Every object must still be reachable by name and by enumeration */
+    ok_eq_ulong(CountDirectoryEntries(DirectoryHandle), Created);
+
+    Failures = 0;
+    StartTime = KeQueryInterruptTime();
+    for (i = 0; i < OPEN_COUNT && Created; i++)
+    {
+        Status = OpenNamedEvent(DirectoryHandle, (i * 7919) % Created, &EventHandle);
+        if (!NT_SUCCESS(Status))
+        {
+            Failures++;
+            continue;
+        }
+        ObCloseHandle(EventHandle, KernelMode);
+    }
+    EndTime = KeQueryInterruptTime();
+    ok_eq_ulong(Failures, 0UL);
+    trace("Opened %lu events in %I64u us each\n",
+          i, i ? (EndTime - StartTime) / 10 / i : 0);
+
+    /* Repeated misses must keep missing, and a new name must show up at once */
+    Status = OpenNamedEvent(DirectoryHandle, OBJECT_COUNT, &EventHandle);
+    ok_eq_hex(Status, STATUS_OBJECT_NAME_NOT_FOUND);
+    Status = CreateNamedEvent(DirectoryHandle, OBJECT_COUNT, &EventHandle);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+    {
+        HANDLE OpenedHandle;
+
+        Status = OpenNamedEvent(DirectoryHandle, OBJECT_COUNT, &OpenedHandle);
+        ok_eq_hex(Status, STATUS_SUCCESS);
+        if (NT_SUCCESS(Status))
+            ObCloseHandle(OpenedHandle, KernelMode);
+
+        /* And disappear as soon as it's gone */
+        ObCloseHandle(EventHandle, KernelMode);
+        Status = OpenNamedEvent(DirectoryHandle, OBJECT_COUNT, &OpenedHandle);
+        ok_eq_hex(Status, STATUS_OBJECT_NAME_NOT_FOUND);
+    }
+
+    /* The same goes for a name found just before */
+    if (Created)
+    {
+        Status = OpenNamedEvent(DirectoryHandle, 0, &EventHandle);
+        ok_eq_hex(Status, STATUS_SUCCESS);
+        if (NT_SUCCESS(Status))
+            ObCloseHandle(EventHandle, KernelMode);
+        ObCloseHandle(Handles[0], KernelMode);
+        Handles[0] = NULL;
+        Status = OpenNamedEvent(DirectoryHandle, 0, &EventHandle);
+        ok_eq_hex(Status, STATUS_OBJECT_NAME_NOT_FOUND);
+    }
+
+    for (i = 0; i < Created; i++)
+    {
+        if (Handles[i])
+            ObCloseHandle(Handles[i], KernelMode);
+    }
+    ok_eq_ulong(CountDirectoryEntries(DirectoryHandle), 0UL);
+
+    ExFreePoolWithTag(Handles, 'dOmK');
+    ObCloseHandle(DirectoryHandle, KernelMode);
+}
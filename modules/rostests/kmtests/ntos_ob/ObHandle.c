@@ -25,8 +25,22 @@
 #define IsUserHandle(h)   (((ULONG_PTR)(h) & KERNEL_HANDLE_FLAG) == 0)
 #define IsKernelHandle(h) (((ULONG_PTR)(h) & KERNEL_HANDLE_FLAG) == KERNEL_HANDLE_FLAG)
 
+#define STRESS_THREADS  8
+#define STRESS_ROUNDS   64
+#define STRESS_HANDLES  256
+
 static HANDLE SystemProcessHandle;
 
+typedef struct _STRESS_CONTEXT
+{
+    PVOID Object;
+    KEVENT StartEvent;
+    ULONG OpenFailures;
+    ULONG CloseFailures;
+    ULONG MismatchedObjects;
+    HANDLE Handles[STRESS_HANDLES];
+} STRESS_CONTEXT, *PSTRESS_CONTEXT;
+
 static
 VOID
 TestDuplicate(
@@ -150,6 +164,135 @@ TestDuplicate(
     }
 }
 
+static
+VOID
+NTAPI
+StressThread(
+    _In_ PVOID Context)
+{
+    PSTRESS_CONTEXT StressContext = Context;
+    NTSTATUS Status;
+    PVOID Object;
+    ULONG Round, i;
+
+    KeWaitForSingleObject(&StressContext->StartEvent,
+                          Executive,
+                          KernelMode,
+                          FALSE,
+                          NULL);
+
+    for (Round = 0; Round < STRESS_ROUNDS; Round++)
+    {
+        for (i = 0; i < STRESS_HANDLES; i++)
+        {
+            Status = ObOpenObjectByPointer(StressContext->Object,
+                                           OBJ_KERNEL_HANDLE,
+                                           NULL,
+                                           DIRECTORY_QUERY,
+                                           NULL,
+                                           KernelMode,
+                                           &StressContext->Handles[i]);
+            if (!NT_SUCCESS(Status))
+            {
+                StressContext->OpenFailures++;
+                StressContext->Handles[i] = NULL;
+                continue;
+            }
+
+            Status = ObReferenceObjectByHandle(StressContext->Handles[i],
+                                               DIRECTORY_QUERY,
+                                               NULL,
+                                               KernelMode,
+                                               &Object,
+                                               NULL);
+            if (!NT_SUCCESS(Status) || Object != StressContext->Object)
+                StressContext->MismatchedObjects++;
+            if (NT_SUCCESS(Status))
+                ObDereferenceObject(Object);
+        }
+
+        /* A handle handed out twice would fail to close the second time */
+        for (i = 0; i < STRESS_HANDLES; i++)
+        {
+            if (!StressContext->Handles[i])
+                continue;
+            Status = ObCloseHandle(StressContext->Handles[i], KernelMode);
+            if (!NT_SUCCESS(Status))
+                StressContext->CloseFailures++;
+        }
+    }
+}
+
+static
+VOID
+TestStress(
+    _In_ HANDLE Handle)
+{
+    NTSTATUS Status;
+    PVOID Object;
+    PSTRESS_CONTEXT Contexts;
+    PKTHREAD Threads[STRESS_THREADS];
+    ULONG ThreadCount, i;
+    ULONGLONG StartTime, EndTime;
+    PUBLIC_OBJECT_BASIC_INFORMATION ObjectInfo;
+
+    Status = ObReferenceObjectByHandle(Handle,
+                                       DIRECTORY_QUERY,
+                                       NULL,
+                                       KernelMode,
+                                       &Object,
+                                       NULL);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    if (skip(NT_SUCCESS(Status), "No directory object\n"))
+        return;
+
+    Contexts = ExAllocatePoolWithTag(NonPagedPool,
+                                     STRESS_THREADS * sizeof(*Contexts),
+                                     'hOmK');
+    if (skip(Contexts != NULL, "No memory\n"))
+    {
+        ObDereferenceObject(Object);
+        return;
+    }
+
+    ThreadCount = min(2 * (ULONG)KeNumberProcessors, STRESS_THREADS);
+    for (i = 0; i < ThreadCount; i++)
+    {
+        RtlZeroMemory(&Contexts[i], sizeof(Contexts[i]));
+        Contexts[i].Object = Object;
+        KeInitializeEvent(&Contexts[i].StartEvent, NotificationEvent, FALSE);
+        Threads[i] = KmtStartThread(StressThread, &Contexts[i]);
+    }
+
+    StartTime = KeQueryInterruptTime();
+    for (i = 0; i < ThreadCount; i++)
+        KeSetEvent(&Contexts[i].StartEvent, IO_NO_INCREMENT, FALSE);
+    for (i = 0; i < ThreadCount; i++)
+        KmtFinishThread(Threads[i], NULL);
+    EndTime = KeQueryInterruptTime();
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        ok_eq_ulong(Contexts[i].OpenFailures, 0UL);
+        ok_eq_ulong(Contexts[i].CloseFailures, 0UL);
+        ok_eq_ulong(Contexts[i].MismatchedObjects, 0UL);
+    }
+
+    /* Every handle we opened must be gone again */
+    Status = ZwQueryObject(Handle, ObjectBasicInformation,
+                           &ObjectInfo, sizeof ObjectInfo, NULL);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    ok_eq_ulong(ObjectInfo.HandleCount, 1UL);
+
+    trace("%lu threads opened and closed %lu handles in %I64u ms\n",
+          ThreadCount,
+          ThreadCount * STRESS_ROUNDS * STRESS_HANDLES,
+          (EndTime - StartTime) / 10000);
+
+    ExFreePoolWithTag(Contexts, 'hOmK');
+    ObDereferenceObject(Object);
+}
+
 START_TEST(ObHandle)
 {
     NTSTATUS Status;
@@ -219,6 +362,7 @@ START_TEST(ObHandle)
             CheckObject(KernelDirectoryHandle, 2UL, 1UL, 0UL, DIRECTORY_ALL_ACCESS);
 
         TestDuplicate(KernelDirectoryHandle);
+        TestStress(KernelDirectoryHandle);
 
         Status = ObCloseHandle(KernelDirectoryHandle, UserMode);
         ok_eq_hex(Status, STATUS_INVALID_HANDLE);
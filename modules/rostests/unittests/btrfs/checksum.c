@@ -0,0 +1,194 @@
+/*
+ * PROJECT:     ReactOS btrfs driver - Unit-tests
+ * LICENSE:     LGPL-3.0-or-later (https://spdx.org/licenses/LGPL-3.0-or-later)
+ * PURPOSE:     Tests for the SIMD checksum kernels against the portable code
+ */
+
+#include "precomp.h"
+
+#define SECTOR_SIZE 4096
+#define BENCH_SECTORS 8
+#define BENCH_ROUNDS 5000
+
+/* The data may start anywhere, so the kernels get run at every offset in a block */
+#define MAX_MISALIGNMENT 16
+
+static const UCHAR Sha256Abc[32] =
+{
+    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+    0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+};
+
+/* btrfs keeps the first 256 bits of BLAKE2b */
+static const UCHAR Blake2bAbc[32] =
+{
+    0xbd, 0xdd, 0x81, 0x3c, 0x63, 0x42, 0x39, 0x72, 0x31, 0x71, 0xef, 0x3f, 0xee, 0x98, 0x57, 0x9b,
+    0x94, 0x96, 0x4e, 0x3b, 0xb1, 0xcb, 0x3e, 0x42, 0x72, 0x62, 0xc8, 0xc0, 0x68, 0xd5, 0x23, 0x19
+};
+
+typedef void (*CHECKSUM_FUNC)(uint8_t* hash, const void* input, size_t len);
+
+static PUCHAR Data;
+static LARGE_INTEGER Frequency;
+
+static
+void
+Blake2b256(uint8_t* hash, const void* input, size_t len)
+{
+    blake2b(hash, 32, input, len);
+}
+
+static
+void
+Test_KnownValues(void)
+{
+    UCHAR Hash[32];
+
+    calc_sha256_sw(Hash, "abc", 3);
+    ok(RtlEqualMemory(Hash, Sha256Abc, sizeof(Hash)), "Wrong SHA-256 of \"abc\"\n");
+
+    blake2b_compress = blake2b_compress_ref;
+    Blake2b256(Hash, "abc", 3);
+    ok(RtlEqualMemory(Hash, Blake2bAbc, sizeof(Hash)), "Wrong BLAKE2b of \"abc\"\n");
+}
+
+/* Every length across a few blocks, so that all the padding cases are covered */
+static
+ULONG
+CountMismatches(
+    _In_ CHECKSUM_FUNC Reference,
+    _In_ CHECKSUM_FUNC Fast,
+    _In_ ULONG MaxLength)
+{
+    UCHAR Expected[32], Hash[32];
+    ULONG Length, Offset, Mismatches = 0;
+
+    for (Length = 0; Length <= MaxLength; Length++)
+    {
+        Offset = Length % MAX_MISALIGNMENT;
+        Reference(Expected, Data + Offset, Length);
+        Fast(Hash, Data + Offset, Length);
+        if (!RtlEqualMemory(Hash, Expected, sizeof(Hash)))
+            Mismatches++;
+    }
+
+    return Mismatches;
+}
+
+/* Throughput on whole sectors, which is what the driver checksums */
+static
+ULONG
+MeasureMBs(
+    _In_ CHECKSUM_FUNC Func)
+{
+    LARGE_INTEGER Start, End;
+    UCHAR Hash[32];
+    ULONG i;
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < BENCH_ROUNDS; i++)
+        Func(Hash, Data + (i % BENCH_SECTORS) * SECTOR_SIZE, SECTOR_SIZE);
+    QueryPerformanceCounter(&End);
+
+    if (End.QuadPart == Start.QuadPart)
+        return 0;
+    return (ULONG)((ULONGLONG)BENCH_ROUNDS * SECTOR_SIZE * Frequency.QuadPart /
+                   (End.QuadPart - Start.QuadPart) / (1024 * 1024));
+}
+
+#ifdef _M_AMD64
+
+static
+void
+Blake2b256Sse(uint8_t* hash, const void* input, size_t len)
+{
+    blake2b_compress = blake2b_compress_sse;
+    Blake2b256(hash, input, len);
+    blake2b_compress = blake2b_compress_ref;
+}
+
+static
+void
+Test_Sha256Ni(BOOL Supported)
+{
+    ULONG Mismatches;
+
+    if (!Supported)
+    {
+        skip("The CPU doesn't have the SHA extensions\n");
+        return;
+    }
+
+    Mismatches = CountMismatches(calc_sha256_sw, calc_sha256_ni, 600);
+    ok(Mismatches == 0, "SHA-NI got %lu of 601 lengths wrong\n", Mismatches);
+
+    trace("SHA-256: %lu MB/s portable, %lu MB/s SHA-NI\n",
+          MeasureMBs(calc_sha256_sw), MeasureMBs(calc_sha256_ni));
+}
+
+static
+void
+Test_Blake2bSse(BOOL Supported)
+{
+    ULONG Mismatches;
+
+    if (!Supported)
+    {
+        skip("The CPU doesn't have SSSE3\n");
+        return;
+    }
+
+    blake2b_compress = blake2b_compress_ref;
+    Mismatches = CountMismatches(Blake2b256, Blake2b256Sse, 1200);
+    ok(Mismatches == 0, "SSSE3 BLAKE2b got %lu of 1201 lengths wrong\n", Mismatches);
+
+    trace("BLAKE2b: %lu MB/s portable, %lu MB/s SSSE3\n",
+          MeasureMBs(Blake2b256), MeasureMBs(Blake2b256Sse));
+}
+
+#endif /* _M_AMD64 */
+
+START_TEST(checksum)
+{
+#ifdef _M_AMD64
+    BOOL HaveSsse3, HaveSse41, HaveSha = FALSE;
+    int CpuInfo[4], MaxLeaf;
+#endif
+    ULONG Seed = 0xb7f5, i;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    Data = HeapAlloc(GetProcessHeap(), 0, BENCH_SECTORS * SECTOR_SIZE + MAX_MISALIGNMENT);
+    if (!Data)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    for (i = 0; i < BENCH_SECTORS * SECTOR_SIZE + MAX_MISALIGNMENT; i++)
+        Data[i] = (UCHAR)RtlRandom(&Seed);
+
+    Test_KnownValues();
+
+#ifdef _M_AMD64
+    /* The same checks as check_cpu() in the driver */
+    __cpuid(CpuInfo, 0);
+    MaxLeaf = CpuInfo[0];
+    __cpuid(CpuInfo, 1);
+    HaveSsse3 = !!(CpuInfo[2] & (1 << 9));
+    HaveSse41 = !!(CpuInfo[2] & (1 << 19));
+    if (MaxLeaf >= 7)
+    {
+        __cpuidex(CpuInfo, 7, 0);
+        HaveSha = !!(CpuInfo[1] & (1 << 29));
+    }
+
+    Test_Sha256Ni(HaveSha && HaveSse41);
+    Test_Blake2bSse(HaveSsse3);
+#else
+    trace("SHA-256: %lu MB/s, BLAKE2b: %lu MB/s\n",
+          MeasureMBs(calc_sha256_sw), MeasureMBs(Blake2b256));
+#endif
+
+    HeapFree(GetProcessHeap(), 0, Data);
+}
@@ -0,0 +1,22 @@
+/*
+ * PROJECT:     ReactOS btrfs driver - Unit-tests
+ * LICENSE:     LGPL-3.0-or-later (https://spdx.org/licenses/LGPL-3.0-or-later)
+ * PURPOSE:     Precompiled header
+ */
+
+#pragma once
+
+#include <apitest.h>
+#include <intrin.h>
+#include <stdint.h>
+
+/* The driver's checksum code, see btrfs_drv.h */
+#include <blake2-impl.h>
+
+void calc_sha256_sw(uint8_t* hash, const void* input, size_t len);
+#ifdef _M_AMD64
+void calc_sha256_ni(uint8_t* hash, const void* input, size_t len);
+#endif
+void blake2b(void *out, size_t outlen, const void* in, size_t inlen);
+
+/* EOF */
@@ -0,0 +1,10 @@
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_checksum(void);
+
+const struct test winetest_testlist[] =
+{
+    { "checksum", func_checksum },
+    { 0, 0 }
+};
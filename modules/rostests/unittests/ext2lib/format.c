@@ -0,0 +1,370 @@
+/*
+ * PROJECT:     ReactOS EXT2 filesystem library - Unit-tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests for the layout Ext2Format writes
+ */
+
+#include "precomp.h"
+
+/*
+ * Eight block groups with 1K blocks, so that there are groups with and without
+ * sparse_super backups. The image is filled with a pattern first, which has
+ * to survive wherever the format is not supposed to write.
+ */
+#define IMAGE_SIZE (64 * 1024 * 1024)
+#define CHUNK_SIZE (1024 * 1024)
+#define FILL_BYTE 0xA5
+
+#define SUPERBLOCK_OFFSET 1024
+
+static WCHAR ImagePath[MAX_PATH];
+static UNICODE_STRING NtImagePath;
+static HANDLE hImage = INVALID_HANDLE_VALUE;
+
+static struct ext2_super_block Super;
+static struct ext2_group_desc* Groups;
+static ULONG BlockSize;
+static ULONG GroupCount;
+static ULONG DescSize;
+
+/* crc16 with the 0x8005 polynomial, bit reversed, as uninit_bg defines it */
+static
+USHORT
+Crc16(
+    _In_ USHORT Crc,
+    _In_reads_bytes_(Length) const VOID* Data,
+    _In_ ULONG Length)
+{
+    const UCHAR* Bytes = Data;
+    ULONG Bit;
+
+    while (Length--)
+    {
+        Crc ^= *Bytes++;
+        for (Bit = 0; Bit < 8; Bit++)
+            Crc = (Crc >> 1) ^ ((Crc & 1) ? 0xA001 : 0);
+    }
+
+    return Crc;
+}
+
+static
+USHORT
+GroupChecksum(
+    _In_ ULONG Group,
+    _In_ const struct ext2_group_desc* Desc)
+{
+    USHORT Crc;
+
+    Crc = Crc16(0xFFFF, Super.s_uuid, sizeof(Super.s_uuid));
+    Crc = Crc16(Crc, &Group, sizeof(Group));
+    return Crc16(Crc, Desc, FIELD_OFFSET(struct ext2_group_desc, bg_checksum));
+}
+
+/* sparse_super keeps copies in groups 0, 1 and the powers of 3, 5 and 7 */
+static
+BOOL
+HasSuperBackup(
+    _In_ ULONG Group)
+{
+    static const ULONG Bases[] = { 3, 5, 7 };
+    ULONG i, Power;
+
+    if (Group <= 1)
+        return TRUE;
+
+    for (i = 0; i < _countof(Bases); i++)
+    {
+        for (Power = Bases[i]; Power < Group; Power *= Bases[i])
+            ;
+        if (Power == Group)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static
+BOOL
+ReadImage(
+    _In_ ULONGLONG Offset,
+    _Out_writes_bytes_(Length) PVOID Data,
+    _In_ ULONG Length)
+{
+    LARGE_INTEGER Position;
+    DWORD Read;
+
+    Position.QuadPart = Offset;
+    return SetFilePointerEx(hImage, Position, NULL, FILE_BEGIN) &&
+           ReadFile(hImage, Data, Length, &Read, NULL) &&
+           Read == Length;
+}
+
+static
+BOOL
+IsFilled(
+    _In_reads_bytes_(Length) const UCHAR* Data,
+    _In_ ULONG Length,
+    _In_ UCHAR Value)
+{
+    ULONG i;
+
+    for (i = 0; i < Length; i++)
+    {
+        if (Data[i] != Value)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+ULONGLONG
+GroupStart(
+    _In_ ULONG Group)
+{
+    return ((ULONGLONG)Group * Super.s_blocks_per_group + Super.s_first_data_block) * BlockSize;
+}
+
+static
+BOOL
+Test_Superblock(void)
+{
+    ULONG DescBytes;
+
+    ok(ReadImage(SUPERBLOCK_OFFSET, &Super, sizeof(Super)), "Failed to read the superblock\n");
+    ok_hex(Super.s_magic, EXT2_SUPER_MAGIC);
+    if (Super.s_magic != EXT2_SUPER_MAGIC)
+        return FALSE;
+
+    ok_long(Super.s_rev_level, EXT2_DYNAMIC_REV);
+    ok(Super.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER, "No sparse_super\n");
+    ok(Super.s_feature_ro_compat & EXT4_FEATURE_RO_COMPAT_GDT_CSUM, "No uninit_bg\n");
+    ok(!strncmp(Super.s_volume_name, "ext2test", sizeof(Super.s_volume_name)),
+       "Wrong label '%.16s'\n", Super.s_volume_name);
+
+    BlockSize = EXT2_MIN_BLOCK_SIZE << Super.s_log_block_size;
+    ok_long(BlockSize, 1024);
+    ok_long(Super.s_blocks_count, IMAGE_SIZE / BlockSize);
+    if (!Super.s_blocks_per_group || !Super.s_inodes_per_group)
+        return FALSE;
+
+    GroupCount = (Super.s_blocks_count - Super.s_first_data_block +
+                  Super.s_blocks_per_group - 1) / Super.s_blocks_per_group;
+    ok_long(GroupCount, 8);
+
+    /* The descriptors fill whole blocks right after the superblock */
+    DescBytes = GroupCount * sizeof(struct ext2_group_desc);
+    DescSize = (DescBytes + BlockSize - 1) / BlockSize * BlockSize;
+    Groups = HeapAlloc(GetProcessHeap(), 0, DescSize);
+    if (!Groups)
+        return FALSE;
+
+    ok(ReadImage(GroupStart(0) + BlockSize, Groups, DescSize), "Failed to read the group descriptors\n");
+    return TRUE;
+}
+
+static
+void
+Test_Checksums(void)
+{
+    ULONG Group;
+
+    /* CRC-16/ARC check value, to make sure the reference is right */
+    ok_hex(Crc16(0, "123456789", 9), 0xBB3D);
+
+    for (Group = 0; Group < GroupCount; Group++)
+    {
+        ok(Groups[Group].bg_checksum == GroupChecksum(Group, &Groups[Group]),
+           "Group %lu has checksum 0x%04x, expected 0x%04x\n",
+           Group, Groups[Group].bg_checksum, GroupChecksum(Group, &Groups[Group]));
+    }
+}
+
+/*
+ * Only the first group, with the root directory and lost+found, gets a zeroed
+ * inode table. The other ones are flagged as unused and left alone.
+ */
+static
+void
+Test_InodeTables(void)
+{
+    ULONG InodeSize = Super.s_inode_size;
+    ULONG TableSize = Super.s_inodes_per_group * InodeSize;
+    ULONG Group, FreeInodes = 0, Inode;
+    struct ext2_inode* Entry;
+    PUCHAR Table;
+
+    Table = HeapAlloc(GetProcessHeap(), 0, TableSize);
+    if (!Table)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    for (Group = 0; Group < GroupCount; Group++)
+    {
+        FreeInodes += Groups[Group].bg_free_inodes_count;
+
+        if (!ReadImage((ULONGLONG)Groups[Group].bg_inode_table * BlockSize, Table, TableSize))
+        {
+            ok(FALSE, "Failed to read the inode table of group %lu\n", Group);
+            continue;
+        }
+
+        if (Group == 0)
+        {
+            ok(!(Groups[0].bg_flags & EXT4_BG_INODE_UNINIT), "Group 0 is flagged INODE_UNINIT\n");
+            ok(Groups[0].bg_flags & EXT4_BG_INODE_ZEROED, "Group 0 isn't flagged INODE_ZEROED\n");
+            ok_long(Groups[0].bg_used_dirs_count, 2);
+
+            Entry = (struct ext2_inode*)(Table + (EXT2_ROOT_INO - 1) * InodeSize);
+            ok_hex(Entry->i_mode & 0xF000, 0x4000);
+            Entry = (struct ext2_inode*)(Table + (Super.s_first_ino - 1) * InodeSize);
+            ok_hex(Entry->i_mode & 0xF000, 0x4000);
+
+            /* Everything after lost+found is zeroed */
+            for (Inode = Super.s_first_ino; Inode < Super.s_inodes_per_group; Inode++)
+            {
+                if (!IsFilled(Table + Inode * InodeSize, InodeSize, 0))
+                    break;
+            }
+            ok(Inode == Super.s_inodes_per_group, "Inode %lu of group 0 isn't zeroed\n", Inode + 1);
+            continue;
+        }
+
+        ok(Groups[Group].bg_flags & EXT4_BG_INODE_UNINIT, "Group %lu isn't flagged INODE_UNINIT\n", Group);
+        ok(Groups[Group].bg_itable_unused == Super.s_inodes_per_group,
+           "Group %lu has %u unused inodes\n", Group, Groups[Group].bg_itable_unused);
+        ok(Groups[Group].bg_free_inodes_count == Super.s_inodes_per_group,
+           "Group %lu has %u free inodes\n", Group, Groups[Group].bg_free_inodes_count);
+        ok(Groups[Group].bg_used_dirs_count == 0,
+           "Group %lu has %u directories\n", Group, Groups[Group].bg_used_dirs_count);
+        ok(IsFilled(Table, TableSize, FILL_BYTE), "The inode table of group %lu was written\n", Group);
+    }
+
+    ok_long(FreeInodes, Super.s_free_inodes_count);
+
+    HeapFree(GetProcessHeap(), 0, Table);
+}
+
+/* The backup groups hold the superblock and all of the descriptors, the others nothing */
+static
+void
+Test_Backups(void)
+{
+    struct ext2_super_block Backup;
+    PUCHAR Desc;
+    ULONG Group;
+
+    Desc = HeapAlloc(GetProcessHeap(), 0, DescSize);
+    if (!Desc)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    for (Group = 1; Group < GroupCount; Group++)
+    {
+        if (!ReadImage(GroupStart(Group), &Backup, sizeof(Backup)) ||
+            !ReadImage(GroupStart(Group) + BlockSize, Desc, DescSize))
+        {
+            ok(FALSE, "Failed to read group %lu\n", Group);
+            continue;
+        }
+
+        if (!HasSuperBackup(Group))
+        {
+            ok(Backup.s_magic != EXT2_SUPER_MAGIC, "Group %lu has a superblock\n", Group);
+            continue;
+        }
+
+        ok(Backup.s_magic == EXT2_SUPER_MAGIC, "Group %lu has no superblock\n", Group);
+        ok(Backup.s_block_group_nr == Group, "Superblock of group %lu says %u\n", Group, Backup.s_block_group_nr);
+        ok(RtlEqualMemory(Backup.s_uuid, Super.s_uuid, sizeof(Super.s_uuid)), "Group %lu has another UUID\n", Group);
+        ok(RtlEqualMemory(Desc, Groups, DescSize), "The descriptors in group %lu are different\n", Group);
+    }
+
+    HeapFree(GetProcessHeap(), 0, Desc);
+}
+
+static
+BOOL
+CreateImage(void)
+{
+    PUCHAR Chunk;
+    DWORD Written;
+    ULONG i;
+    BOOL Ret = TRUE;
+
+    if (!GetTempPathW(_countof(ImagePath), ImagePath) ||
+        FAILED(StringCchCatW(ImagePath, _countof(ImagePath), L"ext2lib_format.img")))
+    {
+        return FALSE;
+    }
+
+    Chunk = HeapAlloc(GetProcessHeap(), 0, CHUNK_SIZE);
+    if (!Chunk)
+        return FALSE;
+    FillMemory(Chunk, CHUNK_SIZE, FILL_BYTE);
+
+    hImage = CreateFileW(ImagePath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    if (hImage == INVALID_HANDLE_VALUE)
+    {
+        HeapFree(GetProcessHeap(), 0, Chunk);
+        return FALSE;
+    }
+
+    for (i = 0; Ret && i < IMAGE_SIZE / CHUNK_SIZE; i++)
+        Ret = WriteFile(hImage, Chunk, CHUNK_SIZE, &Written, NULL) && Written == CHUNK_SIZE;
+
+    CloseHandle(hImage);
+    hImage = INVALID_HANDLE_VALUE;
+    HeapFree(GetProcessHeap(), 0, Chunk);
+    if (!Ret)
+        return FALSE;
+
+    return RtlDosPathNameToNtPathName_U(ImagePath, &NtImagePath, NULL, NULL);
+}
+
+START_TEST(format)
+{
+    UNICODE_STRING Label = RTL_CONSTANT_STRING(L"ext2test");
+    BOOLEAN Success;
+
+    if (!CreateImage())
+    {
+        skip("Failed to create the image file (%lu)\n", GetLastError());
+        goto Cleanup;
+    }
+
+    Success = Ext2Format(&NtImagePath, NULL, TRUE, FALSE, FixedMedia, &Label, 0);
+    ok(Success, "Ext2Format failed\n");
+    if (!Success)
+        goto Cleanup;
+
+    hImage = CreateFileW(ImagePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    ok(hImage != INVALID_HANDLE_VALUE, "Failed to open the image (%lu)\n", GetLastError());
+    if (hImage == INVALID_HANDLE_VALUE)
+        goto Cleanup;
+
+    if (!Test_Superblock())
+    {
+        skip("No usable superblock\n");
+        goto Cleanup;
+    }
+
+    Test_Checksums();
+    Test_InodeTables();
+    Test_Backups();
+
+Cleanup:
+    if (Groups)
+        HeapFree(GetProcessHeap(), 0, Groups);
+    if (hImage != INVALID_HANDLE_VALUE)
+        CloseHandle(hImage);
+    if (NtImagePath.Buffer)
+        RtlFreeUnicodeString(&NtImagePath);
+    if (ImagePath[0])
+        DeleteFileW(ImagePath);
+}
@@ -0,0 +1,22 @@
+/*
+ * PROJECT:     ReactOS EXT2 filesystem library - Unit-tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Precompiled header
+ */
+
+#pragma once
+
+#define WIN32_NO_STATUS
+#define _INC_WINDOWS
+#define COM_NO_WINDOWS_H
+
+#include <apitest.h>
+#include <strsafe.h>
+#define NTOS_MODE_USER
+#include <ndk/rtlfuncs.h>
+#include <fslib/ext2lib.h>
+
+/* The library's own on-disk structures */
+#include <ext2_fs.h>
+
+/* EOF */
@@ -0,0 +1,10 @@
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_format(void);
+
+const struct test winetest_testlist[] =
+{
+    { "format", func_format },
+    { 0, 0 }
+};
@@ -0,0 +1,258 @@
+/*
+ * PROJECT:     ReactOS VFAT filesystem library - Unit-tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests for the checker's disk I/O layer
+ */
+
+#include "precomp.h"
+
+/*
+ * Not a multiple of the 64K read cache chunk, so that the last chunk comes
+ * back short from the device.
+ */
+#define IMAGE_SIZE (5 * 64 * 1024 + 9 * 512)
+#define CHUNK_SIZE (64 * 1024)
+
+static WCHAR ImagePath[MAX_PATH];
+static UNICODE_STRING NtImagePath;
+static ULONG Seed;
+
+/* What the image is expected to hold, changes included */
+static PUCHAR Reference;
+static PUCHAR Buffer;
+
+static
+ULONG
+Random(
+    _In_ ULONG Max)
+{
+    return RtlRandom(&Seed) % Max;
+}
+
+static
+VOID
+FillRandom(
+    _Out_writes_bytes_(Size) PUCHAR Data,
+    _In_ ULONG Size)
+{
+    ULONG i;
+
+    for (i = 0; i < Size; i++)
+        Data[i] = (UCHAR)Random(256);
+}
+
+/* Reads through the checker, which has to see every change made so far */
+static
+BOOL
+ReadMatches(
+    _In_ ULONG Pos,
+    _In_ ULONG Size)
+{
+    fs_read(Pos, Size, Buffer);
+    return RtlEqualMemory(Buffer, Reference + Pos, Size);
+}
+
+/* Reads the image file itself, once the checker has closed it */
+static
+BOOL
+ImageMatches(VOID)
+{
+    HANDLE hFile;
+    DWORD Read;
+    BOOL Ret;
+
+    hFile = CreateFileW(ImagePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    Ret = ReadFile(hFile, Buffer, IMAGE_SIZE, &Read, NULL) &&
+          Read == IMAGE_SIZE &&
+          RtlEqualMemory(Buffer, Reference, IMAGE_SIZE);
+    CloseHandle(hFile);
+    return Ret;
+}
+
+static
+void
+Test_Reads(void)
+{
+    ULONG Pos, Size, i;
+    ULONG Mismatches;
+
+    /* Directory walks: one entry after the other */
+    Mismatches = 0;
+    for (Pos = 0; Pos < IMAGE_SIZE; Pos += 32)
+    {
+        if (!ReadMatches(Pos, 32))
+            Mismatches++;
+    }
+    ok(Mismatches == 0, "%lu sequential entries were wrong\n", Mismatches);
+
+    /* Entries straddling two chunks, and the short one at the end */
+    for (Pos = CHUNK_SIZE; Pos < IMAGE_SIZE; Pos += CHUNK_SIZE)
+        ok(ReadMatches(Pos - 16, 32), "Read across %lu is wrong\n", Pos);
+    ok(ReadMatches(IMAGE_SIZE - 32, 32), "Last entry is wrong\n");
+    ok(ReadMatches(IMAGE_SIZE - CHUNK_SIZE, CHUNK_SIZE), "Last chunk is wrong\n");
+
+    /* FAT-sized reads bypass the cache */
+    ok(ReadMatches(1000, 2 * CHUNK_SIZE), "Large read is wrong\n");
+
+    Mismatches = 0;
+    for (i = 0; i < 2000; i++)
+    {
+        Size = Random(4096) + 1;
+        Pos = Random(IMAGE_SIZE - Size);
+        if (!ReadMatches(Pos, Size))
+            Mismatches++;
+    }
+    ok(Mismatches == 0, "%lu random reads were wrong\n", Mismatches);
+}
+
+/*
+ * Queued changes only reach the disk on close, but have to show in every read
+ * before that, whether it is served by the cache or not.
+ */
+static
+void
+Test_QueuedWrites(void)
+{
+    ULONG Pos, Size, i;
+    ULONG Mismatches = 0;
+    PUCHAR Data = Buffer + 2 * CHUNK_SIZE;
+
+    for (i = 0; i < 500; i++)
+    {
+        Size = (i % 4) ? 32 : Random(2 * CHUNK_SIZE) + 1;
+        Pos = Random(IMAGE_SIZE - Size);
+
+        /* Get the old contents cached first */
+        ReadMatches(Pos, min(Size, CHUNK_SIZE));
+
+        FillRandom(Data, Size);
+        fs_write(Pos, Size, Data);
+        RtlCopyMemory(Reference + Pos, Data, Size);
+
+        if (!ReadMatches(Pos, min(Size, CHUNK_SIZE)))
+            Mismatches++;
+
+        Size = Random(4096) + 1;
+        Pos = Random(IMAGE_SIZE - Size);
+        if (!ReadMatches(Pos, Size))
+            Mismatches++;
+    }
+    ok(Mismatches == 0, "%lu reads missed queued changes\n", Mismatches);
+    ok(fs_changed() != 0, "No changes queued\n");
+}
+
+/* Immediate writes go to the disk, and must not leave a stale cached copy */
+static
+void
+Test_ImmediateWrites(void)
+{
+    ULONG Pos, Size, i;
+    ULONG Mismatches = 0;
+    PUCHAR Data = Buffer + 2 * CHUNK_SIZE;
+
+    for (i = 0; i < 500; i++)
+    {
+        Size = (i % 4) ? 32 : Random(4096) + 1;
+        Pos = Random(IMAGE_SIZE - Size);
+
+        ReadMatches(Pos - Pos % CHUNK_SIZE, 32);
+        ReadMatches(Pos, Size);
+
+        FillRandom(Data, Size);
+        fs_write(Pos, Size, Data);
+        RtlCopyMemory(Reference + Pos, Data, Size);
+
+        if (!ReadMatches(Pos, Size))
+            Mismatches++;
+        if (!ReadMatches(Pos - Pos % CHUNK_SIZE, min(CHUNK_SIZE, IMAGE_SIZE - (Pos - Pos % CHUNK_SIZE))))
+            Mismatches++;
+    }
+    ok(Mismatches == 0, "%lu reads returned stale data\n", Mismatches);
+}
+
+static
+BOOL
+CreateImage(void)
+{
+    HANDLE hFile;
+    DWORD Written;
+    BOOL Ret;
+
+    if (!GetTempPathW(_countof(ImagePath), ImagePath) ||
+        FAILED(StringCchCatW(ImagePath, _countof(ImagePath), L"vfatlib_fs_io.img")))
+    {
+        return FALSE;
+    }
+
+    FillRandom(Reference, IMAGE_SIZE);
+
+    hFile = CreateFileW(ImagePath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    Ret = WriteFile(hFile, Reference, IMAGE_SIZE, &Written, NULL) && Written == IMAGE_SIZE;
+    CloseHandle(hFile);
+    if (!Ret)
+        return FALSE;
+
+    return RtlDosPathNameToNtPathName_U(ImagePath, &NtImagePath, NULL, NULL);
+}
+
+START_TEST(fs_io)
+{
+    NTSTATUS Status;
+
+    Seed = 0x12345678;
+    Reference = HeapAlloc(GetProcessHeap(), 0, IMAGE_SIZE);
+    Buffer = HeapAlloc(GetProcessHeap(), 0, 4 * CHUNK_SIZE + IMAGE_SIZE);
+    if (!Reference || !Buffer)
+    {
+        skip("Out of memory\n");
+        goto Cleanup;
+    }
+
+    if (!CreateImage())
+    {
+        skip("Failed to create the image file (%lu)\n", GetLastError());
+        goto Cleanup;
+    }
+
+    FsCheckFlags = 0;
+    Status = fs_open(&NtImagePath, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    Test_Reads();
+    ok_int(fs_close(FALSE), 0);
+
+    /* The volume lock fails on a plain file, which is open by then regardless */
+    FsCheckFlags = FSCHECK_READ_WRITE;
+    fs_open(&NtImagePath, TRUE);
+
+    Test_QueuedWrites();
+    ok(fs_close(TRUE) != 0, "fs_close didn't report the changes\n");
+    ok(ImageMatches(), "The queued changes weren't all written\n");
+
+    FsCheckFlags = FSCHECK_READ_WRITE | FSCHECK_IMMEDIATE_WRITE;
+    fs_open(&NtImagePath, TRUE);
+
+    Test_Reads();
+    Test_ImmediateWrites();
+    ok(fs_close(TRUE) != 0, "fs_close didn't report the changes\n");
+    ok(ImageMatches(), "The immediate writes didn't all reach the disk\n");
+
+Cleanup:
+    FsCheckFlags = 0;
+    if (NtImagePath.Buffer)
+        RtlFreeUnicodeString(&NtImagePath);
+    if (ImagePath[0])
+        DeleteFileW(ImagePath);
+    if (Buffer)
+        HeapFree(GetProcessHeap(), 0, Buffer);
+    if (Reference)
+        HeapFree(GetProcessHeap(), 0, Reference);
+}
@@ -0,0 +1,15 @@
+/*
+ * PROJECT:     ReactOS VFAT filesystem library - Unit-tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Precompiled header
+ */
+
+#pragma once
+
+#include <apitest.h>
+#include <strsafe.h>
+
+/* The checker's own headers, with its I/O layer */
+#include <vfatlib.h>
+
+/* EOF */
@@ -0,0 +1,10 @@
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_fs_io(void);
+
+const struct test winetest_testlist[] =
+{
+    { "fs_io", func_fs_io },
+    { 0, 0 }
+};
@@ -20,6 +20,20 @@ EX_PUSH_LOCK HandleTableListLock;
 #define SizeOfHandle(x) (sizeof(HANDLE) * (x))
 #define INDEX_TO_HANDLE_VALUE(x) ((x) << HANDLE_TAG_BITS)
 
+/* Per-processor batches of free handles, kept by tables that have grown */
+#define EX_HANDLE_FREE_CACHE_DEPTH  14
+#define EX_HANDLE_FREE_CACHE_BATCH  (EX_HANDLE_FREE_CACHE_DEPTH / 2)
+
+/* Most low level tables allocated ahead of demand in a single expansion */
+#define EX_HANDLE_MAXIMUM_SPECULATIVE_TABLES    8
+
+typedef struct _EX_HANDLE_FREE_CACHE
+{
+    EX_PUSH_LOCK Lock;
+    ULONG Depth;
+    ULONG Handles[EX_HANDLE_FREE_CACHE_DEPTH];
+} EX_HANDLE_FREE_CACHE, *PEX_HANDLE_FREE_CACHE;
+
 /* PRIVATE FUNCTIONS *********************************************************/
 
 #ifdef _WIN64
@@ -265,6 +279,14 @@ ExpFreeHandleTable(IN PHANDLE_TABLE HandleTable)
                               SizeOfHandle(HIGH_LEVEL_ENTRIES));
     }
 
+    /* Free the per-processor free handle batches, if we had any */
+    if (HandleTable->FreeHandleCache)
+    {
+        ExpFreeTablePagedPool(Process,
+                              HandleTable->FreeHandleCache,
+                              KeNumberProcessors * sizeof(EX_HANDLE_FREE_CACHE));
+    }
+
     /* Free the actual table and check if we need to release quota */
     ExFreePoolWithTag(HandleTable, TAG_OBJECT_TABLE);
     if (Process)
@@ -276,20 +298,12 @@ ExpFreeHandleTable(IN PHANDLE_TABLE HandleTable)
 
 VOID
 NTAPI
-ExpFreeHandleTableEntry(IN PHANDLE_TABLE HandleTable,
-                        IN EXHANDLE Handle,
-                        IN PHANDLE_TABLE_ENTRY HandleTableEntry)
+ExpPushFreeHandle(IN PHANDLE_TABLE HandleTable,
+                  IN EXHANDLE Handle,
+                  IN PHANDLE_TABLE_ENTRY HandleTableEntry)
 {
     ULONG OldValue, *Free;
     ULONG LockIndex;
-    PAGED_CODE();
-
-    /* Sanity checks */
-    ASSERT(HandleTableEntry->Object == NULL);
-    ASSERT(HandleTableEntry == ExpLookupHandleTableEntry(HandleTable, Handle));
-
-    /* Decrement the handle count */
-    InterlockedDecrement(&HandleTable->HandleCount);
 
     /* Mark the handle as free */
     Handle.TagBits = 0;
@@ -326,6 +340,67 @@ ExpFreeHandleTableEntry(IN PHANDLE_TABLE HandleTable,
     }
 }
 
+VOID
+NTAPI
+ExpFreeHandleTableEntry(IN PHANDLE_TABLE HandleTable,
+                        IN EXHANDLE Handle,
+                        IN PHANDLE_TABLE_ENTRY HandleTableEntry)
+{
+    PEX_HANDLE_FREE_CACHE Cache;
+    EXHANDLE FreeHandle;
+    ULONG i;
+    PAGED_CODE();
+
+    /* Sanity checks */
+    ASSERT(HandleTableEntry->Object == NULL);
+    ASSERT(HandleTableEntry == ExpLookupHandleTableEntry(HandleTable, Handle));
+
+    /* Decrement the handle count */
+    InterlockedDecrement(&HandleTable->HandleCount);
+
+    /* Check if this table has per-processor free handle batches */
+    Cache = HandleTable->FreeHandleCache;
+    if (!Cache)
+    {
+        /* It doesn't, put the handle straight back on the free list */
+        ExpPushFreeHandle(HandleTable, Handle, HandleTableEntry);
+        return;
+    }
+
+    /* Lock the batch of the current processor */
+    Cache += KeGetCurrentProcessorNumber();
+    KeEnterCriticalRegion();
+    ExAcquirePushLockExclusive(&Cache->Lock);
+
+    /* Check if the batch is full */
+    if (Cache->Depth == EX_HANDLE_FREE_CACHE_DEPTH)
+    {
+        /* Return the oldest half of it to the table's free list */
+        for (i = 0; i < EX_HANDLE_FREE_CACHE_BATCH; i++)
+        {
+            FreeHandle.Value = Cache->Handles[i];
+            ExpPushFreeHandle(HandleTable,
+                              FreeHandle,
+                              ExpLookupHandleTableEntry(HandleTable, FreeHandle));
+        }
+
+        /* Slide the remaining handles down */
+        RtlMoveMemory(&Cache->Handles[0],
+                      &Cache->Handles[EX_HANDLE_FREE_CACHE_BATCH],
+                      (EX_HANDLE_FREE_CACHE_DEPTH - EX_HANDLE_FREE_CACHE_BATCH) *
+                      sizeof(ULONG));
+        Cache->Depth -= EX_HANDLE_FREE_CACHE_BATCH;
+    }
+
+    /* Mark the handle as free and keep it for the next allocation here */
+    Handle.TagBits = 0;
+    Cache->Handles[Cache->Depth++] = Handle.AsULONG;
+
+    /* Release the batch */
+    ExReleasePushLockExclusive(&Cache->Lock);
+    KeLeaveCriticalRegion();
+}
+
 PHANDLE_TABLE
 NTAPI
 ExpAllocateHandleTable(IN PEPROCESS Process OPTIONAL,
@@ -643,6 +718,50 @@ ExpAllocateHandleTableEntrySlow(IN PHANDLE_TABLE HandleTable,
     return TRUE;
 }
 
+VOID
+NTAPI
+ExpExpandHandleTable(IN PHANDLE_TABLE HandleTable)
+{
+    PEX_HANDLE_FREE_CACHE Cache;
+    ULONG Tables, i;
+    PAGED_CODE();
+
+    /* Check if the table outgrew its first page without free batches */
+    if (!(HandleTable->FreeHandleCache) &&
+        !(HandleTable->StrictFIFO) &&
+        (KeNumberProcessors > 1))
+    {
+        /* Allocate a batch for each processor */
+        Cache = ExpAllocateTablePagedPool(HandleTable->QuotaProcess,
+                                          KeNumberProcessors *
+                                          sizeof(EX_HANDLE_FREE_CACHE));
+        if (Cache)
+        {
+            /* Initialize the batch locks */
+            for (i = 0; i < (ULONG)KeNumberProcessors; i++)
+            {
+                ExInitializePushLock(&Cache[i].Lock);
+            }
+
+            /* Make them visible to other threads only when they are ready */
+            InterlockedExchangePointer(&HandleTable->FreeHandleCache, Cache);
+        }
+    }
+
+    /*
+     * A table that keeps growing is likely to grow again soon, so add a
+     * quarter of its current size on top of the table just allocated.
+     */
+    Tables = HandleTable->NextHandleNeedingPool /
+             INDEX_TO_HANDLE_VALUE(LOW_LEVEL_ENTRIES);
+    Tables = min(Tables / 4, EX_HANDLE_MAXIMUM_SPECULATIVE_TABLES);
+    for (i = 0; i < Tables; i++)
+    {
+        /* This is only a hint, so stop at the first failure */
+        if (!ExpAllocateHandleTableEntrySlow(HandleTable, TRUE)) break;
+    }
+}
+
 ULONG
 NTAPI
 ExpMoveFreeHandles(IN PHANDLE_TABLE HandleTable)
@@ -680,8 +799,8 @@ ExpMoveFreeHandles(IN PHANDLE_TABLE HandleTable)
 
 PHANDLE_TABLE_ENTRY
 NTAPI
-ExpAllocateHandleTableEntry(IN PHANDLE_TABLE HandleTable,
-                            OUT PEXHANDLE NewHandle)
+ExpPopFreeHandle(IN PHANDLE_TABLE HandleTable,
+                 OUT PEXHANDLE NewHandle)
 {
     ULONG OldValue, NewValue, NewValue1;
     PHANDLE_TABLE_ENTRY Entry;
@@ -722,6 +841,7 @@ ExpAllocateHandleTableEntry(IN PHANDLE_TABLE HandleTable,
 
             /* We're the first one through, so do the actual allocation */
             Result = ExpAllocateHandleTableEntrySlow(HandleTable, TRUE);
+            if (Result) ExpExpandHandleTable(HandleTable);
 
             /* Unlock the table and get the value now */
             ExReleasePushLockExclusive(&HandleTable->HandleTableLock[0]);
@@ -788,14 +908,66 @@ ExpAllocateHandleTableEntry(IN PHANDLE_TABLE HandleTable,
         }
     }
 
-    /* Increase the number of handles */
-    InterlockedIncrement(&HandleTable->HandleCount);
-
     /* Return the handle and the entry */
     *NewHandle = Handle;
     return Entry;
 }
 
+PHANDLE_TABLE_ENTRY
+NTAPI
+ExpAllocateHandleTableEntry(IN PHANDLE_TABLE HandleTable,
+                            OUT PEXHANDLE NewHandle)
+{
+    PEX_HANDLE_FREE_CACHE Cache;
+    PHANDLE_TABLE_ENTRY Entry;
+    EXHANDLE Handle;
+
+    /* Check if this table has per-processor free handle batches */
+    Cache = HandleTable->FreeHandleCache;
+    if (!Cache)
+    {
+        /* It doesn't, take a handle from the free list */
+        Entry = ExpPopFreeHandle(HandleTable, NewHandle);
+    }
+    else
+    {
+        /* Lock the batch of the current processor */
+        Cache += KeGetCurrentProcessorNumber();
+        KeEnterCriticalRegion();
+        ExAcquirePushLockExclusive(&Cache->Lock);
+
+        /* Check if it still has handles */
+        if (Cache->Depth)
+        {
+            /* Use the most recently freed one */
+            NewHandle->Value = Cache->Handles[--Cache->Depth];
+            Entry = ExpLookupHandleTableEntry(HandleTable, *NewHandle);
+        }
+        else
+        {
+            /* Take a handle from the free list */
+            Entry = ExpPopFreeHandle(HandleTable, NewHandle);
+
+            /* Refill half of the batch while free handles are around */
+            while ((Entry) &&
+                   (Cache->Depth < EX_HANDLE_FREE_CACHE_BATCH) &&
+                   (HandleTable->FirstFree))
+            {
+                if (!ExpPopFreeHandle(HandleTable, &Handle)) break;
+                Cache->Handles[Cache->Depth++] = Handle.AsULONG;
+            }
+        }
+
+        /* Release the batch */
+        ExReleasePushLockExclusive(&Cache->Lock);
+        KeLeaveCriticalRegion();
+    }
+
+    /* Increase the number of handles if we got one */
+    if (Entry) InterlockedIncrement(&HandleTable->HandleCount);
+    return Entry;
+}
+
 PHANDLE_TABLE
 NTAPI
 ExCreateHandleTable(IN PEPROCESS Process OPTIONAL)
@@ -16,6 +16,27 @@
 
 ULONG ExPushLockSpinCount = 0;
 
+/* Bounds of the adaptive spin done before queuing a wait block */
+#define EXP_PUSH_LOCK_MINIMUM_SPIN      16
+#define EXP_PUSH_LOCK_INITIAL_SPIN      128
+
+/* Number of call sites tracked by the contention profile */
+#define EXP_PUSH_LOCK_PROFILE_SITES     128
+#define EXP_PUSH_LOCK_PROFILE_PROBES    8
+
+typedef struct _EXP_PUSH_LOCK_SITE
+{
+    PVOID Site;
+    LONG Contentions;
+    LONG SpinAcquires;
+    LONG Waits;
+    LONGLONG WaitTime;
+} EXP_PUSH_LOCK_SITE, *PEXP_PUSH_LOCK_SITE;
+
+ULONG ExpPushLockSpinLimit[MAXIMUM_PROCESSORS];
+BOOLEAN ExpPushLockProfiling;
+EXP_PUSH_LOCK_SITE ExpPushLockProfile[EXP_PUSH_LOCK_PROFILE_SITES];
+
 #undef EX_PUSH_LOCK
 #undef PEX_PUSH_LOCK
 
@@ -45,12 +66,122 @@ NTAPI
 ExpInitializePushLocks(VOID)
 {
 #ifdef CONFIG_SMP
+    ULONG i;
+
     /* Initialize an internal 1024-iteration spin for MP CPUs */
     if (KeNumberProcessors > 1)
         ExPushLockSpinCount = 1024;
+
+    /* Start every processor's adaptive spin half-way */
+    for (i = 0; i < MAXIMUM_PROCESSORS; i++)
+        ExpPushLockSpinLimit[i] = EXP_PUSH_LOCK_INITIAL_SPIN;
 #endif
 }
 
+/*++
+ * @name ExpGetPushLockSite
+ *
+ *     The ExpGetPushLockSite routine finds or claims the contention profile
+ *     entry of a pushlock call site.
+ *
+ * @param Site
+ *        Return address of the caller that hit a contended pushlock.
+ *
+ * @return Pointer to the profile entry, or NULL if the profile is full.
+ *
+ * @remarks Only used while profiling is turned on from the debugger.
+ *
+ *--*/
+PEXP_PUSH_LOCK_SITE
+NTAPI
+ExpGetPushLockSite(IN PVOID Site)
+{
+    PEXP_PUSH_LOCK_SITE Entry;
+    PVOID OldSite;
+    ULONG Index, i;
+
+    /* Hash the return address and probe a few entries from there */
+    Index = (ULONG)(((ULONG_PTR)Site >> 2) % EXP_PUSH_LOCK_PROFILE_SITES);
+    for (i = 0; i < EXP_PUSH_LOCK_PROFILE_PROBES; i++)
+    {
+        Entry = &ExpPushLockProfile[(Index + i) % EXP_PUSH_LOCK_PROFILE_SITES];
+
+        /* Claim the entry if it's free, or use it if it's ours */
+        OldSite = InterlockedCompareExchangePointer(&Entry->Site, Site, NULL);
+        if (!(OldSite) || (OldSite == Site)) return Entry;
+    }
+
+    /* Too many sites collide here, don't track this one */
+    return NULL;
+}
+
+#ifdef CONFIG_SMP
+/*++
+ * @name ExpSpinOnPushLock
+ *
+ *     The ExpSpinOnPushLock routine spins on a pushlock held by another
+ *     processor, hoping it gets released before we have to block.
+ *
+ * @param PushLock
+ *        Pointer to the contended pushlock.
+ *
+ * @param Exclusive
+ *        Whether the caller wants the pushlock exclusively.
+ *
+ * @param OldValue
+ *        Receives the last value of the pushlock that was seen.
+ *
+ * @return TRUE if the pushlock can now be acquired, FALSE otherwise.
+ *
+ * @remarks The spin length is kept per processor. It doubles every time
+ *          spinning pays off and halves every time it doesn't, within
+ *          EXP_PUSH_LOCK_MINIMUM_SPIN and ExPushLockSpinCount. Spinning
+ *          stops as soon as waiters are queued, since they'll be woken
+ *          before us anyway.
+ *
+ *--*/
+BOOLEAN
+NTAPI
+ExpSpinOnPushLock(IN PEX_PUSH_LOCK PushLock,
+                  IN BOOLEAN Exclusive,
+                  OUT PEX_PUSH_LOCK OldValue)
+{
+    PULONG SpinLimit;
+    ULONG Limit, i;
+    EX_PUSH_LOCK Value;
+
+    /* Get this processor's current spin length */
+    SpinLimit = &ExpPushLockSpinLimit[KeGetCurrentProcessorNumber()];
+    Limit = *SpinLimit;
+
+    /* Start spinning */
+    Value.Ptr = *(PVOID volatile *)&PushLock->Ptr;
+    for (i = 0; i < Limit; i++)
+    {
+        /* Give up if someone is already queued */
+        if (Value.Waiting) break;
+
+        /* Check if the pushlock can be acquired the way we want it */
+        if (!(Value.Locked) || (!(Exclusive) && (Value.Shared > 0)))
+        {
+            /* It can, so spin a bit longer next time */
+            *SpinLimit = min(Limit * 2, ExPushLockSpinCount);
+            *OldValue = Value;
+            return TRUE;
+        }
+
+        /* Read it again */
+        YieldProcessor();
+        Value.Ptr = *(PVOID volatile *)&PushLock->Ptr;
+    }
+
+    /* Spinning didn't help, so spin less next time */
+    *SpinLimit = max(Limit / 2, EXP_PUSH_LOCK_MINIMUM_SPIN);
+    *OldValue = Value;
+    return FALSE;
+}
+#endif
+
 /*++
  * @name ExfWakePushLock
  *
@@ -472,8 +603,21 @@ ExfAcquirePushLockExclusive(PEX_PUSH_LOCK PushLock)
 {
     EX_PUSH_LOCK OldValue = *PushLock, NewValue, TempValue;
     BOOLEAN NeedWake;
+#ifdef CONFIG_SMP
+    BOOLEAN Spun = FALSE;
+#endif
     EX_PUSH_LOCK_WAIT_BLOCK Block;
     PEX_PUSH_LOCK_WAIT_BLOCK WaitBlock = &Block;
+    PEXP_PUSH_LOCK_SITE Site = NULL;
+    ULONGLONG WaitStart;
+
+    /* Check if we're profiling contention */
+    if (ExpPushLockProfiling)
+    {
+        /* Account this call to our caller */
+        Site = ExpGetPushLockSite(_ReturnAddress());
+        if (Site) InterlockedIncrement(&Site->Contentions);
+    }
 
     /* Start main loop */
     for (;;)
@@ -500,6 +644,20 @@ ExfAcquirePushLockExclusive(PEX_PUSH_LOCK PushLock)
         }
         else
         {
+#ifdef CONFIG_SMP
+            /* Spin once for the owner to release it before queuing */
+            if (!(Spun) && (ExPushLockSpinCount))
+            {
+                Spun = TRUE;
+                if (ExpSpinOnPushLock(PushLock, TRUE, &OldValue))
+                {
+                    /* It was released, try to take it */
+                    if (Site) InterlockedIncrement(&Site->SpinAcquires);
+                    continue;
+                }
+            }
+#endif
+
             /* We'll have to create a Waitblock */
             WaitBlock->Flags = EX_PUSH_LOCK_FLAGS_EXCLUSIVE |
                                EX_PUSH_LOCK_FLAGS_WAIT;
@@ -612,8 +770,17 @@ ExfAcquirePushLockExclusive(PEX_PUSH_LOCK PushLock)
             if (InterlockedBitTestAndReset(&WaitBlock->Flags, 1))
             {
                 /* Nobody removed it already, let's do a full wait */
+                WaitStart = KeQueryInterruptTime();
                 KeWaitForGate(&WaitBlock->WakeGate, WrPushLock, KernelMode);
                 ASSERT(WaitBlock->Signaled);
+
+                /* Account the time we were blocked */
+                if (Site)
+                {
+                    InterlockedIncrement(&Site->Waits);
+                    InterlockedExchangeAdd64(&Site->WaitTime,
+                                             KeQueryInterruptTime() - WaitStart);
+                }
             }
 
             /* We shouldn't be shared anymore */
@@ -646,8 +813,21 @@ ExfAcquirePushLockShared(PEX_PUSH_LOCK PushLock)
 {
     EX_PUSH_LOCK OldValue = *PushLock, NewValue;
     BOOLEAN NeedWake;
+#ifdef CONFIG_SMP
+    BOOLEAN Spun = FALSE;
+#endif
     EX_PUSH_LOCK_WAIT_BLOCK Block;
     PEX_PUSH_LOCK_WAIT_BLOCK WaitBlock = &Block;
+    PEXP_PUSH_LOCK_SITE Site = NULL;
+    ULONGLONG WaitStart;
+
+    /* Check if we're profiling contention */
+    if (ExpPushLockProfiling)
+    {
+        /* Account this call to our caller */
+        Site = ExpGetPushLockSite(_ReturnAddress());
+        if (Site) InterlockedIncrement(&Site->Contentions);
+    }
 
     /* Start main loop */
     for (;;)
@@ -687,6 +867,20 @@ ExfAcquirePushLockShared(PEX_PUSH_LOCK PushLock)
         }
         else
         {
+#ifdef CONFIG_SMP
+            /* Spin once for the exclusive owner to release it before queuing */
+            if (!(Spun) && (ExPushLockSpinCount))
+            {
+                Spun = TRUE;
+                if (ExpSpinOnPushLock(PushLock, FALSE, &OldValue))
+                {
+                    /* It was released, try to share it */
+                    if (Site) InterlockedIncrement(&Site->SpinAcquires);
+                    continue;
+                }
+            }
+#endif
+
             /* We'll have to create a Waitblock */
             WaitBlock->Flags = EX_PUSH_LOCK_FLAGS_WAIT;
             WaitBlock->ShareCount = 0;
@@ -779,8 +973,17 @@ ExfAcquirePushLockShared(PEX_PUSH_LOCK PushLock)
             if (InterlockedBitTestAndReset(&WaitBlock->Flags, 1))
             {
                 /* Fast-path did not work, we need to do a full wait */
+                WaitStart = KeQueryInterruptTime();
                 KeWaitForGate(&WaitBlock->WakeGate, WrPushLock, KernelMode);
                 ASSERT(WaitBlock->Signaled);
+
+                /* Account the time we were blocked */
+                if (Site)
+                {
+                    InterlockedIncrement(&Site->Waits);
+                    InterlockedExchangeAdd64(&Site->WaitTime,
+                                             KeQueryInterruptTime() - WaitStart);
+                }
             }
 
             /* We shouldn't be shared anymore */
@@ -1245,3 +1448,66 @@ ExfUnblockPushLock(PEX_PUSH_LOCK PushLock,
         ExWaitForUnblockPushLock(PushLock, CurrentWaitBlock);
     }
 }
+
+#if DBG && defined(KDBG)
+
+#include <kdbg/kdb.h>
+
+BOOLEAN
+ExpKdbgExtPushLock(
+    ULONG Argc,
+    PCHAR Argv[])
+{
+    PEXP_PUSH_LOCK_SITE Entry;
+    ULONG i;
+
+    /* Check if we were asked to change the profiling state */
+    if (Argc > 1)
+    {
+        if (!strcmp(Argv[1], "on"))
+        {
+            ExpPushLockProfiling = TRUE;
+        }
+        else if (!strcmp(Argv[1], "off"))
+        {
+            ExpPushLockProfiling = FALSE;
+        }
+        else if (!strcmp(Argv[1], "reset"))
+        {
+            RtlZeroMemory(ExpPushLockProfile, sizeof(ExpPushLockProfile));
+        }
+        else
+        {
+            KdbpPrint("Unknown argument '%s'.\n", Argv[1]);
+            return TRUE;
+        }
+    }
+
+    KdbpPrint("Profiling is %s, spin count %lu\n",
+              ExpPushLockProfiling ? "on" : "off",
+              ExPushLockSpinCount);
+    for (i = 0; i < (ULONG)KeNumberProcessors; i++)
+    {
+        KdbpPrint("CPU %lu adaptive spin: %lu\n", i, ExpPushLockSpinLimit[i]);
+    }
+
+    KdbpPrint("Contended\tSpun\t\tWaits\t\tWait (ms)\tSite\n");
+    for (i = 0; i < EXP_PUSH_LOCK_PROFILE_SITES; i++)
+    {
+        Entry = &ExpPushLockProfile[i];
+        if (!Entry->Site) continue;
+
+        KdbpPrint("%-8ld\t%-8ld\t%-8ld\t%-8I64u\t",
+                  Entry->Contentions,
+                  Entry->SpinAcquires,
+                  Entry->Waits,
+                  Entry->WaitTime / 10000);
+        if (!KdbSymPrintAddress(Entry->Site, NULL))
+            KdbpPrint("<%p>", Entry->Site);
+        KdbpPrint("\n");
+    }
+
+    return TRUE;
+}
+
+#endif // DBG && KDBG
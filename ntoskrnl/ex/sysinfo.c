@@ -2197,6 +2197,13 @@ QSI_DEF(SystemLookasideInformation)
         goto Leave;
     }
 
+    /* Copy info from the pool magazines that take over above them */
+    ExGetPoolMagazineInformation(&Info, &Remaining);
+    if (Remaining == 0)
+    {
+        goto Leave;
+    }
+
     /* Copy info from system lookaside lists */
     ExpCopyLookasideInformation(&Info,
                                 &Remaining,
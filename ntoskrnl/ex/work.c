@@ -22,6 +22,16 @@
 /* Magic flag for dynamic worker threads */
 #define EX_DYNAMIC_WORK_THREAD                      0x80000000
 
+/* Maximum number of dynamic worker threads for each Queue */
+#define EX_MAXIMUM_DYNAMIC_WORK_THREADS             16
+
+/* Average queue wait times (in ms) above/below which dynamic threads come and go */
+#define EX_WORK_QUEUE_WAIT_HIGH                     100
+#define EX_WORK_QUEUE_WAIT_LOW                      10
+
+/* Time (in seconds) a dynamic worker thread waits for work before retiring */
+#define EX_DYNAMIC_WORK_THREAD_TIMEOUT              60
+
 /* Worker thread priority increments (added to base priority) */
 #define EX_HYPERCRITICAL_QUEUE_PRIORITY_INCREMENT   7
 #define EX_CRITICAL_QUEUE_PRIORITY_INCREMENT        5
@@ -63,8 +73,9 @@ PETHREAD ExpLastWorkerThread;
  *
  * @return None.
  *
- * @remarks A dynamic thread can timeout after 10 minutes of waiting on a queue
- *          while a static thread will never timeout.
+ * @remarks A dynamic thread can timeout after a minute of waiting on a queue
+ *          while a static thread will never timeout. It only exits when it
+ *          does, if work items are not waiting too long on the queue anymore.
  *
  *          Worker threads must return at IRQL == PASSIVE_LEVEL, must not have
  *          active impersonation info, and must not have disabled APCs.
@@ -90,8 +101,8 @@ ExpWorkerThreadEntryPoint(IN PVOID Context)
     /* Check if this is a dyamic thread */
     if ((ULONG_PTR)Context & EX_DYNAMIC_WORK_THREAD)
     {
-        /* It is, which means we will eventually time out after 10 minutes */
-        Timeout.QuadPart = Int32x32To64(10, -10000000 * 60);
+        /* It is, which means we will eventually time out after a minute */
+        Timeout.QuadPart = Int32x32To64(EX_DYNAMIC_WORK_THREAD_TIMEOUT, -10000000);
         TimeoutPointer = &Timeout;
     }
 
@@ -199,6 +210,9 @@ ProcessLoop:
     /* Don't terminate it if the queue is disabled either */
     if (WorkQueue->Info.QueueDisabled) goto ProcessLoop;
 
+    /* Nor if work items still have to wait for a worker thread */
+    if (WorkQueue->AverageWaitTime >= EX_WORK_QUEUE_WAIT_LOW) goto ProcessLoop;
+
     /* Set the worker flags */
     do
     {
@@ -321,7 +335,8 @@ ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
  * @name ExpDetectWorkerThreadDeadlock
  *
  *     The ExpDetectWorkerThreadDeadlock routine checks every queue and creates
- *     a dynamic thread if the queue seems to be deadlocked.
+ *     a dynamic thread if the queue seems to be deadlocked, or if work items
+ *     have to wait too long before being processed.
  *
  * @param None
  *
@@ -331,6 +346,11 @@ ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
  *          on whether the queue has processed no new items in the last second,
  *          and new items are still enqueued.
  *
+ *          The average wait time of the queue is estimated from its depth and
+ *          the number of items processed in the last second (Little's law).
+ *          Dynamic threads are also created for the critical and delayed queues
+ *          when it is too high, and allowed to retire when it gets low again.
+ *
  *--*/
 VOID
 NTAPI
@@ -338,18 +358,20 @@ ExpDetectWorkerThreadDeadlock(VOID)
 {
     ULONG i;
     PEX_WORK_QUEUE Queue;
+    ULONG Processed, QueueDepth;
 
     /* Loop the 3 queues */
     for (i = 0; i < MaximumWorkQueue; i++)
     {
         /* Get the queue */
         Queue = &ExWorkerQueue[i];
-        ASSERT(Queue->DynamicThreadCount <= 16);
+        ASSERT(Queue->DynamicThreadCount <= EX_MAXIMUM_DYNAMIC_WORK_THREADS);
 
         /* Check if stuff is on the queue that still is unprocessed */
+        Processed = Queue->WorkItemsProcessed - Queue->WorkItemsProcessedLastPass;
         if ((Queue->QueueDepthLastPass) &&
-            (Queue->WorkItemsProcessed == Queue->WorkItemsProcessedLastPass) &&
-            (Queue->DynamicThreadCount < 16))
+            (Processed == 0) &&
+            (Queue->DynamicThreadCount < EX_MAXIMUM_DYNAMIC_WORK_THREADS))
         {
             /* Stuff is still on the queue and nobody did anything about it */
             DPRINT1("EX: Work Queue Deadlock detected: %lu\n", i);
@@ -357,9 +379,40 @@ ExpDetectWorkerThreadDeadlock(VOID)
             DPRINT1("Dynamic threads queued %d\n", Queue->DynamicThreadCount);
         }
 
+        /* Estimate how long items waited on the queue during the last second */
+        QueueDepth = KeReadStateQueue(&Queue->WorkerQueue);
+        if (!QueueDepth)
+        {
+            /* Nothing is waiting */
+            Queue->AverageWaitTime = 0;
+        }
+        else if (!Processed)
+        {
+            /* Nothing got processed, so items waited for the whole second */
+            Queue->AverageWaitTime = 1000;
+        }
+        else
+        {
+            /* Divide the queue depth by the throughput */
+            Queue->AverageWaitTime = min((QueueDepth * 1000) / Processed, 1000);
+        }
+
+        /* Check if items are waiting too long while CPUs could handle them */
+        if ((i != HyperCriticalWorkQueue) &&
+            (Processed) &&
+            (Queue->AverageWaitTime >= EX_WORK_QUEUE_WAIT_HIGH) &&
+            (Queue->WorkerQueue.CurrentCount < Queue->WorkerQueue.MaximumCount) &&
+            (Queue->DynamicThreadCount < EX_MAXIMUM_DYNAMIC_WORK_THREADS))
+        {
+            /* Add a thread to help */
+            DPRINT("EX: Work Queue %lu average wait is %lu ms, adding a thread\n",
+                   i, Queue->AverageWaitTime);
+            ExpCreateWorkerThread(i, TRUE);
+        }
+
         /* Update our data */
         Queue->WorkItemsProcessedLastPass = Queue->WorkItemsProcessed;
-        Queue->QueueDepthLastPass = KeReadStateQueue(&Queue->WorkerQueue);
+        Queue->QueueDepthLastPass = QueueDepth;
     }
 }
 
@@ -395,7 +448,7 @@ ExpCheckDynamicThreadCount(VOID)
             (!IsListEmpty(&Queue->WorkerQueue.EntryListHead)) &&
             (Queue->WorkerQueue.CurrentCount <
              Queue->WorkerQueue.MaximumCount) &&
-            (Queue->DynamicThreadCount < 16))
+            (Queue->DynamicThreadCount < EX_MAXIMUM_DYNAMIC_WORK_THREADS))
         {
             /* Create a new thread */
             DPRINT1("EX: Creating new dynamic thread as requested\n");
@@ -741,6 +794,7 @@ ExQueueWorkItem(IN PWORK_QUEUE_ITEM WorkItem,
     /* Insert the Queue */
     KeInsertQueue(&WorkQueue->WorkerQueue, &WorkItem->List);
     ASSERT(!WorkQueue->Info.QueueDisabled);
+    InterlockedIncrement((PLONG)&WorkQueue->WorkItemsQueued);
 
     /*
      * Check if we need a new thread. Our decision is as follows:
@@ -753,7 +807,7 @@ ExQueueWorkItem(IN PWORK_QUEUE_ITEM WorkItem,
         (!IsListEmpty(&WorkQueue->WorkerQueue.EntryListHead)) &&
         (WorkQueue->WorkerQueue.CurrentCount <
          WorkQueue->WorkerQueue.MaximumCount) &&
-        (WorkQueue->DynamicThreadCount < 16))
+        (WorkQueue->DynamicThreadCount < EX_MAXIMUM_DYNAMIC_WORK_THREADS))
     {
         /* Let the balance manager know about it */
         DPRINT1("Requesting a new thread. CurrentCount: %lu. MaxCount: %lu\n",
@@ -763,4 +817,39 @@ ExQueueWorkItem(IN PWORK_QUEUE_ITEM WorkItem,
     }
 }
 
+#if DBG && defined(KDBG)
+
+#include <kdbg/kdb.h>
+
+BOOLEAN ExpKdbgExtWorkQueue(ULONG Argc, PCHAR Argv[])
+{
+    static PCSTR QueueNames[MaximumWorkQueue] =
+    {
+        "Critical", "Delayed", "HyperCritical"
+    };
+    PEX_WORK_QUEUE WorkQueue;
+    ULONG i;
+
+    /* Windows has no information class for these, so they are only shown here */
+    KdbpPrint("%-14s%-8s%-8s%-8s%-12s%-12s%-8s%s\n",
+              "Queue", "Threads", "Dynamic", "Active", "Queued", "Processed", "Depth", "AvgWait");
+    for (i = 0; i < MaximumWorkQueue; i++)
+    {
+        WorkQueue = &ExWorkerQueue[i];
+        KdbpPrint("%-14s%-8lu%-8ld%-8lu%-12lu%-12lu%-8ld%lu ms\n",
+                  QueueNames[i],
+                  WorkQueue->Info.WorkerCount,
+                  WorkQueue->DynamicThreadCount,
+                  WorkQueue->WorkerQueue.CurrentCount,
+                  WorkQueue->WorkItemsQueued,
+                  WorkQueue->WorkItemsProcessed,
+                  KeReadStateQueue(&WorkQueue->WorkerQueue),
+                  WorkQueue->AverageWaitTime);
+    }
+
+    return TRUE;
+}
+
+#endif // DBG && KDBG
+
 /* EOF */
@@ -32,7 +32,7 @@ typedef union _COMBINED_LOCK_ELEMENT
 
 typedef struct _LOCK_INFORMATION
 {
-    RTL_GENERIC_TABLE RangeTable;
+    RTL_AVL_TABLE RangeTable;
     IO_CSQ Csq;
     KSPIN_LOCK CsqLock;
     LIST_ENTRY CsqList;
@@ -64,7 +64,7 @@ FsRtlCompleteLockIrpReal(IN PCOMPLETE_LOCK_IRP_ROUTINE CompleteRoutine,
 
 /* Generic table methods */
 
-static PVOID NTAPI LockAllocate(PRTL_GENERIC_TABLE Table, CLONG Bytes)
+static PVOID NTAPI LockAllocate(PRTL_AVL_TABLE Table, CLONG Bytes)
 {
     PVOID Result;
     Result = ExAllocatePoolWithTag(NonPagedPool, Bytes, TAG_TABLE);
@@ -72,14 +72,14 @@ static PVOID NTAPI LockAllocate(PRTL_GENERIC_TABLE Table, CLONG Bytes)
     return Result;
 }
 
-static VOID NTAPI LockFree(PRTL_GENERIC_TABLE Table, PVOID Buffer)
+static VOID NTAPI LockFree(PRTL_AVL_TABLE Table, PVOID Buffer)
 {
     DPRINT("LockFree(%p)\n", Buffer);
     ExFreePoolWithTag(Buffer, TAG_TABLE);
 }
 
 static RTL_GENERIC_COMPARE_RESULTS NTAPI LockCompare
-(PRTL_GENERIC_TABLE Table, PVOID PtrA, PVOID PtrB)
+(PRTL_AVL_TABLE Table, PVOID PtrA, PVOID PtrB)
 {
     PCOMBINED_LOCK_ELEMENT A = PtrA, B = PtrB;
     RTL_GENERIC_COMPARE_RESULTS Result;
@@ -115,6 +115,56 @@ static RTL_GENERIC_COMPARE_RESULTS NTAPI LockCompare
     return Result;
 }
 
+/* The ranges in the table never overlap: an exclusive lock conflicts with
+ * anything in its range, and overlapping shared locks are merged into one
+ * range. Ordered by their starting byte, the ranges overlapping a given one
+ * are thus consecutive, and we can walk them in O(log n + k). */
+
+static PCOMBINED_LOCK_ELEMENT
+FsRtlpFirstOverlappingLock(PLOCK_INFORMATION LockInfo,
+                           PCOMBINED_LOCK_ELEMENT Range,
+                           PVOID *RestartKey)
+{
+    return RtlLookupFirstMatchingElementGenericTableAvl(&LockInfo->RangeTable,
+                                                        Range,
+                                                        RestartKey);
+}
+
+static PCOMBINED_LOCK_ELEMENT
+FsRtlpNextOverlappingLock(PLOCK_INFORMATION LockInfo,
+                          PCOMBINED_LOCK_ELEMENT Range,
+                          PVOID *RestartKey)
+{
+    PCOMBINED_LOCK_ELEMENT Entry;
+
+    Entry = RtlEnumerateGenericTableWithoutSplayingAvl(&LockInfo->RangeTable,
+                                                       RestartKey);
+    if (Entry && LockCompare(&LockInfo->RangeTable, Entry, Range) != GenericEqual)
+        Entry = NULL;
+
+    return Entry;
+}
+
+/* The first lock that ends after Start. Unlocking may free any number of
+ * table nodes (granting a waiting shared lock rebuilds the ranges around it),
+ * so walks that unlock use this to find their place again. */
+static PCOMBINED_LOCK_ELEMENT
+FsRtlpFirstLockFrom(PLOCK_INFORMATION LockInfo,
+                    LONGLONG Start,
+                    PVOID *RestartKey)
+{
+    COMBINED_LOCK_ELEMENT Find;
+
+    Find.Exclusive.FileLock.StartingByte.QuadPart = Start;
+    Find.Exclusive.FileLock.EndingByte.QuadPart = MAXLONGLONG;
+    return FsRtlpFirstOverlappingLock(LockInfo, &Find, RestartKey);
+}
+
+/* Files nobody ever locked, or with all their locks gone, need no lookup at all */
+#define FsRtlpHasNoLocks(FileLock) \
+    (!(FileLock)->LockInformation || \
+     RtlIsGenericTableEmptyAvl(&((PLOCK_INFORMATION)(FileLock)->LockInformation)->RangeTable))
+
 /* CSQ methods */
 
 static NTSTATUS NTAPI LockInsertIrpEx
@@ -256,8 +306,9 @@ FsRtlGetNextFileLock(IN PFILE_LOCK FileLock,
                      IN BOOLEAN Restart)
 {
     PCOMBINED_LOCK_ELEMENT Entry;
-    if (!FileLock->LockInformation) return NULL;
-    Entry = RtlEnumerateGenericTable(FileLock->LockInformation, Restart);
+    PLOCK_INFORMATION LockInfo = FileLock->LockInformation;
+    if (!LockInfo) return NULL;
+    Entry = RtlEnumerateGenericTableAvl(&LockInfo->RangeTable, Restart);
     if (!Entry) return NULL;
     else return &Entry->Exclusive.FileLock;
 }
@@ -298,16 +349,16 @@ FsRtlpRebuildSharedLockRange
     BOOLEAN InsertedNew = FALSE, RemovedOld;
     COMBINED_LOCK_ELEMENT NewElement = *Conflict;
     PCOMBINED_LOCK_ELEMENT Entry;
-    while ((Entry = RtlLookupElementGenericTable
-            (FileLock->LockInformation, &NewElement)))
+    while ((Entry = RtlLookupElementGenericTableAvl
+            (&LockInfo->RangeTable, &NewElement)))
     {
         FsRtlpExpandLockElement(&NewElement, Entry);
-        RemovedOld = RtlDeleteElementGenericTable
+        RemovedOld = RtlDeleteElementGenericTableAvl
             (&LockInfo->RangeTable,
              Entry);
         ASSERT(RemovedOld);
     }
-    Conflict = RtlInsertElementGenericTable
+    Conflict = RtlInsertElementGenericTableAvl
         (&LockInfo->RangeTable,
          &NewElement,
          sizeof(NewElement),
@@ -390,7 +441,7 @@ FsRtlPrivateLock(IN PFILE_LOCK FileLock,
         LockInfo->BelongsTo = FileLock;
         InitializeListHead(&LockInfo->SharedLocks);
 
-        RtlInitializeGenericTable
+        RtlInitializeGenericTableAvl
             (&LockInfo->RangeTable,
              LockCompare,
              LockAllocate,
@@ -418,8 +469,8 @@ FsRtlPrivateLock(IN PFILE_LOCK FileLock,
     ToInsert.Exclusive.FileLock.Key = Key;
     ToInsert.Exclusive.FileLock.ExclusiveLock = ExclusiveLock;
 
-    Conflict = RtlInsertElementGenericTable
-        (FileLock->LockInformation,
+    Conflict = RtlInsertElementGenericTableAvl
+        (&LockInfo->RangeTable,
          &ToInsert,
          sizeof(ToInsert),
          &InsertedNew);
@@ -470,59 +521,55 @@ FsRtlPrivateLock(IN PFILE_LOCK FileLock,
         }
         else
         {
-            ULONG i;
+            PVOID RestartKey;
             /* We know of at least one lock in range that's shared.  We need to
              * find out if any more exist and any are exclusive. */
-            for (i = 0; i < RtlNumberGenericTableElements(&LockInfo->RangeTable); i++)
+            for (Conflict = FsRtlpFirstOverlappingLock(LockInfo, &ToInsert, &RestartKey);
+                 Conflict;
+                 Conflict = FsRtlpNextOverlappingLock(LockInfo, &ToInsert, &RestartKey))
             {
-                Conflict = RtlGetElementGenericTable(&LockInfo->RangeTable, i);
-
-                /* The first argument will be inserted as a shared range */
-                if (Conflict && (LockCompare(&LockInfo->RangeTable, Conflict, &ToInsert) == GenericEqual))
+                if (Conflict->Exclusive.FileLock.ExclusiveLock)
                 {
-                    if (Conflict->Exclusive.FileLock.ExclusiveLock)
+                    /* Found an exclusive match */
+                    if (FailImmediately)
                     {
-                        /* Found an exclusive match */
-                        if (FailImmediately)
+                        IoStatus->Status = STATUS_FILE_LOCK_CONFLICT;
+                        DPRINT("STATUS_FILE_LOCK_CONFLICT\n");
+                        if (Irp)
                         {
-                            IoStatus->Status = STATUS_FILE_LOCK_CONFLICT;
-                            DPRINT("STATUS_FILE_LOCK_CONFLICT\n");
-                            if (Irp)
-                            {
-                                DPRINT("STATUS_FILE_LOCK_CONFLICT: Complete\n");
-                                FsRtlCompleteLockIrpReal
-                                    (FileLock->CompleteLockIrpRoutine,
-                                     Context,
-                                     Irp,
-                                     IoStatus->Status,
-                                     &Status,
-                                     FileObject);
-                            }
+                            DPRINT("STATUS_FILE_LOCK_CONFLICT: Complete\n");
+                            FsRtlCompleteLockIrpReal
+                                (FileLock->CompleteLockIrpRoutine,
+                                 Context,
+                                 Irp,
+                                 IoStatus->Status,
+                                 &Status,
+                                 FileObject);
                         }
-                        else
+                    }
+                    else
+                    {
+                        IoStatus->Status = STATUS_PENDING;
+                        if (Irp)
                         {
-                            IoStatus->Status = STATUS_PENDING;
-                            if (Irp)
-                            {
-                                IoMarkIrpPending(Irp);
-                                IoCsqInsertIrpEx
-                                    (&LockInfo->Csq,
-                                     Irp,
-                                     NULL,
-                                     NULL);
-                            }
+                            IoMarkIrpPending(Irp);
+                            IoCsqInsertIrpEx
+                                (&LockInfo->Csq,
+                                 Irp,
+                                 NULL,
+                                 NULL);
                         }
-                        return FALSE;
                     }
+                    return FALSE;
                 }
             }
 
             DPRINT("Overlapping shared lock %wZ %08x%08x %08x%08x\n",
                    &FileObject->FileName,
-                   Conflict->Exclusive.FileLock.StartingByte.HighPart,
-                   Conflict->Exclusive.FileLock.StartingByte.LowPart,
-                   Conflict->Exclusive.FileLock.EndingByte.HighPart,
-                   Conflict->Exclusive.FileLock.EndingByte.LowPart);
+                   ToInsert.Exclusive.FileLock.StartingByte.HighPart,
+                   ToInsert.Exclusive.FileLock.StartingByte.LowPart,
+                   ToInsert.Exclusive.FileLock.EndingByte.HighPart,
+                   ToInsert.Exclusive.FileLock.EndingByte.LowPart);
             Conflict = FsRtlpRebuildSharedLockRange(FileLock,
                                                     LockInfo,
                                                     &ToInsert);
@@ -672,16 +719,17 @@ NTAPI
 FsRtlCheckLockForReadAccess(IN PFILE_LOCK FileLock,
                             IN PIRP Irp)
 {
-    BOOLEAN Result;
+    BOOLEAN Result = TRUE;
     PIO_STACK_LOCATION IoStack = IoGetCurrentIrpStackLocation(Irp);
     COMBINED_LOCK_ELEMENT ToFind;
     PCOMBINED_LOCK_ELEMENT Found;
+    PVOID RestartKey;
     DPRINT("CheckLockForReadAccess(%wZ, Offset %08x%08x, Length %x)\n",
            &IoStack->FileObject->FileName,
            IoStack->Parameters.Read.ByteOffset.HighPart,
            IoStack->Parameters.Read.ByteOffset.LowPart,
            IoStack->Parameters.Read.Length);
-    if (!FileLock->LockInformation) {
+    if (FsRtlpHasNoLocks(FileLock)) {
         DPRINT("CheckLockForReadAccess(%wZ) => TRUE\n", &IoStack->FileObject->FileName);
         return TRUE;
     }
@@ -689,15 +737,14 @@ FsRtlCheckLockForReadAccess(IN PFILE_LOCK FileLock,
     ToFind.Exclusive.FileLock.EndingByte.QuadPart =
         ToFind.Exclusive.FileLock.StartingByte.QuadPart +
         IoStack->Parameters.Read.Length;
-    Found = RtlLookupElementGenericTable
-        (FileLock->LockInformation,
-         &ToFind);
-    if (!Found) {
-        DPRINT("CheckLockForReadAccess(%wZ) => TRUE\n", &IoStack->FileObject->FileName);
-        return TRUE;
+    /* Every exclusive lock in the range must be ours */
+    for (Found = FsRtlpFirstOverlappingLock(FileLock->LockInformation, &ToFind, &RestartKey);
+         Found && Result;
+         Found = FsRtlpNextOverlappingLock(FileLock->LockInformation, &ToFind, &RestartKey))
+    {
+        Result = !Found->Exclusive.FileLock.ExclusiveLock ||
+            IoStack->Parameters.Read.Key == Found->Exclusive.FileLock.Key;
     }
-    Result = !Found->Exclusive.FileLock.ExclusiveLock ||
-        IoStack->Parameters.Read.Key == Found->Exclusive.FileLock.Key;
     DPRINT("CheckLockForReadAccess(%wZ) => %s\n", &IoStack->FileObject->FileName, Result ? "TRUE" : "FALSE");
     return Result;
 }
@@ -710,17 +757,18 @@ NTAPI
 FsRtlCheckLockForWriteAccess(IN PFILE_LOCK FileLock,
                              IN PIRP Irp)
 {
-    BOOLEAN Result;
+    BOOLEAN Result = TRUE;
     PIO_STACK_LOCATION IoStack = IoGetCurrentIrpStackLocation(Irp);
     COMBINED_LOCK_ELEMENT ToFind;
     PCOMBINED_LOCK_ELEMENT Found;
+    PVOID RestartKey;
     PEPROCESS Process = Irp->Tail.Overlay.Thread->ThreadsProcess;
     DPRINT("CheckLockForWriteAccess(%wZ, Offset %08x%08x, Length %x)\n",
            &IoStack->FileObject->FileName,
            IoStack->Parameters.Write.ByteOffset.HighPart,
            IoStack->Parameters.Write.ByteOffset.LowPart,
            IoStack->Parameters.Write.Length);
-    if (!FileLock->LockInformation) {
+    if (FsRtlpHasNoLocks(FileLock)) {
         DPRINT("CheckLockForWriteAccess(%wZ) => TRUE\n", &IoStack->FileObject->FileName);
         return TRUE;
     }
@@ -728,14 +776,13 @@ FsRtlCheckLockForWriteAccess(IN PFILE_LOCK FileLock,
     ToFind.Exclusive.FileLock.EndingByte.QuadPart =
         ToFind.Exclusive.FileLock.StartingByte.QuadPart +
         IoStack->Parameters.Write.Length;
-    Found = RtlLookupElementGenericTable
-        (FileLock->LockInformation,
-         &ToFind);
-    if (!Found) {
-        DPRINT("CheckLockForWriteAccess(%wZ) => TRUE\n", &IoStack->FileObject->FileName);
-        return TRUE;
+    /* Every lock in the range must be ours */
+    for (Found = FsRtlpFirstOverlappingLock(FileLock->LockInformation, &ToFind, &RestartKey);
+         Found && Result;
+         Found = FsRtlpNextOverlappingLock(FileLock->LockInformation, &ToFind, &RestartKey))
+    {
+        Result = Process == Found->Exclusive.FileLock.ProcessId;
     }
-    Result = Process == Found->Exclusive.FileLock.ProcessId;
     DPRINT("CheckLockForWriteAccess(%wZ) => %s\n", &IoStack->FileObject->FileName, Result ? "TRUE" : "FALSE");
     return Result;
 }
@@ -755,6 +802,7 @@ FsRtlFastCheckLockForRead(IN PFILE_LOCK FileLock,
     PEPROCESS EProcess = Process;
     COMBINED_LOCK_ELEMENT ToFind;
     PCOMBINED_LOCK_ELEMENT Found;
+    PVOID RestartKey;
     DPRINT("FsRtlFastCheckLockForRead(%wZ, Offset %08x%08x, Length %08x%08x, Key %x)\n",
            &FileObject->FileName,
            FileOffset->HighPart,
@@ -762,16 +810,22 @@ FsRtlFastCheckLockForRead(IN PFILE_LOCK FileLock,
            Length->HighPart,
            Length->LowPart,
            Key);
+    if (FsRtlpHasNoLocks(FileLock)) return TRUE;
     ToFind.Exclusive.FileLock.StartingByte = *FileOffset;
     ToFind.Exclusive.FileLock.EndingByte.QuadPart =
         FileOffset->QuadPart + Length->QuadPart;
-    if (!FileLock->LockInformation) return TRUE;
-    Found = RtlLookupElementGenericTable
-        (FileLock->LockInformation,
-         &ToFind);
-    if (!Found || !Found->Exclusive.FileLock.ExclusiveLock) return TRUE;
-    return Found->Exclusive.FileLock.Key == Key &&
-        Found->Exclusive.FileLock.ProcessId == EProcess;
+    for (Found = FsRtlpFirstOverlappingLock(FileLock->LockInformation, &ToFind, &RestartKey);
+         Found;
+         Found = FsRtlpNextOverlappingLock(FileLock->LockInformation, &ToFind, &RestartKey))
+    {
+        if (Found->Exclusive.FileLock.ExclusiveLock &&
+            (Found->Exclusive.FileLock.Key != Key ||
+             Found->Exclusive.FileLock.ProcessId != EProcess))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
 }
 
 /*
@@ -786,10 +840,11 @@ FsRtlFastCheckLockForWrite(IN PFILE_LOCK FileLock,
                            IN PFILE_OBJECT FileObject,
                            IN PVOID Process)
 {
-    BOOLEAN Result;
+    BOOLEAN Result = TRUE;
     PEPROCESS EProcess = Process;
     COMBINED_LOCK_ELEMENT ToFind;
     PCOMBINED_LOCK_ELEMENT Found;
+    PVOID RestartKey;
     DPRINT("FsRtlFastCheckLockForWrite(%wZ, Offset %08x%08x, Length %08x%08x, Key %x)\n",
            &FileObject->FileName,
            FileOffset->HighPart,
@@ -797,22 +852,20 @@ FsRtlFastCheckLockForWrite(IN PFILE_LOCK FileLock,
            Length->HighPart,
            Length->LowPart,
            Key);
-    ToFind.Exclusive.FileLock.StartingByte = *FileOffset;
-    ToFind.Exclusive.FileLock.EndingByte.QuadPart =
-        FileOffset->QuadPart + Length->QuadPart;
-    if (!FileLock->LockInformation) {
+    if (FsRtlpHasNoLocks(FileLock)) {
         DPRINT("CheckForWrite(%wZ) => TRUE\n", &FileObject->FileName);
         return TRUE;
     }
-    Found = RtlLookupElementGenericTable
-        (FileLock->LockInformation,
-         &ToFind);
-    if (!Found) {
-        DPRINT("CheckForWrite(%wZ) => TRUE\n", &FileObject->FileName);
-        return TRUE;
+    ToFind.Exclusive.FileLock.StartingByte = *FileOffset;
+    ToFind.Exclusive.FileLock.EndingByte.QuadPart =
+        FileOffset->QuadPart + Length->QuadPart;
+    for (Found = FsRtlpFirstOverlappingLock(FileLock->LockInformation, &ToFind, &RestartKey);
+         Found && Result;
+         Found = FsRtlpNextOverlappingLock(FileLock->LockInformation, &ToFind, &RestartKey))
+    {
+        Result = Found->Exclusive.FileLock.Key == Key &&
+            Found->Exclusive.FileLock.ProcessId == EProcess;
     }
-    Result = Found->Exclusive.FileLock.Key == Key &&
-        Found->Exclusive.FileLock.ProcessId == EProcess;
     DPRINT("CheckForWrite(%wZ) => %s\n", &FileObject->FileName, Result ? "TRUE" : "FALSE");
     return Result;
 }
@@ -858,7 +911,7 @@ FsRtlFastUnlockSingle(IN PFILE_LOCK FileLock,
         DPRINT("File not previously locked (ever)\n");
         return STATUS_RANGE_NOT_LOCKED;
     }
-    Entry = RtlLookupElementGenericTable(&InternalInfo->RangeTable, &Find);
+    Entry = RtlLookupElementGenericTableAvl(&InternalInfo->RangeTable, &Find);
     if (!Entry) {
         DPRINT("Range not locked %wZ\n", &FileObject->FileName);
         return STATUS_RANGE_NOT_LOCKED;
@@ -885,7 +938,7 @@ FsRtlFastUnlockSingle(IN PFILE_LOCK FileLock,
         }
         RtlCopyMemory(&Find, Entry, sizeof(Find));
         // Remove the old exclusive lock region
-        RtlDeleteElementGenericTable(&InternalInfo->RangeTable, Entry);
+        RtlDeleteElementGenericTableAvl(&InternalInfo->RangeTable, Entry);
     }
     else
     {
@@ -931,7 +984,7 @@ FsRtlFastUnlockSingle(IN PFILE_LOCK FileLock,
 
             /* Remember what was in there and remove it from the table */
             Find = *Entry;
-            RtlDeleteElementGenericTable(&InternalInfo->RangeTable, &Find);
+            RtlDeleteElementGenericTableAvl(&InternalInfo->RangeTable, &Find);
             /* Put shared locks back in place */
             for (SharedEntry = InternalInfo->SharedLocks.Flink;
                  SharedEntry != &InternalInfo->SharedLocks;
@@ -1017,6 +1070,64 @@ FsRtlFastUnlockSingle(IN PFILE_LOCK FileLock,
     return STATUS_SUCCESS;
 }
 
+/* Drops the exclusive locks of a process (with a given key, if MatchKey is
+ * set). Its shared locks are on the SharedLocks list, and dealt with there. */
+static VOID
+FsRtlpUnlockAllExclusive(IN PFILE_LOCK FileLock,
+                         IN PEPROCESS Process,
+                         IN BOOLEAN MatchKey,
+                         IN ULONG Key,
+                         IN PVOID Context OPTIONAL)
+{
+    COMBINED_LOCK_ELEMENT Unlock;
+    PCOMBINED_LOCK_ELEMENT Entry;
+    PVOID RestartKey = NULL;
+    PLOCK_INFORMATION InternalInfo = FileLock->LockInformation;
+    LARGE_INTEGER Length;
+    NTSTATUS Status;
+
+    Entry = RtlEnumerateGenericTableWithoutSplayingAvl(&InternalInfo->RangeTable, &RestartKey);
+    while (Entry)
+    {
+        if (!Entry->Exclusive.FileLock.ExclusiveLock ||
+            Entry->Exclusive.FileLock.ProcessId != Process ||
+            (MatchKey && Entry->Exclusive.FileLock.Key != Key))
+        {
+            Entry = RtlEnumerateGenericTableWithoutSplayingAvl(&InternalInfo->RangeTable, &RestartKey);
+            continue;
+        }
+
+        /* Entry and RestartKey may both be freed by the unlock, keep a copy */
+        Unlock = *Entry;
+        Length.QuadPart =
+            Unlock.Exclusive.FileLock.EndingByte.QuadPart -
+            Unlock.Exclusive.FileLock.StartingByte.QuadPart;
+        Status = FsRtlFastUnlockSingle
+            (FileLock,
+             Unlock.Exclusive.FileLock.FileObject,
+             &Unlock.Exclusive.FileLock.StartingByte,
+             &Length,
+             Unlock.Exclusive.FileLock.ProcessId,
+             Unlock.Exclusive.FileLock.Key,
+             Context,
+             TRUE);
+
+        /* Even a failed unlock may have dropped the lock before failing to
+         * grant a waiting one, so look our place up again either way */
+        Entry = FsRtlpFirstLockFrom(InternalInfo,
+                                    Unlock.Exclusive.FileLock.StartingByte.QuadPart,
+                                    &RestartKey);
+
+        /* Don't try the same lock again */
+        if (!NT_SUCCESS(Status) && Entry &&
+            Entry->Exclusive.FileLock.StartingByte.QuadPart ==
+            Unlock.Exclusive.FileLock.StartingByte.QuadPart)
+        {
+            Entry = RtlEnumerateGenericTableWithoutSplayingAvl(&InternalInfo->RangeTable, &RestartKey);
+        }
+    }
+}
+
 /*
  * @implemented
  */
@@ -1028,7 +1139,6 @@ FsRtlFastUnlockAll(IN PFILE_LOCK FileLock,
                    IN PVOID Context OPTIONAL)
 {
     PLIST_ENTRY ListEntry;
-    PCOMBINED_LOCK_ELEMENT Entry;
     PLOCK_INFORMATION InternalInfo = FileLock->LockInformation;
     DPRINT("FsRtlFastUnlockAll(%wZ)\n", &FileObject->FileName);
     // XXX Synchronize somehow
@@ -1055,25 +1165,7 @@ FsRtlFastUnlockAll(IN PFILE_LOCK FileLock,
              Context,
              TRUE);
     }
-    for (Entry = RtlEnumerateGenericTable(&InternalInfo->RangeTable, TRUE);
-         Entry;
-         Entry = RtlEnumerateGenericTable(&InternalInfo->RangeTable, FALSE))
-    {
-        LARGE_INTEGER Length;
-        // We'll take the first one to be the list head, and free the others first...
-        Length.QuadPart =
-            Entry->Exclusive.FileLock.EndingByte.QuadPart -
-            Entry->Exclusive.FileLock.StartingByte.QuadPart;
-        FsRtlFastUnlockSingle
-            (FileLock,
-             Entry->Exclusive.FileLock.FileObject,
-             &Entry->Exclusive.FileLock.StartingByte,
-             &Length,
-             Entry->Exclusive.FileLock.ProcessId,
-             Entry->Exclusive.FileLock.Key,
-             Context,
-             TRUE);
-    }
+    FsRtlpUnlockAllExclusive(FileLock, Process, FALSE, 0, Context);
     DPRINT("Done %wZ\n", &FileObject->FileName);
     return STATUS_SUCCESS;
 }
@@ -1090,7 +1182,6 @@ FsRtlFastUnlockAllByKey(IN PFILE_LOCK FileLock,
                         IN PVOID Context OPTIONAL)
 {
     PLIST_ENTRY ListEntry;
-    PCOMBINED_LOCK_ELEMENT Entry;
     PLOCK_INFORMATION InternalInfo = FileLock->LockInformation;
 
     DPRINT("FsRtlFastUnlockAllByKey(%wZ,Key %x)\n", &FileObject->FileName, Key);
@@ -1117,29 +1208,7 @@ FsRtlFastUnlockAllByKey(IN PFILE_LOCK FileLock,
              Context,
              TRUE);
     }
-    for (Entry = RtlEnumerateGenericTable(&InternalInfo->RangeTable, TRUE);
-         Entry;
-         Entry = RtlEnumerateGenericTable(&InternalInfo->RangeTable, FALSE))
-    {
-        LARGE_INTEGER Length;
-        // We'll take the first one to be the list head, and free the others first...
-        Length.QuadPart =
-            Entry->Exclusive.FileLock.EndingByte.QuadPart -
-            Entry->Exclusive.FileLock.StartingByte.QuadPart;
-        if (Entry->Exclusive.FileLock.Key == Key &&
-            Entry->Exclusive.FileLock.ProcessId == Process)
-        {
-            FsRtlFastUnlockSingle
-                (FileLock,
-                 Entry->Exclusive.FileLock.FileObject,
-                 &Entry->Exclusive.FileLock.StartingByte,
-                 &Length,
-                 Entry->Exclusive.FileLock.ProcessId,
-                 Entry->Exclusive.FileLock.Key,
-                 Context,
-                 TRUE);
-        }
-    }
+    FsRtlpUnlockAllExclusive(FileLock, Process, TRUE, Key, Context);
 
     return STATUS_SUCCESS;
 }
@@ -1294,9 +1363,9 @@ FsRtlUninitializeFileLock(IN PFILE_LOCK FileLock)
             RemoveEntryList(&SharedRange->Entry);
             ExFreePoolWithTag(SharedRange, TAG_RANGE);
         }
-        while ((Entry = RtlGetElementGenericTable(&InternalInfo->RangeTable, 0)) != NULL)
+        while ((Entry = RtlEnumerateGenericTableAvl(&InternalInfo->RangeTable, TRUE)) != NULL)
         {
-            RtlDeleteElementGenericTable(&InternalInfo->RangeTable, Entry);
+            RtlDeleteElementGenericTableAvl(&InternalInfo->RangeTable, Entry);
         }
         while ((Irp = IoCsqRemoveNextIrp(&InternalInfo->Csq, NULL)) != NULL)
         {
@@ -22,17 +22,21 @@
 PAGED_LOOKASIDE_LIST FsRtlFirstMappingLookasideList;
 NPAGED_LOOKASIDE_LIST FsRtlFastMutexLookasideList;
 
-/* We use only real 'mapping' runs; we do not store 'holes' to our GTree. */
+/* We use only real 'mapping' runs; we do not store 'holes' to our run array. */
 typedef struct _LARGE_MCB_MAPPING_ENTRY // run
 {
     LARGE_INTEGER RunStartVbn;
     LARGE_INTEGER RunEndVbn;   /* RunStartVbn+SectorCount; that means +1 after the last sector */
     LARGE_INTEGER StartingLbn; /* Lbn of 'RunStartVbn' */
+    ULONG RunIndex;            /* Index of this run as seen by callers, that is counting the holes before it */
 } LARGE_MCB_MAPPING_ENTRY, *PLARGE_MCB_MAPPING_ENTRY;
 
 typedef struct _LARGE_MCB_MAPPING // mcb_priv
 {
-    RTL_GENERIC_TABLE Table;
+    PLARGE_MCB_MAPPING_ENTRY Runs; /* Sorted by RunStartVbn, never overlapping; MaximumPairCount entries */
+    ULONG ValidRunIndexes;         /* Runs below this one have an up to date RunIndex */
+    ULONG LastRun;                 /* Last run returned by FsRtlGetNextBaseMcbEntry() */
+    LARGE_MCB_MAPPING_ENTRY InitialRuns[MAXIMUM_PAIR_COUNT];
 } LARGE_MCB_MAPPING, *PLARGE_MCB_MAPPING;
 
 typedef struct _BASE_MCB_INTERNAL {
@@ -43,76 +47,172 @@ typedef struct _BASE_MCB_INTERNAL {
     PLARGE_MCB_MAPPING Mapping;
 } BASE_MCB_INTERNAL, *PBASE_MCB_INTERNAL;
 
-/*
-static LARGE_MCB_MAPPING_ENTRY StaticRunBelow0 = {
-    {{-1}}, // ignored
-    {{0}},
-    {{-1}}, // ignored
-};
-*/
-
-static PVOID NTAPI McbMappingAllocate(PRTL_GENERIC_TABLE Table, CLONG Bytes)
+/* PRIVATE FUNCTIONS *********************************************************/
+
+/* Makes room for Extra more runs, doubling the run array when it is full */
+static
+BOOLEAN
+McbReserveRuns(IN PBASE_MCB_INTERNAL Mcb,
+               IN ULONG Extra)
 {
-    PVOID Result;
-    PBASE_MCB Mcb = (PBASE_MCB)Table->TableContext;
-    Result = ExAllocatePoolWithTag(Mcb->PoolType, Bytes, 'BCML');
-    DPRINT("McbMappingAllocate(%lu) => %p\n", Bytes, Result);
-    return Result;
+    PLARGE_MCB_MAPPING_ENTRY NewRuns;
+    ULONG NewCount;
+
+    if (Mcb->PairCount + Extra <= Mcb->MaximumPairCount)
+        return TRUE;
+
+    NewCount = MAX(Mcb->MaximumPairCount * 2, Mcb->PairCount + Extra);
+    if (NewCount > MAXULONG / sizeof(LARGE_MCB_MAPPING_ENTRY))
+        return FALSE;
+
+    NewRuns = ExAllocatePoolWithTag(Mcb->PoolType,
+                                    NewCount * sizeof(LARGE_MCB_MAPPING_ENTRY),
+                                    'BCML');
+    DPRINT("McbReserveRuns(%p, %lu) %lu => %p\n", Mcb, Extra, NewCount, NewRuns);
+    if (!NewRuns)
+        return FALSE;
+
+    RtlCopyMemory(NewRuns,
+                  Mcb->Mapping->Runs,
+                  Mcb->PairCount * sizeof(LARGE_MCB_MAPPING_ENTRY));
+    if (Mcb->Mapping->Runs != Mcb->Mapping->InitialRuns)
+        ExFreePoolWithTag(Mcb->Mapping->Runs, 'BCML');
+
+    Mcb->Mapping->Runs = NewRuns;
+    Mcb->MaximumPairCount = NewCount;
+    return TRUE;
 }
 
-static VOID NTAPI McbMappingFree(PRTL_GENERIC_TABLE Table, PVOID Buffer)
+/* Any change at run Index shifts the caller-visible index of all runs from there on */
+static
+VOID
+McbInvalidateRunIndexes(IN PBASE_MCB_INTERNAL Mcb,
+                        IN ULONG Index)
 {
-    DPRINT("McbMappingFree(%p)\n", Buffer);
-    ExFreePoolWithTag(Buffer, 'BCML');
+    Mcb->Mapping->ValidRunIndexes = MIN(Mcb->Mapping->ValidRunIndexes, Index);
 }
 
 static
-RTL_GENERIC_COMPARE_RESULTS
-NTAPI
-McbMappingCompare(PRTL_GENERIC_TABLE Table,
-                  PVOID PtrA,
-                  PVOID PtrB)
+VOID
+McbUpdateRunIndexes(IN PBASE_MCB_INTERNAL Mcb)
 {
-    PLARGE_MCB_MAPPING_ENTRY A = PtrA, B = PtrB;
-    RTL_GENERIC_COMPARE_RESULTS Res;
-
-    ASSERT(A);
-    ASSERT(B);
-
-    if (A->RunStartVbn.QuadPart == B->RunStartVbn.QuadPart && A->RunEndVbn.QuadPart == B->RunEndVbn.QuadPart)
-        Res = GenericEqual;
-    else if (A->RunEndVbn.QuadPart <= B->RunStartVbn.QuadPart)
-        Res = GenericLessThan;
-    else if (A->RunEndVbn.QuadPart >= B->RunStartVbn.QuadPart)
-        Res = GenericGreaterThan;
-    else
+    PLARGE_MCB_MAPPING_ENTRY Runs = Mcb->Mapping->Runs;
+    ULONG i, RunIndex = 0;
+    LONGLONG LastVbn = 0;
+
+    i = Mcb->Mapping->ValidRunIndexes;
+    if (i)
+    {
+        RunIndex = Runs[i - 1].RunIndex + 1;
+        LastVbn = Runs[i - 1].RunEndVbn.QuadPart;
+    }
+
+    for (; i < Mcb->PairCount; i++)
     {
-        ASSERT(FALSE);
-        Res = GenericEqual;
+        /* Count the 'hole' run we emulate in front of this one */
+        if (Runs[i].RunStartVbn.QuadPart > LastVbn)
+            RunIndex++;
+
+        Runs[i].RunIndex = RunIndex++;
+        LastVbn = Runs[i].RunEndVbn.QuadPart;
     }
 
-    return Res;
+    Mcb->Mapping->ValidRunIndexes = Mcb->PairCount;
 }
 
-static RTL_GENERIC_COMPARE_RESULTS NTAPI McbMappingIntersectCompare(PRTL_GENERIC_TABLE Table, PVOID PtrA, PVOID PtrB)
+/* Returns the first run ending after Vbn, or PairCount if there is none */
+static
+ULONG
+McbFindRun(IN PBASE_MCB_INTERNAL Mcb,
+           IN LONGLONG Vbn)
 {
-    PLARGE_MCB_MAPPING_ENTRY A = PtrA, B = PtrB;
-    RTL_GENERIC_COMPARE_RESULTS Res;
-
-    if (A->RunStartVbn.QuadPart <= B->RunStartVbn.QuadPart && A->RunEndVbn.QuadPart > B->RunStartVbn.QuadPart)
-        Res = GenericEqual;
-    else if (A->RunStartVbn.QuadPart >= B->RunStartVbn.QuadPart && B->RunEndVbn.QuadPart > A->RunStartVbn.QuadPart)
-        Res = GenericEqual;
-    else if (A->RunStartVbn.QuadPart < B->RunStartVbn.QuadPart)
-        Res = GenericLessThan;
-    else if (A->RunStartVbn.QuadPart > B->RunStartVbn.QuadPart)
-        Res = GenericGreaterThan;
-    else
-        Res = GenericEqual;
+    PLARGE_MCB_MAPPING_ENTRY Runs = Mcb->Mapping->Runs;
+    ULONG Low = 0, High = Mcb->PairCount, Middle;
+
+    while (Low < High)
+    {
+        Middle = Low + (High - Low) / 2;
+        if (Runs[Middle].RunEndVbn.QuadPart <= Vbn)
+            Low = Middle + 1;
+        else
+            High = Middle;
+    }
+
+    return Low;
+}
+
+/* Returns the first run whose caller-visible index is at least RunIndex, or PairCount */
+static
+ULONG
+McbFindRunByIndex(IN PBASE_MCB_INTERNAL Mcb,
+                  IN ULONG RunIndex)
+{
+    PLARGE_MCB_MAPPING_ENTRY Runs = Mcb->Mapping->Runs;
+    ULONG Low, High, Middle;
+
+    McbUpdateRunIndexes(Mcb);
+
+    /* Callers walk the runs in order, so try the one we returned last and its successor first */
+    for (Middle = Mcb->Mapping->LastRun; Middle <= Mcb->Mapping->LastRun + 1; Middle++)
+    {
+        if (Middle < Mcb->PairCount &&
+            Runs[Middle].RunIndex >= RunIndex &&
+            (Middle == 0 || Runs[Middle - 1].RunIndex < RunIndex))
+        {
+            return Middle;
+        }
+    }
+
+    Low = 0;
+    High = Mcb->PairCount;
+    while (Low < High)
+    {
+        Middle = Low + (High - Low) / 2;
+        if (Runs[Middle].RunIndex < RunIndex)
+            Low = Middle + 1;
+        else
+            High = Middle;
+    }
 
-    return Res;
+    return Low;
 }
 
+/* The caller must have reserved room for the new run */
+static
+VOID
+McbInsertRun(IN PBASE_MCB_INTERNAL Mcb,
+             IN ULONG Index,
+             IN PLARGE_MCB_MAPPING_ENTRY Run)
+{
+    PLARGE_MCB_MAPPING_ENTRY Runs = Mcb->Mapping->Runs;
+
+    ASSERT(Mcb->PairCount < Mcb->MaximumPairCount);
+    ASSERT(Index <= Mcb->PairCount);
+
+    RtlMoveMemory(&Runs[Index + 1],
+                  &Runs[Index],
+                  (Mcb->PairCount - Index) * sizeof(LARGE_MCB_MAPPING_ENTRY));
+    Runs[Index] = *Run;
+    ++Mcb->PairCount;
+    McbInvalidateRunIndexes(Mcb, Index);
+}
+
+static
+VOID
+McbDeleteRuns(IN PBASE_MCB_INTERNAL Mcb,
+              IN ULONG Index,
+              IN ULONG Count)
+{
+    PLARGE_MCB_MAPPING_ENTRY Runs = Mcb->Mapping->Runs;
+
+    ASSERT(Index + Count <= Mcb->PairCount);
+
+    RtlMoveMemory(&Runs[Index],
+                  &Runs[Index + Count],
+                  (Mcb->PairCount - Index - Count) * sizeof(LARGE_MCB_MAPPING_ENTRY));
+    Mcb->PairCount -= Count;
+    McbInvalidateRunIndexes(Mcb, Index);
+}
 
 /* PUBLIC FUNCTIONS **********************************************************/
 
@@ -140,9 +240,9 @@ FsRtlAddBaseMcbEntry(IN PBASE_MCB OpaqueMcb,
     BOOLEAN Result = TRUE;
     BOOLEAN IntResult;
     PBASE_MCB_INTERNAL Mcb = (PBASE_MCB_INTERNAL)OpaqueMcb;
-    LARGE_MCB_MAPPING_ENTRY Node, NeedleRun;
-    PLARGE_MCB_MAPPING_ENTRY LowerRun, HigherRun;
-    BOOLEAN NewElement;
+    LARGE_MCB_MAPPING_ENTRY Node;
+    PLARGE_MCB_MAPPING_ENTRY Runs, LowerRun, HigherRun;
+    ULONG First, Last;
     LONGLONG IntLbn, IntSectorCount;
 
     DPRINT("FsRtlAddBaseMcbEntry(%p, %I64d, %I64d, %I64d)\n", OpaqueMcb, Vbn, Lbn, SectorCount);
@@ -175,6 +275,13 @@ FsRtlAddBaseMcbEntry(IN PBASE_MCB OpaqueMcb,
         }
     }
 
+    /* the removal below may split a run, and we may not merge with anything */
+    if (!McbReserveRuns(Mcb, 2))
+    {
+        Result = FALSE;
+        goto quit;
+    }
+
     /* clean any possible previous entries in our range */
     FsRtlRemoveBaseMcbEntry(OpaqueMcb, Vbn, SectorCount);
 
@@ -187,43 +294,42 @@ FsRtlAddBaseMcbEntry(IN PBASE_MCB OpaqueMcb,
     Node.RunEndVbn.QuadPart = Vbn + SectorCount;
     Node.StartingLbn.QuadPart = Lbn;
 
+    /* our range is free now, so this is where we go */
+    Runs = Mcb->Mapping->Runs;
+    First = Last = McbFindRun(Mcb, Vbn);
+
     /* optionally merge with lower run */
-    NeedleRun.RunStartVbn.QuadPart = Node.RunStartVbn.QuadPart - 1;
-    NeedleRun.RunEndVbn.QuadPart = NeedleRun.RunStartVbn.QuadPart + 1;
-    NeedleRun.StartingLbn.QuadPart = ~0ULL;
-    Mcb->Mapping->Table.CompareRoutine = McbMappingIntersectCompare;
-    if ((LowerRun = RtlLookupElementGenericTable(&Mcb->Mapping->Table, &NeedleRun)) &&
+    LowerRun = First ? &Runs[First - 1] : NULL;
+    if (LowerRun && LowerRun->RunEndVbn.QuadPart == Node.RunStartVbn.QuadPart &&
         (LowerRun->StartingLbn.QuadPart + (LowerRun->RunEndVbn.QuadPart - LowerRun->RunStartVbn.QuadPart) == Node.StartingLbn.QuadPart))
     {
-        ASSERT(LowerRun->RunEndVbn.QuadPart == Node.RunStartVbn.QuadPart);
         Node.RunStartVbn.QuadPart = LowerRun->RunStartVbn.QuadPart;
         Node.StartingLbn.QuadPart = LowerRun->StartingLbn.QuadPart;
-        Mcb->Mapping->Table.CompareRoutine = McbMappingCompare;
-        RtlDeleteElementGenericTable(&Mcb->Mapping->Table, LowerRun);
-        --Mcb->PairCount;
+        --First;
         DPRINT("Intersecting lower run found (%I64d,%I64d) Lbn: %I64d\n", LowerRun->RunStartVbn.QuadPart, LowerRun->RunEndVbn.QuadPart, LowerRun->StartingLbn.QuadPart);
     }
 
     /* optionally merge with higher run */
-    NeedleRun.RunStartVbn.QuadPart = Node.RunEndVbn.QuadPart;
-    NeedleRun.RunEndVbn.QuadPart = NeedleRun.RunStartVbn.QuadPart + 1;
-    Mcb->Mapping->Table.CompareRoutine = McbMappingIntersectCompare;
-    if ((HigherRun = RtlLookupElementGenericTable(&Mcb->Mapping->Table, &NeedleRun)) &&
-        (Node.StartingLbn.QuadPart <= HigherRun->StartingLbn.QuadPart))
+    HigherRun = (Last < Mcb->PairCount) ? &Runs[Last] : NULL;
+    if (HigherRun && HigherRun->RunStartVbn.QuadPart == Node.RunEndVbn.QuadPart &&
+        (Node.StartingLbn.QuadPart + (Node.RunEndVbn.QuadPart - Node.RunStartVbn.QuadPart) == HigherRun->StartingLbn.QuadPart))
     {
-        ASSERT(HigherRun->RunStartVbn.QuadPart == Node.RunEndVbn.QuadPart);
         Node.RunEndVbn.QuadPart = HigherRun->RunEndVbn.QuadPart;
-        Mcb->Mapping->Table.CompareRoutine = McbMappingCompare;
-        RtlDeleteElementGenericTable(&Mcb->Mapping->Table, HigherRun);
-        --Mcb->PairCount;
+        ++Last;
         DPRINT("Intersecting higher run found (%I64d,%I64d) Lbn: %I64d\n", HigherRun->RunStartVbn.QuadPart, HigherRun->RunEndVbn.QuadPart, HigherRun->StartingLbn.QuadPart);
     }
-    Mcb->Mapping->Table.CompareRoutine = McbMappingCompare;
 
-    /* finally insert the resulting run */
-    RtlInsertElementGenericTable(&Mcb->Mapping->Table, &Node, sizeof(Node), &NewElement);
-    ++Mcb->PairCount;
-    ASSERT(NewElement);
+    /* finally store the resulting run, in place of those it absorbed */
+    if (First == Last)
+    {
+        McbInsertRun(Mcb, First, &Node);
+    }
+    else
+    {
+        Runs[First] = Node;
+        McbDeleteRuns(Mcb, First + 1, Last - First - 1);
+        McbInvalidateRunIndexes(Mcb, First);
+    }
 
     // NB: Two consecutive runs can only be merged, if actual LBNs also match!
 
@@ -322,7 +428,7 @@ FsRtlAddLargeMcbEntry(IN PLARGE_MCB Mcb,
  * Retrieves the parameters of the specified run with index @RunIndex.
  *
  * Mapping %0 always starts at virtual block %0, either as 'hole' or as 'real' mapping.
- * libcaptive does not store 'hole' information to its #GTree.
+ * We do not store 'hole' information to our run array.
  * Last run is always a 'real' run. 'hole' runs appear as mapping to constant @Lbn value %-1.
  *
  * Returns: %TRUE if successful.
@@ -337,47 +443,33 @@ FsRtlGetNextBaseMcbEntry(IN PBASE_MCB OpaqueMcb,
 {
     BOOLEAN Result = FALSE;
     PBASE_MCB_INTERNAL Mcb = (PBASE_MCB_INTERNAL)OpaqueMcb;
-    PLARGE_MCB_MAPPING_ENTRY Run = NULL;
-    ULONG CurrentIndex = 0;
-    ULONGLONG LastVbn = 0;
-    ULONGLONG LastSectorCount = 0;
-
-    // Traverse the tree
-    for (Run = (PLARGE_MCB_MAPPING_ENTRY)RtlEnumerateGenericTable(&Mcb->Mapping->Table, TRUE);
-    Run;
-        Run = (PLARGE_MCB_MAPPING_ENTRY)RtlEnumerateGenericTable(&Mcb->Mapping->Table, FALSE))
-    {
-        // is the current index a hole?
-        if (Run->RunStartVbn.QuadPart > (LastVbn + LastSectorCount))
-        {
-            // Is this the index we're looking for?
-            if (RunIndex == CurrentIndex)
-            {
-                *Vbn = LastVbn + LastSectorCount;
-                *Lbn = -1;
-                *SectorCount = Run->RunStartVbn.QuadPart - *Vbn;
-
-                Result = TRUE;
-                goto quit;
-            }
+    PLARGE_MCB_MAPPING_ENTRY Run;
+    ULONG i;
 
-            CurrentIndex++;
-        }
+    i = McbFindRunByIndex(Mcb, RunIndex);
+    if (i == Mcb->PairCount)
+        goto quit;
 
-        if (RunIndex == CurrentIndex)
-        {
-            *Vbn = Run->RunStartVbn.QuadPart;
-            *Lbn = Run->StartingLbn.QuadPart;
-            *SectorCount = Run->RunEndVbn.QuadPart - Run->RunStartVbn.QuadPart;
+    Mcb->Mapping->LastRun = i;
+    Run = &Mcb->Mapping->Runs[i];
 
-            Result = TRUE;
-            goto quit;
-        }
+    // is the current index a hole?
+    if (Run->RunIndex != RunIndex)
+    {
+        ASSERT(Run->RunIndex == RunIndex + 1);
 
-        CurrentIndex++;
-        LastVbn = Run->RunStartVbn.QuadPart;
-        LastSectorCount = Run->RunEndVbn.QuadPart - Run->RunStartVbn.QuadPart;
+        *Vbn = i ? Run[-1].RunEndVbn.QuadPart : 0;
+        *Lbn = -1;
+        *SectorCount = Run->RunStartVbn.QuadPart - *Vbn;
     }
+    else
+    {
+        *Vbn = Run->RunStartVbn.QuadPart;
+        *Lbn = Run->StartingLbn.QuadPart;
+        *SectorCount = Run->RunEndVbn.QuadPart - Run->RunStartVbn.QuadPart;
+    }
+
+    Result = TRUE;
 
 quit:
     DPRINT("FsRtlGetNextBaseMcbEntry(%p, %d, %p, %p, %p) = %d (%I64d, %I64d, %I64d)\n", Mcb, RunIndex, Vbn, Lbn, SectorCount, Result, *Vbn, *Lbn, *SectorCount);
@@ -436,11 +528,9 @@ FsRtlInitializeBaseMcb(IN PBASE_MCB OpaqueMcb,
     Mcb->PoolType = PoolType;
     Mcb->PairCount = 0;
     Mcb->MaximumPairCount = MAXIMUM_PAIR_COUNT;
-    RtlInitializeGenericTable(&Mcb->Mapping->Table,
-                              McbMappingCompare,
-                              McbMappingAllocate,
-                              McbMappingFree,
-                              Mcb);
+    Mcb->Mapping->Runs = Mcb->Mapping->InitialRuns;
+    Mcb->Mapping->ValidRunIndexes = 0;
+    Mcb->Mapping->LastRun = 0;
 }
 
 /*
@@ -511,38 +601,57 @@ FsRtlLookupBaseMcbEntry(IN PBASE_MCB OpaqueMcb,
     OUT PULONG Index OPTIONAL)
 {
     BOOLEAN Result = FALSE;
+    PBASE_MCB_INTERNAL Mcb = (PBASE_MCB_INTERNAL)OpaqueMcb;
+    PLARGE_MCB_MAPPING_ENTRY Run;
     ULONG i;
-    LONGLONG LastVbn = 0, LastLbn = 0, Count = 0;   // the last values we've found during traversal
+    LONGLONG LastVbn, LastLbn, Count;   // the mapping we've found, maybe a hole
 
     DPRINT("FsRtlLookupBaseMcbEntry(%p, %I64d, %p, %p, %p, %p, %p)\n", OpaqueMcb, Vbn, Lbn, SectorCountFromLbn, StartingLbn, SectorCountFromStartingLbn, Index);
 
-    for (i = 0; FsRtlGetNextBaseMcbEntry(OpaqueMcb, i, &LastVbn, &LastLbn, &Count); i++)
-    {
-        // have we reached the target mapping?
-        if (Vbn < LastVbn + Count)
-        {
-            if (Lbn)
-            {
-                if (LastLbn == -1)
-                    *Lbn = -1;
-                else
-                    *Lbn = LastLbn + (Vbn - LastVbn);
-            }
+    i = McbFindRun(Mcb, Vbn);
+    if (i == Mcb->PairCount)
+        goto quit;
 
-            if (SectorCountFromLbn)
-                *SectorCountFromLbn = LastVbn + Count - Vbn;
-            if (StartingLbn)
-                *StartingLbn = LastLbn;
-            if (SectorCountFromStartingLbn)
-                *SectorCountFromStartingLbn = LastVbn + Count - LastVbn;
-            if (Index)
-                *Index = i;
+    if (Index)
+        McbUpdateRunIndexes(Mcb);
 
-            Result = TRUE;
-            goto quit;
-        }
+    Run = &Mcb->Mapping->Runs[i];
+    LastVbn = i ? Run[-1].RunEndVbn.QuadPart : 0;
+
+    // does the target fall into the hole in front of this run?
+    if (Vbn < Run->RunStartVbn.QuadPart && Run->RunStartVbn.QuadPart > LastVbn)
+    {
+        LastLbn = -1;
+        Count = Run->RunStartVbn.QuadPart - LastVbn;
+        if (Index)
+            *Index = Run->RunIndex - 1;
+    }
+    else
+    {
+        LastVbn = Run->RunStartVbn.QuadPart;
+        LastLbn = Run->StartingLbn.QuadPart;
+        Count = Run->RunEndVbn.QuadPart - Run->RunStartVbn.QuadPart;
+        if (Index)
+            *Index = Run->RunIndex;
     }
 
+    if (Lbn)
+    {
+        if (LastLbn == -1)
+            *Lbn = -1;
+        else
+            *Lbn = LastLbn + (Vbn - LastVbn);
+    }
+
+    if (SectorCountFromLbn)
+        *SectorCountFromLbn = LastVbn + Count - Vbn;
+    if (StartingLbn)
+        *StartingLbn = LastLbn;
+    if (SectorCountFromStartingLbn)
+        *SectorCountFromStartingLbn = LastVbn + Count - LastVbn;
+
+    Result = TRUE;
+
 quit:
     DPRINT("FsRtlLookupBaseMcbEntry(%p, %I64d, %p, %p, %p, %p, %p) = %d (%I64d, %I64d, %I64d, %I64d, %d)\n",
            OpaqueMcb, Vbn, Lbn, SectorCountFromLbn, StartingLbn, SectorCountFromStartingLbn, Index, Result,
@@ -594,29 +703,15 @@ FsRtlLookupLastLargeMcbEntryAndIndex_internal(IN PBASE_MCB_INTERNAL Mcb,
                                               OUT PLONGLONG Lbn,
                                               OUT PULONG Index OPTIONAL)
 {
-    ULONG RunIndex = 0;
-    PLARGE_MCB_MAPPING_ENTRY Run, RunFound = NULL;
-    LONGLONG LastVbn = 0;
+    PLARGE_MCB_MAPPING_ENTRY RunFound;
 
-    for (Run = (PLARGE_MCB_MAPPING_ENTRY)RtlEnumerateGenericTable(&Mcb->Mapping->Table, TRUE);
-        Run;
-        Run = (PLARGE_MCB_MAPPING_ENTRY)RtlEnumerateGenericTable(&Mcb->Mapping->Table, FALSE))
-    {
-        /* Take care when we must emulate missing 'hole' runs. */
-        if (Run->RunStartVbn.QuadPart > LastVbn)
-        {
-            RunIndex++;
-        }
-        LastVbn = Run->RunEndVbn.QuadPart;
-        RunIndex++;
-        RunFound = Run;
-    }
-
-    if (!RunFound)
+    if (!Mcb->PairCount)
     {
         return FALSE;
     }
 
+    RunFound = &Mcb->Mapping->Runs[Mcb->PairCount - 1];
+
     if (Vbn)
     {
         *Vbn = RunFound->RunEndVbn.QuadPart - 1;
@@ -634,7 +729,8 @@ FsRtlLookupLastLargeMcbEntryAndIndex_internal(IN PBASE_MCB_INTERNAL Mcb,
     }
     if (Index)
     {
-        *Index = RunIndex - 1;
+        McbUpdateRunIndexes(Mcb);
+        *Index = RunFound->RunIndex;
     }
 
     return TRUE;
@@ -741,16 +837,16 @@ ULONG
 NTAPI
 FsRtlNumberOfRunsInBaseMcb(IN PBASE_MCB OpaqueMcb)
 {
+    PBASE_MCB_INTERNAL Mcb = (PBASE_MCB_INTERNAL)OpaqueMcb;
     ULONG NumberOfRuns = 0;
-    LONGLONG Vbn, Lbn, Count;
-    int i;
 
     DPRINT("FsRtlNumberOfRunsInBaseMcb(%p)\n", OpaqueMcb);
 
-    // Count how many Mcb entries there are
-    for (i = 0; FsRtlGetNextBaseMcbEntry(OpaqueMcb, i, &Vbn, &Lbn, &Count); i++)
+    // The index of the last run counts all the runs and holes before it
+    if (Mcb->PairCount)
     {
-        NumberOfRuns++;
+        McbUpdateRunIndexes(Mcb);
+        NumberOfRuns = Mcb->Mapping->Runs[Mcb->PairCount - 1].RunIndex + 1;
     }
 
     DPRINT("FsRtlNumberOfRunsInBaseMcb(%p) = %d\n", OpaqueMcb, NumberOfRuns);
@@ -798,7 +894,8 @@ FsRtlRemoveBaseMcbEntry(IN PBASE_MCB OpaqueMcb,
 {
     PBASE_MCB_INTERNAL Mcb = (PBASE_MCB_INTERNAL)OpaqueMcb;
     LARGE_MCB_MAPPING_ENTRY NeedleRun;
-    PLARGE_MCB_MAPPING_ENTRY HaystackRun;
+    PLARGE_MCB_MAPPING_ENTRY Runs;
+    ULONG First, Last;
     BOOLEAN Result = TRUE;
 
     DPRINT("FsRtlRemoveBaseMcbEntry(%p, %I64d, %I64d)\n", OpaqueMcb, Vbn, SectorCount);
@@ -819,78 +916,56 @@ FsRtlRemoveBaseMcbEntry(IN PBASE_MCB OpaqueMcb,
     NeedleRun.RunEndVbn.QuadPart = Vbn + SectorCount;
     NeedleRun.StartingLbn.QuadPart = -1;
 
-    /* adjust/destroy all intersecting ranges */
-    Mcb->Mapping->Table.CompareRoutine = McbMappingIntersectCompare;
-    while ((HaystackRun = RtlLookupElementGenericTable(&Mcb->Mapping->Table, &NeedleRun)))
+    Runs = Mcb->Mapping->Runs;
+    First = McbFindRun(Mcb, NeedleRun.RunStartVbn.QuadPart);
+
+    /* truncate the run we start in */
+    if (First < Mcb->PairCount &&
+        Runs[First].RunStartVbn.QuadPart < NeedleRun.RunStartVbn.QuadPart)
     {
-        if (HaystackRun->RunStartVbn.QuadPart < NeedleRun.RunStartVbn.QuadPart)
+        if (Runs[First].RunEndVbn.QuadPart > NeedleRun.RunEndVbn.QuadPart)
         {
-            LONGLONG HaystackRunEnd = HaystackRun->RunEndVbn.QuadPart;
-            ASSERT(HaystackRun->RunEndVbn.QuadPart > NeedleRun.RunStartVbn.QuadPart);
+            /* The run we are deleting is included in the run we truncate.
+             * Add the tail back. */
+            LARGE_MCB_MAPPING_ENTRY TailRun;
 
-            HaystackRun->RunEndVbn.QuadPart = NeedleRun.RunStartVbn.QuadPart;
-
-            if (HaystackRunEnd > NeedleRun.RunEndVbn.QuadPart)
+            if (!McbReserveRuns(Mcb, 1))
             {
-                /* The run we are deleting is included in the run we just truncated.
-                 * Add the tail back. */
-                LARGE_MCB_MAPPING_ENTRY TailRun;
-                BOOLEAN NewElement;
-
-                TailRun.RunStartVbn.QuadPart = NeedleRun.RunEndVbn.QuadPart;
-                TailRun.RunEndVbn.QuadPart = HaystackRunEnd;
-                TailRun.StartingLbn.QuadPart = HaystackRun->StartingLbn.QuadPart + (NeedleRun.RunEndVbn.QuadPart - HaystackRun->RunStartVbn.QuadPart);
-
-                Mcb->Mapping->Table.CompareRoutine = McbMappingCompare;
-
-                RtlInsertElementGenericTable(&Mcb->Mapping->Table, &TailRun, sizeof(TailRun), &NewElement);
-                ++Mcb->PairCount;
-                ASSERT(NewElement);
-
-                Mcb->Mapping->Table.CompareRoutine = McbMappingIntersectCompare;
+                Result = FALSE;
+                goto quit;
             }
-        }
-        else if (HaystackRun->RunEndVbn.QuadPart > NeedleRun.RunEndVbn.QuadPart)
-        {
-            LONGLONG HaystackRunStart = HaystackRun->RunStartVbn.QuadPart;
-            LONGLONG HaystackStartingLbn = HaystackRun->StartingLbn.QuadPart;
+            Runs = Mcb->Mapping->Runs;
 
-            ASSERT(HaystackRun->RunStartVbn.QuadPart < NeedleRun.RunEndVbn.QuadPart);
-            HaystackRun->RunStartVbn.QuadPart = NeedleRun.RunEndVbn.QuadPart;
-            /* Adjust the starting LBN */
-            HaystackRun->StartingLbn.QuadPart += NeedleRun.RunEndVbn.QuadPart - HaystackRunStart;
+            TailRun.RunStartVbn.QuadPart = NeedleRun.RunEndVbn.QuadPart;
+            TailRun.RunEndVbn.QuadPart = Runs[First].RunEndVbn.QuadPart;
+            TailRun.StartingLbn.QuadPart = Runs[First].StartingLbn.QuadPart + (NeedleRun.RunEndVbn.QuadPart - Runs[First].RunStartVbn.QuadPart);
 
-            if (HaystackRunStart < NeedleRun.RunStartVbn.QuadPart)
-            {
-                /* The run we are deleting is included in the run we just truncated.
-                 * Add the head back. */
-                LARGE_MCB_MAPPING_ENTRY HeadRun;
-                BOOLEAN NewElement;
-
-                HeadRun.RunStartVbn.QuadPart = HaystackRunStart;
-                HeadRun.RunEndVbn.QuadPart = NeedleRun.RunStartVbn.QuadPart;
-                HeadRun.StartingLbn.QuadPart = HaystackStartingLbn;
+            Runs[First].RunEndVbn.QuadPart = NeedleRun.RunStartVbn.QuadPart;
+            McbInsertRun(Mcb, First + 1, &TailRun);
+            goto quit;
+        }
 
-                Mcb->Mapping->Table.CompareRoutine = McbMappingCompare;
+        Runs[First].RunEndVbn.QuadPart = NeedleRun.RunStartVbn.QuadPart;
+        McbInvalidateRunIndexes(Mcb, First);
+        ++First;
+    }
 
-                RtlInsertElementGenericTable(&Mcb->Mapping->Table, &HeadRun, sizeof(HeadRun), &NewElement);
-                ++Mcb->PairCount;
-                ASSERT(NewElement);
+    /* destroy all runs we fully cover */
+    for (Last = First;
+         Last < Mcb->PairCount && Runs[Last].RunEndVbn.QuadPart <= NeedleRun.RunEndVbn.QuadPart;
+         Last++);
 
-                Mcb->Mapping->Table.CompareRoutine = McbMappingIntersectCompare;
-            }
-        }
-        else
-        {
-            //ASSERT(NeedleRun.RunStartVbn.QuadPart >= HaystackRun->RunStartVbn.QuadPart);
-            //ASSERT(NeedleRun.RunEndVbn.QuadPart <= HaystackRun->RunEndVbn.QuadPart);
-            Mcb->Mapping->Table.CompareRoutine = McbMappingCompare;
-            RtlDeleteElementGenericTable(&Mcb->Mapping->Table, HaystackRun);
-            --Mcb->PairCount;
-            Mcb->Mapping->Table.CompareRoutine = McbMappingIntersectCompare;
-        }
+    /* and adjust the run we end in */
+    if (Last < Mcb->PairCount &&
+        Runs[Last].RunStartVbn.QuadPart < NeedleRun.RunEndVbn.QuadPart)
+    {
+        /* Adjust the starting LBN */
+        Runs[Last].StartingLbn.QuadPart += NeedleRun.RunEndVbn.QuadPart - Runs[Last].RunStartVbn.QuadPart;
+        Runs[Last].RunStartVbn.QuadPart = NeedleRun.RunEndVbn.QuadPart;
+        McbInvalidateRunIndexes(Mcb, Last);
     }
-    Mcb->Mapping->Table.CompareRoutine = McbMappingCompare;
+
+    McbDeleteRuns(Mcb, First, Last - First);
 
 quit:
     DPRINT("FsRtlRemoveBaseMcbEntry(%p, %I64d, %I64d) = %d\n", OpaqueMcb, Vbn, SectorCount, Result);
@@ -921,18 +996,19 @@ NTAPI
 FsRtlResetBaseMcb(IN PBASE_MCB OpaqueMcb)
 {
     PBASE_MCB_INTERNAL Mcb = (PBASE_MCB_INTERNAL)OpaqueMcb;
-    PLARGE_MCB_MAPPING_ENTRY Element;
 
     DPRINT("FsRtlResetBaseMcb(%p)\n", OpaqueMcb);
 
-    while (RtlNumberGenericTableElements(&Mcb->Mapping->Table) &&
-           (Element = (PLARGE_MCB_MAPPING_ENTRY)RtlGetElementGenericTable(&Mcb->Mapping->Table, 0)))
+    if (Mcb->Mapping->Runs != Mcb->Mapping->InitialRuns)
     {
-        RtlDeleteElementGenericTable(&Mcb->Mapping->Table, Element);
+        ExFreePoolWithTag(Mcb->Mapping->Runs, 'BCML');
+        Mcb->Mapping->Runs = Mcb->Mapping->InitialRuns;
     }
 
+    Mcb->Mapping->ValidRunIndexes = 0;
+    Mcb->Mapping->LastRun = 0;
     Mcb->PairCount = 0;
-    Mcb->MaximumPairCount = 0;
+    Mcb->MaximumPairCount = MAXIMUM_PAIR_COUNT;
 }
 
 /*
@@ -955,7 +1031,7 @@ FsRtlResetLargeMcb(IN PLARGE_MCB Mcb,
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 BOOLEAN
 NTAPI
@@ -964,54 +1040,64 @@ FsRtlSplitBaseMcb(IN PBASE_MCB OpaqueMcb,
                   IN LONGLONG Amount)
 {
     PBASE_MCB_INTERNAL Mcb = (PBASE_MCB_INTERNAL)OpaqueMcb;
-    PLARGE_MCB_MAPPING_ENTRY Run, InsertLowerRun = NULL, ExistingRun = NULL;
-    BOOLEAN NewElement;
+    PLARGE_MCB_MAPPING_ENTRY Runs;
+    ULONG First, i;
+    BOOLEAN Result = TRUE;
 
     DPRINT("FsRtlSplitBaseMcb(%p, %I64d, %I64d)\n", OpaqueMcb, Vbn, Amount);
 
-    /* Traverse the tree */
-    for (Run = (PLARGE_MCB_MAPPING_ENTRY)RtlEnumerateGenericTable(&Mcb->Mapping->Table, TRUE);
-        Run;
-        Run = (PLARGE_MCB_MAPPING_ENTRY)RtlEnumerateGenericTable(&Mcb->Mapping->Table, FALSE))
+    if (Vbn < 0 || Amount <= 0)
     {
-        /* unaffected run? */
-        /* FIXME: performance: effective skip of all 'lower' runs without traversing them */
-        if (Vbn >= Run->RunEndVbn.QuadPart) { DPRINT("Skipping it\n"); continue; }
-
-        /* crossing run to be split?
-        * 'lower_run' is created on the original place; just shortened.
-        * current 'run' is shifted up later
-        */
-        if (Vbn < Run->RunEndVbn.QuadPart)
-        {
-            /* FIXME: shift 'run->Lbn_start' ? */
-            Run->RunStartVbn.QuadPart = Vbn;
+        Result = FALSE;
+        goto quit;
+    }
+
+    /* overflow? */
+    if (Mcb->PairCount &&
+        Mcb->Mapping->Runs[Mcb->PairCount - 1].RunEndVbn.QuadPart + Amount <= Mcb->Mapping->Runs[Mcb->PairCount - 1].RunEndVbn.QuadPart)
+    {
+        Result = FALSE;
+        goto quit;
+    }
+
+    /* effectively skip all the unaffected 'lower' runs */
+    First = McbFindRun(Mcb, Vbn);
+    Runs = Mcb->Mapping->Runs;
 
-            InsertLowerRun = NULL;
+    /* crossing run to be split?
+     * the lower part stays in place, just shortened;
+     * the upper part becomes a run of its own, shifted up below
+     */
+    if (First < Mcb->PairCount && Runs[First].RunStartVbn.QuadPart < Vbn)
+    {
+        LARGE_MCB_MAPPING_ENTRY UpperRun;
+
+        if (!McbReserveRuns(Mcb, 1))
+        {
+            Result = FALSE;
+            goto quit;
         }
+        Runs = Mcb->Mapping->Runs;
 
-        /* Shift the current 'run'.
-        * Ordering is not changed in Generic Tree so I hope I do not need to reinsert it.
-        */
-        Run->RunStartVbn.QuadPart += Amount;
-        ASSERT(Run->RunEndVbn.QuadPart + Amount > Run->RunEndVbn.QuadPart); /* overflow? */
-        Run->RunEndVbn.QuadPart += Amount;
-        /* FIXME: shift 'run->Lbn_start' ? */
+        UpperRun.RunStartVbn.QuadPart = Vbn;
+        UpperRun.RunEndVbn.QuadPart = Runs[First].RunEndVbn.QuadPart;
+        UpperRun.StartingLbn.QuadPart = Runs[First].StartingLbn.QuadPart + (Vbn - Runs[First].RunStartVbn.QuadPart);
 
-        /* continue the traversal */
+        Runs[First].RunEndVbn.QuadPart = Vbn;
+        McbInsertRun(Mcb, ++First, &UpperRun);
     }
 
-    if (InsertLowerRun)
+    /* Shift all the following runs; their LBNs do not move and their order is kept */
+    for (i = First; i < Mcb->PairCount; i++)
     {
-        ExistingRun = RtlInsertElementGenericTable(&Mcb->Mapping->Table, InsertLowerRun, sizeof(*InsertLowerRun), &NewElement);
-        ++Mcb->PairCount;
+        Runs[i].RunStartVbn.QuadPart += Amount;
+        Runs[i].RunEndVbn.QuadPart += Amount;
     }
+    McbInvalidateRunIndexes(Mcb, First);
 
-    ASSERT(ExistingRun == NULL);
-
-    DPRINT("FsRtlSplitBaseMcb(%p, %I64d, %I64d) = %d\n", OpaqueMcb, Vbn, Amount, TRUE);
-
-    return TRUE;
+quit:
+    DPRINT("FsRtlSplitBaseMcb(%p, %I64d, %I64d) = %d\n", OpaqueMcb, Vbn, Amount, Result);
+    return Result;
 }
 
 /*
@@ -1075,6 +1161,7 @@ FsRtlUninitializeBaseMcb(IN PBASE_MCB Mcb)
 {
     DPRINT("FsRtlUninitializeBaseMcb(%p)\n", Mcb);
 
+    /* This also releases a run array we grew out of the mapping */
     FsRtlResetBaseMcb(Mcb);
 
     if ((Mcb->PoolType == PagedPool)/* && (Mcb->MaximumPairCount == MAXIMUM_PAIR_COUNT)*/)
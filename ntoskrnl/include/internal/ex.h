@@ -175,6 +175,19 @@ ExGetPoolTagInfo(
     IN OUT PULONG ReturnLength OPTIONAL
 );
 
+VOID
+NTAPI
+ExGetPoolMagazineInformation(
+    IN OUT PSYSTEM_LOOKASIDE_INFORMATION *InfoPointer,
+    IN OUT PULONG RemainingPointer
+);
+
+VOID
+NTAPI
+ExTrimPoolMagazines(
+    VOID
+);
+
 typedef struct _UUID_CACHED_VALUES_STRUCT
 {
     ULONGLONG Time;
@@ -107,12 +107,20 @@ typedef struct _FILE_OBJECT_EXTENSION
 
 
 //
-// We can call the Ob Inlined API, it's the same thing
+// IRPs and MDLs come from per-processor lookaside lists in several size
+// classes. IRP classes hold 1, 4, 8 and 16 stack locations, MDL classes
+// map up to 23 and 256 pages. Anything bigger comes from pool.
 //
-#define IopAllocateMdlFromLookaside                     \
-    ObpAllocateObjectCreateInfoBuffer
-#define IopFreeMdlFromLookaside                         \
-    ObpFreeCapturedAttributes
+#define IOP_IRP_STACK_CLASSES               4
+#define IOP_MDL_SIZE_CLASSES                2
+#define IOP_SMALL_MDL_PAGES                 23
+#define IOP_LARGE_MDL_PAGES                 256
+
+typedef struct _IOP_PP_LOOKASIDE
+{
+    PP_LOOKASIDE_LIST Irp[IOP_IRP_STACK_CLASSES];
+    PP_LOOKASIDE_LIST Mdl[IOP_MDL_SIZE_CLASSES];
+} IOP_PP_LOOKASIDE, *PIOP_PP_LOOKASIDE;
 
 //
 // Determines if the IRP is Synchronous
@@ -123,6 +131,23 @@ typedef struct _FILE_OBJECT_EXTENSION
         FALSE :                                         \
         FileObject->Flags & FO_SYNCHRONOUS_IO))         \
 
+//
+// Completion notification modes were added to 2003 SP2, but the headers
+// only define their information class for Vista
+//
+#if (NTDDI_VERSION < NTDDI_VISTA)
+#define FileIoCompletionNotificationInformation         \
+    ((FILE_INFORMATION_CLASS)41)
+#endif
+
+//
+// Determines if a request that completed without pending can skip the
+// completion port of its File Object
+//
+#define IopSkipCompletionPort(FileObject, Status)       \
+    (((FileObject)->Flags & FO_SKIP_COMPLETION_PORT) && \
+     !NT_ERROR(Status))
+
 //
 // Returns the internal Device Object Extension
 //
@@ -1448,6 +1473,9 @@ extern PDEVICE_NODE IopRootDeviceNode;
 extern KSPIN_LOCK IopDeviceTreeLock;
 extern ULONG IopTraceLevel;
 extern GENERAL_LOOKASIDE IopMdlLookasideList;
+extern IOP_PP_LOOKASIDE IopPPLookaside[MAXIMUM_PROCESSORS];
+extern LONG IopIrpPoolAllocations[IOP_IRP_STACK_CLASSES + 1];
+extern LONG IopMdlPoolAllocations[IOP_MDL_SIZE_CLASSES + 1];
 extern GENERIC_MAPPING IopCompletionMapping;
 extern GENERIC_MAPPING IopFileMapping;
 extern POBJECT_TYPE _IoFileObjectType;
@@ -165,3 +165,85 @@ IopValidateOpenPacket(IN POPEN_PACKET OpenPacket)
     /* Good packet */
     return TRUE;
 }
+
+static
+__inline
+ULONG
+IopGetIrpStackClass(IN CCHAR StackSize)
+{
+    /* Return the smallest class that fits, or the class count if none does */
+    if (StackSize <= 1) return 0;
+    if (StackSize <= 4) return 1;
+    if (StackSize <= 8) return 2;
+    if (StackSize <= 16) return 3;
+    return IOP_IRP_STACK_CLASSES;
+}
+
+static
+__inline
+CCHAR
+IopGetIrpStackClassSize(IN ULONG Class)
+{
+    /* Classes hold 1, 4, 8 and 16 stack locations */
+    return (Class == 0) ? 1 : (CCHAR)(4 << (Class - 1));
+}
+
+static
+__inline
+PVOID
+IopAllocateFromPPLookaside(IN PPP_LOOKASIDE_LIST LookasideList)
+{
+    PNPAGED_LOOKASIDE_LIST List;
+    PVOID Entry;
+
+    /* Try the P List first */
+    List = (PNPAGED_LOOKASIDE_LIST)LookasideList->P;
+    List->L.TotalAllocates++;
+    Entry = InterlockedPopEntrySList(&List->L.ListHead);
+    if (!Entry)
+    {
+        /* Let the balancer know, and try the L List */
+        List->L.AllocateMisses++;
+        List = (PNPAGED_LOOKASIDE_LIST)LookasideList->L;
+        List->L.TotalAllocates++;
+        Entry = InterlockedPopEntrySList(&List->L.ListHead);
+        if (!Entry) List->L.AllocateMisses++;
+    }
+
+    /* Return what we got, the caller falls back to pool */
+    return Entry;
+}
+
+static
+__inline
+BOOLEAN
+IopFreeToPPLookaside(IN PPP_LOOKASIDE_LIST LookasideList,
+                     IN PVOID Entry)
+{
+    PNPAGED_LOOKASIDE_LIST List;
+
+    /* Use the P List */
+    List = (PNPAGED_LOOKASIDE_LIST)LookasideList->P;
+    List->L.TotalFrees++;
+
+    /* Check if the Free was within the Depth or not */
+    if (ExQueryDepthSList(&List->L.ListHead) >= List->L.Depth)
+    {
+        /* Let the balancer know, and use the L List */
+        List->L.FreeMisses++;
+        List = (PNPAGED_LOOKASIDE_LIST)LookasideList->L;
+        List->L.TotalFrees++;
+
+        /* Check if the Free was within the Depth or not */
+        if (ExQueryDepthSList(&List->L.ListHead) >= List->L.Depth)
+        {
+            /* All lists failed, the caller has to use the pool */
+            List->L.FreeMisses++;
+            return FALSE;
+        }
+    }
+
+    /* The free was within the Depth */
+    InterlockedPushEntrySList(&List->L.ListHead, (PSLIST_ENTRY)Entry);
+    return TRUE;
+}
@@ -718,6 +718,17 @@ BOOLEAN
 NTAPI
 KeRemoveQueueApc(PKAPC Apc);
 
+ULONG
+NTAPI
+KeRemoveQueueEx(
+    IN PKQUEUE Queue,
+    IN KPROCESSOR_MODE WaitMode,
+    IN BOOLEAN Alertable,
+    IN PLARGE_INTEGER Timeout OPTIONAL,
+    OUT PLIST_ENTRY *EntryArray,
+    IN ULONG Count
+);
+
 VOID
 FASTCALL
 KiActivateWaiterQueue(IN PKQUEUE Queue);
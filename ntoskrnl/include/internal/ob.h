@@ -185,6 +185,12 @@ ObShutdownSystem(
 //
 // Directory Namespace Functions
 //
+VOID
+NTAPI
+ObpDeleteDirectory(
+    IN PVOID ObjectBody
+);
+
 BOOLEAN
 NTAPI
 ObpDeleteEntryDirectory(
@@ -73,6 +73,10 @@
 #define IO_SMALLIRP             'sprI'
 #define IO_LARGEIRP_CPU         'LprI'
 #define IO_SMALLIRP_CPU         'SprI'
+#define IO_MEDIUMIRP            'mprI'
+#define IO_MEDIUMIRP_CPU        'MprI'
+#define IO_HUGEIRP              'hprI'
+#define IO_HUGEIRP_CPU          'HprI'
 #define IOC_TAG1                ' cpI'
 #define IOC_CPU                 'PcpI'
 #define TAG_APC                 'CPAK'
@@ -13,6 +13,9 @@
 #define NDEBUG
 #include <debug.h>
 
+/* Most entries NtRemoveIoCompletionEx removes in one call */
+#define IOP_MAX_REMOVE_COMPLETION_ENTRIES   64
+
 POBJECT_TYPE IoCompletionType;
 
 GENERAL_LOOKASIDE IoCompletionPacketLookaside;
@@ -95,6 +98,48 @@ IopFreeMiniPacket(PIOP_MINI_COMPLETION_PACKET Packet)
     InterlockedPushEntrySList(&List->L.ListHead, (PSLIST_ENTRY)Packet);
 }
 
+static
+VOID
+IopDequeueCompletionPacket(IN PLIST_ENTRY ListEntry,
+                           OUT PFILE_IO_COMPLETION_INFORMATION Information)
+{
+    PIOP_MINI_COMPLETION_PACKET Packet;
+    PIRP Irp;
+
+    /* Get the Packet Data */
+    Packet = CONTAINING_RECORD(ListEntry,
+                               IOP_MINI_COMPLETION_PACKET,
+                               ListEntry);
+
+    /* Check if this is piggybacked on an IRP */
+    if (Packet->PacketType == IopCompletionPacketIrp)
+    {
+        /* Get the IRP */
+        Irp = CONTAINING_RECORD(ListEntry,
+                                IRP,
+                                Tail.Overlay.ListEntry);
+
+        /* Save values */
+        Information->KeyContext = Irp->Tail.CompletionKey;
+        Information->ApcContext = Irp->Overlay.AsynchronousParameters.UserApcContext;
+        Information->IoStatusBlock = Irp->IoStatus;
+
+        /* Free the IRP */
+        IoFreeIrp(Irp);
+    }
+    else
+    {
+        /* Save values */
+        Information->KeyContext = Packet->KeyContext;
+        Information->ApcContext = Packet->ApcContext;
+        Information->IoStatusBlock.Status = Packet->IoStatus;
+        Information->IoStatusBlock.Information = Packet->IoStatusInformation;
+
+        /* Free the packet */
+        IopFreeMiniPacket(Packet);
+    }
+}
+
 VOID
 NTAPI
 IopDeleteIoCompletion(PVOID ObjectBody)
@@ -450,13 +495,10 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
 {
     LARGE_INTEGER SafeTimeout;
     PKQUEUE Queue;
-    PIOP_MINI_COMPLETION_PACKET Packet;
     PLIST_ENTRY ListEntry;
     KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
     NTSTATUS Status;
-    PIRP Irp;
-    PVOID Apc, Key;
-    IO_STATUS_BLOCK IoStatus;
+    FILE_IO_COMPLETION_INFORMATION CompletionInfo;
     PAGED_CODE();
 
     /* Check if the call was from user mode */
@@ -507,46 +549,16 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
         }
         else
         {
-            /* Get the Packet Data */
-            Packet = CONTAINING_RECORD(ListEntry,
-                                       IOP_MINI_COMPLETION_PACKET,
-                                       ListEntry);
-
-            /* Check if this is piggybacked on an IRP */
-            if (Packet->PacketType == IopCompletionPacketIrp)
-            {
-                /* Get the IRP */
-                Irp = CONTAINING_RECORD(ListEntry,
-                                        IRP,
-                                        Tail.Overlay.ListEntry);
-
-                /* Save values */
-                Key = Irp->Tail.CompletionKey;
-                Apc = Irp->Overlay.AsynchronousParameters.UserApcContext;
-                IoStatus = Irp->IoStatus;
-
-                /* Free the IRP */
-                IoFreeIrp(Irp);
-            }
-            else
-            {
-                /* Save values */
-                Key = Packet->KeyContext;
-                Apc = Packet->ApcContext;
-                IoStatus.Status = Packet->IoStatus;
-                IoStatus.Information = Packet->IoStatusInformation;
-
-                /* Free the packet */
-                IopFreeMiniPacket(Packet);
-            }
+            /* Get the packet data and free it */
+            IopDequeueCompletionPacket(ListEntry, &CompletionInfo);
 
             /* Enter SEH to write back the values */
             _SEH2_TRY
             {
                 /* Write the values to caller */
-                *ApcContext = Apc;
-                *KeyContext = Key;
-                *IoStatusBlock = IoStatus;
+                *ApcContext = CompletionInfo.ApcContext;
+                *KeyContext = CompletionInfo.KeyContext;
+                *IoStatusBlock = CompletionInfo.IoStatusBlock;
             }
             _SEH2_EXCEPT(ExSystemExceptionFilter())
             {
@@ -564,6 +576,122 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
     return Status;
 }
 
+NTSTATUS
+NTAPI
+NtRemoveIoCompletionEx(IN HANDLE IoCompletionHandle,
+                       OUT PFILE_IO_COMPLETION_INFORMATION IoCompletionInformation,
+                       IN ULONG Count,
+                       OUT PULONG NumEntriesRemoved,
+                       IN PLARGE_INTEGER Timeout OPTIONAL,
+                       IN BOOLEAN Alertable)
+{
+    LARGE_INTEGER SafeTimeout;
+    PKQUEUE Queue;
+    PLIST_ENTRY EntryArray[IOP_MAX_REMOVE_COMPLETION_ENTRIES];
+    KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
+    NTSTATUS Status;
+    FILE_IO_COMPLETION_INFORMATION CompletionInfo;
+    ULONG Removed, i;
+    PAGED_CODE();
+
+    /* We need room for at least one entry */
+    if (!Count) return STATUS_INVALID_PARAMETER;
+
+    /* Don't remove more than we can hold on the stack */
+    if (Count > IOP_MAX_REMOVE_COMPLETION_ENTRIES)
+    {
+        Count = IOP_MAX_REMOVE_COMPLETION_ENTRIES;
+    }
+
+    /* Check if the call was from user mode */
+    if (PreviousMode != KernelMode)
+    {
+        /* Protect probes in SEH */
+        _SEH2_TRY
+        {
+            /* Probe the output array and the count */
+            ProbeForWrite(IoCompletionInformation,
+                          Count * sizeof(FILE_IO_COMPLETION_INFORMATION),
+                          sizeof(PVOID));
+            ProbeForWriteUlong(NumEntriesRemoved);
+            if (Timeout)
+            {
+                /* Probe and capture the timeout */
+                SafeTimeout = ProbeForReadLargeInteger(Timeout);
+                Timeout = &SafeTimeout;
+            }
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Return the exception code */
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+    }
+
+    /* Open the Object */
+    Status = ObReferenceObjectByHandle(IoCompletionHandle,
+                                       IO_COMPLETION_MODIFY_STATE,
+                                       IoCompletionType,
+                                       PreviousMode,
+                                       (PVOID*)&Queue,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Remove as many entries as are ready, waiting for the first one */
+    Removed = KeRemoveQueueEx(Queue,
+                              PreviousMode,
+                              Alertable,
+                              Timeout,
+                              EntryArray,
+                              Count);
+
+    /* If we got a timeout, user_apc or alert back, return the status */
+    if (((NTSTATUS)(ULONG_PTR)EntryArray[0] == STATUS_TIMEOUT) ||
+        ((NTSTATUS)(ULONG_PTR)EntryArray[0] == STATUS_USER_APC) ||
+        ((NTSTATUS)(ULONG_PTR)EntryArray[0] == STATUS_ALERTED))
+    {
+        /* Set this as the status, nothing was removed */
+        Status = (NTSTATUS)(ULONG_PTR)EntryArray[0];
+        Removed = 0;
+    }
+
+    /* Get the packets, freeing them even if the caller's buffer went bad */
+    for (i = 0; i < Removed; i++)
+    {
+        IopDequeueCompletionPacket(EntryArray[i], &CompletionInfo);
+        if (Status != STATUS_SUCCESS) continue;
+
+        /* Enter SEH to write back the values */
+        _SEH2_TRY
+        {
+            IoCompletionInformation[i] = CompletionInfo;
+        }
+        _SEH2_EXCEPT(ExSystemExceptionFilter())
+        {
+            /* Get the exception code */
+            Status = _SEH2_GetExceptionCode();
+        }
+        _SEH2_END;
+    }
+
+    /* Tell the caller how many entries it got */
+    _SEH2_TRY
+    {
+        *NumEntriesRemoved = Removed;
+    }
+    _SEH2_EXCEPT(ExSystemExceptionFilter())
+    {
+        /* Get the exception code */
+        Status = _SEH2_GetExceptionCode();
+    }
+    _SEH2_END;
+
+    /* Dereference the Object */
+    ObDereferenceObject(Queue);
+    return Status;
+}
+
 NTSTATUS
 NTAPI
 NtSetIoCompletion(IN HANDLE IoCompletionPortHandle,
@@ -433,10 +433,13 @@ IopDeviceFsIoControl(IN HANDLE DeviceHandle,
                     CompletionInfo = *(FileObject->CompletionContext);
                 }
 
-                /* If we had an event, signal it */
+                /* If we had an event, signal it unless we were told not to */
                 if (Event)
                 {
-                    KeSetEvent(EventObject, IO_NO_INCREMENT, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                    {
+                        KeSetEvent(EventObject, IO_NO_INCREMENT, FALSE);
+                    }
                     ObDereferenceObject(EventObject);
                 }
 
@@ -447,7 +450,8 @@ IopDeviceFsIoControl(IN HANDLE DeviceHandle,
                 }
 
                 /* Set completion if required */
-                if (CompletionInfo.Port != NULL && UserApcContext != NULL)
+                if (CompletionInfo.Port != NULL && UserApcContext != NULL &&
+                    !IopSkipCompletionPort(FileObject, KernelIosb.Status))
                 {
                     if (!NT_SUCCESS(IoSetIoCompletion(CompletionInfo.Port,
                                                       CompletionInfo.Key,
@@ -1136,6 +1140,145 @@ IopGetDriverPathInformation(IN PFILE_OBJECT FileObject,
     return STATUS_SUCCESS;
 }
 
+static
+NTSTATUS
+IopSetCompletionNotificationModes(IN HANDLE FileHandle,
+                                  OUT PIO_STATUS_BLOCK IoStatusBlock,
+                                  IN PVOID FileInformation,
+                                  IN ULONG Length,
+                                  IN KPROCESSOR_MODE PreviousMode)
+{
+    PFILE_OBJECT FileObject;
+    NTSTATUS Status;
+    ULONG Modes, Flags = 0;
+
+    /* Validate the length */
+    if (Length < sizeof(FILE_IO_COMPLETION_NOTIFICATION_INFORMATION))
+    {
+        return STATUS_INFO_LENGTH_MISMATCH;
+    }
+
+    /* Enter SEH for probing and capturing the modes */
+    _SEH2_TRY
+    {
+        if (PreviousMode != KernelMode)
+        {
+            ProbeForWriteIoStatusBlock(IoStatusBlock);
+            ProbeForRead(FileInformation, Length, sizeof(ULONG));
+        }
+        Modes = ((PFILE_IO_COMPLETION_NOTIFICATION_INFORMATION)FileInformation)->Flags;
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Return the exception code */
+        _SEH2_YIELD(return _SEH2_GetExceptionCode());
+    }
+    _SEH2_END;
+
+    /* Validate the modes */
+    if (Modes & ~(FILE_SKIP_COMPLETION_PORT_ON_SUCCESS |
+                  FILE_SKIP_SET_EVENT_ON_HANDLE |
+                  FILE_SKIP_SET_USER_EVENT_ON_FAST_IO))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* This is handled by us, so no access is needed beyond the handle */
+    Status = ObReferenceObjectByHandle(FileHandle,
+                                       0,
+                                       IoFileObjectType,
+                                       PreviousMode,
+                                       (PVOID *)&FileObject,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Synchronous File Objects can't have a port, so they can't skip it */
+    if ((Modes & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS) &&
+        (FileObject->Flags & FO_SYNCHRONOUS_IO))
+    {
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Convert the modes to File Object flags */
+    if (Modes & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS) Flags |= FO_SKIP_COMPLETION_PORT;
+    if (Modes & FILE_SKIP_SET_EVENT_ON_HANDLE) Flags |= FO_SKIP_SET_EVENT;
+    if (Modes & FILE_SKIP_SET_USER_EVENT_ON_FAST_IO) Flags |= FO_SKIP_SET_FAST_IO;
+
+    /* The modes can only be turned on, and they stay on for the handle's lifetime */
+    InterlockedOr((PLONG)&FileObject->Flags, Flags);
+    ObDereferenceObject(FileObject);
+
+    /* Enter SEH to write back the status */
+    _SEH2_TRY
+    {
+        IoStatusBlock->Status = STATUS_SUCCESS;
+        IoStatusBlock->Information = 0;
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Ignore, the modes were set anyway */
+    }
+    _SEH2_END;
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+IopQueryCompletionNotificationModes(IN HANDLE FileHandle,
+                                    OUT PIO_STATUS_BLOCK IoStatusBlock,
+                                    OUT PVOID FileInformation,
+                                    IN ULONG Length,
+                                    IN KPROCESSOR_MODE PreviousMode)
+{
+    PFILE_OBJECT FileObject;
+    NTSTATUS Status;
+    ULONG Modes = 0;
+
+    /* Validate the length */
+    if (Length < sizeof(FILE_IO_COMPLETION_NOTIFICATION_INFORMATION))
+    {
+        return STATUS_INFO_LENGTH_MISMATCH;
+    }
+
+    /* Get the File Object */
+    Status = ObReferenceObjectByHandle(FileHandle,
+                                       0,
+                                       IoFileObjectType,
+                                       PreviousMode,
+                                       (PVOID *)&FileObject,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Convert its flags back to modes */
+    if (FileObject->Flags & FO_SKIP_COMPLETION_PORT) Modes |= FILE_SKIP_COMPLETION_PORT_ON_SUCCESS;
+    if (FileObject->Flags & FO_SKIP_SET_EVENT) Modes |= FILE_SKIP_SET_EVENT_ON_HANDLE;
+    if (FileObject->Flags & FO_SKIP_SET_FAST_IO) Modes |= FILE_SKIP_SET_USER_EVENT_ON_FAST_IO;
+    ObDereferenceObject(FileObject);
+
+    /* Enter SEH to probe and write back the data */
+    _SEH2_TRY
+    {
+        if (PreviousMode != KernelMode)
+        {
+            ProbeForWriteIoStatusBlock(IoStatusBlock);
+            ProbeForWrite(FileInformation, Length, sizeof(ULONG));
+        }
+        ((PFILE_IO_COMPLETION_NOTIFICATION_INFORMATION)FileInformation)->Flags = Modes;
+        IoStatusBlock->Status = STATUS_SUCCESS;
+        IoStatusBlock->Information = sizeof(FILE_IO_COMPLETION_NOTIFICATION_INFORMATION);
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Return the exception code */
+        _SEH2_YIELD(return _SEH2_GetExceptionCode());
+    }
+    _SEH2_END;
+
+    return STATUS_SUCCESS;
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -1886,15 +2029,19 @@ NtLockFile(IN HANDLE FileHandle,
             }
             _SEH2_END;
 
-            /* If we had an event, signal it */
+            /* If we had an event, signal it unless we were told not to */
             if (EventHandle)
             {
-                KeSetEvent(Event, IO_NO_INCREMENT, FALSE);
+                if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                {
+                    KeSetEvent(Event, IO_NO_INCREMENT, FALSE);
+                }
                 ObDereferenceObject(Event);
             }
 
             /* Set completion if required */
-            if (FileObject->CompletionContext != NULL && ApcContext != NULL)
+            if (FileObject->CompletionContext != NULL && ApcContext != NULL &&
+                !IopSkipCompletionPort(FileObject, KernelIosb.Status))
             {
                 if (!NT_SUCCESS(IoSetIoCompletion(FileObject->CompletionContext->Port,
                                                   FileObject->CompletionContext->Key,
@@ -2304,6 +2451,16 @@ NtQueryInformationFile(IN HANDLE FileHandle,
     PAGED_CODE();
     IOTRACE(IO_API_DEBUG, "FileHandle: %p\n", FileHandle);
 
+    /* Completion notification modes only live in the File Object */
+    if (FileInformationClass == FileIoCompletionNotificationInformation)
+    {
+        return IopQueryCompletionNotificationModes(FileHandle,
+                                                   IoStatusBlock,
+                                                   FileInformation,
+                                                   Length,
+                                                   PreviousMode);
+    }
+
     /* Check if we're called from user mode */
     if (PreviousMode != KernelMode)
     {
@@ -3119,6 +3276,16 @@ NtSetInformationFile(IN HANDLE FileHandle,
     PAGED_CODE();
     IOTRACE(IO_API_DEBUG, "FileHandle: %p\n", FileHandle);
 
+    /* Completion notification modes only touch the File Object */
+    if (FileInformationClass == FileIoCompletionNotificationInformation)
+    {
+        return IopSetCompletionNotificationModes(FileHandle,
+                                                 IoStatusBlock,
+                                                 FileInformation,
+                                                 Length,
+                                                 PreviousMode);
+    }
+
     /* Check if we're called from user mode */
     if (PreviousMode != KernelMode)
     {
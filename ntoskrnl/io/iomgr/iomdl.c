@@ -27,7 +27,8 @@ IoAllocateMdl(IN PVOID VirtualAddress,
 {
     PMDL Mdl = NULL, p;
     ULONG Flags = 0;
-    ULONG Size;
+    ULONG Size, Class;
+    PKPRCB Prcb;
 
     /* Make sure we got a valid length */
     ASSERT(Length != 0);
@@ -37,27 +38,32 @@ IoAllocateMdl(IN PVOID VirtualAddress,
 
     /* Calculate the number of pages for the allocation */
     Size = ADDRESS_AND_SIZE_TO_SPAN_PAGES(VirtualAddress, Length);
-    if (Size > 23)
+    if (Size > IOP_LARGE_MDL_PAGES)
     {
         /* This is bigger then our fixed-size MDLs. Calculate real size */
         Size *= sizeof(PFN_NUMBER);
         Size += sizeof(MDL);
         if (Size > MAXUSHORT) return NULL;
+        Class = IOP_MDL_SIZE_CLASSES;
     }
     else
     {
         /* Use an internal fixed MDL size */
-        Size = (23 * sizeof(PFN_NUMBER)) + sizeof(MDL);
+        Class = (Size > IOP_SMALL_MDL_PAGES) ? 1 : 0;
+        Size = ((Class ? IOP_LARGE_MDL_PAGES : IOP_SMALL_MDL_PAGES) *
+                sizeof(PFN_NUMBER)) + sizeof(MDL);
         Flags |= MDL_ALLOCATED_FIXED_SIZE;
 
-        /* Allocate one from the lookaside list */
-        Mdl = IopAllocateMdlFromLookaside(LookasideMdlList);
+        /* Allocate one from this processor's lookaside lists */
+        Prcb = KeGetCurrentPrcb();
+        Mdl = IopAllocateFromPPLookaside(&IopPPLookaside[Prcb->Number].Mdl[Class]);
     }
 
     /* Check if we don't have an mdl yet */
     if (!Mdl)
     {
         /* Allocate one from pool */
+        InterlockedIncrement(&IopMdlPoolAllocations[Class]);
         Mdl = ExAllocatePoolWithTag(NonPagedPool, Size, TAG_MDL);
         if (!Mdl) return NULL;
     }
@@ -145,6 +151,9 @@ VOID
 NTAPI
 IoFreeMdl(PMDL Mdl)
 {
+    ULONG Class;
+    PKPRCB Prcb;
+
     /* Tell Mm to reuse the MDL */
     MmPrepareMdlForReuse(Mdl);
 
@@ -156,8 +165,16 @@ IoFreeMdl(PMDL Mdl)
     }
     else
     {
-        /* Free it from the lookaside */
-        IopFreeMdlFromLookaside(Mdl, LookasideMdlList);
+        /* Anything that doesn't fit a small MDL came from the large class */
+        Class = (Mdl->Size > sizeof(MDL) + (IOP_SMALL_MDL_PAGES * sizeof(PFN_NUMBER))) ? 1 : 0;
+
+        /* Free it to this processor's lookaside lists */
+        Prcb = KeGetCurrentPrcb();
+        if (!IopFreeToPPLookaside(&IopPPLookaside[Prcb->Number].Mdl[Class], Mdl))
+        {
+            /* All lists failed, use the pool */
+            ExFreePoolWithTag(Mdl, TAG_MDL);
+        }
     }
 }
 
@@ -83,26 +83,72 @@ extern BOOLEAN PnPBootDriversInitialized;
 GENERAL_LOOKASIDE IoLargeIrpLookaside;
 GENERAL_LOOKASIDE IoSmallIrpLookaside;
 GENERAL_LOOKASIDE IopMdlLookasideList;
+GENERAL_LOOKASIDE IopMediumIrpLookaside;
+GENERAL_LOOKASIDE IopHugeIrpLookaside;
+GENERAL_LOOKASIDE IopLargeMdlLookasideList;
 extern GENERAL_LOOKASIDE IoCompletionPacketLookaside;
 
+/* Per-processor IRP and MDL lists, by size class */
+IOP_PP_LOOKASIDE IopPPLookaside[MAXIMUM_PROCESSORS];
+
+/* Allocations that had to go to pool, by size class, oversized ones last */
+LONG IopIrpPoolAllocations[IOP_IRP_STACK_CLASSES + 1];
+LONG IopMdlPoolAllocations[IOP_MDL_SIZE_CLASSES + 1];
+
 PLOADER_PARAMETER_BLOCK IopLoaderBlock;
 
 /* INIT FUNCTIONS ************************************************************/
 
+CODE_SEG("INIT")
+static
+VOID
+IopInitPPLookasideList(IN OUT PPP_LOOKASIDE_LIST LookasideList,
+                       IN PGENERAL_LOOKASIDE GlobalList,
+                       IN OUT PGENERAL_LOOKASIDE *CurrentList,
+                       IN ULONG Size,
+                       IN ULONG Tag,
+                       IN USHORT Depth)
+{
+    /* The L list is shared by all processors */
+    LookasideList->L = GlobalList;
+    if (*CurrentList)
+    {
+        /* Initialize this processor's own P list */
+        ExInitializeSystemLookasideList(*CurrentList,
+                                        NonPagedPool,
+                                        Size,
+                                        Tag,
+                                        Depth,
+                                        &ExSystemLookasideListHead);
+        LookasideList->P = *CurrentList;
+        (*CurrentList)++;
+    }
+    else
+    {
+        /* We couldn't allocate P lists, so share the L list */
+        LookasideList->P = GlobalList;
+    }
+}
+
 CODE_SEG("INIT")
 VOID
 NTAPI
 IopInitLookasideLists(VOID)
 {
-    ULONG LargeIrpSize, SmallIrpSize, MdlSize;
+    ULONG LargeIrpSize, SmallIrpSize, MediumIrpSize, HugeIrpSize;
+    ULONG MdlSize, LargeMdlSize;
     LONG i;
     PKPRCB Prcb;
+    PIOP_PP_LOOKASIDE PPLookaside;
     PGENERAL_LOOKASIDE CurrentList = NULL;
 
     /* Calculate the sizes */
-    LargeIrpSize = sizeof(IRP) + (8 * sizeof(IO_STACK_LOCATION));
-    SmallIrpSize = sizeof(IRP) + sizeof(IO_STACK_LOCATION);
-    MdlSize = sizeof(MDL) + (23 * sizeof(PFN_NUMBER));
+    SmallIrpSize = IoSizeOfIrp(IopGetIrpStackClassSize(0));
+    MediumIrpSize = IoSizeOfIrp(IopGetIrpStackClassSize(1));
+    LargeIrpSize = IoSizeOfIrp(IopGetIrpStackClassSize(2));
+    HugeIrpSize = IoSizeOfIrp(IopGetIrpStackClassSize(3));
+    MdlSize = sizeof(MDL) + (IOP_SMALL_MDL_PAGES * sizeof(PFN_NUMBER));
+    LargeMdlSize = sizeof(MDL) + (IOP_LARGE_MDL_PAGES * sizeof(PFN_NUMBER));
 
     /* Initialize the Lookaside List for I\O Completion */
     ExInitializeSystemLookasideList(&IoCompletionPacketLookaside,
@@ -129,17 +175,37 @@ IopInitLookasideLists(VOID)
                                     32,
                                     &ExSystemLookasideListHead);
 
-    /* Initialize the Lookaside List for MDLs */
+    /* Initialize the Lookaside Lists for Medium and Huge IRPs */
+    ExInitializeSystemLookasideList(&IopMediumIrpLookaside,
+                                    NonPagedPool,
+                                    MediumIrpSize,
+                                    IO_MEDIUMIRP,
+                                    64,
+                                    &ExSystemLookasideListHead);
+    ExInitializeSystemLookasideList(&IopHugeIrpLookaside,
+                                    NonPagedPool,
+                                    HugeIrpSize,
+                                    IO_HUGEIRP,
+                                    32,
+                                    &ExSystemLookasideListHead);
+
+    /* Initialize the Lookaside Lists for MDLs */
     ExInitializeSystemLookasideList(&IopMdlLookasideList,
                                     NonPagedPool,
                                     MdlSize,
                                     TAG_MDL,
                                     128,
                                     &ExSystemLookasideListHead);
+    ExInitializeSystemLookasideList(&IopLargeMdlLookasideList,
+                                    NonPagedPool,
+                                    LargeMdlSize,
+                                    TAG_MDL,
+                                    32,
+                                    &ExSystemLookasideListHead);
 
     /* Allocate the global lookaside list buffer */
     CurrentList = ExAllocatePoolWithTag(NonPagedPool,
-                                        4 * KeNumberProcessors *
+                                        7 * KeNumberProcessors *
                                         sizeof(GENERAL_LOOKASIDE),
                                         TAG_IO);
 
@@ -148,91 +214,64 @@ IopInitLookasideLists(VOID)
     {
         /* Get the PRCB for this CPU */
         Prcb = KiProcessorBlock[i];
+        PPLookaside = &IopPPLookaside[Prcb->Number];
         DPRINT("Setting up lookaside for CPU: %x, PRCB: %p\n", i, Prcb);
 
         /* Write IRP credit limit */
         Prcb->LookasideIrpFloat = 512 / KeNumberProcessors;
 
         /* Set the I/O Completion List */
-        Prcb->PPLookasideList[LookasideCompletionList].L = &IoCompletionPacketLookaside;
-        if (CurrentList)
-        {
-            /* Initialize the Lookaside List for mini-packets */
-            ExInitializeSystemLookasideList(CurrentList,
-                                            NonPagedPool,
-                                            sizeof(IOP_MINI_COMPLETION_PACKET),
-                                            IO_SMALLIRP_CPU,
-                                            32,
-                                            &ExSystemLookasideListHead);
-            Prcb->PPLookasideList[LookasideCompletionList].P = CurrentList;
-            CurrentList++;
-
-        }
-        else
-        {
-            Prcb->PPLookasideList[LookasideCompletionList].P = &IoCompletionPacketLookaside;
-        }
-
-        /* Set the Large IRP List */
-        Prcb->PPLookasideList[LookasideLargeIrpList].L = &IoLargeIrpLookaside;
-        if (CurrentList)
-        {
-            /* Initialize the Lookaside List for Large IRPs */
-            ExInitializeSystemLookasideList(CurrentList,
-                                            NonPagedPool,
-                                            LargeIrpSize,
-                                            IO_LARGEIRP_CPU,
-                                            64,
-                                            &ExSystemLookasideListHead);
-            Prcb->PPLookasideList[LookasideLargeIrpList].P = CurrentList;
-            CurrentList++;
-
-        }
-        else
-        {
-            Prcb->PPLookasideList[LookasideLargeIrpList].P = &IoLargeIrpLookaside;
-        }
-
-        /* Set the Small IRP List */
-        Prcb->PPLookasideList[LookasideSmallIrpList].L = &IoSmallIrpLookaside;
-        if (CurrentList)
-        {
-            /* Initialize the Lookaside List for Small IRPs */
-            ExInitializeSystemLookasideList(CurrentList,
-                                            NonPagedPool,
-                                            SmallIrpSize,
-                                            IO_SMALLIRP_CPU,
-                                            32,
-                                            &ExSystemLookasideListHead);
-            Prcb->PPLookasideList[LookasideSmallIrpList].P = CurrentList;
-            CurrentList++;
-
-        }
-        else
-        {
-            Prcb->PPLookasideList[LookasideSmallIrpList].P = &IoSmallIrpLookaside;
-        }
-
-        /* Set the MDL Completion List */
-        Prcb->PPLookasideList[LookasideMdlList].L = &IopMdlLookasideList;
-        if (CurrentList)
-        {
-            /* Initialize the Lookaside List for MDLs */
-            ExInitializeSystemLookasideList(CurrentList,
-                                            NonPagedPool,
-                                            SmallIrpSize,
-                                            TAG_MDL,
-                                            128,
-                                            &ExSystemLookasideListHead);
-
-            Prcb->PPLookasideList[LookasideMdlList].P = CurrentList;
-            CurrentList++;
-
-        }
-        else
-        {
-            Prcb->PPLookasideList[LookasideMdlList].P = &IopMdlLookasideList;
-        }
+        IopInitPPLookasideList(&Prcb->PPLookasideList[LookasideCompletionList],
+                               &IoCompletionPacketLookaside,
+                               &CurrentList,
+                               sizeof(IOP_MINI_COMPLETION_PACKET),
+                               IO_SMALLIRP_CPU,
+                               32);
+
+        /* Set the Large and Small IRP Lists, which the PRCB also tracks */
+        IopInitPPLookasideList(&Prcb->PPLookasideList[LookasideLargeIrpList],
+                               &IoLargeIrpLookaside,
+                               &CurrentList,
+                               LargeIrpSize,
+                               IO_LARGEIRP_CPU,
+                               64);
+        IopInitPPLookasideList(&Prcb->PPLookasideList[LookasideSmallIrpList],
+                               &IoSmallIrpLookaside,
+                               &CurrentList,
+                               SmallIrpSize,
+                               IO_SMALLIRP_CPU,
+                               32);
+        PPLookaside->Irp[0] = Prcb->PPLookasideList[LookasideSmallIrpList];
+        PPLookaside->Irp[2] = Prcb->PPLookasideList[LookasideLargeIrpList];
+
+        /* Set the Medium and Huge IRP Lists */
+        IopInitPPLookasideList(&PPLookaside->Irp[1],
+                               &IopMediumIrpLookaside,
+                               &CurrentList,
+                               MediumIrpSize,
+                               IO_MEDIUMIRP_CPU,
+                               64);
+        IopInitPPLookasideList(&PPLookaside->Irp[3],
+                               &IopHugeIrpLookaside,
+                               &CurrentList,
+                               HugeIrpSize,
+                               IO_HUGEIRP_CPU,
+                               32);
+
+        /* Set the MDL Lists */
+        IopInitPPLookasideList(&Prcb->PPLookasideList[LookasideMdlList],
+                               &IopMdlLookasideList,
+                               &CurrentList,
+                               MdlSize,
+                               TAG_MDL,
+                               128);
+        PPLookaside->Mdl[0] = Prcb->PPLookasideList[LookasideMdlList];
+        IopInitPPLookasideList(&PPLookaside->Mdl[1],
+                               &IopLargeMdlLookasideList,
+                               &CurrentList,
+                               LargeMdlSize,
+                               TAG_MDL,
+                               32);
     }
 }
 
@@ -653,4 +692,105 @@ IoInitializeCrashDump(IN HANDLE PageFileHandle)
     return FALSE;
 }
 
+#if DBG && defined(KDBG)
+
+#include <kdbg/kdb.h>
+
+static
+VOID
+IopKdbgPrintCacheClass(IN PCSTR Name,
+                       IN ULONG Size,
+                       IN PPP_LOOKASIDE_LIST (*GetList)(ULONG Cpu, ULONG Class),
+                       IN ULONG Class,
+                       IN LONG PoolAllocations)
+{
+    PPP_LOOKASIDE_LIST LookasideList;
+    PGENERAL_LOOKASIDE List;
+    ULONG i, Allocates = 0, PHits = 0, LHits = 0, Frees = 0;
+
+    /* Sum up the P lists of every processor, and the shared L list once */
+    for (i = 0; i < (ULONG)KeNumberProcessors; i++)
+    {
+        LookasideList = GetList(i, Class);
+        if (i == 0)
+        {
+            List = LookasideList->L;
+            LHits = List->TotalAllocates - List->AllocateMisses;
+        }
+
+        /* Without P lists, everyone used the L list directly */
+        List = LookasideList->P;
+        if (List == LookasideList->L)
+        {
+            if (i == 0)
+            {
+                Allocates = List->TotalAllocates;
+                Frees = List->TotalFrees;
+            }
+            continue;
+        }
+
+        Allocates += List->TotalAllocates;
+        Frees += List->TotalFrees;
+        PHits += List->TotalAllocates - List->AllocateMisses;
+    }
+
+    KdbpPrint("%-8s%-8lu%-12lu%-12lu%-12lu%-12ld%-12lu\n",
+              Name, Size, Allocates, PHits, LHits, PoolAllocations, Frees);
+}
+
+static
+PPP_LOOKASIDE_LIST
+IopKdbgGetIrpList(IN ULONG Cpu,
+                  IN ULONG Class)
+{
+    return &IopPPLookaside[KiProcessorBlock[Cpu]->Number].Irp[Class];
+}
+
+static
+PPP_LOOKASIDE_LIST
+IopKdbgGetMdlList(IN ULONG Cpu,
+                  IN ULONG Class)
+{
+    return &IopPPLookaside[KiProcessorBlock[Cpu]->Number].Mdl[Class];
+}
+
+BOOLEAN
+IopKdbgExtIoCache(
+    ULONG Argc,
+    PCHAR Argv[])
+{
+    ULONG Class;
+
+    KdbpPrint("%-8s%-8s%-12s%-12s%-12s%-12s%-12s\n",
+              "Type", "Size", "Allocates", "P hits", "L hits", "Pool", "Frees");
+    for (Class = 0; Class < IOP_IRP_STACK_CLASSES; Class++)
+    {
+        IopKdbgPrintCacheClass("IRP",
+                               IopGetIrpStackClassSize(Class),
+                               IopKdbgGetIrpList,
+                               Class,
+                               IopIrpPoolAllocations[Class]);
+    }
+    KdbpPrint("IRPs with more than %lu stack locations: %ld\n",
+              (ULONG)IopGetIrpStackClassSize(IOP_IRP_STACK_CLASSES - 1),
+              IopIrpPoolAllocations[IOP_IRP_STACK_CLASSES]);
+
+    for (Class = 0; Class < IOP_MDL_SIZE_CLASSES; Class++)
+    {
+        IopKdbgPrintCacheClass("MDL",
+                               Class ? IOP_LARGE_MDL_PAGES : IOP_SMALL_MDL_PAGES,
+                               IopKdbgGetMdlList,
+                               Class,
+                               IopMdlPoolAllocations[Class]);
+    }
+    KdbpPrint("MDLs with more than %lu pages: %ld\n",
+              (ULONG)IOP_LARGE_MDL_PAGES,
+              IopMdlPoolAllocations[IOP_MDL_SIZE_CLASSES]);
+
+    return TRUE;
+}
+
+#endif // DBG && KDBG
+
 /* EOF */
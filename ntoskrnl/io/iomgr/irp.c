@@ -399,8 +399,16 @@ IopCompleteRequest(IN PKAPC Apc,
         }
         else if (FileObject)
         {
-            /* Signal the file object and set the status */
-            KeSetEvent(&FileObject->Event, 0, FALSE);
+            /*
+             * Signal the file object and set the status, unless the caller
+             * asked us not to. This holds for requests that pended as well,
+             * only synchronous I/O always needs the event.
+             */
+            if (!(FileObject->Flags & FO_SKIP_SET_EVENT) ||
+                (FileObject->Flags & FO_SYNCHRONOUS_IO))
+            {
+                KeSetEvent(&FileObject->Event, 0, FALSE);
+            }
             FileObject->FinalStatus = Irp->IoStatus.Status;
 
             /*
@@ -460,7 +468,9 @@ IopCompleteRequest(IN PKAPC Apc,
             KeInsertQueueApc(&Irp->Tail.Apc, Irp->UserIosb, NULL, 2);
         }
         else if ((Port) &&
-                 (Irp->Overlay.AsynchronousParameters.UserApcContext))
+                 (Irp->Overlay.AsynchronousParameters.UserApcContext) &&
+                 ((Irp->PendingReturned) ||
+                  !(IopSkipCompletionPort(FileObject, Irp->IoStatus.Status))))
         {
             /* We have an I/O Completion setup... create the special Overlay */
             Irp->Tail.CompletionKey = Key;
@@ -619,8 +629,7 @@ IoAllocateIrp(IN CCHAR StackSize,
     USHORT Size = IoSizeOfIrp(StackSize);
     PKPRCB Prcb;
     UCHAR Flags = 0;
-    PNPAGED_LOOKASIDE_LIST List = NULL;
-    PP_NPAGED_LOOKASIDE_NUMBER ListType = LookasideSmallIrpList;
+    ULONG Class;
 
     /* Set Charge Quota Flag */
     if (ChargeQuota) Flags |= IRP_QUOTA_CHARGED;
@@ -629,43 +638,23 @@ IoAllocateIrp(IN CCHAR StackSize,
     Prcb = KeGetCurrentPrcb();
 
     /* Figure out which Lookaside List to use */
-    if ((StackSize <= 8) && (ChargeQuota == FALSE || Prcb->LookasideIrpFloat > 0))
+    Class = IopGetIrpStackClass(StackSize);
+    if ((Class < IOP_IRP_STACK_CLASSES) &&
+        (ChargeQuota == FALSE || Prcb->LookasideIrpFloat > 0))
     {
-        /* Set Fixed Size Flag */
+        /* Set Fixed Size Flag, and use the size of the whole class */
         Flags |= IRP_ALLOCATED_FIXED_SIZE;
+        Size = IoSizeOfIrp(IopGetIrpStackClassSize(Class));
 
-        /* See if we should use big list */
-        if (StackSize != 1)
-        {
-            Size = IoSizeOfIrp(8);
-            ListType = LookasideLargeIrpList;
-        }
-
-        /* Get the P List First */
-        List = (PNPAGED_LOOKASIDE_LIST)Prcb->PPLookasideList[ListType].P;
-
-        /* Attempt allocation */
-        List->L.TotalAllocates++;
-        Irp = (PIRP)InterlockedPopEntrySList(&List->L.ListHead);
-
-        /* Check if the P List failed */
-        if (!Irp)
-        {
-            /* Let the balancer know */
-            List->L.AllocateMisses++;
-
-            /* Try the L List */
-            List = (PNPAGED_LOOKASIDE_LIST)Prcb->PPLookasideList[ListType].L;
-            List->L.TotalAllocates++;
-            Irp = (PIRP)InterlockedPopEntrySList(&List->L.ListHead);
-        }
+        /* Attempt allocation from this processor's lists */
+        Irp = IopAllocateFromPPLookaside(&IopPPLookaside[Prcb->Number].Irp[Class]);
     }
 
     /* Check if we have to use the pool */
     if (!Irp)
     {
-        /* Did we try lookaside and fail? */
-        if (Flags & IRP_ALLOCATED_FIXED_SIZE) List->L.AllocateMisses++;
+        /* Keep track of what the lists couldn't give us */
+        InterlockedIncrement(&IopIrpPoolAllocations[Class]);
 
         /* Check if we should charge quota */
         if (ChargeQuota)
@@ -1665,9 +1654,8 @@ VOID
 NTAPI
 IoFreeIrp(IN PIRP Irp)
 {
-    PNPAGED_LOOKASIDE_LIST List;
-    PP_NPAGED_LOOKASIDE_NUMBER ListType = LookasideSmallIrpList;
     PKPRCB Prcb;
+    ULONG Class;
     IOTRACE(IO_IRP_DEBUG,
             "%s - Freeing IRPs %p\n",
             __FUNCTION__,
@@ -1696,46 +1684,20 @@ IoFreeIrp(IN PIRP Irp)
     }
     else
     {
-        /* Check if this was a Big IRP */
-        if (Irp->StackCount != 1) ListType = LookasideLargeIrpList;
-
-        /* Use the P List */
-        List = (PNPAGED_LOOKASIDE_LIST)Prcb->PPLookasideList[ListType].P;
-        List->L.TotalFrees++;
-
-        /* Check if the Free was within the Depth or not */
-        if (ExQueryDepthSList(&List->L.ListHead) >= List->L.Depth)
+        /* Remove the association with the process */
+        if (Irp->AllocationFlags & IRP_QUOTA_CHARGED)
         {
-            /* Let the balancer know */
-            List->L.FreeMisses++;
-
-            /* Use the L List */
-            List = (PNPAGED_LOOKASIDE_LIST)Prcb->PPLookasideList[ListType].L;
-            List->L.TotalFrees++;
-
-            /* Check if the Free was within the Depth or not */
-            if (ExQueryDepthSList(&List->L.ListHead) >= List->L.Depth)
-            {
-                /* All lists failed, use the pool */
-                List->L.FreeMisses++;
-                ExFreePoolWithTag(Irp, TAG_IRP);
-                Irp = NULL;
-            }
+            ExReturnPoolQuota(Irp);
+            Irp->AllocationFlags &= ~IRP_QUOTA_CHARGED;
         }
 
-        /* The free was within the Depth */
-        if (Irp)
+        /* Give it back to the list of its class on this processor */
+        Class = IopGetIrpStackClass(Irp->StackCount);
+        ASSERT(Class < IOP_IRP_STACK_CLASSES);
+        if (!IopFreeToPPLookaside(&IopPPLookaside[Prcb->Number].Irp[Class], Irp))
         {
-            /* Remove the association with the process */
-            if (Irp->AllocationFlags & IRP_QUOTA_CHARGED)
-            {
-                ExReturnPoolQuota(Irp);
-                Irp->AllocationFlags &= ~IRP_QUOTA_CHARGED;
-            }
-
-            /* Add it to the lookaside list */
-            InterlockedPushEntrySList(&List->L.ListHead,
-                                      (PSLIST_ENTRY)Irp);
+            /* All lists failed, use the pool */
+            ExFreePoolWithTag(Irp, TAG_IRP);
         }
     }
 }
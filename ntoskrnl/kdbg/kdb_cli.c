@@ -89,6 +89,10 @@ BOOLEAN ExpKdbgExtFileCache(ULONG Argc, PCHAR Argv[]);
 BOOLEAN ExpKdbgExtDefWrites(ULONG Argc, PCHAR Argv[]);
 BOOLEAN ExpKdbgExtIrpFind(ULONG Argc, PCHAR Argv[]);
 BOOLEAN ExpKdbgExtHandle(ULONG Argc, PCHAR Argv[]);
+BOOLEAN KiKdbgExtReady(ULONG Argc, PCHAR Argv[]);
+BOOLEAN ExpKdbgExtWorkQueue(ULONG Argc, PCHAR Argv[]);
+BOOLEAN ExpKdbgExtPushLock(ULONG Argc, PCHAR Argv[]);
+BOOLEAN IopKdbgExtIoCache(ULONG Argc, PCHAR Argv[]);
 
 extern char __ImageBase;
 
@@ -404,6 +408,10 @@ static const struct
     { "!defwrites", "!defwrites", "Display cache write values.", ExpKdbgExtDefWrites },
     { "!irpfind", "!irpfind [Pool [startaddress [criteria data]]]", "Lists IRPs potentially matching criteria.", ExpKdbgExtIrpFind },
     { "!handle", "!handle [Handle]", "Displays info about handles.", ExpKdbgExtHandle },
+    { "!exqueue", "!exqueue", "Display executive work queue threads and counters.", ExpKdbgExtWorkQueue },
+    { "!ready", "!ready [v]", "Display ready queues and scheduler counters of each processor.", KiKdbgExtReady },
+    { "!pushlock", "!pushlock [on|off|reset]", "Display or control the pushlock contention profile.", ExpKdbgExtPushLock },
+    { "!iocache", "!iocache", "Display IRP and MDL lookaside usage by size class.", IopKdbgExtIoCache },
 };
 
 /* FUNCTIONS *****************************************************************/
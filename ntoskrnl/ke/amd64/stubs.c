@@ -158,6 +158,11 @@ KiIdleLoop(VOID)
         }
         else
         {
+#ifdef CONFIG_SMP
+            /* Try to pull a ready thread from a busy processor first */
+            if ((Prcb->IdleSchedule) && (KiIdleSchedule(Prcb) != NULL)) continue;
+#endif
+
             /* Continue staying idle. Note the HAL returns with interrupts on */
             Prcb->PowerState.IdleFunction(&Prcb->PowerState);
         }
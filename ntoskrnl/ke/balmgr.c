@@ -178,6 +178,9 @@ KeBalanceSetManager(IN PVOID Context)
                 /* Adjust lookaside lists */
                 //ExAdjustLookasideDepth();
 
+                /* Give back the blocks of idle pool magazines */
+                ExTrimPoolMagazines();
+
                 /* Call the working set manager */
                 //MmWorkingSetManager();
 
@@ -138,6 +138,44 @@ KiInsertQueue(IN PKQUEUE Queue,
     return InitialState;
 }
 
+/*
+ * Takes up to Count entries that are already queued, without waiting.
+ * The dispatcher lock must be held.
+ */
+static
+ULONG
+KiRemoveQueueBatch(IN PKQUEUE Queue,
+                   OUT PLIST_ENTRY *EntryArray,
+                   IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
+    ULONG Removed = 0;
+
+    while ((Removed < Count) && !IsListEmpty(&Queue->EntryListHead))
+    {
+        /* Check if the entry is valid. If not, bugcheck */
+        QueueEntry = Queue->EntryListHead.Flink;
+        if (!(QueueEntry->Flink) || !(QueueEntry->Blink))
+        {
+            /* Invalid item */
+            KeBugCheckEx(INVALID_WORK_QUEUE_ITEM,
+                         (ULONG_PTR)QueueEntry,
+                         (ULONG_PTR)Queue,
+                         (ULONG_PTR)NULL,
+                         (ULONG_PTR)((PWORK_QUEUE_ITEM)QueueEntry)->
+                                     WorkerRoutine);
+        }
+
+        /* Remove it and decrease the number of entries */
+        RemoveEntryList(QueueEntry);
+        QueueEntry->Flink = NULL;
+        Queue->Header.SignalState--;
+        EntryArray[Removed++] = QueueEntry;
+    }
+
+    return Removed;
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -231,15 +269,22 @@ KeReadStateQueue(IN PKQUEUE Queue)
 }
 
 /*
- * @implemented
+ * Removes up to Count entries from the queue, waiting for the first one.
+ * The extra entries are only taken if they are already queued, and they
+ * don't count as additional running threads. If the wait fails, the status
+ * is returned in the first element and the function returns 1.
  */
-PLIST_ENTRY
+ULONG
 NTAPI
-KeRemoveQueue(IN PKQUEUE Queue,
-              IN KPROCESSOR_MODE WaitMode,
-              IN PLARGE_INTEGER Timeout OPTIONAL)
+KeRemoveQueueEx(IN PKQUEUE Queue,
+                IN KPROCESSOR_MODE WaitMode,
+                IN BOOLEAN Alertable,
+                IN PLARGE_INTEGER Timeout OPTIONAL,
+                OUT PLIST_ENTRY *EntryArray,
+                IN ULONG Count)
 {
     PLIST_ENTRY QueueEntry;
+    ULONG Removed = 1;
     LONG_PTR Status;
     PKTHREAD Thread = KeGetCurrentThread();
     PKQUEUE PreviousQueue;
@@ -250,8 +295,10 @@ KeRemoveQueue(IN PKQUEUE Queue,
     PLARGE_INTEGER OriginalDueTime = Timeout;
     LARGE_INTEGER DueTime = {{0}}, NewDueTime, InterruptTime;
     ULONG Hand = 0;
+    KIRQL OldIrql;
     ASSERT_QUEUE(Queue);
     ASSERT_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);
+    ASSERT(Count != 0);
 
     /* Check if the Lock is already held */
     if (Thread->WaitNext)
@@ -328,6 +375,10 @@ KeRemoveQueue(IN PKQUEUE Queue,
             RemoveEntryList(QueueEntry);
             QueueEntry->Flink = NULL;
 
+            /* Grab whatever else is ready while we hold the lock */
+            EntryArray[0] = QueueEntry;
+            Removed += KiRemoveQueueBatch(Queue, &EntryArray[1], Count - 1);
+
             /* Nothing to wait on */
             break;
         }
@@ -344,12 +395,12 @@ KeRemoveQueue(IN PKQUEUE Queue,
             }
             else
             {
-                /* Fail if there's a User APC Pending */
-                if ((WaitMode != KernelMode) &&
-                    (Thread->ApcState.UserApcPending))
+                /* Fail if we were alerted or there's a User APC Pending */
+                Status = KiCheckAlertability(Thread, Alertable, WaitMode);
+                if (Status != STATUS_WAIT_0)
                 {
                     /* Return the status and increase the pending threads */
-                    QueueEntry = (PLIST_ENTRY)STATUS_USER_APC;
+                    EntryArray[0] = (PLIST_ENTRY)Status;
                     Queue->CurrentCount++;
                     break;
                 }
@@ -362,7 +413,7 @@ KeRemoveQueue(IN PKQUEUE Queue,
                     if ((ULONG64)InterruptTime.QuadPart >= Timer->DueTime.QuadPart)
                     {
                         /* It did, so we don't need to wait */
-                        QueueEntry = (PLIST_ENTRY)STATUS_TIMEOUT;
+                        EntryArray[0] = (PLIST_ENTRY)STATUS_TIMEOUT;
                         Queue->CurrentCount++;
                         break;
                     }
@@ -404,7 +455,24 @@ KeRemoveQueue(IN PKQUEUE Queue,
                 Thread->WaitReason = 0;
 
                 /* Check if we were executing an APC */
-                if (Status != STATUS_KERNEL_APC) return (PLIST_ENTRY)Status;
+                if (Status != STATUS_KERNEL_APC)
+                {
+                    /* We weren't, so this is either a failure or our entry */
+                    EntryArray[0] = (PLIST_ENTRY)Status;
+                    if ((Count == 1) ||
+                        (Status == STATUS_TIMEOUT) ||
+                        (Status == STATUS_USER_APC) ||
+                        (Status == STATUS_ALERTED))
+                    {
+                        return 1;
+                    }
+
+                    /* Pick up anything else that got queued behind it */
+                    OldIrql = KiAcquireDispatcherLock();
+                    Removed += KiRemoveQueueBatch(Queue, &EntryArray[1], Count - 1);
+                    KiReleaseDispatcherLock(OldIrql);
+                    return Removed;
+                }
 
                 /* Check if we had a timeout */
                 if (Timeout)
@@ -427,6 +495,22 @@ KeRemoveQueue(IN PKQUEUE Queue,
     /* Unlock Database and return */
     KiReleaseDispatcherLockFromSynchLevel();
     KiExitDispatcher(Thread->WaitIrql);
+    return Removed;
+}
+
+/*
+ * @implemented
+ */
+PLIST_ENTRY
+NTAPI
+KeRemoveQueue(IN PKQUEUE Queue,
+              IN KPROCESSOR_MODE WaitMode,
+              IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+    PLIST_ENTRY QueueEntry;
+
+    /* Remove a single entry, non-alertable */
+    KeRemoveQueueEx(Queue, WaitMode, FALSE, Timeout, &QueueEntry, 1);
     return QueueEntry;
 }
 
@@ -15,25 +15,155 @@
 #ifdef _WIN64
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr64((PLONG64)Destination, SetMember);
+# define InterlockedAndSetMember(Destination, SetMember) \
+    InterlockedAnd64((PLONG64)Destination, SetMember);
 #else
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr((PLONG)Destination, SetMember);
+# define InterlockedAndSetMember(Destination, SetMember) \
+    InterlockedAnd((PLONG)Destination, SetMember);
 #endif
 
+typedef struct _KI_SCHEDULER_STATISTICS
+{
+    ULONG IdleScans;
+    ULONG IdleSteals;
+    ULONG StolenThreads;
+    ULONG Migrations;
+} KI_SCHEDULER_STATISTICS, *PKI_SCHEDULER_STATISTICS;
+
 /* GLOBALS *******************************************************************/
 
 KAFFINITY KiIdleSummary;
 KAFFINITY KiIdleSMTSummary;
+KI_SCHEDULER_STATISTICS KiSchedulerStatistics[MAXIMUM_PROCESSORS];
 
 /* FUNCTIONS *****************************************************************/
 
+#ifdef CONFIG_SMP
+static
+PKTHREAD
+KiStealReadyThread(
+    _In_ PKPRCB TargetPrcb,
+    _In_ PKPRCB Prcb)
+{
+    ULONG PrioritySet;
+    LONG Priority;
+    PLIST_ENTRY ListHead, NextEntry;
+    PKTHREAD Thread;
+
+    /* Scan the ready lists of the target processor from the highest priority */
+    PrioritySet = TargetPrcb->ReadySummary;
+    while (PrioritySet)
+    {
+        BitScanReverse((PULONG)&Priority, PrioritySet);
+        PrioritySet ^= PRIORITY_MASK(Priority);
+
+        /* Look for a thread that is allowed to run on this processor */
+        ListHead = &TargetPrcb->DispatcherReadyListHead[Priority];
+        for (NextEntry = ListHead->Flink;
+             NextEntry != ListHead;
+             NextEntry = NextEntry->Flink)
+        {
+            Thread = CONTAINING_RECORD(NextEntry, KTHREAD, WaitListEntry);
+            ASSERT(Thread->State == Ready);
+            ASSERT(Thread->NextProcessor == TargetPrcb->Number);
+            if (!(Thread->Affinity & Prcb->SetMember)) continue;
+
+            /* A thread readied by the code it was running may still be
+               switching out on the target, and its stack still in use there.
+               Only take threads that are fully switched out. */
+            if (Thread->SwapBusy) continue;
+
+            /* Found one, remove it from the target's ready list */
+            if (RemoveEntryList(&Thread->WaitListEntry))
+            {
+                /* The list is empty now, reset the ready summary */
+                TargetPrcb->ReadySummary ^= PRIORITY_MASK(Priority);
+            }
+
+            return Thread;
+        }
+    }
+
+    /* Nothing on the target processor can run here */
+    return NULL;
+}
+#endif
+
 PKTHREAD
 FASTCALL
 KiIdleSchedule(IN PKPRCB Prcb)
 {
+#ifdef CONFIG_SMP
+    PKPRCB TargetPrcb;
+    PKTHREAD Thread = NULL;
+    ULONG Number;
+
+    /* We are idle, so go looking for processors that have threads waiting */
+    ASSERT(Prcb->CurrentThread == Prcb->IdleThread);
+    KiSchedulerStatistics[Prcb->Number].IdleScans++;
+    for (Number = 0; Number < (ULONG)KeNumberProcessors; Number++)
+    {
+        /* Skip ourselves and processors without ready threads */
+        TargetPrcb = KiProcessorBlock[Number];
+        if ((TargetPrcb == Prcb) || !(TargetPrcb->ReadySummary)) continue;
+
+        /* Lock both PRCBs, always in the same order to avoid deadlocks */
+        if (Prcb->Number < TargetPrcb->Number)
+        {
+            KiAcquirePrcbLock(Prcb);
+            KiAcquirePrcbLock(TargetPrcb);
+        }
+        else
+        {
+            KiAcquirePrcbLock(TargetPrcb);
+            KiAcquirePrcbLock(Prcb);
+        }
+
+        /* Someone may have given us a thread in the meantime */
+        if (!Prcb->NextThread)
+        {
+            Thread = KiStealReadyThread(TargetPrcb, Prcb);
+            if (Thread)
+            {
+                /* Move it over to us and make it the next thread to run */
+                Thread->NextProcessor = Prcb->Number;
+                Thread->State = Standby;
+                Prcb->NextThread = Thread;
+
+                /* We are no longer idle */
+                InterlockedAndSetMember(&KiIdleSummary, ~Prcb->SetMember);
+                Prcb->IdleSchedule = FALSE;
+
+                /* Update the counters */
+                KiSchedulerStatistics[Prcb->Number].IdleSteals++;
+                KiSchedulerStatistics[TargetPrcb->Number].StolenThreads++;
+            }
+        }
+
+        /* Release the locks */
+        KiReleasePrcbLock(TargetPrcb);
+        KiReleasePrcbLock(Prcb);
+
+        /* Stop if we have something to run */
+        if (Thread) break;
+        if (Prcb->NextThread) return Prcb->NextThread;
+    }
+
+    /*
+     * Nothing to steal, so stop scanning on every pass of the idle loop. Threads
+     * readied from now on are handed to idle processors directly, and we scan
+     * again the next time we go idle.
+     */
+    if (!Thread) Prcb->IdleSchedule = FALSE;
+
+    return Thread;
+#else
     /* FIXME: TODO */
     ASSERTMSG("SMP: Not yet implemented\n", FALSE);
     return NULL;
+#endif
 }
 
 VOID
@@ -301,6 +431,11 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
 
     /* Select a processor to run on */
     Processor = KiSelectNextProcessor(Thread);
+    if (Processor != Thread->NextProcessor)
+    {
+        /* The thread is moving to another processor */
+        KiSchedulerStatistics[Processor].Migrations++;
+    }
     Thread->NextProcessor = Processor;
 
     /* Get the PRCB and lock it */
@@ -360,6 +495,15 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
             Thread->State = Standby;
             Prcb->NextThread = Thread;
 
+#ifdef CONFIG_SMP
+            /* If the processor was idle, it isn't anymore */
+            if (NextThread == Prcb->IdleThread)
+            {
+                InterlockedAndSetMember(&KiIdleSummary, ~Prcb->SetMember);
+                Prcb->IdleSchedule = FALSE;
+            }
+#endif
+
             /* Release the lock */
             KiReleasePrcbLock(Prcb);
 
@@ -458,8 +602,9 @@ KiSwapThread(IN PKTHREAD CurrentThread,
         }
         else
         {
-            /* Set the idle summary */
+            /* Set the idle summary and enable idle scheduling */
             InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
+            Prcb->IdleSchedule = TRUE;
 
             /* Schedule the idle thread */
             NextThread = Prcb->IdleThread;
@@ -959,3 +1104,69 @@ NtYieldExecution(VOID)
     KeLowerIrql(OldIrql);
     return Status;
 }
+
+#if DBG && defined(KDBG)
+
+#include <kdbg/kdb.h>
+
+BOOLEAN
+KiKdbgExtReady(
+    ULONG Argc,
+    PCHAR Argv[])
+{
+    PKPRCB Prcb;
+    PLIST_ENTRY ListHead, NextEntry;
+    PKTHREAD Thread;
+    ULONG Number, Priority, ReadyCount;
+    BOOLEAN Verbose = (Argc > 1);
+
+    KdbpPrint("CPU\tReady\tSummary\t\tIdle\tScans\t\tSteals\t\tStolen\t\tMigrations\n");
+    for (Number = 0; Number < (ULONG)KeNumberProcessors; Number++)
+    {
+        Prcb = KiProcessorBlock[Number];
+
+        /* Count the threads waiting in the dispatcher ready lists */
+        ReadyCount = 0;
+        for (Priority = 0; Priority < MAXIMUM_PRIORITY; Priority++)
+        {
+            ListHead = &Prcb->DispatcherReadyListHead[Priority];
+            for (NextEntry = ListHead->Flink;
+                 NextEntry != ListHead;
+                 NextEntry = NextEntry->Flink)
+            {
+                ReadyCount++;
+            }
+        }
+
+        KdbpPrint("%lu\t%lu\t0x%08lx\t%s\t%lu\t\t%lu\t\t%lu\t\t%lu\n",
+                  Number,
+                  ReadyCount,
+                  Prcb->ReadySummary,
+                  (KiIdleSummary & AFFINITY_MASK(Number)) ? "Yes" : "No",
+                  KiSchedulerStatistics[Number].IdleScans,
+                  KiSchedulerStatistics[Number].IdleSteals,
+                  KiSchedulerStatistics[Number].StolenThreads,
+                  KiSchedulerStatistics[Number].Migrations);
+
+        /* List the ready threads themselves if asked to */
+        if (!Verbose) continue;
+        for (Priority = MAXIMUM_PRIORITY; Priority-- > 0;)
+        {
+            ListHead = &Prcb->DispatcherReadyListHead[Priority];
+            for (NextEntry = ListHead->Flink;
+                 NextEntry != ListHead;
+                 NextEntry = NextEntry->Flink)
+            {
+                Thread = CONTAINING_RECORD(NextEntry, KTHREAD, WaitListEntry);
+                KdbpPrint("\tThread %p, priority %lu, affinity 0x%p\n",
+                          Thread,
+                          Priority,
+                          (PVOID)Thread->Affinity);
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+#endif // DBG && KDBG
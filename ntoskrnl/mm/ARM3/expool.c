@@ -38,6 +38,57 @@ typedef struct _POOL_DPC_CONTEXT
     SIZE_T PoolTrackTableSizeExpansion;
 } POOL_DPC_CONTEXT, *PPOOL_DPC_CONTEXT;
 
+//
+// Per-processor magazines cache freed blocks that are too big for the pool
+// lookaside lists. Such allocations are rounded up to one of four size
+// classes per power of two, so that any cached block can satisfy any request
+// of its class. Block sizes are counted in pool blocks, so the first class
+// starts right above the last lookaside list, and the last power of two ends
+// at the largest block a page can hold.
+//
+#define POOL_MAGAZINE_FIRST_BIT 5
+#define POOL_MAGAZINE_CLASSES 16
+C_ASSERT((1 << POOL_MAGAZINE_FIRST_BIT) == NUMBER_POOL_LOOKASIDE_LISTS);
+C_ASSERT(POOL_LISTS_PER_PAGE <= (1 << (POOL_MAGAZINE_FIRST_BIT + POOL_MAGAZINE_CLASSES / 4)));
+
+//
+// Blocks sitting in a magazine belong to nobody, so they are tagged as such
+// instead of keeping the tag of whoever freed them last
+//
+#define TAG_POOL_MAGAZINE 'gaMP'
+
+typedef struct _POOL_MAGAZINE
+{
+    SLIST_HEADER ListHead;
+    ULONG TotalAllocates;
+    ULONG AllocateHits;
+    ULONG TotalFrees;
+    ULONG FreeHits;
+    ULONG WastedBlocks;
+    ULONG LastTotalAllocates;
+} POOL_MAGAZINE, *PPOOL_MAGAZINE;
+
+typedef struct _POOL_MAGAZINE_CACHE
+{
+    POOL_MAGAZINE Magazines[2][POOL_MAGAZINE_CLASSES];
+    ULONG Refills[2];
+    ULONG Drains[2];
+} POOL_MAGAZINE_CACHE, *PPOOL_MAGAZINE_CACHE;
+
+typedef struct _POOL_MAGAZINE_STATISTICS
+{
+    ULONG TotalAllocates;
+    ULONG AllocateHits;
+    ULONG TotalFrees;
+    ULONG FreeHits;
+    ULONG Refills;
+    ULONG Drains;
+    ULONG Trims;
+    ULONG LockContention;
+    ULONGLONG AllocatedBytes;
+    ULONGLONG WastedBytes;
+} POOL_MAGAZINE_STATISTICS, *PPOOL_MAGAZINE_STATISTICS;
+
 ULONG ExpNumberOfPagedPools;
 POOL_DESCRIPTOR NonPagedPoolDescriptor;
 PPOOL_DESCRIPTOR ExpPagedPoolDescriptor[16 + 1];
@@ -56,6 +107,9 @@ ULONG ExpPoolBigEntriesInUse;
 ULONG ExpPoolFlags;
 ULONG ExPoolFailures;
 ULONGLONG MiLastPoolDumpTime;
+POOL_MAGAZINE_CACHE ExpPoolMagazineCache[MAXIMUM_PROCESSORS];
+ULONG ExpPoolMagazineTrims[2];
+ULONG ExpPoolLockContention[2];
 
 /* Pool block/header/list access macros */
 #define POOL_ENTRY(x)       (PPOOL_HEADER)((ULONG_PTR)(x) - sizeof(POOL_HEADER))
@@ -470,6 +524,107 @@ ExpComputePartialHashForAddress(IN PVOID BaseAddress)
     return (Result >> 24) ^ (Result >> 16) ^ (Result >> 8) ^ Result;
 }
 
+FORCEINLINE
+ULONG
+ExpPoolMagazineIndex(IN USHORT BlockSize)
+{
+    ULONG HighBit, Base;
+
+    //
+    // Only blocks above the lookaside range are cached in magazines
+    //
+    ASSERT(BlockSize > NUMBER_POOL_LOOKASIDE_LISTS);
+    ASSERT(BlockSize < POOL_LISTS_PER_PAGE);
+
+    //
+    // Every power of two above the lookaside range is split into four classes,
+    // so that rounding up never wastes more than a quarter of the block
+    //
+    BitScanReverse(&HighBit, BlockSize - 1);
+    Base = 1 << HighBit;
+    return ((HighBit - POOL_MAGAZINE_FIRST_BIT) * 4) + (((BlockSize - 1) - Base) >> (HighBit - 2));
+}
+
+FORCEINLINE
+USHORT
+ExpPoolMagazineBlockSize(IN ULONG Index)
+{
+    ULONG HighBit, BlockSize;
+
+    //
+    // Compute the largest block size for this class, remembering that the
+    // last class of the page can't be a full page
+    //
+    ASSERT(Index < POOL_MAGAZINE_CLASSES);
+    HighBit = (Index / 4) + POOL_MAGAZINE_FIRST_BIT;
+    BlockSize = (1 << HighBit) + (((Index % 4) + 1) << (HighBit - 2));
+    return (USHORT)min(BlockSize, POOL_LISTS_PER_PAGE - 1);
+}
+
+FORCEINLINE
+ULONG
+ExpPoolMagazineDepth(IN USHORT BlockSize)
+{
+    //
+    // Don't let a single magazine cache more than a page worth of blocks
+    //
+    return max(POOL_LISTS_PER_PAGE / BlockSize, 2);
+}
+
+VOID
+NTAPI
+ExpQueryPoolMagazineStatistics(OUT POOL_MAGAZINE_STATISTICS Statistics[2])
+{
+    PPOOL_MAGAZINE_CACHE Cache;
+    PPOOL_MAGAZINE Magazine;
+    ULONG Processor, PoolType, Index;
+    USHORT BlockSize;
+
+    //
+    // Sum up the counters of every processor's magazines. These are updated
+    // without interlocked operations, so the totals are only approximations,
+    // just like the lookaside list hit counters.
+    //
+    RtlZeroMemory(Statistics, 2 * sizeof(POOL_MAGAZINE_STATISTICS));
+    for (Processor = 0; Processor < (ULONG)KeNumberProcessors; Processor++)
+    {
+        Cache = &ExpPoolMagazineCache[Processor];
+        for (PoolType = NonPagedPool; PoolType <= PagedPool; PoolType++)
+        {
+            for (Index = 0; Index < POOL_MAGAZINE_CLASSES; Index++)
+            {
+                Magazine = &Cache->Magazines[PoolType][Index];
+                BlockSize = ExpPoolMagazineBlockSize(Index);
+                Statistics[PoolType].TotalAllocates += Magazine->TotalAllocates;
+                Statistics[PoolType].AllocateHits += Magazine->AllocateHits;
+                Statistics[PoolType].TotalFrees += Magazine->TotalFrees;
+                Statistics[PoolType].FreeHits += Magazine->FreeHits;
+
+                //
+                // Every allocation of the class got the same block size, and
+                // the magazine knows how much of it was only rounding
+                //
+                Statistics[PoolType].AllocatedBytes +=
+                    (ULONGLONG)Magazine->TotalAllocates * BlockSize * POOL_BLOCK_SIZE;
+                Statistics[PoolType].WastedBytes +=
+                    (ULONGLONG)Magazine->WastedBlocks * POOL_BLOCK_SIZE;
+            }
+
+            Statistics[PoolType].Refills += Cache->Refills[PoolType];
+            Statistics[PoolType].Drains += Cache->Drains[PoolType];
+        }
+    }
+
+    //
+    // Add the counters that aren't kept per processor
+    //
+    for (PoolType = NonPagedPool; PoolType <= PagedPool; PoolType++)
+    {
+        Statistics[PoolType].Trims = ExpPoolMagazineTrims[PoolType];
+        Statistics[PoolType].LockContention = ExpPoolLockContention[PoolType];
+    }
+}
+
 #if DBG
 /*
  * FORCEINLINE
@@ -625,6 +780,39 @@ MiDumpPoolConsumers(BOOLEAN CalledFromDbg, ULONG Tag, ULONG Mask, ULONG Flags)
         }
     }
 
+    //
+    // In verbose mode, also show how well the per-processor magazines are doing
+    //
+    if (Verbose)
+    {
+        POOL_MAGAZINE_STATISTICS Statistics[2];
+        ULONG PoolType, Waste;
+
+        ExpQueryPoolMagazineStatistics(Statistics);
+        MiDumperPrint(CalledFromDbg, "\nMagazines\tAllocs\t\tHits\t\tFrees\t\tHits\t\tRefills\t\tDrains\t\tTrims\t\tContention\tWaste\n");
+        for (PoolType = NonPagedPool; PoolType <= PagedPool; PoolType++)
+        {
+            //
+            // Show how much of what the magazine classes handed out was only
+            // there because of rounding, in tenths of a percent
+            //
+            Waste = Statistics[PoolType].AllocatedBytes ?
+                    (ULONG)(Statistics[PoolType].WastedBytes * 1000 / Statistics[PoolType].AllocatedBytes) : 0;
+            MiDumperPrint(CalledFromDbg, "%s\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%ld\t\t%lu.%lu%%\n",
+                          (PoolType == NonPagedPool) ? "NonPaged" : "Paged\t",
+                          Statistics[PoolType].TotalAllocates,
+                          Statistics[PoolType].AllocateHits,
+                          Statistics[PoolType].TotalFrees,
+                          Statistics[PoolType].FreeHits,
+                          Statistics[PoolType].Refills,
+                          Statistics[PoolType].Drains,
+                          Statistics[PoolType].Trims,
+                          Statistics[PoolType].LockContention,
+                          Waste / 10,
+                          Waste % 10);
+        }
+    }
+
     if (!CalledFromDbg)
     {
         DPRINT1("---------------------\n");
@@ -1277,17 +1465,29 @@ ExLockPool(IN PPOOL_DESCRIPTOR Descriptor)
     //
     if ((Descriptor->PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
     {
+        KIRQL OldIrql;
+
         //
-        // Use the queued spin lock
+        // Use the queued spin lock, and remember if someone else was holding it
         //
+        if (KeTryToAcquireQueuedSpinLock(LockQueueNonPagedPoolLock, &OldIrql))
+        {
+            return OldIrql;
+        }
+
+        InterlockedIncrement((PLONG)&ExpPoolLockContention[NonPagedPool]);
         return KeAcquireQueuedSpinLock(LockQueueNonPagedPoolLock);
     }
     else
     {
         //
-        // Use the guarded mutex
+        // Use the guarded mutex, and remember if someone else was holding it
         //
-        KeAcquireGuardedMutex(Descriptor->LockAddress);
+        if (!KeTryToAcquireGuardedMutex(Descriptor->LockAddress))
+        {
+            InterlockedIncrement((PLONG)&ExpPoolLockContention[PagedPool]);
+            KeAcquireGuardedMutex(Descriptor->LockAddress);
+        }
         return APC_LEVEL;
     }
 }
@@ -1456,6 +1656,53 @@ ExGetPoolTagInfo(IN PSYSTEM_POOLTAG_INFORMATION SystemInformation,
     return Status;
 }
 
+VOID
+NTAPI
+ExGetPoolMagazineInformation(IN OUT PSYSTEM_LOOKASIDE_INFORMATION *InfoPointer,
+                             IN OUT PULONG RemainingPointer)
+{
+    PSYSTEM_LOOKASIDE_INFORMATION Info = *InfoPointer;
+    ULONG Remaining = *RemainingPointer;
+    PPOOL_MAGAZINE Magazine;
+    ULONG Processor, PoolType, Index, Depth;
+    USHORT BlockSize;
+
+    //
+    // Report each magazine class like a lookaside list, with the counters of
+    // all the processors added up
+    //
+    for (PoolType = NonPagedPool; PoolType <= PagedPool; PoolType++)
+    {
+        for (Index = 0; (Index < POOL_MAGAZINE_CLASSES) && (Remaining > 0); Index++)
+        {
+            BlockSize = ExpPoolMagazineBlockSize(Index);
+            RtlZeroMemory(Info, sizeof(*Info));
+            Info->Type = PoolType;
+            Info->Tag = TAG_POOL_MAGAZINE;
+            Info->Size = BlockSize * POOL_BLOCK_SIZE;
+
+            Depth = 0;
+            for (Processor = 0; Processor < (ULONG)KeNumberProcessors; Processor++)
+            {
+                Magazine = &ExpPoolMagazineCache[Processor].Magazines[PoolType][Index];
+                Depth += ExQueryDepthSList(&Magazine->ListHead);
+                Info->TotalAllocates += Magazine->TotalAllocates;
+                Info->TotalFrees += Magazine->TotalFrees;
+                Info->AllocateMisses += Magazine->TotalAllocates - Magazine->AllocateHits;
+                Info->FreeMisses += Magazine->TotalFrees - Magazine->FreeHits;
+            }
+
+            Info->CurrentDepth = (USHORT)min(Depth, MAXUSHORT);
+            Info->MaximumDepth = (USHORT)min(ExpPoolMagazineDepth(BlockSize) * KeNumberProcessors, MAXUSHORT);
+            Info++;
+            Remaining--;
+        }
+    }
+
+    *InfoPointer = Info;
+    *RemainingPointer = Remaining;
+}
+
 _IRQL_requires_(DISPATCH_LEVEL)
 static
 BOOLEAN
@@ -1894,199 +2141,672 @@ ExReturnPoolQuota(IN PVOID P)
     }
 }
 
-/* PUBLIC FUNCTIONS ***********************************************************/
-
-/*
- * @implemented
- */
-PVOID
-NTAPI
-ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
-                      IN SIZE_T NumberOfBytes,
-                      IN ULONG Tag)
+static
+PPOOL_HEADER
+ExpSplitPoolBlock(IN PPOOL_DESCRIPTOR PoolDesc,
+                  IN PLIST_ENTRY ListHead,
+                  IN USHORT i)
 {
-    PPOOL_DESCRIPTOR PoolDesc;
-    PLIST_ENTRY ListHead;
     PPOOL_HEADER Entry, NextEntry, FragmentEntry;
-    KIRQL OldIrql;
-    USHORT BlockSize, i;
-    ULONG OriginalType;
-    PKPRCB Prcb = KeGetCurrentPrcb();
-    PGENERAL_LOOKASIDE LookasideList;
-
-    //
-    // Some sanity checks
-    //
-    ASSERT(Tag != 0);
-    ASSERT(Tag != ' GIB');
-    ASSERT(NumberOfBytes != 0);
-    ExpCheckPoolIrqlLevel(PoolType, NumberOfBytes, NULL);
+    USHORT BlockSize;
 
     //
-    // Not supported in ReactOS
+    // Remove a free entry from the list
+    // Note that due to the way we insert free blocks into multiple lists
+    // there is a guarantee that any block on this list will either be
+    // of the correct size, or perhaps larger.
     //
-    ASSERT(!(PoolType & SESSION_POOL_MASK));
+    ExpCheckPoolLinks(ListHead);
+    Entry = POOL_ENTRY(ExpRemovePoolHeadList(ListHead));
+    ExpCheckPoolLinks(ListHead);
+    ExpCheckPoolBlocks(Entry);
+    ASSERT(Entry->BlockSize >= i);
+    ASSERT(Entry->PoolType == 0);
 
     //
-    // Check if verifier or special pool is enabled
+    // Check if this block is larger that what we need. The block could
+    // not possibly be smaller, due to the reason explained above (and
+    // we would've asserted on a checked build if this was the case).
     //
-    if (ExpPoolFlags & (POOL_FLAG_VERIFIER | POOL_FLAG_SPECIAL_POOL))
+    if (Entry->BlockSize != i)
     {
         //
-        // For verifier, we should call the verification routine
+        // Is there an entry before this one?
         //
-        if (ExpPoolFlags & POOL_FLAG_VERIFIER)
+        if (Entry->PreviousSize == 0)
         {
-            DPRINT1("Driver Verifier is not yet supported\n");
-        }
+            //
+            // There isn't anyone before us, so take the next block and
+            // turn it into a fragment that contains the leftover data
+            // that we don't need to satisfy the caller's request
+            //
+            FragmentEntry = POOL_BLOCK(Entry, i);
+            FragmentEntry->BlockSize = Entry->BlockSize - i;
 
-        //
-        // For special pool, we check if this is a suitable allocation and do
-        // the special allocation if needed
-        //
-        if (ExpPoolFlags & POOL_FLAG_SPECIAL_POOL)
-        {
             //
-            // Check if this is a special pool allocation
+            // And make it point back to us
             //
-            if (MmUseSpecialPool(NumberOfBytes, Tag))
+            FragmentEntry->PreviousSize = i;
+
+            //
+            // Now get the block that follows the new fragment and check
+            // if it's still on the same page as us (and not at the end)
+            //
+            NextEntry = POOL_NEXT_BLOCK(FragmentEntry);
+            if (PAGE_ALIGN(NextEntry) != NextEntry)
             {
                 //
-                // Try to allocate using special pool
+                // Adjust this next block to point to our newly created
+                // fragment block
                 //
-                Entry = MmAllocateSpecialPool(NumberOfBytes, Tag, PoolType, 2);
-                if (Entry) return Entry;
+                NextEntry->PreviousSize = FragmentEntry->BlockSize;
             }
         }
-    }
-
-    //
-    // Get the pool type and its corresponding vector for this request
-    //
-    OriginalType = PoolType;
-    PoolType = PoolType & BASE_POOL_TYPE_MASK;
-    PoolDesc = PoolVector[PoolType];
-    ASSERT(PoolDesc != NULL);
-
-    //
-    // Check if this is a big page allocation
-    //
-    if (NumberOfBytes > POOL_MAX_ALLOC)
-    {
-        //
-        // Allocate pages for it
-        //
-        Entry = MiAllocatePoolPages(OriginalType, NumberOfBytes);
-        if (!Entry)
+        else
         {
-#if DBG
             //
-            // Out of memory, display current consumption
-            // Let's consider that if the caller wanted more
-            // than a hundred pages, that's a bogus caller
-            // and we are not out of memory. Dump at most
-            // once a second to avoid spamming the log.
+            // There is a free entry before us, which we know is smaller
+            // so we'll make this entry the fragment instead
             //
-            if (NumberOfBytes < 100 * PAGE_SIZE &&
-                KeQueryInterruptTime() >= MiLastPoolDumpTime + 10000000)
-            {
-                MiDumpPoolConsumers(FALSE, 0, 0, 0);
-                MiLastPoolDumpTime = KeQueryInterruptTime();
-            }
-#endif
+            FragmentEntry = Entry;
 
             //
-            // Must succeed pool is deprecated, but still supported. These allocation
-            // failures must cause an immediate bugcheck
+            // And then we'll remove from it the actual size required.
+            // Now the entry is a leftover free fragment
             //
-            if (OriginalType & MUST_SUCCEED_POOL_MASK)
-            {
-                KeBugCheckEx(MUST_SUCCEED_POOL_EMPTY,
-                             NumberOfBytes,
-                             NonPagedPoolDescriptor.TotalPages,
-                             NonPagedPoolDescriptor.TotalBigPages,
-                             0);
-            }
+            Entry->BlockSize -= i;
 
             //
-            // Internal debugging
-            //
-            ExPoolFailures++;
-
+            // Now let's go to the next entry after the fragment (which
+            // used to point to our original free entry) and make it
+            // reference the new fragment entry instead.
             //
-            // This flag requests printing failures, and can also further specify
-            // breaking on failures
+            // This is the entry that will actually end up holding the
+            // allocation!
             //
-            if (ExpPoolFlags & POOL_FLAG_DBGPRINT_ON_FAILURE)
-            {
-                DPRINT1("EX: ExAllocatePool (%lu, 0x%x) returning NULL\n",
-                        NumberOfBytes,
-                        OriginalType);
-                if (ExpPoolFlags & POOL_FLAG_CRASH_ON_FAILURE) DbgBreakPoint();
-            }
+            Entry = POOL_NEXT_BLOCK(Entry);
+            Entry->PreviousSize = FragmentEntry->BlockSize;
 
             //
-            // Finally, this flag requests an exception, which we are more than
-            // happy to raise!
+            // And now let's go to the entry after that one and check if
+            // it's still on the same page, and not at the end
             //
-            if (OriginalType & POOL_RAISE_IF_ALLOCATION_FAILURE)
+            NextEntry = POOL_BLOCK(Entry, i);
+            if (PAGE_ALIGN(NextEntry) != NextEntry)
             {
-                ExRaiseStatus(STATUS_INSUFFICIENT_RESOURCES);
+                //
+                // Make it reference the allocation entry
+                //
+                NextEntry->PreviousSize = i;
             }
-
-            return NULL;
         }
 
         //
-        // Increment required counters
+        // Now our (allocation) entry is the right size
         //
-        InterlockedExchangeAdd((PLONG)&PoolDesc->TotalBigPages,
-                               (LONG)BYTES_TO_PAGES(NumberOfBytes));
-        InterlockedExchangeAddSizeT(&PoolDesc->TotalBytes, NumberOfBytes);
-        InterlockedIncrement((PLONG)&PoolDesc->RunningAllocs);
+        Entry->BlockSize = i;
 
         //
-        // Add a tag for the big page allocation and switch to the generic "BIG"
-        // tag if we failed to do so, then insert a tracker for this alloation.
+        // And the next entry is now the free fragment which contains
+        // the remaining difference between how big the original entry
+        // was, and the actual size the caller needs/requested.
         //
-        if (!ExpAddTagForBigPages(Entry,
-                                  Tag,
-                                  (ULONG)BYTES_TO_PAGES(NumberOfBytes),
-                                  OriginalType))
+        FragmentEntry->PoolType = 0;
+        BlockSize = FragmentEntry->BlockSize;
+
+        //
+        // Now check if enough free bytes remained for us to have a
+        // "full" entry, which contains enough bytes for a linked list
+        // and thus can be used for allocations (up to 8 bytes...)
+        //
+        ExpCheckPoolLinks(&PoolDesc->ListHeads[BlockSize - 1]);
+        if (BlockSize != 1)
         {
-            Tag = ' GIB';
+            //
+            // Insert the free entry into the free list for this size
+            //
+            ExpInsertPoolTailList(&PoolDesc->ListHeads[BlockSize - 1],
+                                  POOL_FREE_BLOCK(FragmentEntry));
+            ExpCheckPoolLinks(POOL_FREE_BLOCK(FragmentEntry));
         }
-        ExpInsertPoolTracker(Tag, ROUND_TO_PAGES(NumberOfBytes), OriginalType);
-        return Entry;
     }
 
     //
-    // Should never request 0 bytes from the pool, but since so many drivers do
-    // it, we'll just assume they want 1 byte, based on NT's similar behavior
+    // Return the entry, which is now the right size
     //
-    if (!NumberOfBytes) NumberOfBytes = 1;
+    return Entry;
+}
 
-    //
-    // A pool allocation is defined by its data, a linked list to connect it to
-    // the free list (if necessary), and a pool header to store accounting info.
-    // Calculate this size, then convert it into a block size (units of pool
-    // headers)
-    //
-    // Note that i cannot overflow (past POOL_LISTS_PER_PAGE) because any such
-    // request would've been treated as a POOL_MAX_ALLOC earlier and resulted in
-    // the direct allocation of pages.
-    //
-    i = (USHORT)((NumberOfBytes + sizeof(POOL_HEADER) + (POOL_BLOCK_SIZE - 1))
-                 / POOL_BLOCK_SIZE);
-    ASSERT(i < POOL_LISTS_PER_PAGE);
+static
+PPOOL_HEADER
+ExpReleasePoolBlock(IN PPOOL_DESCRIPTOR PoolDesc,
+                    IN PPOOL_HEADER Entry)
+{
+    PPOOL_HEADER NextEntry;
+    USHORT BlockSize;
+    BOOLEAN Combined = FALSE;
 
     //
-    // Handle lookaside list optimization for both paged and nonpaged pool
+    // Get the pointer to the next entry, and check if it's at the end of the page
     //
-    if (i <= NUMBER_POOL_LOOKASIDE_LISTS)
+    NextEntry = POOL_NEXT_BLOCK(Entry);
+    ExpCheckPoolBlocks(Entry);
+    if (PAGE_ALIGN(NextEntry) != NextEntry)
     {
         //
-        // Try popping it from the per-CPU lookaside list
+        // We may be able to combine the block if it's free
+        //
+        if (NextEntry->PoolType == 0)
+        {
+            //
+            // The next block is free, so we'll do a combine
+            //
+            Combined = TRUE;
+
+            //
+            // Make sure there's actual data in the block -- anything smaller
+            // than this means we only have the header, so there's no linked list
+            // for us to remove
+            //
+            if ((NextEntry->BlockSize != 1))
+            {
+                //
+                // The block is at least big enough to have a linked list, so go
+                // ahead and remove it
+                //
+                ExpCheckPoolLinks(POOL_FREE_BLOCK(NextEntry));
+                ExpRemovePoolEntryList(POOL_FREE_BLOCK(NextEntry));
+                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Flink));
+                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Blink));
+            }
+
+            //
+            // Our entry is now combined with the next entry
+            //
+            Entry->BlockSize = Entry->BlockSize + NextEntry->BlockSize;
+        }
+    }
+
+    //
+    // Now check if there was a previous entry on the same page as us
+    //
+    if (Entry->PreviousSize)
+    {
+        //
+        // Great, grab that entry and check if it's free
+        //
+        NextEntry = POOL_PREV_BLOCK(Entry);
+        if (NextEntry->PoolType == 0)
+        {
+            //
+            // It is, so we can do a combine
+            //
+            Combined = TRUE;
+
+            //
+            // Make sure there's actual data in the block -- anything smaller
+            // than this means we only have the header so there's no linked list
+            // for us to remove
+            //
+            if ((NextEntry->BlockSize != 1))
+            {
+                //
+                // The block is at least big enough to have a linked list, so go
+                // ahead and remove it
+                //
+                ExpCheckPoolLinks(POOL_FREE_BLOCK(NextEntry));
+                ExpRemovePoolEntryList(POOL_FREE_BLOCK(NextEntry));
+                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Flink));
+                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Blink));
+            }
+
+            //
+            // Combine our original block (which might've already been combined
+            // with the next block), into the previous block
+            //
+            NextEntry->BlockSize = NextEntry->BlockSize + Entry->BlockSize;
+
+            //
+            // And now we'll work with the previous block instead
+            //
+            Entry = NextEntry;
+        }
+    }
+
+    //
+    // By now, it may have been possible for our combined blocks to actually
+    // have made up a full page (if there were only 2-3 allocations on the
+    // page, they could've all been combined).
+    //
+    if ((PAGE_ALIGN(Entry) == Entry) &&
+        (PAGE_ALIGN(POOL_NEXT_BLOCK(Entry)) == POOL_NEXT_BLOCK(Entry)))
+    {
+        //
+        // In this case, the caller must free the page once the pool lock has
+        // been released
+        //
+        return Entry;
+    }
+
+    //
+    // Otherwise, we now have a free block (or a combination of 2 or 3)
+    //
+    Entry->PoolType = 0;
+    BlockSize = Entry->BlockSize;
+    ASSERT(BlockSize != 1);
+
+    //
+    // Check if we actually did combine it with anyone
+    //
+    if (Combined)
+    {
+        //
+        // Get the first combined block (either our original to begin with, or
+        // the one after the original, depending if we combined with the previous)
+        //
+        NextEntry = POOL_NEXT_BLOCK(Entry);
+
+        //
+        // As long as the next block isn't on a page boundary, have it point
+        // back to us
+        //
+        if (PAGE_ALIGN(NextEntry) != NextEntry) NextEntry->PreviousSize = BlockSize;
+    }
+
+    //
+    // Insert this new free block
+    //
+    ExpInsertPoolHeadList(&PoolDesc->ListHeads[BlockSize - 1], POOL_FREE_BLOCK(Entry));
+    ExpCheckPoolLinks(POOL_FREE_BLOCK(Entry));
+    return NULL;
+}
+
+static
+PPOOL_HEADER
+ExpRefillPoolMagazine(IN PPOOL_DESCRIPTOR PoolDesc,
+                      IN PPOOL_MAGAZINE_CACHE Cache,
+                      IN PPOOL_MAGAZINE Magazine,
+                      IN USHORT i)
+{
+    PLIST_ENTRY ListHead;
+    PPOOL_HEADER Entry, FirstEntry = NULL;
+    POOL_TYPE PoolType = PoolDesc->PoolType & BASE_POOL_TYPE_MASK;
+    ULONG Count = 0, BatchSize;
+    KIRQL OldIrql;
+
+    //
+    // Find the first free list that could satisfy this block size, without
+    // bothering to take the lock if there isn't any
+    //
+    ListHead = &PoolDesc->ListHeads[i];
+    while (ExpIsPoolListEmpty(ListHead))
+    {
+        if (++ListHead == &PoolDesc->ListHeads[POOL_LISTS_PER_PAGE]) return NULL;
+    }
+
+    //
+    // Fill half of the magazine, plus the block for the caller, while holding
+    // the pool lock only once
+    //
+    BatchSize = ExpPoolMagazineDepth(i) / 2;
+    OldIrql = ExLockPool(PoolDesc);
+    while ((Count <= BatchSize) &&
+           (ListHead != &PoolDesc->ListHeads[POOL_LISTS_PER_PAGE]))
+    {
+        //
+        // Someone may have raced us for this list, or we emptied it already
+        //
+        if (ExpIsPoolListEmpty(ListHead))
+        {
+            ListHead++;
+            continue;
+        }
+
+        //
+        // Carve a block and mark it as in use, so that it can't be combined
+        // with its neighbours while it sits in the magazine
+        //
+        Entry = ExpSplitPoolBlock(PoolDesc, ListHead, i);
+        Entry->PoolType = PoolType + 1;
+        Entry->PoolTag = TAG_POOL_MAGAZINE;
+        ExpCheckPoolBlocks(Entry);
+        Count++;
+
+        //
+        // The first block goes to the caller, the others to the magazine
+        //
+        if (!FirstEntry)
+        {
+            FirstEntry = Entry;
+        }
+        else
+        {
+            InterlockedPushEntrySList(&Magazine->ListHead,
+                                      (PSLIST_ENTRY)POOL_FREE_BLOCK(Entry));
+        }
+    }
+    ExUnlockPool(PoolDesc, OldIrql);
+
+    //
+    // Blocks in the magazines are accounted as allocated
+    //
+    if (Count)
+    {
+        InterlockedExchangeAddSizeT(&PoolDesc->TotalBytes, Count * i * POOL_BLOCK_SIZE);
+        InterlockedExchangeAdd((PLONG)&PoolDesc->RunningAllocs, Count);
+        Cache->Refills[PoolType]++;
+    }
+
+    return FirstEntry;
+}
+
+static
+ULONG
+ExpDrainPoolMagazine(IN PPOOL_DESCRIPTOR PoolDesc,
+                     IN PPOOL_MAGAZINE Magazine,
+                     IN USHORT BlockSize,
+                     IN PPOOL_HEADER Entry OPTIONAL,
+                     IN ULONG BatchSize)
+{
+    PSLIST_ENTRY ListEntry;
+    PVOID Page, FreePages = NULL;
+    ULONG Count = 0;
+    KIRQL OldIrql;
+
+    //
+    // Start with the block being freed, if any, or else with the magazine
+    //
+    if (!Entry)
+    {
+        ListEntry = InterlockedPopEntrySList(&Magazine->ListHead);
+        if (!ListEntry) return 0;
+        Entry = POOL_ENTRY(ListEntry);
+    }
+
+    //
+    // Give back up to BatchSize blocks while holding the pool lock only once
+    //
+    OldIrql = ExLockPool(PoolDesc);
+    while (TRUE)
+    {
+        ASSERT(Entry->BlockSize == BlockSize);
+        Page = ExpReleasePoolBlock(PoolDesc, Entry);
+        if (Page)
+        {
+            //
+            // This released a whole page. Chain it through its first bytes so
+            // that it can be freed after the pool lock has been released
+            //
+            *(PVOID*)Page = FreePages;
+            FreePages = Page;
+        }
+
+        if (++Count == BatchSize) break;
+        ListEntry = InterlockedPopEntrySList(&Magazine->ListHead);
+        if (!ListEntry) break;
+        Entry = POOL_ENTRY(ListEntry);
+    }
+    ExUnlockPool(PoolDesc, OldIrql);
+
+    //
+    // Update performance counters
+    //
+    InterlockedExchangeAdd((PLONG)&PoolDesc->RunningDeAllocs, Count);
+    InterlockedExchangeAddSizeT(&PoolDesc->TotalBytes,
+                                -(LONG_PTR)(Count * BlockSize * POOL_BLOCK_SIZE));
+
+    //
+    // Now free the pages that became empty
+    //
+    while (FreePages)
+    {
+        Page = FreePages;
+        FreePages = *(PVOID*)Page;
+        InterlockedExchangeAdd((PLONG)&PoolDesc->TotalPages, -1);
+        MiFreePoolPages(Page);
+    }
+
+    return Count;
+}
+
+VOID
+NTAPI
+ExTrimPoolMagazines(VOID)
+{
+    PPOOL_MAGAZINE Magazine;
+    ULONG Processor, PoolType, Index, TotalAllocates;
+    USHORT BlockSize;
+
+    //
+    // Magazines only give blocks back when they overflow, so a burst of frees
+    // of some size would otherwise stay cached for good. Empty the ones that
+    // didn't serve a single allocation since the last call. Their SLISTs can
+    // be popped from any processor, and paged pool needs us at PASSIVE_LEVEL.
+    //
+    PAGED_CODE();
+    for (Processor = 0; Processor < (ULONG)KeNumberProcessors; Processor++)
+    {
+        for (PoolType = NonPagedPool; PoolType <= PagedPool; PoolType++)
+        {
+            for (Index = 0; Index < POOL_MAGAZINE_CLASSES; Index++)
+            {
+                Magazine = &ExpPoolMagazineCache[Processor].Magazines[PoolType][Index];
+                TotalAllocates = Magazine->TotalAllocates;
+                if ((TotalAllocates == Magazine->LastTotalAllocates) &&
+                    (ExQueryDepthSList(&Magazine->ListHead) != 0))
+                {
+                    BlockSize = ExpPoolMagazineBlockSize(Index);
+                    if (ExpDrainPoolMagazine(PoolVector[PoolType],
+                                             Magazine,
+                                             BlockSize,
+                                             NULL,
+                                             ExpPoolMagazineDepth(BlockSize)))
+                    {
+                        ExpPoolMagazineTrims[PoolType]++;
+                    }
+                }
+
+                Magazine->LastTotalAllocates = TotalAllocates;
+            }
+        }
+    }
+}
+
+/* PUBLIC FUNCTIONS ***********************************************************/
+
+/*
+ * @implemented
+ */
+PVOID
+NTAPI
+ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
+                      IN SIZE_T NumberOfBytes,
+                      IN ULONG Tag)
+{
+    PPOOL_DESCRIPTOR PoolDesc;
+    PLIST_ENTRY ListHead;
+    PPOOL_HEADER Entry, FragmentEntry;
+    KIRQL OldIrql;
+    USHORT BlockSize, i;
+    ULONG OriginalType, Index;
+    PKPRCB Prcb = KeGetCurrentPrcb();
+    PGENERAL_LOOKASIDE LookasideList;
+    PPOOL_MAGAZINE_CACHE Cache;
+    PPOOL_MAGAZINE Magazine;
+
+    //
+    // Some sanity checks
+    //
+    ASSERT(Tag != 0);
+    ASSERT(Tag != ' GIB');
+    ASSERT(NumberOfBytes != 0);
+    ExpCheckPoolIrqlLevel(PoolType, NumberOfBytes, NULL);
+
+    //
+    // Not supported in ReactOS
+    //
+    ASSERT(!(PoolType & SESSION_POOL_MASK));
+
+    //
+    // Check if verifier or special pool is enabled
+    //
+    if (ExpPoolFlags & (POOL_FLAG_VERIFIER | POOL_FLAG_SPECIAL_POOL))
+    {
+        //
+        // For verifier, we should call the verification routine
+        //
+        if (ExpPoolFlags & POOL_FLAG_VERIFIER)
+        {
+            DPRINT1("Driver Verifier is not yet supported\n");
+        }
+
+        //
+        // For special pool, we check if this is a suitable allocation and do
+        // the special allocation if needed
+        //
+        if (ExpPoolFlags & POOL_FLAG_SPECIAL_POOL)
+        {
+            //
+            // Check if this is a special pool allocation
+            //
+            if (MmUseSpecialPool(NumberOfBytes, Tag))
+            {
+                //
+                // Try to allocate using special pool
+                //
+                Entry = MmAllocateSpecialPool(NumberOfBytes, Tag, PoolType, 2);
+                if (Entry) return Entry;
+            }
+        }
+    }
+
+    //
+    // Get the pool type and its corresponding vector for this request
+    //
+    OriginalType = PoolType;
+    PoolType = PoolType & BASE_POOL_TYPE_MASK;
+    PoolDesc = PoolVector[PoolType];
+    ASSERT(PoolDesc != NULL);
+
+    //
+    // Check if this is a big page allocation
+    //
+    if (NumberOfBytes > POOL_MAX_ALLOC)
+    {
+        //
+        // Allocate pages for it
+        //
+        Entry = MiAllocatePoolPages(OriginalType, NumberOfBytes);
+        if (!Entry)
+        {
+#if DBG
+            //
+            // Out of memory, display current consumption
+            // Let's consider that if the caller wanted more
+            // than a hundred pages, that's a bogus caller
+            // and we are not out of memory. Dump at most
+            // once a second to avoid spamming the log.
+            //
+            if (NumberOfBytes < 100 * PAGE_SIZE &&
+                KeQueryInterruptTime() >= MiLastPoolDumpTime + 10000000)
+            {
+                MiDumpPoolConsumers(FALSE, 0, 0, 0);
+                MiLastPoolDumpTime = KeQueryInterruptTime();
+            }
+#endif
+
+            //
+            // Must succeed pool is deprecated, but still supported. These allocation
+            // failures must cause an immediate bugcheck
+            //
+            if (OriginalType & MUST_SUCCEED_POOL_MASK)
+            {
+                KeBugCheckEx(MUST_SUCCEED_POOL_EMPTY,
+                             NumberOfBytes,
+                             NonPagedPoolDescriptor.TotalPages,
+                             NonPagedPoolDescriptor.TotalBigPages,
+                             0);
+            }
+
+            //
+            // Internal debugging
+            //
+            ExPoolFailures++;
+
+            //
+            // This flag requests printing failures, and can also further specify
+            // breaking on failures
+            //
+            if (ExpPoolFlags & POOL_FLAG_DBGPRINT_ON_FAILURE)
+            {
+                DPRINT1("EX: ExAllocatePool (%lu, 0x%x) returning NULL\n",
+                        NumberOfBytes,
+                        OriginalType);
+                if (ExpPoolFlags & POOL_FLAG_CRASH_ON_FAILURE) DbgBreakPoint();
+            }
+
+            //
+            // Finally, this flag requests an exception, which we are more than
+            // happy to raise!
+            //
+            if (OriginalType & POOL_RAISE_IF_ALLOCATION_FAILURE)
+            {
+                ExRaiseStatus(STATUS_INSUFFICIENT_RESOURCES);
+            }
+
+            return NULL;
+        }
+
+        //
+        // Increment required counters
+        //
+        InterlockedExchangeAdd((PLONG)&PoolDesc->TotalBigPages,
+                               (LONG)BYTES_TO_PAGES(NumberOfBytes));
+        InterlockedExchangeAddSizeT(&PoolDesc->TotalBytes, NumberOfBytes);
+        InterlockedIncrement((PLONG)&PoolDesc->RunningAllocs);
+
+        //
+        // Add a tag for the big page allocation and switch to the generic "BIG"
+        // tag if we failed to do so, then insert a tracker for this alloation.
+        //
+        if (!ExpAddTagForBigPages(Entry,
+                                  Tag,
+                                  (ULONG)BYTES_TO_PAGES(NumberOfBytes),
+                                  OriginalType))
+        {
+            Tag = ' GIB';
+        }
+        ExpInsertPoolTracker(Tag, ROUND_TO_PAGES(NumberOfBytes), OriginalType);
+        return Entry;
+    }
+
+    //
+    // Should never request 0 bytes from the pool, but since so many drivers do
+    // it, we'll just assume they want 1 byte, based on NT's similar behavior
+    //
+    if (!NumberOfBytes) NumberOfBytes = 1;
+
+    //
+    // A pool allocation is defined by its data, a linked list to connect it to
+    // the free list (if necessary), and a pool header to store accounting info.
+    // Calculate this size, then convert it into a block size (units of pool
+    // headers)
+    //
+    // Note that i cannot overflow (past POOL_LISTS_PER_PAGE) because any such
+    // request would've been treated as a POOL_MAX_ALLOC earlier and resulted in
+    // the direct allocation of pages.
+    //
+    i = (USHORT)((NumberOfBytes + sizeof(POOL_HEADER) + (POOL_BLOCK_SIZE - 1))
+                 / POOL_BLOCK_SIZE);
+    ASSERT(i < POOL_LISTS_PER_PAGE);
+
+    //
+    // Handle lookaside list optimization for both paged and nonpaged pool
+    //
+    if (i <= NUMBER_POOL_LOOKASIDE_LISTS)
+    {
+        //
+        // Try popping it from the per-CPU lookaside list
         //
         LookasideList = (PoolType == PagedPool) ?
                          Prcb->PPPagedLookasideList[i - 1].P :
@@ -2130,6 +2850,57 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
             return POOL_FREE_BLOCK(Entry);
         }
     }
+    else
+    {
+        //
+        // Bigger blocks are cached in the per-CPU magazines instead, so round
+        // the request up to the block size of its magazine class
+        //
+        Index = ExpPoolMagazineIndex(i);
+        BlockSize = ExpPoolMagazineBlockSize(Index);
+        Cache = &ExpPoolMagazineCache[KeGetCurrentProcessorNumber()];
+        Magazine = &Cache->Magazines[PoolType][Index];
+
+        //
+        // Try popping a block from the magazine, and refill it in one go from
+        // the pool descriptor if it's empty. Keep track of what the rounding
+        // costs, since it can take up to a quarter of the block.
+        //
+        Magazine->TotalAllocates++;
+        Magazine->WastedBlocks += BlockSize - i;
+        i = BlockSize;
+        Entry = (PPOOL_HEADER)InterlockedPopEntrySList(&Magazine->ListHead);
+        if (Entry)
+        {
+            Magazine->AllocateHits++;
+            Entry--;
+        }
+        else
+        {
+            Entry = ExpRefillPoolMagazine(PoolDesc, Cache, Magazine, i);
+        }
+
+        //
+        // If we got a block, write down its pool type, track it and return it
+        //
+        if (Entry)
+        {
+            ASSERT(Entry->BlockSize == i);
+            Entry->PoolType = OriginalType + 1;
+            ExpInsertPoolTracker(Tag,
+                                 Entry->BlockSize * POOL_BLOCK_SIZE,
+                                 OriginalType);
+
+            Entry->PoolTag = Tag;
+            (POOL_FREE_BLOCK(Entry))->Flink = NULL;
+            (POOL_FREE_BLOCK(Entry))->Blink = NULL;
+            return POOL_FREE_BLOCK(Entry);
+        }
+
+        //
+        // Otherwise, the free lists are empty, so fall back to a fresh page
+        //
+    }
 
     //
     // Loop in the free lists looking for a block if this size. Start with the
@@ -2164,125 +2935,9 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
             }
 
             //
-            // Remove a free entry from the list
-            // Note that due to the way we insert free blocks into multiple lists
-            // there is a guarantee that any block on this list will either be
-            // of the correct size, or perhaps larger.
+            // Remove a free entry from the list, and split it if needed
             //
-            ExpCheckPoolLinks(ListHead);
-            Entry = POOL_ENTRY(ExpRemovePoolHeadList(ListHead));
-            ExpCheckPoolLinks(ListHead);
-            ExpCheckPoolBlocks(Entry);
-            ASSERT(Entry->BlockSize >= i);
-            ASSERT(Entry->PoolType == 0);
-
-            //
-            // Check if this block is larger that what we need. The block could
-            // not possibly be smaller, due to the reason explained above (and
-            // we would've asserted on a checked build if this was the case).
-            //
-            if (Entry->BlockSize != i)
-            {
-                //
-                // Is there an entry before this one?
-                //
-                if (Entry->PreviousSize == 0)
-                {
-                    //
-                    // There isn't anyone before us, so take the next block and
-                    // turn it into a fragment that contains the leftover data
-                    // that we don't need to satisfy the caller's request
-                    //
-                    FragmentEntry = POOL_BLOCK(Entry, i);
-                    FragmentEntry->BlockSize = Entry->BlockSize - i;
-
-                    //
-                    // And make it point back to us
-                    //
-                    FragmentEntry->PreviousSize = i;
-
-                    //
-                    // Now get the block that follows the new fragment and check
-                    // if it's still on the same page as us (and not at the end)
-                    //
-                    NextEntry = POOL_NEXT_BLOCK(FragmentEntry);
-                    if (PAGE_ALIGN(NextEntry) != NextEntry)
-                    {
-                        //
-                        // Adjust this next block to point to our newly created
-                        // fragment block
-                        //
-                        NextEntry->PreviousSize = FragmentEntry->BlockSize;
-                    }
-                }
-                else
-                {
-                    //
-                    // There is a free entry before us, which we know is smaller
-                    // so we'll make this entry the fragment instead
-                    //
-                    FragmentEntry = Entry;
-
-                    //
-                    // And then we'll remove from it the actual size required.
-                    // Now the entry is a leftover free fragment
-                    //
-                    Entry->BlockSize -= i;
-
-                    //
-                    // Now let's go to the next entry after the fragment (which
-                    // used to point to our original free entry) and make it
-                    // reference the new fragment entry instead.
-                    //
-                    // This is the entry that will actually end up holding the
-                    // allocation!
-                    //
-                    Entry = POOL_NEXT_BLOCK(Entry);
-                    Entry->PreviousSize = FragmentEntry->BlockSize;
-
-                    //
-                    // And now let's go to the entry after that one and check if
-                    // it's still on the same page, and not at the end
-                    //
-                    NextEntry = POOL_BLOCK(Entry, i);
-                    if (PAGE_ALIGN(NextEntry) != NextEntry)
-                    {
-                        //
-                        // Make it reference the allocation entry
-                        //
-                        NextEntry->PreviousSize = i;
-                    }
-                }
-
-                //
-                // Now our (allocation) entry is the right size
-                //
-                Entry->BlockSize = i;
-
-                //
-                // And the next entry is now the free fragment which contains
-                // the remaining difference between how big the original entry
-                // was, and the actual size the caller needs/requested.
-                //
-                FragmentEntry->PoolType = 0;
-                BlockSize = FragmentEntry->BlockSize;
-
-                //
-                // Now check if enough free bytes remained for us to have a
-                // "full" entry, which contains enough bytes for a linked list
-                // and thus can be used for allocations (up to 8 bytes...)
-                //
-                ExpCheckPoolLinks(&PoolDesc->ListHeads[BlockSize - 1]);
-                if (BlockSize != 1)
-                {
-                    //
-                    // Insert the free entry into the free list for this size
-                    //
-                    ExpInsertPoolTailList(&PoolDesc->ListHeads[BlockSize - 1],
-                                          POOL_FREE_BLOCK(FragmentEntry));
-                    ExpCheckPoolLinks(POOL_FREE_BLOCK(FragmentEntry));
-                }
-            }
+            Entry = ExpSplitPoolBlock(PoolDesc, ListHead, i);
 
             //
             // We have found an entry for this allocation, so set the pool type
@@ -2494,16 +3149,17 @@ NTAPI
 ExFreePoolWithTag(IN PVOID P,
                   IN ULONG TagToFree)
 {
-    PPOOL_HEADER Entry, NextEntry;
+    PPOOL_HEADER Entry;
     USHORT BlockSize;
     KIRQL OldIrql;
     POOL_TYPE PoolType;
     PPOOL_DESCRIPTOR PoolDesc;
-    ULONG Tag;
-    BOOLEAN Combined = FALSE;
+    ULONG Tag, Index;
     PFN_NUMBER PageCount, RealPageCount;
     PKPRCB Prcb = KeGetCurrentPrcb();
     PGENERAL_LOOKASIDE LookasideList;
+    PPOOL_MAGAZINE_CACHE Cache;
+    PPOOL_MAGAZINE Magazine;
     PEPROCESS Process;
 
     //
@@ -2758,158 +3414,66 @@ ExFreePoolWithTag(IN PVOID P,
             return;
         }
     }
-
-    //
-    // Get the pointer to the next entry
-    //
-    NextEntry = POOL_BLOCK(Entry, BlockSize);
-
-    //
-    // Update performance counters
-    //
-    InterlockedIncrement((PLONG)&PoolDesc->RunningDeAllocs);
-    InterlockedExchangeAddSizeT(&PoolDesc->TotalBytes, -BlockSize * POOL_BLOCK_SIZE);
-
-    //
-    // Acquire the pool lock
-    //
-    OldIrql = ExLockPool(PoolDesc);
-
-    //
-    // Check if the next allocation is at the end of the page
-    //
-    ExpCheckPoolBlocks(Entry);
-    if (PAGE_ALIGN(NextEntry) != NextEntry)
+    else
     {
         //
-        // We may be able to combine the block if it's free
+        // Blocks that were rounded up to a magazine class go back to the
+        // per-CPU magazine for that class
         //
-        if (NextEntry->PoolType == 0)
+        Index = ExpPoolMagazineIndex(BlockSize);
+        if (BlockSize == ExpPoolMagazineBlockSize(Index))
         {
-            //
-            // The next block is free, so we'll do a combine
-            //
-            Combined = TRUE;
-
-            //
-            // Make sure there's actual data in the block -- anything smaller
-            // than this means we only have the header, so there's no linked list
-            // for us to remove
-            //
-            if ((NextEntry->BlockSize != 1))
+            Cache = &ExpPoolMagazineCache[KeGetCurrentProcessorNumber()];
+            Magazine = &Cache->Magazines[PoolType][Index];
+            Magazine->TotalFrees++;
+            if (ExQueryDepthSList(&Magazine->ListHead) < ExpPoolMagazineDepth(BlockSize))
             {
-                //
-                // The block is at least big enough to have a linked list, so go
-                // ahead and remove it
-                //
-                ExpCheckPoolLinks(POOL_FREE_BLOCK(NextEntry));
-                ExpRemovePoolEntryList(POOL_FREE_BLOCK(NextEntry));
-                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Flink));
-                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Blink));
+                Magazine->FreeHits++;
+                Entry->PoolTag = TAG_POOL_MAGAZINE;
+                InterlockedPushEntrySList(&Magazine->ListHead, P);
+                return;
             }
 
             //
-            // Our entry is now combined with the next entry
+            // The magazine is full, so return half of it to the pool
+            // descriptor along with this block
             //
-            Entry->BlockSize = Entry->BlockSize + NextEntry->BlockSize;
+            ExpDrainPoolMagazine(PoolDesc,
+                                 Magazine,
+                                 BlockSize,
+                                 Entry,
+                                 ExpPoolMagazineDepth(BlockSize) / 2 + 1);
+            Cache->Drains[PoolType]++;
+            return;
         }
     }
 
     //
-    // Now check if there was a previous entry on the same page as us
+    // Update performance counters
     //
-    if (Entry->PreviousSize)
-    {
-        //
-        // Great, grab that entry and check if it's free
-        //
-        NextEntry = POOL_PREV_BLOCK(Entry);
-        if (NextEntry->PoolType == 0)
-        {
-            //
-            // It is, so we can do a combine
-            //
-            Combined = TRUE;
-
-            //
-            // Make sure there's actual data in the block -- anything smaller
-            // than this means we only have the header so there's no linked list
-            // for us to remove
-            //
-            if ((NextEntry->BlockSize != 1))
-            {
-                //
-                // The block is at least big enough to have a linked list, so go
-                // ahead and remove it
-                //
-                ExpCheckPoolLinks(POOL_FREE_BLOCK(NextEntry));
-                ExpRemovePoolEntryList(POOL_FREE_BLOCK(NextEntry));
-                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Flink));
-                ExpCheckPoolLinks(ExpDecodePoolLink((POOL_FREE_BLOCK(NextEntry))->Blink));
-            }
-
-            //
-            // Combine our original block (which might've already been combined
-            // with the next block), into the previous block
-            //
-            NextEntry->BlockSize = NextEntry->BlockSize + Entry->BlockSize;
-
-            //
-            // And now we'll work with the previous block instead
-            //
-            Entry = NextEntry;
-        }
-    }
+    InterlockedIncrement((PLONG)&PoolDesc->RunningDeAllocs);
+    InterlockedExchangeAddSizeT(&PoolDesc->TotalBytes, -BlockSize * POOL_BLOCK_SIZE);
 
     //
-    // By now, it may have been possible for our combined blocks to actually
-    // have made up a full page (if there were only 2-3 allocations on the
-    // page, they could've all been combined).
+    // Acquire the pool lock
     //
-    if ((PAGE_ALIGN(Entry) == Entry) &&
-        (PAGE_ALIGN(POOL_NEXT_BLOCK(Entry)) == POOL_NEXT_BLOCK(Entry)))
-    {
-        //
-        // In this case, release the pool lock, update the performance counter,
-        // and free the page
-        //
-        ExUnlockPool(PoolDesc, OldIrql);
-        InterlockedExchangeAdd((PLONG)&PoolDesc->TotalPages, -1);
-        MiFreePoolPages(Entry);
-        return;
-    }
+    OldIrql = ExLockPool(PoolDesc);
 
     //
-    // Otherwise, we now have a free block (or a combination of 2 or 3)
+    // Combine the block with its free neighbours and put it back on the free
+    // lists, unless this released the whole page
     //
-    Entry->PoolType = 0;
-    BlockSize = Entry->BlockSize;
-    ASSERT(BlockSize != 1);
+    Entry = ExpReleasePoolBlock(PoolDesc, Entry);
+    ExUnlockPool(PoolDesc, OldIrql);
 
     //
-    // Check if we actually did combine it with anyone
+    // If it did, update the performance counter and free the page
     //
-    if (Combined)
+    if (Entry)
     {
-        //
-        // Get the first combined block (either our original to begin with, or
-        // the one after the original, depending if we combined with the previous)
-        //
-        NextEntry = POOL_NEXT_BLOCK(Entry);
-
-        //
-        // As long as the next block isn't on a page boundary, have it point
-        // back to us
-        //
-        if (PAGE_ALIGN(NextEntry) != NextEntry) NextEntry->PreviousSize = BlockSize;
+        InterlockedExchangeAdd((PLONG)&PoolDesc->TotalPages, -1);
+        MiFreePoolPages(Entry);
     }
-
-    //
-    // Insert this new free block, and release the pool lock
-    //
-    ExpInsertPoolHeadList(&PoolDesc->ListHeads[BlockSize - 1], POOL_FREE_BLOCK(Entry));
-    ExpCheckPoolLinks(POOL_FREE_BLOCK(Entry));
-    ExUnlockPool(PoolDesc, OldIrql);
 }
 
 /*
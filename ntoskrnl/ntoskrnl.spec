@@ -676,6 +676,7 @@
 @ stdcall KeRemoveEntryDeviceQueue(ptr ptr)
 @ stdcall KeRemoveQueue(ptr long ptr)
 @ stdcall KeRemoveQueueDpc(ptr)
+@ stdcall -version=0x600+ KeRemoveQueueEx(ptr long long ptr ptr long)
 @ stdcall KeRemoveSystemServiceTable(long)
 @ stdcall KeResetEvent(ptr)
 @ stdcall -arch=i386 KeRestoreFloatingPointState(ptr)
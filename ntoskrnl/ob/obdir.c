@@ -19,8 +19,163 @@
 
 POBJECT_TYPE ObpDirectoryObjectType = NULL;
 
+/* Average chain length past which a directory gets more hash buckets */
+#define OBP_DIRECTORY_LOAD_FACTOR   4
+
+/* Bucket counts directories grow through once NUMBER_HASH_BUCKETS is full */
+static const ULONG ObpDirectoryHashSizes[] = { 151, 601, 2411, 9643, 38569 };
+
+/* Per-processor cache of recent directory lookups */
+#define OBP_LOOKUP_CACHE_SIZE       8
+
+typedef struct _OBP_LOOKUP_CACHE_ENTRY
+{
+    POBJECT_DIRECTORY Directory;
+    POBJECT_DIRECTORY_ENTRY Entry;
+    ULONG HashValue;
+    LONG Generation;
+} OBP_LOOKUP_CACHE_ENTRY, *POBP_LOOKUP_CACHE_ENTRY;
+
+OBP_LOOKUP_CACHE_ENTRY ObpLookupCache[MAXIMUM_PROCESSORS][OBP_LOOKUP_CACHE_SIZE];
+
 /* PRIVATE FUNCTIONS ******************************************************/
 
+static
+POBJECT_DIRECTORY_ENTRY*
+ObpGetDirectoryHashBuckets(IN POBJECT_DIRECTORY Directory,
+                           OUT PULONG BucketCount)
+{
+    /* Check if the directory has outgrown its built-in buckets */
+    if (Directory->ExtendedHashBuckets)
+    {
+        /* Use the larger array it was given */
+        *BucketCount = Directory->HashBucketCount;
+        return Directory->ExtendedHashBuckets;
+    }
+
+    /* Use the built-in buckets */
+    *BucketCount = NUMBER_HASH_BUCKETS;
+    return Directory->HashBuckets;
+}
+
+static
+BOOLEAN
+ObpGetCachedEntry(IN POBJECT_DIRECTORY Directory,
+                  IN ULONG HashValue,
+                  OUT POBJECT_DIRECTORY_ENTRY *Entry)
+{
+    POBP_LOOKUP_CACHE_ENTRY CacheEntry;
+    BOOLEAN Found = FALSE;
+    KIRQL OldIrql;
+
+    /* Stay on this processor while we look at its cache */
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+    CacheEntry = &ObpLookupCache[KeGetCurrentProcessorNumber()]
+                                [HashValue % OBP_LOOKUP_CACHE_SIZE];
+
+    /* The entry is only good if the directory didn't change since it was saved */
+    if ((CacheEntry->Directory == Directory) &&
+        (CacheEntry->HashValue == HashValue) &&
+        (CacheEntry->Generation == Directory->Generation))
+    {
+        *Entry = CacheEntry->Entry;
+        Found = TRUE;
+    }
+
+    KeLowerIrql(OldIrql);
+    return Found;
+}
+
+static
+VOID
+ObpSetCachedEntry(IN POBJECT_DIRECTORY Directory,
+                  IN ULONG HashValue,
+                  IN POBJECT_DIRECTORY_ENTRY Entry OPTIONAL)
+{
+    POBP_LOOKUP_CACHE_ENTRY CacheEntry;
+    KIRQL OldIrql;
+
+    /* Stay on this processor while we update its cache */
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+    CacheEntry = &ObpLookupCache[KeGetCurrentProcessorNumber()]
+                                [HashValue % OBP_LOOKUP_CACHE_SIZE];
+
+    /* Save the result, a NULL entry meaning nothing has this hash */
+    CacheEntry->Directory = Directory;
+    CacheEntry->Entry = Entry;
+    CacheEntry->HashValue = HashValue;
+    CacheEntry->Generation = Directory->Generation;
+
+    KeLowerIrql(OldIrql);
+}
+
+/*++
+* @name ObpExpandDirectory
+*
+*     The ObpExpandDirectory routine moves the entries of a directory to a
+*     larger hash bucket array, once its chains have become too long.
+*
+* @param Directory
+*        Directory to expand. Its lock must be held exclusively.
+*
+* @return None.
+*
+* @remarks Failing to allocate the new array is not an error, the directory
+*          just keeps its current buckets.
+*
+*--*/
+VOID
+NTAPI
+ObpExpandDirectory(IN POBJECT_DIRECTORY Directory)
+{
+    POBJECT_DIRECTORY_ENTRY *OldBuckets, *NewBuckets;
+    POBJECT_DIRECTORY_ENTRY Entry;
+    ULONG OldCount, NewCount = 0;
+    ULONG i;
+
+    /* Find the next size up */
+    OldBuckets = ObpGetDirectoryHashBuckets(Directory, &OldCount);
+    for (i = 0; i < RTL_NUMBER_OF(ObpDirectoryHashSizes); i++)
+    {
+        if (ObpDirectoryHashSizes[i] > OldCount)
+        {
+            NewCount = ObpDirectoryHashSizes[i];
+            break;
+        }
+    }
+
+    /* Bail out if we're already as large as we get */
+    if (!NewCount) return;
+
+    /* Allocate the new buckets */
+    NewBuckets = ExAllocatePoolWithTag(PagedPool,
+                                       NewCount * sizeof(POBJECT_DIRECTORY_ENTRY),
+                                       OB_DIR_TAG);
+    if (!NewBuckets) return;
+    RtlZeroMemory(NewBuckets, NewCount * sizeof(POBJECT_DIRECTORY_ENTRY));
+
+    /* Move every entry over, using the hash we saved when inserting it */
+    for (i = 0; i < OldCount; i++)
+    {
+        while ((Entry = OldBuckets[i]))
+        {
+            OldBuckets[i] = Entry->ChainLink;
+            Entry->ChainLink = NewBuckets[Entry->HashValue % NewCount];
+            NewBuckets[Entry->HashValue % NewCount] = Entry;
+        }
+    }
+
+    /* Free the old array, unless it was the built-in one */
+    if (Directory->ExtendedHashBuckets)
+    {
+        ExFreePoolWithTag(Directory->ExtendedHashBuckets, OB_DIR_TAG);
+    }
+
+    /* Switch to the new buckets */
+    Directory->ExtendedHashBuckets = NewBuckets;
+    Directory->HashBucketCount = NewCount;
+}
+
 /*++
 * @name ObpInsertEntryDirectory
 *
@@ -49,6 +204,8 @@ ObpInsertEntryDirectory(IN POBJECT_DIRECTORY Parent,
     POBJECT_DIRECTORY_ENTRY *AllocatedEntry;
     POBJECT_DIRECTORY_ENTRY NewEntry;
     POBJECT_HEADER_NAME_INFO HeaderNameInfo;
+    POBJECT_DIRECTORY_ENTRY *HashBuckets;
+    ULONG BucketCount;
 
     /* Make sure we have a name */
     ASSERT(ObjectHeader->NameInfoOffset != 0);
@@ -78,7 +235,8 @@ ObpInsertEntryDirectory(IN POBJECT_DIRECTORY Parent,
     HeaderNameInfo = OBJECT_HEADER_TO_NAME_INFO(ObjectHeader);
 
     /* Get the Allocated entry */
-    AllocatedEntry = &Parent->HashBuckets[Context->HashIndex];
+    HashBuckets = ObpGetDirectoryHashBuckets(Parent, &BucketCount);
+    AllocatedEntry = &HashBuckets[Context->HashValue % BucketCount];
 
     /* Set it */
     NewEntry->ChainLink = *AllocatedEntry;
@@ -89,6 +247,14 @@ ObpInsertEntryDirectory(IN POBJECT_DIRECTORY Parent,
 
     /* Associate the Directory */
     HeaderNameInfo->Directory = Parent;
+
+    /* Invalidate cached lookups, and grow the directory if it got crowded */
+    InterlockedIncrement(&Parent->Generation);
+    if (++Parent->EntryCount > (BucketCount * OBP_DIRECTORY_LOAD_FACTOR))
+    {
+        ObpExpandDirectory(Parent);
+    }
+
     return TRUE;
 }
 
@@ -171,6 +337,9 @@ ObpLookupEntryDirectory(IN POBJECT_DIRECTORY Directory,
     POBJECT_DIRECTORY_ENTRY *AllocatedEntry;
     POBJECT_DIRECTORY_ENTRY *LookupBucket;
     POBJECT_DIRECTORY_ENTRY CurrentEntry;
+    POBJECT_DIRECTORY_ENTRY *HashBuckets;
+    ULONG BucketCount;
+    BOOLEAN HashMatched;
     PVOID FoundObject = NULL;
     PWSTR Buffer;
     POBJECT_DIRECTORY ShadowDirectory;
@@ -208,31 +377,54 @@ ObpLookupEntryDirectory(IN POBJECT_DIRECTORY Directory,
         else HashValue += (CurrentChar - ('a'-'A'));
     }
 
-    /* Merge it with our number of hash buckets */
-    HashIndex = HashValue % 37;
-
     /* Save the result */
     Context->HashValue = HashValue;
-    Context->HashIndex = (USHORT)HashIndex;
 
 DoItAgain:
-    /* Get the root entry and set it as our lookup bucket */
-    AllocatedEntry = &Directory->HashBuckets[HashIndex];
-    LookupBucket = AllocatedEntry;
-
     /* Check if the directory is already locked */
     if (!Context->DirectoryLocked)
     {
         /* Lock it */
         ObpAcquireDirectoryLockShared(Directory, Context);
+
+        /* Check if this processor looked the name up recently */
+        if (ObpGetCachedEntry(Directory, HashValue, &CurrentEntry))
+        {
+            /* Nothing in the directory has this hash, so the name isn't there */
+            if (!CurrentEntry) goto NotFound;
+
+            /* Make sure it really is the same name and not a collision */
+            ObjectHeader = OBJECT_TO_OBJECT_HEADER(CurrentEntry->Object);
+            HeaderNameInfo = OBJECT_HEADER_TO_NAME_INFO(ObjectHeader);
+            if ((Name->Length == HeaderNameInfo->Name.Length) &&
+                (RtlEqualUnicodeString(Name, &HeaderNameInfo->Name, CaseInsensitive)))
+            {
+                /* Save the found object */
+                FoundObject = CurrentEntry->Object;
+                goto Quickie;
+            }
+        }
     }
 
+    /* Merge the hash with the directory's number of hash buckets */
+    HashBuckets = ObpGetDirectoryHashBuckets(Directory, &BucketCount);
+    HashIndex = HashValue % BucketCount;
+    Context->HashIndex = (USHORT)HashIndex;
+
+    /* Get the root entry and set it as our lookup bucket */
+    AllocatedEntry = &HashBuckets[HashIndex];
+    LookupBucket = AllocatedEntry;
+
     /* Start looping */
+    HashMatched = FALSE;
     while ((CurrentEntry = *AllocatedEntry))
     {
         /* Do the hashes match? */
         if (CurrentEntry->HashValue == HashValue)
         {
+            /* Remember we saw this hash, even if the name doesn't match */
+            HashMatched = TRUE;
+
             /* Make sure that it has a name */
             ObjectHeader = OBJECT_TO_OBJECT_HEADER(CurrentEntry->Object);
 
@@ -252,6 +444,12 @@ DoItAgain:
         AllocatedEntry = &CurrentEntry->ChainLink;
     }
 
+    /* Remember the result for the next lookup on this processor */
+    if ((!Context->DirectoryLocked) && ((CurrentEntry) || !(HashMatched)))
+    {
+        ObpSetCachedEntry(Directory, HashValue, CurrentEntry);
+    }
+
     /* Check if we still have an entry */
     if (CurrentEntry)
     {
@@ -279,6 +477,7 @@ DoItAgain:
     }
     else
     {
+NotFound:
         /* Check if the directory was locked */
         if (!Context->DirectoryLocked)
         {
@@ -346,18 +545,25 @@ ObpDeleteEntryDirectory(POBP_LOOKUP_CONTEXT Context)
     POBJECT_DIRECTORY Directory;
     POBJECT_DIRECTORY_ENTRY *AllocatedEntry;
     POBJECT_DIRECTORY_ENTRY CurrentEntry;
+    POBJECT_DIRECTORY_ENTRY *HashBuckets;
+    ULONG BucketCount;
 
     /* Get the Directory */
     Directory = Context->Directory;
     if (!Directory) return FALSE;
 
     /* Get the Entry */
-    AllocatedEntry = &Directory->HashBuckets[Context->HashIndex];
+    HashBuckets = ObpGetDirectoryHashBuckets(Directory, &BucketCount);
+    AllocatedEntry = &HashBuckets[Context->HashIndex];
     CurrentEntry = *AllocatedEntry;
 
     /* Unlink the Entry */
     *AllocatedEntry = CurrentEntry->ChainLink;
     CurrentEntry->ChainLink = NULL;
+    Directory->EntryCount--;
+
+    /* Invalidate cached lookups before the entry goes away */
+    InterlockedIncrement(&Directory->Generation);
 
     /* Free it */
     ExFreePoolWithTag(CurrentEntry, OB_DIR_TAG);
@@ -366,6 +572,51 @@ ObpDeleteEntryDirectory(POBP_LOOKUP_CONTEXT Context)
     return TRUE;
 }
 
+/*++
+* @name ObpDeleteDirectory
+*
+*     The ObpDeleteDirectory routine is the delete procedure of directory
+*     objects.
+*
+* @param ObjectBody
+*        Directory being deleted.
+*
+* @return None.
+*
+* @remarks Frees the hash buckets the directory grew, if any, and drops its
+*          cached lookups.
+*
+*--*/
+VOID
+NTAPI
+ObpDeleteDirectory(IN PVOID ObjectBody)
+{
+    POBJECT_DIRECTORY Directory = ObjectBody;
+    ULONG Processor, i;
+
+    /* Free the larger buckets if the directory had grown */
+    if (Directory->ExtendedHashBuckets)
+    {
+        ExFreePoolWithTag(Directory->ExtendedHashBuckets, OB_DIR_TAG);
+    }
+
+    /*
+     * A new directory can be created at the same address, with its generation
+     * back at zero, so forget everything cached about this one. Nobody can be
+     * looking it up anymore, and a slot that got reused in the meantime is
+     * left alone.
+     */
+    for (Processor = 0; Processor < (ULONG)KeNumberProcessors; Processor++)
+    {
+        for (i = 0; i < OBP_LOOKUP_CACHE_SIZE; i++)
+        {
+            InterlockedCompareExchangePointer((PVOID*)&ObpLookupCache[Processor][i].Directory,
+                                              NULL,
+                                              Directory);
+        }
+    }
+}
+
 /* FUNCTIONS **************************************************************/
 
 /*++
@@ -503,8 +754,8 @@ NtQueryDirectoryObject(IN HANDLE DirectoryHandle,
     POBJECT_DIRECTORY_INFORMATION DirectoryInfo;
     ULONG Length, TotalLength;
     ULONG Count, CurrentEntry;
-    ULONG Hash;
-    POBJECT_DIRECTORY_ENTRY Entry;
+    ULONG Hash, BucketCount;
+    POBJECT_DIRECTORY_ENTRY Entry, *HashBuckets;
     POBJECT_HEADER ObjectHeader;
     POBJECT_HEADER_NAME_INFO ObjectNameInfo;
     UNICODE_STRING Name;
@@ -578,10 +829,11 @@ NtQueryDirectoryObject(IN HANDLE DirectoryHandle,
 
     /* Set default status and start looping */
     Status = STATUS_NO_MORE_ENTRIES;
-    for (Hash = 0; Hash < 37; Hash++)
+    HashBuckets = ObpGetDirectoryHashBuckets(Directory, &BucketCount);
+    for (Hash = 0; Hash < BucketCount; Hash++)
     {
         /* Get this entry and loop all of them */
-        Entry = Directory->HashBuckets[Hash];
+        Entry = HashBuckets[Hash];
         while (Entry)
         {
             /* Check if we should process this entry */
@@ -581,6 +581,10 @@ typedef struct _EX_WORK_QUEUE
     ULONG WorkItemsProcessedLastPass;
     ULONG QueueDepthLastPass;
     EX_QUEUE_WORKER_INFO Info;
+#ifdef __REACTOS__
+    ULONG WorkItemsQueued;
+    ULONG AverageWaitTime;
+#endif
 } EX_WORK_QUEUE, *PEX_WORK_QUEUE;
 
 //
@@ -825,6 +829,9 @@ typedef struct _HANDLE_TABLE
         UCHAR StrictFIFO:1;
     };
 #endif
+#ifdef __REACTOS__
+    PVOID FreeHandleCache;
+#endif
 } HANDLE_TABLE, *PHANDLE_TABLE;
 
 #endif
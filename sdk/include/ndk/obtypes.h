@@ -422,6 +422,12 @@ typedef struct _OBJECT_DIRECTORY
     USHORT Reserved;
     USHORT SymbolicLinkUsageCount;
 #endif
+#ifdef __REACTOS__
+    struct _OBJECT_DIRECTORY_ENTRY **ExtendedHashBuckets;
+    ULONG HashBucketCount;
+    ULONG EntryCount;
+    LONG Generation;
+#endif
 } OBJECT_DIRECTORY, *POBJECT_DIRECTORY;
 
 //
@@ -0,0 +1,79 @@
+/*
+ * PROJECT:     ReactOS NT-Compatible Session Manager
+ * LICENSE:     BSD 2-Clause License (https://spdx.org/licenses/BSD-2-Clause)
+ * PURPOSE:     Layout of the KnownDlls prelinked import cache
+ */
+
+#ifndef _SM_PRELINK_
+#define _SM_PRELINK_
+
+#pragma once
+
+//
+// SMSS maps every KnownDll it created a section for, resolves the imports
+// between them once at boot, and publishes the resulting import address
+// tables as a read-only section in \KnownDlls. The loader then copies the
+// addresses straight into the IAT of a module mapped at the same base with
+// the same image, instead of looking up every name again in each process.
+//
+#define SM_PRELINK_SECTION_NAME     L"PrelinkCache"
+#define SM_PRELINK_SIGNATURE        'knLP'
+
+//
+// One entry for each import descriptor that could be fully resolved ahead of
+// time. Descriptors with forwarders or unresolved names are left out and get
+// snapped the normal way.
+//
+typedef struct _SM_PRELINK_IMPORT
+{
+    ULONG_PTR ExportBase;
+    ULONG ExportTimeDateStamp;
+    ULONG FirstThunk;
+    ULONG NumberOfThunks;
+    ULONG FirstAddress;
+} SM_PRELINK_IMPORT, *PSM_PRELINK_IMPORT;
+
+//
+// One entry for each importing module, sorted by image base
+//
+typedef struct _SM_PRELINK_MODULE
+{
+    ULONG_PTR ImageBase;
+    ULONG TimeDateStamp;
+    ULONG SizeOfImage;
+    ULONG FirstImport;
+    ULONG NumberOfImports;
+} SM_PRELINK_MODULE, *PSM_PRELINK_MODULE;
+
+//
+// The section starts with this header, followed by the module array, the
+// import array and finally the array of resolved addresses
+//
+typedef struct _SM_PRELINK_HEADER
+{
+    ULONG Signature;
+    ULONG Size;
+    ULONG NumberOfModules;
+    ULONG NumberOfImports;
+    ULONG NumberOfAddresses;
+    ULONG Reserved;
+} SM_PRELINK_HEADER, *PSM_PRELINK_HEADER;
+
+#define SM_PRELINK_MODULES(Header) \
+    ((PSM_PRELINK_MODULE)((PSM_PRELINK_HEADER)(Header) + 1))
+#define SM_PRELINK_IMPORTS(Header) \
+    ((PSM_PRELINK_IMPORT)(SM_PRELINK_MODULES(Header) + (Header)->NumberOfModules))
+#define SM_PRELINK_ADDRESSES(Header) \
+    ((PULONG_PTR)(SM_PRELINK_IMPORTS(Header) + (Header)->NumberOfImports))
+
+#define SM_PRELINK_SIZE(Modules, Imports, Addresses) \
+    (sizeof(SM_PRELINK_HEADER) + \
+     (Modules) * sizeof(SM_PRELINK_MODULE) + \
+     (Imports) * sizeof(SM_PRELINK_IMPORT) + \
+     (Addresses) * sizeof(ULONG_PTR))
+
+C_ASSERT(sizeof(SM_PRELINK_HEADER) % sizeof(ULONG_PTR) == 0);
+C_ASSERT(sizeof(SM_PRELINK_MODULE) % sizeof(ULONG_PTR) == 0);
+C_ASSERT(sizeof(SM_PRELINK_IMPORT) % sizeof(ULONG_PTR) == 0);
+
+#endif // _SM_PRELINK_
@@ -10,7 +10,7 @@
 #define _INCLUDED_IMM
 
 //#include <wmmintrin.h>
-#include <emmintrin.h>
+#include <smmintrin.h>
 
 #if defined(_MSC_VER) && !defined(__clang__)
 
@@ -80,6 +80,14 @@ void __cdecl _xrstors64(void const *, unsigned __int64);
 unsigned __int64 __cdecl _xgetbv(unsigned int);
 void __cdecl _xsetbv(unsigned int, unsigned __int64);
 
+extern __m128i __cdecl _mm_sha1msg1_epu32(__m128i, __m128i);
+extern __m128i __cdecl _mm_sha1msg2_epu32(__m128i, __m128i);
+extern __m128i __cdecl _mm_sha1nexte_epu32(__m128i, __m128i);
+extern __m128i __cdecl _mm_sha1rnds4_epu32(__m128i, __m128i, const int);
+extern __m128i __cdecl _mm_sha256msg1_epu32(__m128i, __m128i);
+extern __m128i __cdecl _mm_sha256msg2_epu32(__m128i, __m128i);
+extern __m128i __cdecl _mm_sha256rnds2_epu32(__m128i, __m128i, __m128i);
+
 
 #if defined(_MSC_VER) && !defined(__clang__)
 
@@ -122,6 +130,14 @@ void __cdecl _xsetbv(unsigned int, unsigned __int64);
 #pragma intrinsic(_xgetbv)
 #pragma intrinsic(_xsetbv)
 
+#pragma intrinsic(_mm_sha1msg1_epu32)
+#pragma intrinsic(_mm_sha1msg2_epu32)
+#pragma intrinsic(_mm_sha1nexte_epu32)
+#pragma intrinsic(_mm_sha1rnds4_epu32)
+#pragma intrinsic(_mm_sha256msg1_epu32)
+#pragma intrinsic(_mm_sha256msg2_epu32)
+#pragma intrinsic(_mm_sha256rnds2_epu32)
+
 #else /* _MSC_VER */
 
 #ifdef __clang__
@@ -351,6 +367,46 @@ __INTRIN_INLINE void _xsetbv(unsigned int __A, unsigned __int64 __V)
 }
 #endif // !__clang__
 
+#ifdef __clang__
+#define __ATTRIBUTE_SHA__ __attribute__((__target__("sha"),__min_vector_width__(128)))
+#else
+#define __ATTRIBUTE_SHA__ __attribute__((__target__("sha")))
+#endif
+#define __INTRIN_INLINE_SHA __INTRIN_INLINE __ATTRIBUTE_SHA__
+
+__INTRIN_INLINE_SHA __m128i _mm_sha1msg1_epu32(__m128i __X, __m128i __Y)
+{
+    return (__m128i)__builtin_ia32_sha1msg1((__v4si)__X, (__v4si)__Y);
+}
+
+__INTRIN_INLINE_SHA __m128i _mm_sha1msg2_epu32(__m128i __X, __m128i __Y)
+{
+    return (__m128i)__builtin_ia32_sha1msg2((__v4si)__X, (__v4si)__Y);
+}
+
+__INTRIN_INLINE_SHA __m128i _mm_sha1nexte_epu32(__m128i __X, __m128i __Y)
+{
+    return (__m128i)__builtin_ia32_sha1nexte((__v4si)__X, (__v4si)__Y);
+}
+
+#define _mm_sha1rnds4_epu32(X, Y, I) \
+    ((__m128i)__builtin_ia32_sha1rnds4((__v4si)(__m128i)(X), (__v4si)(__m128i)(Y), (int)(I)))
+
+__INTRIN_INLINE_SHA __m128i _mm_sha256msg1_epu32(__m128i __X, __m128i __Y)
+{
+    return (__m128i)__builtin_ia32_sha256msg1((__v4si)__X, (__v4si)__Y);
+}
+
+__INTRIN_INLINE_SHA __m128i _mm_sha256msg2_epu32(__m128i __X, __m128i __Y)
+{
+    return (__m128i)__builtin_ia32_sha256msg2((__v4si)__X, (__v4si)__Y);
+}
+
+__INTRIN_INLINE_SHA __m128i _mm_sha256rnds2_epu32(__m128i __X, __m128i __Y, __m128i __Z)
+{
+    return (__m128i)__builtin_ia32_sha256rnds2((__v4si)__X, (__v4si)__Y, (__v4si)__Z);
+}
+
 #endif /* _MSC_VER */
 
 #ifdef __cplusplus
@@ -0,0 +1,85 @@
+/*
+ * PROJECT:     ReactOS SDK
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Intrinsics for the SSE4.1 instruction set
+ */
+
+#pragma once
+
+#define _INCLUDED_SMM
+
+#include <tmmintrin.h>
+
+#if !defined(_MSC_VER) || defined(__clang__)
+#ifdef __clang__
+#define __ATTRIBUTE_SSE41__ __attribute__((__target__("sse4.1"),__min_vector_width__(128)))
+#else
+#define __ATTRIBUTE_SSE41__ __attribute__((__target__("sse4.1")))
+#endif
+#define __INTRIN_INLINE_SSE41 __INTRIN_INLINE __ATTRIBUTE_SSE41__
+#endif /* !_MSC_VER || __clang__ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern __m128i _mm_blend_epi16(__m128i a, __m128i b, int imm);
+extern __m128i _mm_blendv_epi8(__m128i a, __m128i b, __m128i mask);
+extern __m128i _mm_cmpeq_epi64(__m128i a, __m128i b);
+extern int _mm_extract_epi32(__m128i a, int imm);
+extern __m128i _mm_mullo_epi32(__m128i a, __m128i b);
+extern int _mm_testz_si128(__m128i a, __m128i b);
+#if defined(_M_X64)
+extern __int64 _mm_extract_epi64(__m128i a, int imm);
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+
+#pragma intrinsic(_mm_blend_epi16)
+#pragma intrinsic(_mm_blendv_epi8)
+#pragma intrinsic(_mm_cmpeq_epi64)
+#pragma intrinsic(_mm_extract_epi32)
+#pragma intrinsic(_mm_mullo_epi32)
+#pragma intrinsic(_mm_testz_si128)
+#if defined(_M_X64)
+#pragma intrinsic(_mm_extract_epi64)
+#endif
+
+#else /* _MSC_VER */
+
+#define _mm_blend_epi16(a, b, imm) \
+    ((__m128i)__builtin_ia32_pblendw128((__v8hi)(__m128i)(a), (__v8hi)(__m128i)(b), (int)(imm)))
+
+__INTRIN_INLINE_SSE41 __m128i _mm_blendv_epi8(__m128i a, __m128i b, __m128i mask)
+{
+    return (__m128i)__builtin_ia32_pblendvb128((__v16qi)a, (__v16qi)b, (__v16qi)mask);
+}
+
+__INTRIN_INLINE_SSE41 __m128i _mm_cmpeq_epi64(__m128i a, __m128i b)
+{
+    return (__m128i)((__v2di)a == (__v2di)b);
+}
+
+#define _mm_extract_epi32(a, imm) \
+    ((int)(((__v4si)(__m128i)(a))[(imm) & 3]))
+
+__INTRIN_INLINE_SSE41 __m128i _mm_mullo_epi32(__m128i a, __m128i b)
+{
+    return (__m128i)((__v4su)a * (__v4su)b);
+}
+
+__INTRIN_INLINE_SSE41 int _mm_testz_si128(__m128i a, __m128i b)
+{
+    return __builtin_ia32_ptestz128((__v2di)a, (__v2di)b);
+}
+
+#if defined(__x86_64__)
+#define _mm_extract_epi64(a, imm) \
+    ((long long)(((__v2di)(__m128i)(a))[(imm) & 1]))
+#endif // __x86_64__
+
+#endif /* _MSC_VER */
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,132 @@
+/*
+ * PROJECT:     ReactOS SDK
+ * LICENSE:     MIT (https://spdx.org/licenses/MIT)
+ * PURPOSE:     Intrinsics for the SSSE3 instruction set
+ */
+
+#pragma once
+
+#define _INCLUDED_TMM
+
+#include <pmmintrin.h>
+
+#if !defined(_MSC_VER) || defined(__clang__)
+#ifdef __clang__
+#define __ATTRIBUTE_SSSE3__ __attribute__((__target__("ssse3"),__min_vector_width__(128)))
+#else
+#define __ATTRIBUTE_SSSE3__ __attribute__((__target__("ssse3")))
+#endif
+#define __INTRIN_INLINE_SSSE3 __INTRIN_INLINE __ATTRIBUTE_SSSE3__
+#endif /* !_MSC_VER || __clang__ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Only the 128 bit forms, the MMX ones are of no use in 64 bit code */
+extern __m128i _mm_hadd_epi16(__m128i a, __m128i b);
+extern __m128i _mm_hadd_epi32(__m128i a, __m128i b);
+extern __m128i _mm_hadds_epi16(__m128i a, __m128i b);
+extern __m128i _mm_hsub_epi16(__m128i a, __m128i b);
+extern __m128i _mm_hsub_epi32(__m128i a, __m128i b);
+extern __m128i _mm_hsubs_epi16(__m128i a, __m128i b);
+extern __m128i _mm_maddubs_epi16(__m128i a, __m128i b);
+extern __m128i _mm_mulhrs_epi16(__m128i a, __m128i b);
+extern __m128i _mm_shuffle_epi8(__m128i a, __m128i b);
+extern __m128i _mm_sign_epi8(__m128i a, __m128i b);
+extern __m128i _mm_sign_epi16(__m128i a, __m128i b);
+extern __m128i _mm_sign_epi32(__m128i a, __m128i b);
+extern __m128i _mm_alignr_epi8(__m128i a, __m128i b, int n);
+
+#if defined(_MSC_VER) && !defined(__clang__)
+
+#pragma intrinsic(_mm_hadd_epi16)
+#pragma intrinsic(_mm_hadd_epi32)
+#pragma intrinsic(_mm_hadds_epi16)
+#pragma intrinsic(_mm_hsub_epi16)
+#pragma intrinsic(_mm_hsub_epi32)
+#pragma intrinsic(_mm_hsubs_epi16)
+#pragma intrinsic(_mm_maddubs_epi16)
+#pragma intrinsic(_mm_mulhrs_epi16)
+#pragma intrinsic(_mm_shuffle_epi8)
+#pragma intrinsic(_mm_sign_epi8)
+#pragma intrinsic(_mm_sign_epi16)
+#pragma intrinsic(_mm_sign_epi32)
+#pragma intrinsic(_mm_alignr_epi8)
+
+#else /* _MSC_VER */
+
+__INTRIN_INLINE_SSSE3 __m128i _mm_hadd_epi16(__m128i a, __m128i b)
+{
+    return (__m128i)__builtin_ia32_phaddw128((__v8hi)a, (__v8hi)b);
+}
+
+__INTRIN_INLINE_SSSE3 __m128i _mm_hadd_epi32(__m128i a, __m128i b)
+{
+    return (__m128i)__builtin_ia32_phaddd128((__v4si)a, (__v4si)b);
+}
+
+__INTRIN_INLINE_SSSE3 __m128i _mm_hadds_epi16(__m128i a, __m128i b)
+{
+    return (__m128i)__builtin_ia32_phaddsw128((__v8hi)a, (__v8hi)b);
+}
+
+__INTRIN_INLINE_SSSE3 __m128i _mm_hsub_epi16(__m128i a, __m128i b)
+{
+    return (__m128i)__builtin_ia32_phsubw128((__v8hi)a, (__v8hi)b);
+}
+
+__INTRIN_INLINE_SSSE3 __m128i _mm_hsub_epi32(__m128i a, __m128i b)
+{
+    return (__m128i)__builtin_ia32_phsubd128((__v4si)a, (__v4si)b);
+}
+
+__INTRIN_INLINE_SSSE3 __m128i _mm_hsubs_epi16(__m128i a, __m128i b)
+{
+    return (__m128i)__builtin_ia32_phsubsw128((__v8hi)a, (__v8hi)b);
+}
+
+__INTRIN_INLINE_SSSE3 __m128i _mm_maddubs_epi16(__m128i a, __m128i b)
+{
+    return (__m128i)__builtin_ia32_pmaddubsw128((__v16qi)a, (__v16qi)b);
+}
+
+__INTRIN_INLINE_SSSE3 __m128i _mm_mulhrs_epi16(__m128i a, __m128i b)
+{
+    return (__m128i)__builtin_ia32_pmulhrsw128((__v8hi)a, (__v8hi)b);
+}
+
+__INTRIN_INLINE_SSSE3 __m128i _mm_shuffle_epi8(__m128i a, __m128i b)
+{
+    return (__m128i)__builtin_ia32_pshufb128((__v16qi)a, (__v16qi)b);
+}
+
+__INTRIN_INLINE_SSSE3 __m128i _mm_sign_epi8(__m128i a, __m128i b)
+{
+    return (__m128i)__builtin_ia32_psignb128((__v16qi)a, (__v16qi)b);
+}
+
+__INTRIN_INLINE_SSSE3 __m128i _mm_sign_epi16(__m128i a, __m128i b)
+{
+    return (__m128i)__builtin_ia32_psignw128((__v8hi)a, (__v8hi)b);
+}
+
+__INTRIN_INLINE_SSSE3 __m128i _mm_sign_epi32(__m128i a, __m128i b)
+{
+    return (__m128i)__builtin_ia32_psignd128((__v4si)a, (__v4si)b);
+}
+
+/* GCC wants the shift count in bits, Clang in bytes */
+#ifdef __clang__
+#define _mm_alignr_epi8(a, b, n) \
+    ((__m128i)__builtin_ia32_palignr128((__v16qi)(__m128i)(a), (__v16qi)(__m128i)(b), (int)(n)))
+#else
+#define _mm_alignr_epi8(a, b, n) \
+    ((__m128i)__builtin_ia32_palignr128((__v2di)(__m128i)(a), (__v2di)(__m128i)(b), (int)(n) * 8))
+#endif
+
+#endif /* _MSC_VER */
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
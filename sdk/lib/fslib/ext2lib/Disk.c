@@ -1096,6 +1096,21 @@ Ext2WriteDisk( PEXT2_FILESYS  Ext2Sys,
         AlignedLength += ((ULONG)(Offset - Address.QuadPart) + SECTOR_SIZE - 1)
                          & (~(SECTOR_SIZE - 1));
 
+        /* Whole sectors, as for the zeroing and the group descriptors */
+        if ((AlignedLength == Length) && (Address.QuadPart == (LONGLONG)Offset))
+        {
+            Status = NtWriteFile( Ext2Sys->MediaHandle,
+                                  NULL,
+                                  NULL,
+                                  NULL,
+                                  &IoStatus,
+                                  Buffer,
+                                  Length,
+                                  &Address,
+                                  NULL );
+            goto errorout;
+        }
+
         NonPagedBuffer = RtlAllocateHeap(RtlGetProcessHeap(), 0, AlignedLength);
         if (!NonPagedBuffer)
         {
@@ -1155,7 +1170,8 @@ errorout:
  *     Success or Fail
  *
  * NOTES:
- *     N/A
+ *     A file that isn't a disk, such as an image, is used as a whole,
+ *     with 512 byte sectors.
  */
 
 NTSTATUS
@@ -1163,6 +1179,7 @@ Ext2GetMediaInfo( PEXT2_FILESYS Ext2Sys )
 {
     NTSTATUS Status;
     IO_STATUS_BLOCK IoSb;
+    FILE_STANDARD_INFORMATION FileInfo;
 
     Status = NtDeviceIoControlFile( Ext2Sys->MediaHandle,
                                 NULL, NULL, NULL, &IoSb,
@@ -1173,6 +1190,23 @@ Ext2GetMediaInfo( PEXT2_FILESYS Ext2Sys )
 
     if (!NT_SUCCESS(Status))
     {
+        Status = NtQueryInformationFile( Ext2Sys->MediaHandle,
+                                         &IoSb,
+                                         &FileInfo,
+                                         sizeof(FileInfo),
+                                         FileStandardInformation );
+        if (!NT_SUCCESS(Status))
+        {
+            goto errorout;
+        }
+
+        RtlZeroMemory(&(Ext2Sys->DiskGeometry), sizeof(DISK_GEOMETRY));
+        Ext2Sys->DiskGeometry.MediaType = FixedMedia;
+        Ext2Sys->DiskGeometry.BytesPerSector = 512;
+
+        RtlZeroMemory(&(Ext2Sys->PartInfo), sizeof(PARTITION_INFORMATION));
+        Ext2Sys->PartInfo.PartitionLength = FileInfo.EndOfFile;
+
         goto errorout;
     }
 
@@ -39,6 +39,48 @@ bool ext2_bg_has_super(PEXT2_SUPER_BLOCK pExt2Sb, int group_block)
     return false;
 }
 
+/*
+ * crc16 as used by the uninit_bg feature: polynomial 0x8005, bit reversed,
+ * no final inversion.
+ */
+static __u16 ext2_crc16(__u16 crc, const void *buffer, ULONG len)
+{
+    const unsigned char *cp = buffer;
+    int bit;
+
+    while (len--)
+    {
+        crc ^= *cp++;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xA001 : 0);
+    }
+
+    return crc;
+}
+
+__u16 ext2_group_desc_csum(PEXT2_FILESYS fs, ULONG group)
+{
+    PEXT2_GROUP_DESC desc = &fs->group_desc[group];
+    __u32 le_group = group;
+    __u16 crc;
+
+    crc = ext2_crc16(~0, fs->ext2_sb->s_uuid, sizeof(fs->ext2_sb->s_uuid));
+    crc = ext2_crc16(crc, &le_group, sizeof(le_group));
+    crc = ext2_crc16(crc, desc, FIELD_OFFSET(EXT2_GROUP_DESC, bg_checksum));
+
+    return crc;
+}
+
+void ext2_group_desc_csum_set(PEXT2_FILESYS fs)
+{
+    ULONG i;
+
+    if (!(fs->ext2_sb->s_feature_ro_compat & EXT4_FEATURE_RO_COMPAT_GDT_CSUM))
+        return;
+
+    for (i = 0; i < fs->group_desc_count; i++)
+        fs->group_desc[i].bg_checksum = ext2_group_desc_csum(fs, i);
+}
 
 bool ext2_allocate_group_desc(PEXT2_FILESYS Ext2Sys)
 {
@@ -223,9 +223,30 @@ bool write_inode_tables(PEXT2_FILESYS fs)
     bool    retval;
     ULONG   blk, num;
     int     i;
+    bool    lazy_itable_init;
+
+    lazy_itable_init = (fs->ext2_sb->s_feature_ro_compat &
+                        EXT4_FEATURE_RO_COMPAT_GDT_CSUM) != 0;
 
     for (i = 0; (ULONG)i < fs->group_desc_count; i++)
     {
+        /*
+         * With uninit_bg only the first group, which gets the root
+         * directory and lost+found, needs a zeroed inode table. The
+         * other ones are left as they are and flagged, the driver
+         * sets up each inode it hands out from them.
+         */
+        if (lazy_itable_init && i != 0)
+        {
+            fs->group_desc[i].bg_flags |= EXT4_BG_INODE_UNINIT;
+            fs->group_desc[i].bg_itable_unused =
+                (__u16)fs->ext2_sb->s_inodes_per_group;
+            continue;
+        }
+
+        if (lazy_itable_init)
+            fs->group_desc[i].bg_flags |= EXT4_BG_INODE_ZEROED;
+
         blk = fs->group_desc[i].bg_inode_table;
         num = fs->inode_blocks_per_group;
 
@@ -122,7 +122,7 @@ void set_fs_defaults(const char *fs_type,
 bool zero_blocks(PEXT2_FILESYS fs, ULONG blk, ULONG num,
                  ULONG *ret_blk, ULONG *ret_count)
 {
-    ULONG       j, count;
+    ULONG       j, count, stride;
     static unsigned char        *buf;
     bool        retval;
 
@@ -137,13 +137,16 @@ bool zero_blocks(PEXT2_FILESYS fs, ULONG blk, ULONG num,
         return true;
     }
 
-#define STRIDE_LENGTH 8
+/* 1MB per write, whatever the block size */
+#define ZERO_BUFFER_SIZE (1024 * 1024)
+
+    stride = ZERO_BUFFER_SIZE / fs->blocksize;
 
     /* Allocate the zeroizing buffer if necessary */
     if (!buf)
     {
         buf = (unsigned char *)
-            RtlAllocateHeap(RtlGetProcessHeap(), 0, fs->blocksize * STRIDE_LENGTH);
+            RtlAllocateHeap(RtlGetProcessHeap(), 0, ZERO_BUFFER_SIZE);
         if (!buf)
         {
             DPRINT1("Mke2fs: while allocating zeroizing buffer");
@@ -151,15 +154,17 @@ bool zero_blocks(PEXT2_FILESYS fs, ULONG blk, ULONG num,
                 *ret_blk = blk;
             return false;
         }
-        memset(buf, 0, fs->blocksize * STRIDE_LENGTH);
+        memset(buf, 0, ZERO_BUFFER_SIZE);
     }
 
-    /* OK, do the write loop */
-    for (j=0; j < num; j += STRIDE_LENGTH, blk += STRIDE_LENGTH)
+    /*
+     * OK, do the write loop. The first write stops at a stride boundary,
+     * so that the following ones are all aligned to the buffer size.
+     */
+    for (j=0; j < num; j += count, blk += count)
     {
-        if (num-j > STRIDE_LENGTH)
-            count = STRIDE_LENGTH;
-        else
+        count = stride - (blk % stride);
+        if (count > num - j)
             count = num - j;
 
         retval = NT_SUCCESS(Ext2WriteDisk(
@@ -524,7 +529,7 @@ void ext2_update_dynamic_rev(PEXT2_FILESYS fs)
 
 bool ext2_flush(PEXT2_FILESYS fs)
 {
-    ULONG       i,j,maxgroup,sgrp;
+    ULONG       i,maxgroup,sgrp;
     ULONG       group_block;
     bool        retval;
     char        *group_ptr;
@@ -538,6 +543,8 @@ bool ext2_flush(PEXT2_FILESYS fs)
 
     fs_state = fs->ext2_sb->s_state;
 
+    ext2_group_desc_csum_set(fs);
+
     RtlTimeToSecondsSince1970(&SysTime, &fs->ext2_sb->s_wtime);
     fs->ext2_sb->s_block_group_nr = 0;
 
@@ -604,20 +611,15 @@ bool ext2_flush(PEXT2_FILESYS fs)
 
         group_ptr = (char *) group_shadow;
 
-        for (j=0; j < fs->desc_blocks; j++)
-        {
-
-            retval = NT_SUCCESS(Ext2WriteDisk(
-                                fs,
-                                ((ULONGLONG)(group_block+1+j) * fs->blocksize),
-                                fs->blocksize, (PUCHAR) group_ptr));
-
-            if (!retval)
-            {
-                goto errout;
-            }
+        /* The descriptor blocks are contiguous, write them all at once */
+        retval = NT_SUCCESS(Ext2WriteDisk(
+                            fs,
+                            ((ULONGLONG)(group_block+1) * fs->blocksize),
+                            fs->desc_blocks * fs->blocksize, (PUCHAR) group_ptr));
 
-            group_ptr += fs->blocksize;
+        if (!retval)
+        {
+            goto errout;
         }
 
     next_group:
@@ -875,6 +877,15 @@ Ext2Format(
 
     Status = STATUS_UNSUCCESSFUL;
 
+    /*
+     * Features need the dynamic revision. On big volumes, sparse_super
+     * keeps the superblock and descriptor backups to a few groups, and
+     * uninit_bg lets us zero the inode table of the first group only.
+     */
+    Ext2Sb.s_rev_level = EXT2_DYNAMIC_REV;
+    Ext2Sb.s_feature_ro_compat |= EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER |
+                                  EXT4_FEATURE_RO_COMPAT_GDT_CSUM;
+
     // Initialize
     if (!ext2_initialize_sb(&FileSys))
     {
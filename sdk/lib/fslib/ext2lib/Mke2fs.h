@@ -294,6 +294,8 @@ Ext2DisMountVolume( PEXT2_FILESYS Ext2Sys );
 bool ext2_allocate_group_desc(PEXT2_FILESYS pExt2Sys);
 void ext2_free_group_desc(PEXT2_FILESYS pExt2Sys);
 bool ext2_bg_has_super(PEXT2_SUPER_BLOCK pExt2Sb, int group_block);
+__u16 ext2_group_desc_csum(PEXT2_FILESYS fs, ULONG group);
+void ext2_group_desc_csum_set(PEXT2_FILESYS fs);
 
 /*
  *  Inode.c
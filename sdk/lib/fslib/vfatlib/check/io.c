@@ -47,6 +47,22 @@ typedef struct _change {
 } CHANGE;
 
 static CHANGE *changes, *last;
+
+/* Reads go through a small direct-mapped cache of large aligned chunks, so
+   that walking a directory one entry at a time does not cost one device read
+   per entry. Only what is on the disk is cached; queued changes are applied
+   on top of it by fs_read(). */
+#define CACHE_CHUNK_SIZE (64 * 1024)
+#define CACHE_CHUNKS 64
+
+typedef struct _cache_chunk {
+    off_t pos;
+    int size;			/* 0 if the chunk holds nothing */
+    char *data;
+} CACHE_CHUNK;
+
+static CACHE_CHUNK cache[CACHE_CHUNKS];
+
 #ifndef __REACTOS__
 static int fd, did_change = 0;
 #else
@@ -85,8 +101,8 @@ static int WIN32read(HANDLE FileHandle, void *buf, unsigned int len)
         return -1;
     }
 
-    CurrentOffset.QuadPart += len;
-    return (int)len;
+    CurrentOffset.QuadPart += IoStatusBlock.Information;
+    return (int)IoStatusBlock.Information;
 }
 #define read	WIN32read
 
@@ -270,31 +286,76 @@ void fs_dismount(void)
 }
 #endif
 
-/**
- * Read data from the partition, accounting for any pending updates that are
- * queued for writing.
- *
- * @param[in]   pos     Byte offset, relative to the beginning of the partition,
- *                      at which to read
- * @param[in]   size    Number of bytes to read
- * @param[out]  data    Where to put the data read
- */
-void fs_read(off_t pos, int size, void *data)
+static CACHE_CHUNK *cache_get(off_t pos)
+{
+    CACHE_CHUNK *chunk = &cache[(pos / CACHE_CHUNK_SIZE) % CACHE_CHUNKS];
+    int got;
+
+    if (chunk->data && chunk->size && chunk->pos == pos)
+	return chunk;
+
+    if (!chunk->data)
+	chunk->data = alloc(CACHE_CHUNK_SIZE);
+
+    chunk->pos = pos;
+    chunk->size = 0;
+    if (lseek(fd, pos, 0) != pos)
+	return NULL;
+    if ((got = read(fd, chunk->data, CACHE_CHUNK_SIZE)) <= 0)
+	return NULL;
+    chunk->size = got;
+    return chunk;
+}
+
+/* Keep the cached copy of whatever was just written to the disk up to date */
+static void cache_update(off_t pos, int size, void *data)
+{
+    CACHE_CHUNK *chunk;
+    off_t chunk_pos, start, end;
+
+    for (chunk_pos = pos - pos % CACHE_CHUNK_SIZE; chunk_pos < pos + size;
+	 chunk_pos += CACHE_CHUNK_SIZE) {
+	chunk = &cache[(chunk_pos / CACHE_CHUNK_SIZE) % CACHE_CHUNKS];
+	if (!chunk->data || !chunk->size || chunk->pos != chunk_pos)
+	    continue;
+	start = pos > chunk_pos ? pos : chunk_pos;
+	end = pos + size;
+	if (end > chunk_pos + chunk->size)
+	    end = chunk_pos + chunk->size;
+	if (start < end)
+	    memcpy(chunk->data + (start - chunk_pos),
+		   (char *)data + (start - pos), (size_t)(end - start));
+    }
+}
+
+static void cache_free(void)
+{
+    int i;
+
+    for (i = 0; i < CACHE_CHUNKS; i++) {
+	if (cache[i].data)
+	    free(cache[i].data);
+	cache[i].data = NULL;
+	cache[i].size = 0;
+    }
+}
+
+/* Reads straight from the device, without the cache or the queued changes */
+static void fs_read_direct(off_t pos, int size, void *data)
 {
-    CHANGE *walk;
     int got;
 
 #ifdef __REACTOS__
-	const size_t readsize_aligned = (size % 512) ? (size + (512 - (size % 512))) : size;
  	const off_t seekpos_aligned = pos - (pos % 512);
+	const size_t readsize_aligned = ((size_t)(pos - seekpos_aligned) + size + 511) & ~511;
  	const size_t seek_delta = (size_t)(pos - seekpos_aligned);
 #if DBG
-	const size_t readsize = (size_t)(pos - seekpos_aligned) + readsize_aligned;
+	const size_t readsize = readsize_aligned;
 #endif
 	char* tmpBuf = alloc(readsize_aligned);
     if (lseek(fd, seekpos_aligned, 0) != seekpos_aligned) pdie("Seek to %lld",pos);
     if ((got = read(fd, tmpBuf, readsize_aligned)) < 0) pdie("Read %d bytes at %lld",size,pos);
-	assert(got >= size);
+	assert(got >= (int)(seek_delta + size));
 	got = size;
 	assert(seek_delta + size <= readsize);
 	memcpy(data, tmpBuf+seek_delta, size);
@@ -307,6 +368,43 @@ void fs_read(off_t pos, int size, void *data)
 #endif
     if (got != size)
 	die("Got %d bytes instead of %d at %lld", got, size, (long long)pos);
+}
+
+/**
+ * Read data from the partition, accounting for any pending updates that are
+ * queued for writing.
+ *
+ * @param[in]   pos     Byte offset, relative to the beginning of the partition,
+ *                      at which to read
+ * @param[in]   size    Number of bytes to read
+ * @param[out]  data    Where to put the data read
+ */
+void fs_read(off_t pos, int size, void *data)
+{
+    CHANGE *walk;
+    CACHE_CHUNK *chunk;
+    off_t chunk_pos;
+    int done, len;
+
+    /* Big reads, like the FATs, gain nothing from going through the cache */
+    if (size > CACHE_CHUNK_SIZE) {
+	fs_read_direct(pos, size, data);
+    } else {
+	for (done = 0; done < size; done += len) {
+	    chunk_pos = (pos + done) - (pos + done) % CACHE_CHUNK_SIZE;
+	    len = (int)(chunk_pos + CACHE_CHUNK_SIZE - (pos + done));
+	    if (len > size - done)
+		len = size - done;
+	    chunk = cache_get(chunk_pos);
+	    if (!chunk || (pos + done) - chunk_pos + len > chunk->size) {
+		/* Past what the device gave us: let the direct read report it */
+		fs_read_direct(pos + done, size - done, (char *)data + done);
+		break;
+	    }
+	    memcpy((char *)data + done, chunk->data + ((pos + done) - chunk_pos), len);
+	}
+    }
+
     for (walk = changes; walk; walk = walk->next) {
 	if (walk->pos < pos + size && walk->pos + walk->size > pos) {
 	    if (walk->pos < pos)
@@ -363,6 +461,7 @@ void fs_write(off_t pos, int size, void *data)
             scratch = data;
 
         did_change = 1;
+        cache_update(pos, size, data);
         if (lseek(fd, seekpos_aligned, 0) != seekpos_aligned) pdie("Seek to %lld",seekpos_aligned);
 
         if (use_read)
@@ -386,6 +485,7 @@ void fs_write(off_t pos, int size, void *data)
 #else
     if (write_immed) {
 	did_change = 1;
+	cache_update(pos, size, data);
 	if (lseek(fd, pos, 0) != pos)
 	    pdie("Seek to %lld", (long long)pos);
 	if ((did = write(fd, data, size)) == size)
@@ -436,6 +536,7 @@ static void fs_flush(void)
     while (changes) {
 	this = changes;
 	changes = changes->next;
+	cache_update(this->pos, this->size, this->data);
 	if (lseek(fd, this->pos, 0) != this->pos)
 	    fprintf(stderr,
 		    "Seek to %lld failed: %s\n  Did not write %d bytes.\n",
@@ -467,6 +568,7 @@ int fs_close(int write)
 	    free(changes);
 	    changes = next;
 	}
+    cache_free();
     if (close(fd) < 0)
 	pdie("closing filesystem");
     return changed || did_change;
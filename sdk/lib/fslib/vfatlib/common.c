@@ -64,51 +64,30 @@ FatWipeSectors(
     PUCHAR Buffer;
     LARGE_INTEGER FileOffset;
     ULONGLONG Sector;
-    ULONG Length;
-    NTSTATUS Status;
+    ULONG ChunkSectors;
+    ULONG Sectors;
+    NTSTATUS Status = STATUS_SUCCESS;
 
-    Length = SectorsPerCluster * BytesPerSector;
+    /* Wipe as many whole clusters at once as fit in a write */
+    ChunkSectors = (FAT_ZERO_WRITE_SIZE / BytesPerSector / SectorsPerCluster) * SectorsPerCluster;
+    if (ChunkSectors == 0)
+        ChunkSectors = SectorsPerCluster;
 
-    /* Allocate buffer for the cluster */
+    /* Allocate the zeroed buffer */
     Buffer = (PUCHAR)RtlAllocateHeap(RtlGetProcessHeap(),
                                      HEAP_ZERO_MEMORY,
-                                     Length);
+                                     ChunkSectors * BytesPerSector);
     if (Buffer == NULL)
         return STATUS_INSUFFICIENT_RESOURCES;
 
-    /* Wipe all clusters */
-    Sector = 0;
-    while (Sector + SectorsPerCluster < TotalSectors)
+    /* Wipe all clusters, and the trailing space behind the last one */
+    for (Sector = 0; Sector < TotalSectors; Sector += Sectors)
     {
-        FileOffset.QuadPart = Sector * BytesPerSector;
-
-        Status = NtWriteFile(FileHandle,
-                             NULL,
-                             NULL,
-                             NULL,
-                             &IoStatusBlock,
-                             Buffer,
-                             Length,
-                             &FileOffset,
-                             NULL);
-        if (!NT_SUCCESS(Status))
-        {
-            DPRINT("NtWriteFile() failed (Status %lx)\n", Status);
-            goto done;
-        }
-
-        UpdateProgress(Context, SectorsPerCluster);
-
-        Sector += SectorsPerCluster;
-    }
-
-    /* Wipe the trailing space behind the last cluster */
-    if (Sector < TotalSectors)
-    {
-        DPRINT("Remaining sectors %lu\n", TotalSectors - Sector);
+        Sectors = ChunkSectors;
+        if (TotalSectors - Sector < Sectors)
+            Sectors = (ULONG)(TotalSectors - Sector);
 
         FileOffset.QuadPart = Sector * BytesPerSector;
-        Length = (TotalSectors - Sector) * BytesPerSector;
 
         Status = NtWriteFile(FileHandle,
                              NULL,
@@ -116,7 +95,7 @@ FatWipeSectors(
                              NULL,
                              &IoStatusBlock,
                              Buffer,
-                             Length,
+                             Sectors * BytesPerSector,
                              &FileOffset,
                              NULL);
         if (!NT_SUCCESS(Status))
@@ -125,7 +104,7 @@ FatWipeSectors(
             goto done;
         }
 
-        UpdateProgress(Context, TotalSectors - Sector);
+        UpdateProgress(Context, Sectors);
     }
 
 done:
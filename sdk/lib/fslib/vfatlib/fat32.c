@@ -226,21 +226,23 @@ Fat32WriteFAT(IN HANDLE FileHandle,
               IN OUT PFORMAT_CONTEXT Context)
 {
     IO_STATUS_BLOCK IoStatusBlock;
-    NTSTATUS Status;
+    NTSTATUS Status = STATUS_SUCCESS;
     PUCHAR Buffer;
     LARGE_INTEGER FileOffset;
+    ULONGLONG FirstSector;
+    ULONG ChunkSectors;
     ULONG i;
     ULONG Sectors;
 
     /* Allocate buffer */
     Buffer = (PUCHAR)RtlAllocateHeap(RtlGetProcessHeap(),
                                      0,
-                                     64 * 1024);
+                                     FAT_ZERO_WRITE_SIZE);
     if (Buffer == NULL)
         return STATUS_INSUFFICIENT_RESOURCES;
 
     /* Zero the buffer */
-    RtlZeroMemory(Buffer, 64 * 1024);
+    RtlZeroMemory(Buffer, FAT_ZERO_WRITE_SIZE);
 
     /* FAT cluster 0 */
     Buffer[0] = 0xf8; /* Media type */
@@ -260,36 +262,19 @@ Fat32WriteFAT(IN HANDLE FileHandle,
     Buffer[10] = 0xff;
     Buffer[11] = 0x0f;
 
-    /* Write first sector of the FAT */
-    FileOffset.QuadPart = (SectorOffset + BootSector->ReservedSectors) * BootSector->BytesPerSector;
-    Status = NtWriteFile(FileHandle,
-                         NULL,
-                         NULL,
-                         NULL,
-                         &IoStatusBlock,
-                         Buffer,
-                         BootSector->BytesPerSector,
-                         &FileOffset,
-                         NULL);
-    if (!NT_SUCCESS(Status))
-    {
-        DPRINT("NtWriteFile() failed (Status %lx)\n", Status);
-        goto done;
-    }
-
-    UpdateProgress(Context, 1);
-
-    /* Zero the begin of the buffer */
-    RtlZeroMemory(Buffer, 12);
-
-    /* Zero the rest of the FAT */
-    Sectors = 64 * 1024 / BootSector->BytesPerSector;
-    for (i = 1; i < BootSector->FATSectors32; i += Sectors)
+    /*
+     * Write the whole FAT, the first sector with the entries above included.
+     * Only the first write may be short, the following ones start on a
+     * multiple of the buffer size on the volume.
+     */
+    ChunkSectors = FAT_ZERO_WRITE_SIZE / BootSector->BytesPerSector;
+    for (i = 0; i < BootSector->FATSectors32; i += Sectors)
     {
-        /* Zero some sectors of the FAT */
-        FileOffset.QuadPart = (SectorOffset + BootSector->ReservedSectors + i) * BootSector->BytesPerSector;
+        FirstSector = (ULONGLONG)SectorOffset + BootSector->ReservedSectors + i;
+        FileOffset.QuadPart = FirstSector * BootSector->BytesPerSector;
 
-        if ((BootSector->FATSectors32 - i) <= Sectors)
+        Sectors = ChunkSectors - (ULONG)(FirstSector % ChunkSectors);
+        if ((BootSector->FATSectors32 - i) < Sectors)
         {
             Sectors = BootSector->FATSectors32 - i;
         }
@@ -309,6 +294,10 @@ Fat32WriteFAT(IN HANDLE FileHandle,
             goto done;
         }
 
+        /* Zero the begin of the buffer */
+        if (i == 0)
+            RtlZeroMemory(Buffer, 12);
+
         UpdateProgress(Context, Sectors);
     }
 
@@ -100,6 +100,9 @@ typedef struct _FAT32_FSINFO
 #define FSINFO_SECTOR_END_SIGNATURE     0xAA550000
 #define FSINFO_SIGNATURE                0x61417272  // 'rrAa'
 
+/* Size of the writes used to zero the FATs and to wipe the volume */
+#define FAT_ZERO_WRITE_SIZE             (1024 * 1024)
+
 typedef struct _FORMAT_CONTEXT
 {
     PFMIFSCALLBACK Callback;
@@ -241,6 +241,64 @@ extern HANDLE TimerThreadHandle;
 NTSTATUS
 RtlpInitializeTimerThread(VOID);
 
+/* timerwheel.c */
+#define TIMER_WHEEL_BITS        6
+#define TIMER_WHEEL_SLOTS       (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS      7
+#define TIMER_WHEEL_NEVER       (~(ULONGLONG)0)
+
+typedef struct _RTLP_TIMER_WHEEL_ENTRY
+{
+    LIST_ENTRY Link;
+    ULONGLONG Expire;
+    LONG Slot;
+} RTLP_TIMER_WHEEL_ENTRY, *PRTLP_TIMER_WHEEL_ENTRY;
+
+typedef struct _RTLP_TIMER_WHEEL
+{
+    ULONGLONG Time;
+    LIST_ENTRY Expired;
+    LIST_ENTRY Far;
+    ULONGLONG Pending[TIMER_WHEEL_LEVELS];
+    LIST_ENTRY Slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} RTLP_TIMER_WHEEL, *PRTLP_TIMER_WHEEL;
+
+VOID
+NTAPI
+RtlpInitializeTimerWheel(
+    _Out_ PRTLP_TIMER_WHEEL Wheel,
+    _In_ ULONGLONG Time);
+
+VOID
+NTAPI
+RtlpInsertTimerWheel(
+    _Inout_ PRTLP_TIMER_WHEEL Wheel,
+    _Out_ PRTLP_TIMER_WHEEL_ENTRY Entry,
+    _In_ ULONGLONG Expire);
+
+VOID
+NTAPI
+RtlpRemoveTimerWheel(
+    _Inout_ PRTLP_TIMER_WHEEL Wheel,
+    _Inout_ PRTLP_TIMER_WHEEL_ENTRY Entry);
+
+ULONGLONG
+NTAPI
+RtlpGetNextTimerWheelTime(
+    _In_ PRTLP_TIMER_WHEEL Wheel);
+
+PRTLP_TIMER_WHEEL_ENTRY
+NTAPI
+RtlpAdvanceTimerWheel(
+    _Inout_ PRTLP_TIMER_WHEEL Wheel,
+    _In_ ULONGLONG Now);
+
+ULONGLONG
+NTAPI
+RtlpCoalesceTimerWheelTime(
+    _In_ ULONGLONG Expire,
+    _In_ ULONG Tolerance);
+
 #endif /* !_BLDR_ */
 
 /* bitmap64.c */
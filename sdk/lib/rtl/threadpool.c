@@ -217,7 +217,7 @@ struct threadpool_object
             /* information about the timer, locked via timerqueue.cs */
             BOOL            timer_initialized;
             BOOL            timer_pending;
-            struct list     timer_entry;
+            RTLP_TIMER_WHEEL_ENTRY timer_entry;
             BOOL            timer_set;
             ULONGLONG       timeout;
             LONG            period;
@@ -285,7 +285,7 @@ static struct
     CRITICAL_SECTION        cs;
     LONG                    objcount;
     BOOL                    thread_running;
-    struct list             pending_timers;
+    RTLP_TIMER_WHEEL        pending_timers; /* in milliseconds of system time */
     RTL_CONDITION_VARIABLE  update_event;
 }
 timerqueue =
@@ -297,7 +297,7 @@ timerqueue =
 #endif
     0,                                          /* objcount */
     FALSE,                                      /* thread_running */
-    LIST_INIT( timerqueue.pending_timers ),     /* pending_timers */
+    { 0 },                                      /* pending_timers */
 #if __REACTOS__
     0,
 #else
@@ -536,6 +536,40 @@ NTSTATUS WINAPI RtlQueueWorkItem( PRTL_WORK_ITEM_ROUTINE function, PVOID context
 /***********************************************************************
  * iocp_poller - get completion events and run callbacks
  */
+#ifdef __REACTOS__
+static DWORD CALLBACK iocp_poller(LPVOID Arg)
+{
+    HANDLE cport = Arg;
+    FILE_IO_COMPLETION_INFORMATION info[16];
+
+    while( TRUE )
+    {
+        ULONG count, i;
+        /* Drain whatever is ready in one call instead of one entry per syscall */
+        NTSTATUS res = NtRemoveIoCompletionEx( cport, info, ARRAY_SIZE(info), &count, NULL, FALSE );
+        if (res)
+        {
+            ERR("NtRemoveIoCompletionEx failed: 0x%lx\n", res);
+            continue;
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            PRTL_OVERLAPPED_COMPLETION_ROUTINE callback = info[i].KeyContext;
+            DWORD transferred = 0;
+            DWORD err = 0;
+
+            if (info[i].IoStatusBlock.Status == STATUS_SUCCESS)
+                transferred = info[i].IoStatusBlock.Information;
+            else
+                err = RtlNtStatusToDosError(info[i].IoStatusBlock.Status);
+
+            callback( err, transferred, info[i].ApcContext );
+        }
+    }
+    return 0;
+}
+#else
 static DWORD CALLBACK iocp_poller(LPVOID Arg)
 {
     HANDLE cport = Arg;
@@ -545,11 +579,7 @@ static DWORD CALLBACK iocp_poller(LPVOID Arg)
         PRTL_OVERLAPPED_COMPLETION_ROUTINE callback;
         LPVOID overlapped;
         IO_STATUS_BLOCK iosb;
-#ifdef __REACTOS__
-        NTSTATUS res = NtRemoveIoCompletion( cport, (PVOID)&callback, (PVOID)&overlapped, &iosb, NULL );
-#else
         NTSTATUS res = NtRemoveIoCompletion( cport, (PULONG_PTR)&callback, (PULONG_PTR)&overlapped, &iosb, NULL );
-#endif
         if (res)
         {
             ERR("NtRemoveIoCompletion failed: 0x%lx\n", res);
@@ -569,6 +599,7 @@ static DWORD CALLBACK iocp_poller(LPVOID Arg)
     }
     return 0;
 }
+#endif /* __REACTOS__ */
 
 /***********************************************************************
  *              RtlSetIoCompletionCallback  (NTDLL.@)
@@ -1135,6 +1166,28 @@ NTSTATUS WINAPI RtlDeleteTimer(HANDLE TimerQueue, HANDLE Timer,
     return status;
 }
 #endif
+/***********************************************************************
+ *           tp_timerqueue_insert    (internal)
+ *
+ * Puts a timer on the timer wheel. Timers fire on the first millisecond
+ * at or after their timeout, moved later within their window length to
+ * a time shared with other timers where possible. Returns whether the
+ * timer thread has to wake up earlier for it.
+ */
+static BOOL tp_timerqueue_insert( struct threadpool_object *timer )
+{
+    ULONGLONG expire, next;
+
+    /* We MUST hold the timerqueue cs while calling this function. */
+    expire = (timer->u.timer.timeout + 9999) / 10000;
+    expire = RtlpCoalesceTimerWheelTime( expire, timer->u.timer.window_length );
+
+    next = RtlpGetNextTimerWheelTime( &timerqueue.pending_timers );
+    RtlpInsertTimerWheel( &timerqueue.pending_timers, &timer->u.timer.timer_entry, expire );
+    timer->u.timer.timer_pending = TRUE;
+    return expire < next;
+}
+
 /***********************************************************************
  *           timerqueue_thread_proc    (internal)
  */
@@ -1144,10 +1197,9 @@ ULONG NTAPI timerqueue_thread_proc(PVOID param )
 static void CALLBACK timerqueue_thread_proc( void *param )
 #endif
 {
-    ULONGLONG timeout_lower, timeout_upper, new_timeout;
-    struct threadpool_object *other_timer;
+    PRTLP_TIMER_WHEEL_ENTRY entry;
     LARGE_INTEGER now, timeout;
-    struct list *ptr;
+    ULONGLONG next;
 
     TRACE( "starting timer queue thread\n" );
     set_thread_name(L"wine_threadpool_timerqueue");
@@ -1157,17 +1209,15 @@ static void CALLBACK timerqueue_thread_proc( void *param )
     {
         NtQuerySystemTime( &now );
 
-        /* Check for expired timers. */
-        while ((ptr = list_head( &timerqueue.pending_timers )))
+        /* Check for expired timers, and submit all of them in one go. */
+        while ((entry = RtlpAdvanceTimerWheel( &timerqueue.pending_timers, now.QuadPart / 10000 )))
         {
-            struct threadpool_object *timer = LIST_ENTRY( ptr, struct threadpool_object, u.timer.timer_entry );
+            struct threadpool_object *timer = CONTAINING_RECORD( entry, struct threadpool_object, u.timer.timer_entry );
             assert( timer->type == TP_OBJECT_TYPE_TIMER );
             assert( timer->u.timer.timer_pending );
-            if (timer->u.timer.timeout > now.QuadPart)
-                break;
 
             /* Queue a new callback in one of the worker threads. */
-            list_remove( &timer->u.timer.timer_entry );
+            RtlpRemoveTimerWheel( &timerqueue.pending_timers, entry );
             timer->u.timer.timer_pending = FALSE;
             tp_object_submit( timer, FALSE );
 
@@ -1178,38 +1228,16 @@ static void CALLBACK timerqueue_thread_proc( void *param )
                 if (timer->u.timer.timeout <= now.QuadPart)
                     timer->u.timer.timeout = now.QuadPart + 1;
 
-                LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
-                                     struct threadpool_object, u.timer.timer_entry )
-                {
-                    assert( other_timer->type == TP_OBJECT_TYPE_TIMER );
-                    if (timer->u.timer.timeout < other_timer->u.timer.timeout)
-                        break;
-                }
-                list_add_before( &other_timer->u.timer.timer_entry, &timer->u.timer.timer_entry );
-                timer->u.timer.timer_pending = TRUE;
+                tp_timerqueue_insert( timer );
             }
         }
 
-        timeout_lower = timeout_upper = MAXLONGLONG;
-
-        /* Determine next timeout and use the window length to optimize wakeup times. */
-        LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
-                             struct threadpool_object, u.timer.timer_entry )
-        {
-            assert( other_timer->type == TP_OBJECT_TYPE_TIMER );
-            if (other_timer->u.timer.timeout >= timeout_upper)
-                break;
-
-            timeout_lower = other_timer->u.timer.timeout;
-            new_timeout   = timeout_lower + (ULONGLONG)other_timer->u.timer.window_length * 10000;
-            if (new_timeout < timeout_upper)
-                timeout_upper = new_timeout;
-        }
-
-        /* Wait for timer update events or until the next timer expires. */
+        /* Wait for timer update events or until the next timer expires. The
+         * wheel already coalesced the timers within their window lengths. */
         if (timerqueue.objcount)
         {
-            timeout.QuadPart = timeout_lower;
+            next = RtlpGetNextTimerWheelTime( &timerqueue.pending_timers );
+            timeout.QuadPart = (next < MAXLONGLONG / 10000) ? next * 10000 : MAXLONGLONG;
             RtlSleepConditionVariableCS( &timerqueue.update_event, &timerqueue.cs, &timeout );
             continue;
         }
@@ -1279,7 +1307,15 @@ static NTSTATUS tp_timerqueue_lock( struct threadpool_object *timer )
     /* Make sure that the timerqueue thread is running. */
     if (!timerqueue.thread_running)
     {
+        LARGE_INTEGER now;
         HANDLE thread;
+
+        /* No timers are left once the thread has quit, so the wheel can
+         * start over from the current time. */
+        assert( !timerqueue.objcount );
+        NtQuerySystemTime( &now );
+        RtlpInitializeTimerWheel( &timerqueue.pending_timers, now.QuadPart / 10000 );
+
         status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, 0, 0, 0,
                                       timerqueue_thread_proc, NULL, &thread, NULL );
         if (status == STATUS_SUCCESS)
@@ -1314,14 +1350,14 @@ static void tp_timerqueue_unlock( struct threadpool_object *timer )
         /* If timer was pending, remove it. */
         if (timer->u.timer.timer_pending)
         {
-            list_remove( &timer->u.timer.timer_entry );
+            RtlpRemoveTimerWheel( &timerqueue.pending_timers, &timer->u.timer.timer_entry );
             timer->u.timer.timer_pending = FALSE;
         }
 
         /* If the last timer object was destroyed, then wake up the thread. */
         if (!--timerqueue.objcount)
         {
-            assert( list_empty( &timerqueue.pending_timers ) );
+            assert( RtlpGetNextTimerWheelTime( &timerqueue.pending_timers ) == TIMER_WHEEL_NEVER );
             RtlWakeAllConditionVariable( &timerqueue.update_event );
         }
 
@@ -2126,7 +2162,9 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
 
     RtlEnterCriticalSection( &pool->cs );
 
-    /* Start new worker threads if required. */
+    /* Start new worker threads if required. This has to happen under the
+     * lock, an idle worker would otherwise retire against a thread that
+     * doesn't exist yet, or may never. */
     if (pool->num_busy_workers >= pool->num_workers &&
         pool->num_workers < pool->max_workers)
         status = tp_new_worker_thread( pool );
@@ -2140,14 +2178,16 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
     if (object->type == TP_OBJECT_TYPE_WAIT && signaled)
         object->u.wait.signaled++;
 
-    /* No new thread started - wake up one existing thread. */
+    assert( status == STATUS_SUCCESS || pool->num_workers > 0 );
+    RtlLeaveCriticalSection( &pool->cs );
+
+    /* No new thread started - wake up one existing thread. Doing this outside of
+     * the lock saves the woken thread from immediately blocking on it again. A
+     * worker only retires after finding the queue empty under the lock, so the
+     * item can't be left behind. The caller's reference to the object keeps
+     * the pool alive. */
     if (status != STATUS_SUCCESS)
-    {
-        assert( pool->num_workers > 0 );
         RtlWakeConditionVariable( &pool->update_event );
-    }
-
-    RtlLeaveCriticalSection( &pool->cs );
 }
 
 /***********************************************************************
@@ -3113,7 +3153,6 @@ BOOL WINAPI TpSetPoolMinThreads( TP_POOL *pool, DWORD minimum )
 VOID WINAPI TpSetTimer( TP_TIMER *timer, LARGE_INTEGER *timeout, LONG period, LONG window_length )
 {
     struct threadpool_object *this = impl_from_TP_TIMER( timer );
-    struct threadpool_object *other_timer;
     BOOL submit_timer = FALSE;
     ULONGLONG timestamp;
 
@@ -3152,7 +3191,7 @@ VOID WINAPI TpSetTimer( TP_TIMER *timer, LARGE_INTEGER *timeout, LONG period, LO
     /* First remove existing timeout. */
     if (this->u.timer.timer_pending)
     {
-        list_remove( &this->u.timer.timer_entry );
+        RtlpRemoveTimerWheel( &timerqueue.pending_timers, &this->u.timer.timer_entry );
         this->u.timer.timer_pending = FALSE;
     }
 
@@ -3163,20 +3202,9 @@ VOID WINAPI TpSetTimer( TP_TIMER *timer, LARGE_INTEGER *timeout, LONG period, LO
         this->u.timer.period        = period;
         this->u.timer.window_length = window_length;
 
-        LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
-                             struct threadpool_object, u.timer.timer_entry )
-        {
-            assert( other_timer->type == TP_OBJECT_TYPE_TIMER );
-            if (this->u.timer.timeout < other_timer->u.timer.timeout)
-                break;
-        }
-        list_add_before( &other_timer->u.timer.timer_entry, &this->u.timer.timer_entry );
-
         /* Wake up the timer thread when the timeout has to be updated. */
-        if (list_head( &timerqueue.pending_timers ) == &this->u.timer.timer_entry )
+        if (tp_timerqueue_insert( this ))
             RtlWakeAllConditionVariable( &timerqueue.update_event );
-
-        this->u.timer.timer_pending = TRUE;
     }
 
     RtlLeaveCriticalSection( &timerqueue.cs );
@@ -40,7 +40,8 @@ struct timer_queue;
 struct queue_timer
 {
     struct timer_queue *q;
-    struct list entry;
+    struct list entry;          /* in the list of all timers of the queue */
+    RTLP_TIMER_WHEEL_ENTRY wheel_entry; /* on the wheel, unless expire is EXPIRE_NEVER */
     ULONG runcount;             /* number of callbacks pending execution */
     WAITORTIMERCALLBACKFUNC callback;
     PVOID param;
@@ -55,10 +56,12 @@ struct timer_queue
 {
     DWORD magic;
     RTL_CRITICAL_SECTION cs;
-    struct list timers;         /* sorted by expiration time */
+    struct list timers;         /* all timers, in no particular order */
     BOOL quit;                  /* queue should be deleted; once set, never unset */
     HANDLE event;
     HANDLE thread;
+    ULONGLONG wakeup;           /* when the timer thread is going to look again */
+    RTLP_TIMER_WHEEL wheel;     /* pending timers, in milliseconds */
 };
 
 #define EXPIRE_NEVER (~(ULONGLONG) 0)
@@ -74,6 +77,8 @@ static void queue_remove_timer(struct queue_timer *t)
     assert(t->runcount == 0);
     assert(t->destroy);
 
+    if (t->expire != EXPIRE_NEVER)
+        RtlpRemoveTimerWheel(&q->wheel, &t->wheel_entry);
     list_remove(&t->entry);
     if (t->event)
         NtSetEvent(t->event, NULL);
@@ -116,46 +121,50 @@ static void queue_add_timer(struct queue_timer *t, ULONGLONG time,
 {
     /* We MUST hold the queue cs while calling this function.  */
     struct timer_queue *q = t->q;
-    struct list *ptr = &q->timers;
 
     assert(!q->quit || (t->destroy && time == EXPIRE_NEVER));
 
-    if (time != EXPIRE_NEVER)
-        LIST_FOR_EACH(ptr, &q->timers)
-        {
-            struct queue_timer *cur = LIST_ENTRY(ptr, struct queue_timer, entry);
-            if (time < cur->expire)
-                break;
-        }
-    list_add_before(ptr, &t->entry);
-
     t->expire = time;
+    if (time != EXPIRE_NEVER)
+        RtlpInsertTimerWheel(&q->wheel, &t->wheel_entry, time);
 
-    /* If we insert at the head of the list, we need to expire sooner
-       than expected.  */
-    if (set_event && &t->entry == list_head(&q->timers))
+    /* If the timer thread would wake up too late for this one, we need
+       to expire sooner than expected.  */
+    if (set_event && time < q->wakeup)
+    {
+        q->wakeup = time;
         NtSetEvent(q->event, NULL);
+    }
 }
 
 static inline void queue_move_timer(struct queue_timer *t, ULONGLONG time,
                                     BOOL set_event)
 {
     /* We MUST hold the queue cs while calling this function.  */
-    list_remove(&t->entry);
+    if (t->expire != EXPIRE_NEVER)
+        RtlpRemoveTimerWheel(&t->q->wheel, &t->wheel_entry);
     queue_add_timer(t, time, set_event);
 }
 
 static void queue_timer_expire(struct timer_queue *q)
 {
-    struct queue_timer *t = NULL;
+    PRTLP_TIMER_WHEEL_ENTRY entry;
+    struct queue_timer *t;
+    ULONGLONG now, next;
 
-    RtlEnterCriticalSection(&q->cs);
-    if (list_head(&q->timers))
+    /* Fire everything that expired in one go rather than waking
+       up again for each of them.  */
+    for (;;)
     {
-        ULONGLONG now, next;
-        t = LIST_ENTRY(list_head(&q->timers), struct queue_timer, entry);
-        if (!t->destroy && t->expire <= ((now = queue_current_time())))
+        t = NULL;
+
+        RtlEnterCriticalSection(&q->cs);
+        entry = RtlpAdvanceTimerWheel(&q->wheel, (now = queue_current_time()));
+        if (entry)
         {
+            t = CONTAINING_RECORD(entry, struct queue_timer, wheel_entry);
+            assert(!t->destroy);
+
             ++t->runcount;
             if (t->period)
             {
@@ -168,13 +177,11 @@ static void queue_timer_expire(struct timer_queue *q)
                 next = EXPIRE_NEVER;
             queue_move_timer(t, next, FALSE);
         }
-        else
-            t = NULL;
-    }
-    RtlLeaveCriticalSection(&q->cs);
+        RtlLeaveCriticalSection(&q->cs);
+
+        if (!t)
+            break;
 
-    if (t)
-    {
         if (t->flags & WT_EXECUTEINTIMERTHREAD)
             timer_callback_wrapper(t);
         else
@@ -192,20 +199,21 @@ static void queue_timer_expire(struct timer_queue *q)
 
 static ULONG queue_get_timeout(struct timer_queue *q)
 {
-    struct queue_timer *t;
     ULONG timeout = INFINITE;
+    ULONGLONG next;
 
     RtlEnterCriticalSection(&q->cs);
-    if (list_head(&q->timers))
+    next = RtlpGetNextTimerWheelTime(&q->wheel);
+    q->wakeup = next;
+    if (next != EXPIRE_NEVER)
     {
-        t = LIST_ENTRY(list_head(&q->timers), struct queue_timer, entry);
-        assert(!t->destroy || t->expire == EXPIRE_NEVER);
-
-        if (t->expire != EXPIRE_NEVER)
-        {
-            ULONGLONG time = queue_current_time();
-            timeout = t->expire < time ? 0 : (ULONG)(t->expire - time);
-        }
+        ULONGLONG time = queue_current_time();
+        if (next <= time)
+            timeout = 0;
+        else if (next - time < INFINITE)
+            timeout = (ULONG)(next - time);
+        else
+            timeout = INFINITE - 1;
     }
     RtlLeaveCriticalSection(&q->cs);
 
@@ -291,6 +299,8 @@ NTSTATUS WINAPI RtlCreateTimerQueue(PHANDLE NewTimerQueue)
 
     RtlInitializeCriticalSection(&q->cs);
     list_init(&q->timers);
+    RtlpInitializeTimerWheel(&q->wheel, queue_current_time());
+    q->wakeup = EXPIRE_NEVER;
     q->quit = FALSE;
     q->magic = TIMER_QUEUE_MAGIC;
     status = NtCreateEvent(&q->event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
@@ -452,7 +462,10 @@ NTSTATUS WINAPI RtlCreateTimer(HANDLE TimerQueue, PHANDLE NewTimer,
     if (q->quit)
         status = STATUS_INVALID_HANDLE;
     else
+    {
+        list_add_tail(&q->timers, &t->entry);
         queue_add_timer(t, queue_current_time() + DueTime, TRUE);
+    }
     RtlLeaveCriticalSection(&q->cs);
 
     if (status == STATUS_SUCCESS)
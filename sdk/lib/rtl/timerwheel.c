@@ -0,0 +1,252 @@
+/*
+ * PROJECT:     ReactOS Runtime Library
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Hierarchical timing wheel for the timer queues
+ */
+
+/*
+ * Pending timers live in a hierarchical timing wheel, so that adding, moving
+ * and removing one doesn't depend on how many others there are. Times are
+ * counted in ticks, whatever unit the caller uses. Each level has
+ * TIMER_WHEEL_SLOTS slots, and a slot on level n covers TIMER_WHEEL_SLOTS^n
+ * ticks. An entry goes on the lowest level where its expiration only differs
+ * from the wheel time in that level's digit and below. When the wheel time
+ * reaches a slot on a higher level, its entries are moved down. Level 0 slots
+ * hold entries that expire on that exact tick, and entries whose time has come
+ * wait on the expired list until the caller takes them off the wheel.
+ *
+ * Entries expiring beyond the last level are kept on a separate list, and
+ * looked at again each time the wheel starts a new round of its last level.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#define TIMER_WHEEL_EXPIRED     (-1)
+#define TIMER_WHEEL_FAR         (-2)
+#define TIMER_WHEEL_SPAN_BITS   (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)
+
+/* PRIVATE FUNCTIONS ********************************************************/
+
+static
+ULONGLONG
+RtlpGetNextTimerWheelSlot(
+    _In_ PRTLP_TIMER_WHEEL Wheel,
+    _Out_ PULONG NextLevel,
+    _Out_ PULONG NextSlot)
+{
+    ULONGLONG Next = TIMER_WHEEL_NEVER, Start, Pending;
+    ULONG Level, Slot, Shift;
+
+    /*
+     * On each level, the first busy slot at or after the current one starts
+     * the earliest. Slots before it belong to the next round, which is kept
+     * on a higher level.
+     */
+    for (Level = 0; Level < TIMER_WHEEL_LEVELS; Level++)
+    {
+        Shift = Level * TIMER_WHEEL_BITS;
+        Slot = (ULONG)(Wheel->Time >> Shift) & (TIMER_WHEEL_SLOTS - 1);
+        Pending = Wheel->Pending[Level] & (~0ULL << Slot);
+        if (!Pending)
+            continue;
+
+        Slot = RtlFindLeastSignificantBit(Pending);
+        Start = (Wheel->Time >> (Shift + TIMER_WHEEL_BITS) << (Shift + TIMER_WHEEL_BITS)) |
+                ((ULONGLONG)Slot << Shift);
+        if (Start < Next)
+        {
+            Next = Start;
+            *NextLevel = Level;
+            *NextSlot = Slot;
+        }
+    }
+
+    /* The far list is looked at when the last level starts over */
+    if (!IsListEmpty(&Wheel->Far))
+    {
+        Start = ((Wheel->Time >> TIMER_WHEEL_SPAN_BITS) + 1) << TIMER_WHEEL_SPAN_BITS;
+        if (Start < Next)
+        {
+            Next = Start;
+            *NextLevel = TIMER_WHEEL_LEVELS;
+            *NextSlot = 0;
+        }
+    }
+
+    return Next;
+}
+
+/* FUNCTIONS ****************************************************************/
+
+VOID
+NTAPI
+RtlpInitializeTimerWheel(
+    _Out_ PRTLP_TIMER_WHEEL Wheel,
+    _In_ ULONGLONG Time)
+{
+    ULONG Level, Slot;
+
+    Wheel->Time = Time;
+    InitializeListHead(&Wheel->Expired);
+    InitializeListHead(&Wheel->Far);
+    for (Level = 0; Level < TIMER_WHEEL_LEVELS; Level++)
+    {
+        Wheel->Pending[Level] = 0;
+        for (Slot = 0; Slot < TIMER_WHEEL_SLOTS; Slot++)
+            InitializeListHead(&Wheel->Slots[Level][Slot]);
+    }
+}
+
+VOID
+NTAPI
+RtlpInsertTimerWheel(
+    _Inout_ PRTLP_TIMER_WHEEL Wheel,
+    _Out_ PRTLP_TIMER_WHEEL_ENTRY Entry,
+    _In_ ULONGLONG Expire)
+{
+    ULONGLONG Diff;
+    ULONG Level, Slot;
+
+    Entry->Expire = Expire;
+    if (Expire <= Wheel->Time)
+    {
+        InsertTailList(&Wheel->Expired, &Entry->Link);
+        Entry->Slot = TIMER_WHEEL_EXPIRED;
+        return;
+    }
+
+    /* Find the highest digit where the expiration differs from the wheel time */
+    Diff = Expire ^ Wheel->Time;
+    if (Diff >> TIMER_WHEEL_SPAN_BITS)
+    {
+        InsertTailList(&Wheel->Far, &Entry->Link);
+        Entry->Slot = TIMER_WHEEL_FAR;
+        return;
+    }
+
+    for (Level = 0; Level < TIMER_WHEEL_LEVELS - 1; Level++)
+    {
+        if (!(Diff >> ((Level + 1) * TIMER_WHEEL_BITS)))
+            break;
+    }
+
+    Slot = (ULONG)(Expire >> (Level * TIMER_WHEEL_BITS)) & (TIMER_WHEEL_SLOTS - 1);
+    InsertTailList(&Wheel->Slots[Level][Slot], &Entry->Link);
+    Wheel->Pending[Level] |= 1ULL << Slot;
+    Entry->Slot = Level * TIMER_WHEEL_SLOTS + Slot;
+}
+
+VOID
+NTAPI
+RtlpRemoveTimerWheel(
+    _Inout_ PRTLP_TIMER_WHEEL Wheel,
+    _Inout_ PRTLP_TIMER_WHEEL_ENTRY Entry)
+{
+    ULONG Level, Slot;
+
+    RemoveEntryList(&Entry->Link);
+    if (Entry->Slot < 0)
+        return;
+
+    Level = Entry->Slot / TIMER_WHEEL_SLOTS;
+    Slot = Entry->Slot % TIMER_WHEEL_SLOTS;
+    if (IsListEmpty(&Wheel->Slots[Level][Slot]))
+        Wheel->Pending[Level] &= ~(1ULL << Slot);
+}
+
+ULONGLONG
+NTAPI
+RtlpGetNextTimerWheelTime(
+    _In_ PRTLP_TIMER_WHEEL Wheel)
+{
+    ULONG Level, Slot;
+
+    /*
+     * Waking up for a slot on a higher level only moves its entries down,
+     * which is cheap and rare enough.
+     */
+    if (!IsListEmpty(&Wheel->Expired))
+        return Wheel->Time;
+    return RtlpGetNextTimerWheelSlot(Wheel, &Level, &Slot);
+}
+
+PRTLP_TIMER_WHEEL_ENTRY
+NTAPI
+RtlpAdvanceTimerWheel(
+    _Inout_ PRTLP_TIMER_WHEEL Wheel,
+    _In_ ULONGLONG Now)
+{
+    PLIST_ENTRY List;
+    LIST_ENTRY Moved;
+    ULONG Level, Slot;
+    ULONGLONG Next;
+
+    /* Only visit slots that hold something, however long we slept */
+    while ((Next = RtlpGetNextTimerWheelSlot(Wheel, &Level, &Slot)) <= Now)
+    {
+        if (Next > Wheel->Time)
+            Wheel->Time = Next;
+
+        /* Move the slot down a level, or to the expired list on level 0 */
+        if (Level == TIMER_WHEEL_LEVELS)
+        {
+            List = &Wheel->Far;
+        }
+        else
+        {
+            List = &Wheel->Slots[Level][Slot];
+            Wheel->Pending[Level] &= ~(1ULL << Slot);
+        }
+
+        /* Take the whole list, then put each entry where it belongs now */
+        ASSERT(!IsListEmpty(List));
+        Moved.Flink = List->Flink;
+        Moved.Blink = List->Blink;
+        Moved.Flink->Blink = &Moved;
+        Moved.Blink->Flink = &Moved;
+        InitializeListHead(List);
+
+        while (!IsListEmpty(&Moved))
+        {
+            PRTLP_TIMER_WHEEL_ENTRY Entry;
+
+            Entry = CONTAINING_RECORD(RemoveHeadList(&Moved), RTLP_TIMER_WHEEL_ENTRY, Link);
+            RtlpInsertTimerWheel(Wheel, Entry, Entry->Expire);
+        }
+    }
+
+    if (Now > Wheel->Time)
+        Wheel->Time = Now;
+
+    /* Hand out the expired entries in the order they were queued */
+    if (IsListEmpty(&Wheel->Expired))
+        return NULL;
+    return CONTAINING_RECORD(Wheel->Expired.Flink, RTLP_TIMER_WHEEL_ENTRY, Link);
+}
+
+ULONGLONG
+NTAPI
+RtlpCoalesceTimerWheelTime(
+    _In_ ULONGLONG Expire,
+    _In_ ULONG Tolerance)
+{
+    ULONGLONG Latest = Expire + Tolerance;
+    ULONG Bit;
+
+    if (!Tolerance || !Expire)
+        return Expire;
+
+    /*
+     * Pick the roundest time within the tolerance window, so that timers with
+     * overlapping windows end up expiring on the same tick. That is the latest
+     * time allowed, with every bit below the highest one it doesn't share with
+     * the tick before the expiration cleared.
+     */
+    Bit = RtlFindMostSignificantBit((Expire - 1) ^ Latest);
+    return Latest & ~((1ULL << Bit) - 1);
+}
@@ -0,0 +1,13 @@
+/*
+ * PROJECT:     FreeLoader cache host tool
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     FreeLoader debug macros, compiled out
+ */
+
+#pragma once
+
+#define DBG_DEFAULT_CHANNEL(ch)
+#define TRACE(...) do { } while (0)
+#define WARN(...) do { } while (0)
+#define ERR(...) do { } while (0)
+#define BugCheck(...) do { fprintf(stderr, __VA_ARGS__); abort(); } while (0)
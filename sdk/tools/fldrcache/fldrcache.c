@@ -0,0 +1,254 @@
+/*
+ * PROJECT:     FreeLoader cache host tool
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Runs the FreeLoader disk cache on a disk image and counts the disk reads
+ */
+
+/*
+ * The cache sources are built as they are, with the machine disk routines
+ * reading from an image file instead. A boot is simulated by loading a kernel,
+ * a hal, a SYSTEM hive and a number of drivers one after the other, with a few
+ * scattered directory and inode lookups before each file, the way the file
+ * system drivers read them. The end of the disk is read last, where the
+ * read-ahead has to stop short. Every read is checked against the image.
+ *
+ * The workload only depends on the size of the image, so the counts can be
+ * compared between block sizes and between versions of the cache.
+ */
+
+#include "freeldr.h"
+
+#ifdef _MSC_VER
+#define fseeko _fseeki64
+#define ftello _ftelli64
+typedef __int64 off_t64;
+#else
+typedef off_t off_t64;
+#endif
+
+#define SECTOR_SIZE 512
+#define FS_BLOCK_SECTORS 8
+#define DRIVE_NUMBER 0x80
+
+/* Where the files start, and how far the metadata lookups go */
+#define DATA_START_SECTOR (2048 * FS_BLOCK_SECTORS)
+#define METADATA_BLOCKS (64 * 1024)
+#define LOOKUPS_PER_FILE 6
+
+#define FILE_COUNT 60
+#define MAX_CHUNK (64 * 1024)
+
+/* The lookups have to stay on the disk, the files fit well within that */
+#define MIN_IMAGE_SECTORS ((ULONGLONG)METADATA_BLOCKS * FS_BLOCK_SECTORS)
+
+PVOID DiskReadBuffer;
+SIZE_T DiskReadBufferSize = MAX_DISKREADBUFFER_SIZE;
+PFN_NUMBER TotalPagesInLookupTable = 65536;
+
+static FILE* Image;
+static ULONGLONG ImageSectors;
+static ULONG BlockSize;
+static ULONG Seed;
+
+static ULONG
+Random(VOID)
+{
+    Seed = Seed * 1103515245 + 12345;
+    return Seed >> 8;
+}
+
+static BOOLEAN
+ReadImage(ULONGLONG SectorNumber, ULONG SectorCount, PVOID Buffer)
+{
+    if (SectorNumber + SectorCount > ImageSectors)
+        return FALSE;
+    if (fseeko(Image, (off_t64)(SectorNumber * SECTOR_SIZE), SEEK_SET) != 0)
+        return FALSE;
+    return fread(Buffer, SECTOR_SIZE, SectorCount, Image) == SectorCount;
+}
+
+BOOLEAN
+MachDiskReadLogicalSectors(UCHAR DriveNumber, ULONGLONG SectorNumber, ULONG SectorCount, PVOID Buffer)
+{
+    if ((SIZE_T)SectorCount * SECTOR_SIZE > DiskReadBufferSize)
+    {
+        fprintf(stderr, "Read of %u sectors overflows the disk read buffer\n", SectorCount);
+        exit(1);
+    }
+    return ReadImage(SectorNumber, SectorCount, Buffer);
+}
+
+BOOLEAN
+MachDiskGetDriveGeometry(UCHAR DriveNumber, PGEOMETRY Geometry)
+{
+    RtlZeroMemory(Geometry, sizeof(*Geometry));
+    Geometry->BytesPerSector = SECTOR_SIZE;
+    Geometry->Sectors = ImageSectors;
+    return TRUE;
+}
+
+ULONG
+MachDiskGetCacheableBlockCount(UCHAR DriveNumber)
+{
+    return BlockSize;
+}
+
+PVOID
+FrLdrTempAlloc(SIZE_T Size, ULONG Tag)
+{
+    return malloc(Size);
+}
+
+VOID
+FrLdrTempFree(PVOID Allocation, ULONG Tag)
+{
+    free(Allocation);
+}
+
+static BOOLEAN
+CheckedRead(ULONGLONG SectorNumber, ULONG SectorCount, PUCHAR Buffer, PUCHAR Expected)
+{
+    if (!CacheReadDiskSectors(DRIVE_NUMBER, SectorNumber, SectorCount, Buffer))
+    {
+        fprintf(stderr, "Cache read of %u sectors at %llu failed\n",
+                SectorCount, (unsigned long long)SectorNumber);
+        return FALSE;
+    }
+    if (!ReadImage(SectorNumber, SectorCount, Expected) ||
+        memcmp(Buffer, Expected, SectorCount * SECTOR_SIZE) != 0)
+    {
+        fprintf(stderr, "Cache read of %u sectors at %llu returned the wrong data\n",
+                SectorCount, (unsigned long long)SectorNumber);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static BOOLEAN
+SimulateBoot(PUCHAR Buffer, PUCHAR Expected)
+{
+    ULONG FileSizes[FILE_COUNT];
+    ULONGLONG Sector = DATA_START_SECTOR;
+    ULONGLONG End;
+    ULONG File, Lookup, Left, Chunk, SectorCount;
+
+    Seed = 12345;
+
+    /* ntoskrnl, hal and the SYSTEM hive, then the boot drivers */
+    FileSizes[0] = 8 * 1024 * 1024;
+    FileSizes[1] = 600 * 1024;
+    FileSizes[2] = 10 * 1024 * 1024;
+    for (File = 3; File < FILE_COUNT; File++)
+        FileSizes[File] = (20 + Random() % 200) * 1024;
+
+    for (File = 0; File < FILE_COUNT; File++)
+    {
+        for (Lookup = 0; Lookup < LOOKUPS_PER_FILE; Lookup++)
+        {
+            if (!CheckedRead((ULONGLONG)(Random() % METADATA_BLOCKS) * FS_BLOCK_SECTORS,
+                             FS_BLOCK_SECTORS, Buffer, Expected))
+            {
+                return FALSE;
+            }
+        }
+
+        /* Read the file from start to end, mostly one block at a time */
+        for (Left = FileSizes[File]; Left != 0; Left -= Chunk)
+        {
+            Chunk = (Random() % 4 == 0) ? MAX_CHUNK : FS_BLOCK_SECTORS * SECTOR_SIZE;
+            Chunk = min(Chunk, Left);
+            SectorCount = (Chunk + SECTOR_SIZE - 1) / SECTOR_SIZE;
+            if (!CheckedRead(Sector, SectorCount, Buffer, Expected))
+                return FALSE;
+            Sector += SectorCount;
+        }
+
+        /* Files are not quite contiguous */
+        Sector += (Random() % 64) * FS_BLOCK_SECTORS;
+    }
+
+    /*
+     * Read the last 64K of the disk one block at a time. The cache only reads
+     * whole cache blocks, so a partial one at the end can't be read at all.
+     */
+    End = ImageSectors - ImageSectors % BlockSize;
+    for (Sector = End - MAX_CHUNK / SECTOR_SIZE;
+         Sector + FS_BLOCK_SECTORS <= End;
+         Sector += FS_BLOCK_SECTORS)
+    {
+        if (!CheckedRead(Sector, FS_BLOCK_SECTORS, Buffer, Expected))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+int main(int argc, char* argv[])
+{
+    static const ULONG DefaultBlockSizes[] = { 64, 16 };
+    PUCHAR Buffer, Expected;
+    int i, Count;
+
+    if (argc < 2)
+    {
+        printf("Usage: %s <disk image> [block size in sectors ...]\n", argv[0]);
+        return 1;
+    }
+
+    Image = fopen(argv[1], "rb");
+    if (!Image)
+    {
+        fprintf(stderr, "Could not open %s\n", argv[1]);
+        return 1;
+    }
+    fseeko(Image, 0, SEEK_END);
+    ImageSectors = (ULONGLONG)ftello(Image) / SECTOR_SIZE;
+    if (ImageSectors < MIN_IMAGE_SECTORS)
+    {
+        fprintf(stderr, "The image has to be at least %llu MB\n",
+                (unsigned long long)(MIN_IMAGE_SECTORS * SECTOR_SIZE / (1024 * 1024)));
+        return 1;
+    }
+
+    DiskReadBuffer = malloc(DiskReadBufferSize);
+    Buffer = malloc(MAX_CHUNK);
+    Expected = malloc(MAX_CHUNK);
+    if (!DiskReadBuffer || !Buffer || !Expected)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    Count = (argc > 2) ? argc - 2 : (int)(sizeof(DefaultBlockSizes) / sizeof(DefaultBlockSizes[0]));
+    for (i = 0; i < Count; i++)
+    {
+        BlockSize = (argc > 2) ? (ULONG)atoi(argv[i + 2]) : DefaultBlockSizes[i];
+        if (BlockSize == 0)
+        {
+            fprintf(stderr, "Invalid block size %s\n", argv[i + 2]);
+            return 1;
+        }
+
+        /* Start over with an empty cache */
+        CacheInvalidateCacheData();
+        if (!CacheInitializeDrive(DRIVE_NUMBER))
+        {
+            fprintf(stderr, "Could not initialize the cache\n");
+            return 1;
+        }
+
+        if (!SimulateBoot(Buffer, Expected))
+            return 1;
+
+        printf("%3u sectors per block: %6u disk reads, %8llu sectors read\n",
+               BlockSize,
+               CacheManagerDrive.ReadCallCount,
+               (unsigned long long)CacheManagerDrive.SectorsRead);
+    }
+
+    free(Expected);
+    free(Buffer);
+    free(DiskReadBuffer);
+    fclose(Image);
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * PROJECT:     FreeLoader cache host tool
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     The parts of the FreeLoader environment the disk cache uses
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <typedefs.h>
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+#define MM_PAGE_SIZE 4096
+#define TEMP_HEAP_SIZE (32 * 1024 * 1024)
+
+/* The most the PC disk read buffer can hold */
+#define MAX_DISKREADBUFFER_SIZE 0xFE00
+
+typedef ULONG_PTR PFN_NUMBER;
+
+typedef struct _GEOMETRY
+{
+    ULONG Cylinders;
+    ULONG Heads;
+    ULONG SectorsPerTrack;
+    ULONG BytesPerSector;
+    ULONGLONG Sectors;
+} GEOMETRY, *PGEOMETRY;
+
+extern PVOID DiskReadBuffer;
+extern SIZE_T DiskReadBufferSize;
+extern PFN_NUMBER TotalPagesInLookupTable;
+
+BOOLEAN MachDiskReadLogicalSectors(UCHAR DriveNumber, ULONGLONG SectorNumber, ULONG SectorCount, PVOID Buffer);
+BOOLEAN MachDiskGetDriveGeometry(UCHAR DriveNumber, PGEOMETRY Geometry);
+ULONG MachDiskGetCacheableBlockCount(UCHAR DriveNumber);
+
+PVOID FrLdrTempAlloc(SIZE_T Size, ULONG Tag);
+VOID FrLdrTempFree(PVOID Allocation, ULONG Tag);
+
+#include <cache.h>